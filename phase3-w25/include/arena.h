@@ -0,0 +1,39 @@
+/* arena.h */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Bump allocator: allocations are carved out of large blocks in order and
+// are only ever freed all at once by arena_release.
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock* blocks;      // Most recent block first
+    char* cursor;            // Next free byte in the current block
+    char* limit;             // End of the current block
+    size_t allocations;      // Number of arena_alloc calls
+    size_t bytes_used;       // Bytes handed out
+    size_t bytes_reserved;   // Bytes obtained from malloc
+    size_t block_count;      // Number of blocks
+} Arena;
+
+typedef struct {
+    size_t allocations;      // Allocations made
+    size_t bytes_used;       // Bytes handed out
+    size_t bytes_reserved;   // Bytes held from malloc
+    size_t block_count;      // Blocks held
+    size_t high_water;       // Peak bytes_reserved (process-wide stats only)
+} ArenaStats;
+
+void arena_init(Arena* arena);
+void* arena_alloc(Arena* arena, size_t size);
+void arena_release(Arena* arena);
+
+// Statistics for one arena
+void arena_get_stats(const Arena* arena, ArenaStats* stats);
+// Totals over every arena in the process, including released ones;
+// bytes_reserved is what is live now and high_water is its peak
+void arena_get_global_stats(ArenaStats* stats);
+
+#endif /* ARENA_H */
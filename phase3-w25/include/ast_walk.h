@@ -0,0 +1,57 @@
+/* ast_walk.h */
+#ifndef AST_WALK_H
+#define AST_WALK_H
+
+#include <stddef.h>
+#include "parser.h"
+
+// Depth-first traversal of an AST on an explicit stack, so walking a tree
+// takes the same C stack however long its statement lists or however deep
+// its expressions are. Each node is visited in the order print_ast prints
+// it: the node, its left subtree, its right subtree, then the statements
+// chained from it by 'next'. A chain of 'next' nodes reuses one frame, so
+// the stack only grows with the nesting of left and right children.
+#define AST_WALK_LOCAL_FRAMES 16    // Frames held in the walker itself
+
+// Returned by a pre-visit callback
+#define AST_WALK_CONTINUE 0         // Visit the node's children
+#define AST_WALK_SKIP 1             // Go straight to the post-visit
+
+typedef struct {
+    ASTNode* node;
+    int depth;                  // 'depth' given to ast_walk, plus one per child level
+    int value;                  // Free for the visitors; 0 when the node is entered
+    int state;                  // Private to ast_walk
+    int follow_next;            // Private to ast_walk
+} AstWalkFrame;
+
+typedef struct AstWalker AstWalker;
+
+// Callbacks get the frame of the node being visited; it stays valid until
+// the callback returns. Post-visit callbacks ignore the return value.
+typedef int (*AstVisitFn)(AstWalker* walker, AstWalkFrame* frame);
+
+struct AstWalker {
+    AstVisitFn pre;             // Either callback may be NULL
+    AstVisitFn post;
+    void* data;                 // For the callbacks
+    AstWalkFrame* frames;       // Points at 'local' until the stack outgrows it
+    size_t count;
+    size_t capacity;
+    AstWalkFrame local[AST_WALK_LOCAL_FRAMES];
+};
+
+// A walker refers to its own storage, so it must not be copied once
+// initialised. It can run any number of walks, one at a time.
+void ast_walker_init(AstWalker* walker, AstVisitFn pre, AstVisitFn post, void* data);
+void ast_walker_release(AstWalker* walker);
+
+// Walks 'node' and its descendants, and with 'siblings' set also the nodes
+// chained from it by 'next'. Returns 0, or 1 after printing an error when
+// the stack cannot grow.
+int ast_walk(AstWalker* walker, ASTNode* node, int depth, int siblings);
+
+// Frame of the node whose child is being visited, NULL at the top level
+AstWalkFrame* ast_walk_parent(AstWalker* walker);
+
+#endif /* AST_WALK_H */
@@ -0,0 +1,78 @@
+/* astfile.h */
+#ifndef ASTFILE_H
+#define ASTFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "parser.h"
+
+// Binary AST files, for handing parsed programs between processes. A file
+// is a header, a flat array of fixed-size nodes and a string table, laid
+// out so a mapped file is used in place: children are node indices, token
+// text is an offset into the string table, and nothing holds a pointer.
+// Node 0 is the AST_PROGRAM root and every child has a higher index than
+// its parent, so a file that passes ast_file_open has no cycles. Files are
+// written in the byte order of the host; the version of a file from a host
+// of the other byte order does not match, so it is rejected.
+#define AST_FILE_MAGIC "CMPAST\r\n"
+#define AST_FILE_VERSION 2
+#define AST_FILE_NONE 0xFFFFFFFFu     // No child
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;       // sizeof(AstFileHeader)
+    uint32_t node_size;         // sizeof(AstFileNode)
+    uint32_t node_count;
+    uint64_t nodes_offset;      // From the start of the file, 8-byte aligned
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    uint64_t file_size;
+} AstFileHeader;
+
+typedef struct {
+    uint32_t left;              // Node indices, AST_FILE_NONE if absent
+    uint32_t right;
+    uint32_t next;
+    uint32_t text;              // Token text in the string table, NUL-terminated
+    int32_t length;             // Token fields as in Token
+    int32_t line;
+    int32_t column;
+    int32_t id;
+    int32_t slot;
+    uint8_t type;               // ASTNodeType
+    uint8_t token_type;
+    uint8_t token_error;
+    uint8_t op;                 // BinaryOp
+} AstFileNode;
+
+// A validated file image, mapped by ast_file_open or borrowed by
+// ast_file_load
+typedef struct {
+    const AstFileHeader* header;
+    const AstFileNode* nodes;
+    const char* strings;
+    size_t size;
+    void* map;                  // Mapping to release, NULL for borrowed images
+} AstFile;
+
+// Serializes the tree rooted at 'root' into one malloc'ed image of '*size'
+// bytes; identical token texts share one string. Returns NULL after
+// printing an error when out of memory or past the format's limits.
+void* ast_file_build(const ASTNode* root, size_t* size);
+// Writes the image of 'root' to 'path' with a single write; returns 0 on
+// success
+int ast_file_write(const ASTNode* root, const char* path, size_t* size);
+// Maps and validates a file; returns 0 on success, or 1 after printing an
+// error
+int ast_file_open(AstFile* file, const char* path);
+// Validates an image already in memory, which must outlive 'file'
+int ast_file_load(AstFile* file, const void* data, size_t size);
+void ast_file_close(AstFile* file);
+
+// Copies the file into an ordinary tree, released with free_ast, for the
+// semantic checker and the execution engines. Returns NULL when out of
+// memory.
+ASTNode* ast_file_to_tree(const AstFile* file);
+
+#endif /* ASTFILE_H */
@@ -0,0 +1,86 @@
+/* aststore.h */
+#ifndef ASTSTORE_H
+#define ASTSTORE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "parser.h"
+
+// Compact AST storage: parallel arrays addressed by 32-bit node indices,
+// about 10 bytes a node against 64 for an ASTNode. Nodes are laid out in
+// pre-order (a node, its left subtree, its right subtree, then its next
+// sibling), so a left child is always the following node and a node's
+// next sibling starts where its subtree ends. Only that end is stored.
+// Tokens are source offsets: their text is re-lexed on demand, their line
+// comes from a table with an entry wherever the line changes, and their
+// column from the source. The store is read-only; semantic checks on it
+// report the diagnostics of the folded tree without rewriting anything.
+#define AST_STORE_NONE 0xFFFFFFFFu
+
+#define AST_STORE_TYPE_MASK 0x0F
+#define AST_STORE_HAS_LEFT  0x10
+#define AST_STORE_HAS_RIGHT 0x20
+#define AST_STORE_HAS_NEXT  0x40
+
+#define AST_STORE_PAGE_SHIFT 12
+
+// Line of the tokens from 'offset' up to the next entry. Columns follow
+// from the source: the lexer counts bytes from the last newline.
+typedef struct {
+    uint32_t offset;
+    int line;
+} AstStorePosition;
+
+typedef struct {
+    const char* source;         // Text the tokens point into; must outlive the store
+    size_t source_size;
+    uint8_t* kinds;             // ASTNodeType and AST_STORE_HAS_* flags
+    uint32_t* tokens;           // Source offset of each node's token
+    uint32_t* extra;            // Index after the subtree for nodes with children;
+                                // for leaves the name ID of an identifier, the
+                                // value of a number (AST_STORE_NONE if it does
+                                // not fit), else 0
+    uint32_t count;             // Node 0 is the AST_PROGRAM root
+    uint32_t capacity;
+    AstStorePosition* positions; // Sorted by offset
+    uint32_t position_count;
+    uint32_t position_capacity;
+    uint32_t* pages;            // Position in effect at the start of each source page
+    uint32_t page_count;
+} AstStore;
+
+#define AST_STORE_TYPE(store, node) ((ASTNodeType)((store)->kinds[node] & AST_STORE_TYPE_MASK))
+#define AST_STORE_LEFT(store, node) \
+    (((store)->kinds[node] & AST_STORE_HAS_LEFT) ? (node) + 1 : AST_STORE_NONE)
+// Name ID of an identifier leaf, without lexing its token
+#define AST_STORE_NAME(store, node) ((int)(store)->extra[node])
+
+// Copies a tree from parse() into 'store'. Every token must point into
+// 'source' (EOF tokens aside), so trees changed by semantic analysis or
+// from parse_edit are refused. Returns 0 on success, or 1 after printing
+// an error.
+int ast_store_build(AstStore* store, const ASTNode* root, const char* source, size_t size);
+void ast_store_free(AstStore* store);
+// Bytes held by the store's arrays
+size_t ast_store_bytes(const AstStore* store);
+
+uint32_t ast_store_right(const AstStore* store, uint32_t node);
+uint32_t ast_store_next(const AstStore* store, uint32_t node);
+// Token of a node, re-lexed from the source. The ID is only kept for
+// identifier leaves; the _text variant leaves line and column at 0 and
+// skips the position lookup.
+Token ast_store_token(const AstStore* store, uint32_t node);
+Token ast_store_token_text(const AstStore* store, uint32_t node);
+
+// Value of an AST_NUMBER node, as ast_number_value
+long long ast_store_number(const AstStore* store, uint32_t node);
+// Operator of an AST_BINOP node. The parser only builds binary nodes on
+// well-formed operators, so the first character tells them apart without
+// lexing.
+BinaryOp ast_store_operator(const AstStore* store, uint32_t node);
+
+// Prints the tree like print_ast
+void ast_store_print(const AstStore* store, uint32_t node, int level, FILE* out);
+
+#endif /* ASTSTORE_H */
@@ -0,0 +1,26 @@
+/* bench.h */
+#ifndef BENCH_H
+#define BENCH_H
+
+// Throughput benchmarks, run from the compiler driver with --bench-* flags
+int bench_lexer(const char* filename);
+int bench_keywords(void);
+// Runs loop kernels on the AST interpreter and the bytecode VM
+int bench_vm(void);
+// Runs the same kernels interpreted and with the loop JIT, including warmup
+int bench_jit(void);
+// Times parse_edit on random edits of a file against full re-parses
+int bench_edit(const char* filename);
+// Applies the same edits to a file as it is and checks each re-parse
+// against a full parse, without timing; returns 0 if all match
+int check_edits(const char* filename);
+// Writes the parse of a file as a binary AST file, maps it back and checks
+// it against the parse
+int bench_ast_file(const char* filename);
+// Compares semantic analysis and printing on an AstStore with the tree
+int bench_ast_store(const char* filename);
+// Parses, checks and walks very long programs and expressions on a small
+// thread stack and reports the stack they used
+int bench_walk(void);
+
+#endif /* BENCH_H */
@@ -0,0 +1,97 @@
+/* bytecode.h */
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stdio.h>
+#include "parser.h"
+#include "interpreter.h"
+
+// Stack bytecode. Code is an array of ints: an opcode followed by its
+// operands. 'K' forms take an immediate instead of popping the right
+// operand, 'L' forms read it from a slot. Fused branches compare the two
+// values on top of the stack, the top value and an immediate (K), or a slot
+// and an immediate (SK), and jump to an absolute code offset when the
+// comparison holds.
+//
+//   X(name, operand count, stack effect)
+#define BYTECODE_OPCODES(X)                                                  \
+    X(CONST, 1, 1)          /* imm: push imm */                              \
+    X(CONST_WIDE, 1, 1)     /* k: push constants[k] */                       \
+    X(LOAD, 1, 1)           /* slot: push frame[slot] */                     \
+    X(STORE, 1, -1)         /* slot: pop into frame[slot] */                 \
+    X(LOAD_ELEM, 2, 0)      /* base, length: index -> frame[base + index] */ \
+    X(STORE_ELEM, 2, -2)    /* base, length: value, index -> */              \
+    X(INC, 2, 0)            /* slot, imm: frame[slot] += imm */              \
+    X(CLEAR, 2, 0)          /* base, length: zero the cells */               \
+    X(ADD, 0, -1)                                                            \
+    X(SUB, 0, -1)                                                            \
+    X(MUL, 0, -1)                                                            \
+    X(DIV, 0, -1)                                                            \
+    X(LT, 0, -1)                                                             \
+    X(GT, 0, -1)                                                             \
+    X(EQ, 0, -1)                                                             \
+    X(NE, 0, -1)                                                             \
+    X(ADD_K, 1, 0)                                                           \
+    X(SUB_K, 1, 0)                                                           \
+    X(MUL_K, 1, 0)                                                           \
+    X(DIV_K, 1, 0)          /* imm is never 0 or -1 */                       \
+    X(ADD_L, 1, 0)                                                           \
+    X(SUB_L, 1, 0)                                                           \
+    X(MUL_L, 1, 0)                                                           \
+    X(DIV_L, 1, 0)                                                           \
+    X(FACTORIAL, 0, 0)                                                       \
+    X(PRINT, 0, -1)                                                          \
+    X(POP, 0, -1)                                                            \
+    X(JUMP, 1, 0)           /* target */                                     \
+    X(JUMP_IF_TRUE, 1, -1)  /* target: pop, jump if non-zero */              \
+    X(JUMP_IF_FALSE, 1, -1) /* target: pop, jump if zero */                  \
+    X(JUMP_IF_LT, 1, -2)    /* target: a, b -> jump if a < b */              \
+    X(JUMP_IF_GT, 1, -2)                                                     \
+    X(JUMP_IF_LE, 1, -2)                                                     \
+    X(JUMP_IF_GE, 1, -2)                                                     \
+    X(JUMP_IF_EQ, 1, -2)                                                     \
+    X(JUMP_IF_NE, 1, -2)                                                     \
+    X(JUMP_IF_LT_K, 2, -1)  /* imm, target: a -> jump if a < imm */          \
+    X(JUMP_IF_GT_K, 2, -1)                                                   \
+    X(JUMP_IF_LE_K, 2, -1)                                                   \
+    X(JUMP_IF_GE_K, 2, -1)                                                   \
+    X(JUMP_IF_EQ_K, 2, -1)                                                   \
+    X(JUMP_IF_NE_K, 2, -1)                                                   \
+    X(JUMP_IF_LT_SK, 3, 0)  /* slot, imm, target: jump if frame[slot] < imm */ \
+    X(JUMP_IF_GT_SK, 3, 0)                                                   \
+    X(JUMP_IF_LE_SK, 3, 0)                                                   \
+    X(JUMP_IF_GE_SK, 3, 0)                                                   \
+    X(JUMP_IF_EQ_SK, 3, 0)                                                   \
+    X(JUMP_IF_NE_SK, 3, 0)                                                   \
+    X(HALT, 0, 0)
+
+typedef enum {
+#define BYTECODE_ENUM(name, operands, effect) OP_##name,
+    BYTECODE_OPCODES(BYTECODE_ENUM)
+#undef BYTECODE_ENUM
+    OP_COUNT
+} Opcode;
+
+typedef struct {
+    int* code;
+    int length;
+    int capacity;
+    int* lines;             // Source line of each code word, for runtime errors
+    Value* constants;       // Values that do not fit an int operand
+    int constant_count;
+    int constant_capacity;
+    int frame_size;         // Storage cells, as laid out by semantic analysis
+    int max_stack;          // Deepest the value stack gets
+} Bytecode;
+
+// Compiles a program that passed semantic analysis. Returns 0 on success
+// and 1 if out of memory.
+int bytecode_compile(ASTNode* program, Bytecode* bytecode);
+void bytecode_free(Bytecode* bytecode);
+void bytecode_disassemble(const Bytecode* bytecode, FILE* out);
+
+// Runs compiled code; same output and runtime errors as interpret().
+// Returns 0 on success and 1 after reporting a runtime error.
+int vm_run(const Bytecode* bytecode, FILE* out);
+
+#endif /* BYTECODE_H */
@@ -0,0 +1,63 @@
+/* cache.h */
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bytecode.h"
+
+// On-disk compilation cache. An entry is keyed by a hash of the source
+// bytes and of the compiler executable (the build ID), and holds what
+// checking the source printed, whether it passed and, if it did, its
+// bytecode, each part with a checksum that must match for a hit. A hit
+// replaces lexing, parsing, semantic analysis and bytecode compilation.
+// Each entry is one file in the cache directory, written
+// under a temporary name and renamed into place, so several compiler
+// processes and threads can share a directory. Hits refresh an entry's
+// modification time; cache_trim removes the least recently used entries
+// once the directory outgrows its size limit.
+#define CACHE_DEFAULT_SIZE ((size_t)256 * 1024 * 1024)
+
+typedef struct Cache Cache;
+
+typedef struct {
+    char* diagnostics;      // Output of checking the source
+    size_t diagnostics_size;
+    int status;             // 1 passed, 0 semantic errors, -1 parse errors
+    int has_bytecode;       // 'bytecode' is filled in (programs that passed)
+    Bytecode bytecode;
+} CacheEntry;
+
+typedef struct {
+    size_t hits;
+    size_t misses;
+    size_t stores;          // Entries written
+    size_t evictions;       // Entries removed by cache_trim
+    size_t bytes_evicted;
+    size_t size;            // Bytes in the directory after the last trim
+} CacheStats;
+
+// Opens or creates the cache in 'dir', which may hold up to 'max_bytes' of
+// entries. Returns NULL after printing an error if the directory cannot be
+// used.
+Cache* cache_open(const char* dir, size_t max_bytes);
+// Trims the cache to its size limit if entries were stored since the last
+// trim, and releases it
+void cache_close(Cache* cache);
+
+uint64_t cache_key(const Cache* cache, const char* source, size_t size);
+// Returns 1 and fills 'entry' on a hit. With 'need_bytecode' set, an entry
+// of a passing program stored without bytecode counts as a miss.
+int cache_lookup(Cache* cache, uint64_t key, size_t source_size, int need_bytecode, CacheEntry* entry);
+// Stores 'entry' under 'key'; failures only cost the entry
+void cache_store(Cache* cache, uint64_t key, size_t source_size, const CacheEntry* entry);
+void cache_entry_free(CacheEntry* entry);
+
+// Removes the least recently used entries until the directory is back
+// under its size limit
+void cache_trim(Cache* cache);
+void cache_get_stats(Cache* cache, CacheStats* stats);
+// Parses a size such as 4096, 512K, 64M or 2G; returns 0 if it is invalid
+size_t cache_parse_size(const char* text);
+
+#endif /* CACHE_H */
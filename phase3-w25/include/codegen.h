@@ -0,0 +1,57 @@
+/* codegen.h */
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include <stdio.h>
+#include "ir.h"
+
+// x86-64 general-purpose registers. RAX, RCX and RDX are scratch registers
+// of the code generator (idiv, setcc, memory-to-memory moves) and are never
+// allocated; RSP and RBP hold the frame.
+typedef enum {
+    X86_RAX, X86_RCX, X86_RDX, X86_RBX, X86_RSI, X86_RDI,
+    X86_R8, X86_R9, X86_R10, X86_R11, X86_R12, X86_R13, X86_R14, X86_R15,
+    X86_RSP, X86_RBP,
+    X86_REGISTER_COUNT
+} X86Register;
+
+// Where the register allocator placed a value. Constants get neither a
+// register nor a slot; they are emitted as immediates at each use.
+typedef struct {
+    int reg;                // X86Register, or -1
+    int slot;               // Spill slot, or -1
+} Location;
+
+typedef struct {
+    int* order;             // Blocks in code layout order (reverse postorder)
+    int block_count;
+    Location* locations;    // Indexed by value
+    int spill_slots;
+    unsigned callee_saved;  // Callee-saved registers used, as 1 << X86Register
+} Allocation;
+
+// Linear-scan register allocation over the IR laid out in reverse
+// postorder. Every value gets one live interval from its definition to its
+// last use, stretched over any loop it is live across; values live across a
+// call only get callee-saved registers. Returns 0 on success and 1 if out of
+// memory.
+int regalloc_linear_scan(IrProgram* ir, Allocation* allocation);
+void regalloc_free(Allocation* allocation);
+
+// Storage cells are a static array addressed relative to RIP with a signed
+// 32-bit displacement, and the small code model keeps code and data within
+// 2 GB of each other, so native programs get at most 1 GB of cells.
+#define CODEGEN_MAX_CELL_BYTES (1LL << 30)
+
+// Writes the program as a complete x86-64 assembly file (AT&T syntax,
+// System V ABI) with a main function and a small runtime for print,
+// factorial and runtime errors. The IR must have been through the "cfg"
+// analysis. Returns 0 on success, and 1 if out of memory or after printing
+// an error when the cells exceed CODEGEN_MAX_CELL_BYTES.
+int codegen_x86_64(IrProgram* ir, FILE* out);
+
+// Assembles and links a file written by codegen_x86_64 with the system C
+// compiler driver. Returns 0 on success.
+int codegen_link(const char* assembly, const char* executable);
+
+#endif /* CODEGEN_H */
@@ -0,0 +1,36 @@
+/* driver.h */
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include <stdio.h>
+#include "parser.h"
+#include "source.h"
+#include "bytecode.h"
+#include "cache.h"
+
+// Runs lexing, parsing and semantic analysis for every file on a thread
+// pool of 'jobs' workers (0 = one per CPU). Each file's diagnostics are
+// collected separately and printed in the order the files were given.
+// With a cache (may be NULL), files seen before are not compiled again.
+// Returns 0 if every file passed, 1 otherwise.
+int driver_run(char** files, int count, int jobs, Cache* cache);
+
+// Parses and checks a loaded source, printing the same diagnostics as the
+// single-file command to 'out'. With a cache, a hit prints the stored
+// diagnostics without compiling anything and a miss stores them. If
+// 'bytecode' is not NULL and the program passes, it receives the
+// program's bytecode, or a NULL code array if memory ran out. Returns 1
+// if the program passed, 0 after semantic errors and -1 after parse errors.
+int driver_check_source(ParserContext* parser, const SourceBuffer* source, Cache* cache,
+                        FILE* out, Bytecode* bytecode);
+
+// A file list is a malloc'd array of malloc'd names that grows as names are
+// added. Both functions return 0 on success and print an error and return 1
+// on failure.
+int driver_add_file(char*** files, int* count, int* capacity, const char* name);
+// Adds the names listed in a response file, one per line; blank lines and
+// surrounding whitespace are ignored
+int driver_read_response_file(const char* path, char*** files, int* count, int* capacity);
+void driver_free_files(char** files, int count);
+
+#endif /* DRIVER_H */
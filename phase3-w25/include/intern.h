@@ -0,0 +1,35 @@
+/* intern.h */
+#ifndef INTERN_H
+#define INTERN_H
+
+#include "arena.h"
+
+// Interns identifier text: every distinct name gets a small integer ID,
+// starting at 1, so names can be compared and hashed as ints. ID 0 is
+// never handed out and means "not interned".
+typedef struct {
+    const char* text;        // Canonical copy of the name (not NUL-terminated)
+    int length;
+    unsigned int hash;
+} InternName;
+
+typedef struct {
+    int* slots;              // ID per slot, 0 when empty; at most half full
+    int slot_capacity;       // Power of two
+    InternName* names;       // Indexed by ID - 1
+    int count;               // Distinct names interned
+    int name_capacity;
+    Arena* text_arena;       // Where names are copied; NULL keeps the caller's text
+} InternPool;
+
+// With a NULL text_arena the pool refers to the text it was given, which
+// must then outlive the pool
+void intern_init(InternPool* pool, Arena* text_arena);
+void intern_release(InternPool* pool);
+
+// Returns the name's ID, adding it on first sight; 0 if out of memory
+int intern(InternPool* pool, const char* text, int length);
+// Canonical text of an ID
+const char* intern_text(const InternPool* pool, int id, int* length);
+
+#endif /* INTERN_H */
@@ -0,0 +1,26 @@
+/* interpreter.h */
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include <stdio.h>
+#include "parser.h"
+
+// Every runtime value is a 64-bit integer; arithmetic wraps on overflow
+typedef long long Value;
+
+// Runs a program that passed semantic analysis, which resolves every
+// variable to a storage slot (ASTNode.slot). Output of print statements
+// goes to 'out'. Returns 0 on success and 1 after reporting a runtime error.
+int interpret(ASTNode* program, FILE* out);
+
+// Same as interpret(), with hot loops compiled to machine code (see jit.h).
+// If 'stats' is not NULL it receives the JIT's counters.
+struct JitStats;
+int interpret_jit(ASTNode* program, FILE* out, struct JitStats* stats);
+
+// Storage needed by a checked program: the cell count, and for each cell
+// the length of the array starting there (0 for scalars). 'lengths' is
+// malloc'd. Returns 0 on success and 1 if out of memory.
+int program_frame_layout(ASTNode* program, int* frame_size, int** lengths);
+
+#endif /* INTERPRETER_H */
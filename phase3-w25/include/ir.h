@@ -0,0 +1,135 @@
+/* ir.h */
+#ifndef IR_H
+#define IR_H
+
+#include <stdio.h>
+#include "parser.h"
+#include "interpreter.h"
+
+// Register-based SSA intermediate representation. Every instruction that
+// produces a value defines a virtual register named by its index (%n), and
+// each register is assigned exactly once. Scalar variables live only in
+// registers: an assignment creates a new value and control-flow joins get
+// PHI instructions. Array cells stay in memory and are accessed through
+// LOAD_ELEM and STORE_ELEM. A block holds its phis first and ends with
+// exactly one terminator (JUMP, BRANCH or RETURN).
+//
+//   X(name, value operands, produces a value)
+#define IR_OPCODES(X)                                                          \
+    X(CONST, 0, 1)          /* imm */                                          \
+    X(PHI, 0, 1)            /* phi_args: one value per predecessor */          \
+    X(ADD, 2, 1)                                                               \
+    X(SUB, 2, 1)                                                               \
+    X(MUL, 2, 1)                                                               \
+    X(DIV, 2, 1)            /* traps on division by zero */                    \
+    X(LT, 2, 1)                                                                \
+    X(GT, 2, 1)                                                                \
+    X(EQ, 2, 1)                                                                \
+    X(NE, 2, 1)                                                                \
+    X(FACTORIAL, 1, 1)      /* traps on a negative argument */                 \
+    X(LOAD_ELEM, 1, 1)      /* index; base, length; traps out of bounds */     \
+    X(STORE_ELEM, 2, 0)     /* index, value; base, length */                   \
+    X(CLEAR, 0, 0)          /* base, length: zero the cells */                 \
+    X(PRINT, 1, 0)                                                             \
+    X(JUMP, 0, 0)           /* targets[0] */                                   \
+    X(BRANCH, 1, 0)         /* cond: targets[0] if non-zero, else targets[1] */\
+    X(RETURN, 0, 0)
+
+typedef enum {
+#define IR_ENUM(name, operands, value) IR_##name,
+    IR_OPCODES(IR_ENUM)
+#undef IR_ENUM
+    IR_OPCODE_COUNT
+} IrOpcode;
+
+typedef struct {
+    IrOpcode op;
+    int block;              // Owning block, or -1 once deleted
+    int line;               // Source line, for runtime errors
+    int args[2];            // Value operands
+    Value imm;              // CONST value
+    int base;               // First cell of an array; variable slot of a PHI
+    int length;             // Array length
+    int targets[2];         // Successor blocks of JUMP and BRANCH
+    int* phi_args;          // PHI operands, parallel to the block's preds
+    int forward;            // Value this one was replaced by, or -1
+} IrInstr;
+
+typedef struct {
+    int* instrs;            // Instruction ids in execution order
+    int count;
+    int capacity;
+    int* preds;             // Predecessor blocks, one entry per incoming edge
+    int pred_count;
+    int pred_capacity;
+    int dead;               // Removed from the graph
+    int rpo_index;          // Position in reverse postorder, -1 if unreachable
+    int idom;               // Immediate dominator, -1 for the entry
+    int dom_child;          // First child in the dominator tree, or -1
+    int dom_sibling;        // Next child of the same dominator, or -1
+    int dom_pre;            // Dominator tree numbering: a dominates b iff
+    int dom_post;           // a.pre <= b.pre and b.post <= a.post
+} IrBlock;
+
+// Analyses kept on the program; transforms invalidate what they change
+#define IR_ANALYSIS_CFG     1   // rpo and IrBlock.rpo_index
+#define IR_ANALYSIS_DOMTREE 2   // IrBlock.idom, dom_* fields
+
+typedef struct {
+    IrInstr* instrs;
+    int instr_count;
+    int instr_capacity;
+    IrBlock* blocks;        // Block 0 is the entry
+    int block_count;
+    int block_capacity;
+    int frame_size;         // Memory cells, as laid out by semantic analysis
+    int* rpo;               // Reachable blocks in reverse postorder
+    int rpo_count;
+    unsigned analyses;      // Valid IR_ANALYSIS_* results
+    int failed;             // Out of memory
+} IrProgram;
+
+typedef struct {
+    const char* pipeline;   // Comma-separated pass names, NULL for the default
+    const char* dump_after; // Print the IR after this pass ("lower", a pass
+                            // name or "all"), NULL for none
+    int time_passes;        // Report the time spent in every pass
+    FILE* out;
+} IrPassOptions;
+
+#define IR_DEFAULT_PIPELINE "fold,simplify-cfg,cse,dce,verify"
+
+// Lowers a program that passed semantic analysis into SSA form. Returns 0
+// on success and 1 if out of memory.
+int ir_lower(ASTNode* program, IrProgram* ir);
+void ir_free(IrProgram* ir);
+void ir_print(IrProgram* ir, FILE* out);
+
+// Runs the pass pipeline, scheduling the analyses each pass needs. Returns
+// 0 on success and 1 for an unknown pass or a failed verification.
+int ir_run_passes(IrProgram* ir, const IrPassOptions* options);
+void ir_list_passes(FILE* out);
+
+// Runs lowered code; same output and runtime errors as interpret().
+// Returns 0 on success and 1 after reporting a runtime error.
+int ir_execute(const IrProgram* ir, FILE* out);
+
+// Construction and editing, shared by the lowering and the passes
+int ir_add_block(IrProgram* ir);
+int ir_add_instr(IrProgram* ir, int block, IrOpcode op, int line);
+void ir_add_edge(IrProgram* ir, int from, int to);
+void ir_remove_edge(IrProgram* ir, int from, int to);
+int ir_successors(const IrProgram* ir, int block, int succs[2]);
+// Fills 'order' with the reachable blocks in reverse postorder; returns
+// their count, or 0 if out of memory
+int ir_reverse_postorder(const IrProgram* ir, int* order);
+int ir_value(const IrProgram* ir, int value);
+void ir_replace(IrProgram* ir, int value, int replacement);
+int ir_remove_trivial_phis(IrProgram* ir);
+void ir_merge_blocks(IrProgram* ir, int into, int from);
+void ir_cleanup(IrProgram* ir);
+int ir_opcode_operands(IrOpcode op);
+int ir_opcode_has_value(IrOpcode op);
+const char* ir_opcode_name(IrOpcode op);
+
+#endif /* IR_H */
@@ -0,0 +1,44 @@
+/* jit.h */
+#ifndef JIT_H
+#define JIT_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "parser.h"
+#include "interpreter.h"
+
+// Loop JIT for the tree-walking interpreter. Once a while or repeat loop has
+// run JIT_HOT_ITERATIONS iterations, the interpreter hands the rest of it to
+// machine code compiled from the loop's AST into mmap'd executable memory.
+// The code works directly on the interpreter's frame, so it can take over at
+// any iteration boundary. Loops it cannot compile stay interpreted.
+#define JIT_HOT_ITERATIONS 16
+
+typedef struct Jit Jit;
+
+typedef enum {
+    JIT_COMPLETED,          // The loop ran to its end
+    JIT_FAILED,             // A runtime error stopped it (*line, *message)
+    JIT_UNSUPPORTED         // Not compiled; the caller interprets the loop
+} JitStatus;
+
+typedef struct JitStats {
+    int loops_compiled;
+    int loops_rejected;
+    size_t code_bytes;      // Machine code generated
+    double compile_seconds;
+} JitStats;
+
+// Returns NULL if out of memory. Print statements in compiled code write to
+// 'out'.
+Jit* jit_create(FILE* out);
+void jit_free(Jit* jit);
+
+// Runs the remaining iterations of 'loop' (AST_WHILE or AST_REPEAT, entered
+// at an iteration boundary), compiling it on first use. 'lengths' gives the
+// array length at each array's first cell, as from program_frame_layout().
+JitStatus jit_run_loop(Jit* jit, ASTNode* loop, Value* frame, const int* lengths,
+                       int* line, const char** message);
+void jit_get_stats(const Jit* jit, JitStats* stats);
+
+#endif /* JIT_H */
@@ -0,0 +1,47 @@
+/* json.h */
+#ifndef JSON_H
+#define JSON_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "arena.h"
+
+// Small JSON reader and writer for the language server. A parsed document
+// lives in an arena; strings are unescaped to UTF-8 and NUL-terminated.
+typedef enum {
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT
+} JsonType;
+
+typedef struct JsonValue {
+    JsonType type;
+    int boolean;
+    double number;
+    const char* string;             // JSON_STRING text
+    size_t length;                  // Bytes in 'string'
+    const char* key;                // Member name inside an object, else NULL
+    struct JsonValue* children;     // First item or member
+    struct JsonValue* next;         // Next item or member of the parent
+} JsonValue;
+
+// Parses 'length' bytes of 'text'; returns NULL if the text is not valid
+// JSON or memory runs out
+JsonValue* json_parse(Arena* arena, const char* text, size_t length);
+// Member 'key' of an object; NULL if 'object' is NULL, not an object, or
+// has no such member
+JsonValue* json_get(const JsonValue* object, const char* key);
+// String text, or NULL if 'value' is not a string
+const char* json_string(const JsonValue* value);
+// Number as an integer, or 'fallback' if 'value' is not a number
+long json_int(const JsonValue* value, long fallback);
+
+// Writes 'text' as a quoted, escaped JSON string
+void json_write_string(FILE* out, const char* text, size_t length);
+// Writes a parsed value back out
+void json_write_value(FILE* out, const JsonValue* value);
+
+#endif /* JSON_H */
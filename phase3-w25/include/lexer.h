@@ -4,9 +4,30 @@
 
 #include "tokens.h"
 
+// Whitespace skipping implementation; AUTO picks the best one the CPU supports
+typedef enum {
+    LEXER_SIMD_AUTO,
+    LEXER_SIMD_SCALAR,
+    LEXER_SIMD_SSE2,
+    LEXER_SIMD_AVX2
+} LexerSimdLevel;
+
+// Per-input lexer state; each input being lexed needs its own
+typedef struct {
+    int line;
+    int column;
+    char last_token_type;   // 'o' after an arithmetic operator, else 'x'
+} LexerState;
+
 // Lexer functions that need to be visible to other files
-Token get_next_token(const char* input, int* pos);
+void lexer_init(void);
+void lexer_reset(LexerState* state);
+LexerSimdLevel lexer_set_simd(LexerSimdLevel level);
+Token get_next_token(LexerState* state, const char* input, int* pos);
+Token get_next_token_reference(LexerState* state, const char* input, int* pos);
+TokenType lookup_keyword(const char* word, int length);
+TokenType lookup_keyword_linear(const char* word);
 void print_token(Token token);
-void print_error(ErrorType error, int line, const char* lexeme);
+void print_error(ErrorType error, int line, const char* lexeme, int length);
 
 #endif /* LEXER_H */
\ No newline at end of file
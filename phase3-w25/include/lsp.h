@@ -0,0 +1,19 @@
+/* lsp.h */
+#ifndef LSP_H
+#define LSP_H
+
+// Language server speaking the Language Server Protocol (JSON-RPC framed by
+// Content-Length headers). Each open document keeps its text, its AST and
+// its symbol table in memory; an edit re-parses only the statements it
+// touches (see parse_edit), and semantic analysis runs again only for
+// documents that changed, once no more input is waiting. The server
+// publishes the parser's and semantic analysis's errors as diagnostics and
+// answers go-to-definition for variables.
+//
+// Reads messages from 'in' and writes replies to 'out' until an exit
+// notification or end of input. Returns 0 if the client sent shutdown
+// before exit, 1 otherwise. With 'show_stats' set, timing totals go to
+// stderr on exit.
+int lsp_serve(int in, int out, int show_stats);
+
+#endif /* LSP_H */
@@ -2,7 +2,11 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <stdio.h>
 #include "tokens.h"
+#include "source.h"
+#include "arena.h"
+#include "token_stream.h"
 
 #define MAX_ERRORS 256 // Can be adjusted later
 
@@ -24,6 +28,19 @@ typedef enum {
     AST_ARRAYACCESS
 } ASTNodeType;
 
+// Operator of an AST_BINOP node, from its token type
+typedef enum {
+    BINOP_NONE,
+    BINOP_ADD,
+    BINOP_SUB,
+    BINOP_MUL,
+    BINOP_DIV,
+    BINOP_LESS,
+    BINOP_GREATER,
+    BINOP_EQUAL,
+    BINOP_NOT_EQUAL
+} BinaryOp;
+
 typedef enum {
     PARSE_ERROR_NONE,
     PARSE_ERROR_UNEXPECTED_TOKEN,
@@ -42,7 +59,9 @@ typedef enum {
 
 // AST Node structure
 typedef struct ASTNode {
-    ASTNodeType type;           // Type of node
+    unsigned char type;         // ASTNodeType
+    unsigned char op;           // BinaryOp of an AST_BINOP node, BINOP_NONE otherwise
+    int slot;                   // Storage slot of a variable, set by semantic analysis; -1 if none
     Token token;               // Token associated with this node
     struct ASTNode* left;      // Left child
     struct ASTNode* right;     // Right child
@@ -62,10 +81,60 @@ typedef struct {
 } ParseErrorInfo;
 
 
+struct ASTUnit;
+
+// All state of one parse. Each thread that parses needs its own context;
+// zero-initialise it before the first parser_init call.
+typedef struct ParserContext {
+    Token current_token;
+    Token previous_token;
+    TokenStream stream;
+    const SourceBuffer* source_buffer;  // Mapped input whose consumed pages are released
+    size_t released_offset;
+    struct ASTUnit* unit;               // Unit being filled; NULL once parse() hands it out
+    ParseErrorInfo errors[MAX_ERRORS];
+    int error_count;
+} ParserContext;
+
+// A change to source text: 'deleted' bytes at 'offset' are replaced by the
+// 'inserted_length' bytes at 'inserted'
+typedef struct {
+    size_t offset;
+    size_t deleted;
+    const char* inserted;
+    size_t inserted_length;
+} TextEdit;
+
 // Parser functions
-void parser_init(const char* input);
-ASTNode* parse(void);
+void parser_init(ParserContext* ctx, const char* input);
+void parser_init_source(ParserContext* ctx, const SourceBuffer* input);
+int parser_init_fd(ParserContext* ctx, int fd);
+ASTNode* parse(ParserContext* ctx);
+// Parses 'source' with 'edit' applied and returns the tree of the edited
+// text, with its errors in ctx->errors; 'root' is the tree of 'source' as
+// parse() or an earlier parse_edit returned it, unmodified since. Only the
+// top-level statements around the edit are re-lexed and re-parsed; the ones
+// before and after it are reused, so 'root' itself is usually returned. The
+// first edit of a tree from parse() parses the whole text once, after which
+// the tree keeps its own copy of every token's text. When a different tree
+// is returned, 'root' has been freed. Returns NULL, with 'root' untouched,
+// if the edit falls outside the text, and NULL when out of memory.
+ASTNode* parse_edit(ParserContext* ctx, ASTNode* root, const char* source, const TextEdit* edit);
+void print_errors(ParserContext* ctx);
+void print_errors_to(ParserContext* ctx, FILE* out);
 void print_ast(ASTNode* node, int level);
+void print_ast_to(ASTNode* node, int level, FILE* out);
+// Every node of a parse comes from one arena; pass the root returned by
+// parse() to free all of them at once
 void free_ast(ASTNode* node);
+void ast_get_stats(const ASTNode* root, ArenaStats* stats);
+// An empty AST_PROGRAM with its own arena, to be filled through ast_alloc
+// and released with free_ast. Returns NULL when out of memory.
+ASTNode* ast_new_program(void);
+// Allocates from the arena that owns the tree rooted at 'root'
+void* ast_alloc(ASTNode* root, size_t size);
+// Value of an AST_NUMBER node. Literals are digits only; constants folded
+// by semantic analysis may be negative. Values wrap to 64 bits.
+long long ast_number_value(const ASTNode* node);
 
 #endif /* PARSER_H */
\ No newline at end of file
@@ -2,22 +2,57 @@
 #ifndef SEMANTIC_H
 #define SEMANTIC_H
 
+#include <limits.h>
+#include <stdio.h>
+#include "parser.h"
+#include "aststore.h"
+
 // Basic symbol structure
 typedef struct Symbol {
-    char name[100];          // Variable name
+    int name_id;             // Interned ID of the variable name
     int type;                // Data type (int, etc.)
     int scope_level;         // Scope nesting level
     int line_declared;       // Line where declared
+    int column_declared;     // Column of the name in the declaration
     int is_initialized;      // Has been assigned a value?
     int is_array;
     int array_size;   
-    struct Symbol* next;     // For linked list implementation
+    int slot;                // First storage cell; arrays take array_size cells
+    struct Symbol* next;     // Symbol declared before this one (declaration stack)
+    struct Symbol* shadowed; // Outer symbol with the same name hidden by this one
 } Symbol;
 
-// Symbol table
+// One distinct name in the symbol table's hash index. Slots are never
+// removed; a name with no visible declaration keeps its slot with a NULL
+// symbol.
 typedef struct {
-    Symbol* head;            // First symbol in the table
+    int name_id;             // Interned name ID, 0 for an empty slot
+    Symbol* symbol;          // Innermost visible declaration of the name
+} SymbolSlot;
+
+// Storage cells a program may declare, scalars and array elements together.
+// The engines hold slots and frame sizes in ints, so declaring more is a
+// semantic error.
+#define SEM_MAX_FRAME_SIZE INT_MAX
+
+// Symbol table: an open-addressing hash index from name to innermost
+// declaration, plus a stack of all visible declarations. Entering a scope
+// marks the top of the stack; exiting pops back to the mark.
+typedef struct {
+    Symbol* head;            // Most recently declared symbol
     int current_scope;       // Current scope level
+    SymbolSlot* slots;       // Power-of-two sized, at most half full
+    int slot_capacity;
+    int slot_count;
+    Symbol** scope_marks;    // head when each open scope was entered
+    int mark_capacity;
+    int frame_size;          // Storage cells handed out; never reused, at most SEM_MAX_FRAME_SIZE
+    int error_count;         // Semantic errors reported against this table
+    FILE* out;               // Where semantic errors are printed
+    ASTNode* root;           // Tree being checked; folded constants are allocated in it
+    const AstStore* store;   // Store being checked instead of a tree, else NULL
+    int keep_symbols;        // Keep the symbols of closed scopes on 'retired'
+    Symbol* retired;         // Symbols popped from closed scopes, most recent first
 } SymbolTable;
 
 typedef enum {
@@ -28,6 +63,7 @@ typedef enum {
     SEM_ERROR_UNINITIALIZED_VARIABLE,
     SEM_ERROR_INVALID_OPERATION,
     SEM_ERROR_INVALID_ARRAY_SIZE,
+    SEM_ERROR_OUT_OF_STORAGE,
     SEM_ERROR_NOT_AN_ARRAY,
     SEM_ERROR_ARRAY_INDEX_OUT_OF_BOUNDS,
     SEM_ERROR_ARRAY_ASSIGNMENT,
@@ -35,7 +71,21 @@ typedef enum {
     SEM_ERROR_SEMANTIC_ERROR  // Generic semantic error
 } SemanticErrorType;
 
+// Checks a parsed program; returns 1 if no semantic errors were found.
+// analyze_semantics prints errors to stdout, analyze_semantics_to to 'out'.
+int analyze_semantics(ASTNode* ast);
+int analyze_semantics_to(ASTNode* ast, FILE* out);
+// Checks like analyze_semantics_to but hands back the symbol table with
+// every declaration kept, including those of closed scopes, so a tool can
+// map the slot of an identifier node to its declaration. Returns NULL if
+// out of memory; release the table with free_symbol_table.
+SymbolTable* analyze_semantics_keep(ASTNode* ast, FILE* out);
+void free_symbol_table(SymbolTable* table);
+// Checks a program held in an AstStore, printing the same errors to 'out'
+// as analyze_semantics_to would for the tree it was built from
+int analyze_semantics_store(const AstStore* store, FILE* out);
+
 // Report semantic errors
-void semantic_error(SemanticErrorType error, const char* name, int line);
+void semantic_error(SymbolTable* table, SemanticErrorType error, const char* name, int length, int line);
 
 #endif /* PARSER_H */
\ No newline at end of file
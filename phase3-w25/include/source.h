@@ -0,0 +1,30 @@
+/* source.h */
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// A loaded input file. 'data' is always NUL-terminated so the lexer can
+// run over it directly, whether it is memory-mapped or read into the heap.
+typedef struct {
+    const char* data;       // Source text
+    size_t size;            // Length of the text, excluding the terminator
+    void* mapping;          // Start of the mapping, or NULL if heap-allocated
+    size_t mapping_size;    // Length of the mapping
+} SourceBuffer;
+
+// Loads a file ("-" reads stdin). Regular files are memory-mapped; pipes,
+// terminals and other special files are read into a heap buffer.
+// Returns 0 on success and prints an error and returns 1 on failure.
+int source_open(SourceBuffer* source, const char* filename);
+// Same as source_open, but errors are written to 'out'
+int source_open_to(SourceBuffer* source, const char* filename, FILE* out);
+void source_close(SourceBuffer* source);
+
+// Tells the kernel the mapped pages before 'offset' are not needed for now.
+// They are file-backed and read-only, so a later access (e.g. printing a
+// token from the AST) faults them back in. No-op for heap buffers.
+void source_release(const SourceBuffer* source, size_t offset);
+
+#endif /* SOURCE_H */
@@ -0,0 +1,19 @@
+/* thread_pool.h */
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// Called once for every task number; 'worker' identifies the calling thread
+// (0 .. workers-1) so callers can keep per-thread state.
+typedef void (*ThreadPoolTask)(void* arg, int task, int worker);
+
+// Runs tasks 0 .. task_count-1 on up to 'workers' threads and waits for all
+// of them. Each worker starts with a contiguous share of the tasks and,
+// once it runs out, steals half of the remaining share of another worker.
+// The calling thread is worker 0. Returns 0 on success, 1 if no thread
+// could be started (the tasks are then run on the calling thread).
+int thread_pool_run(int workers, int task_count, ThreadPoolTask fn, void* arg);
+
+// Number of online CPUs, at least 1
+int thread_pool_default_workers(void);
+
+#endif /* THREAD_POOL_H */
@@ -0,0 +1,63 @@
+/* token_stream.h */
+#ifndef TOKEN_STREAM_H
+#define TOKEN_STREAM_H
+
+#include <stddef.h>
+#include "tokens.h"
+#include "arena.h"
+#include "lexer.h"
+#include "intern.h"
+
+#define TOKEN_RING_SIZE 64          // Must be a power of two
+#ifndef TOKEN_STREAM_CHUNK_SIZE
+#define TOKEN_STREAM_CHUNK_SIZE (1024 * 1024)
+#endif
+
+// Reads an input descriptor in chunks. Each window handed to the lexer ends
+// on a line boundary (tokens never span lines), so no token is split
+// between two windows.
+typedef struct {
+    int fd;
+    char* buffer;           // Window followed by the carried-over partial line
+    size_t capacity;
+    size_t window;          // Bytes visible to the lexer
+    size_t filled;          // Bytes read into the buffer
+    size_t base;            // Input offset of buffer[0]
+    int eof;
+    char saved;             // Byte replaced by the window's NUL terminator
+} ChunkReader;
+
+// Buffers tokens ahead of the parser in a ring and gives k-token lookahead.
+// Input is either one in-memory string or a ChunkReader. Identifiers are
+// interned in 'names' as they are lexed, when a pool is given. Tokens from
+// a ChunkReader have their text copied into 'text_arena', since the window
+// they were lexed from is reused; interned identifiers use the pool's copy.
+typedef struct {
+    Token ring[TOKEN_RING_SIZE];
+    unsigned int head;      // Ring index of the next token
+    unsigned int count;     // Tokens buffered
+    int at_eof;             // The EOF token has been buffered
+    LexerState lexer;
+    const char* text;       // String or current window being lexed
+    int position;           // Lexer position in 'text'
+    ChunkReader* reader;    // NULL for in-memory input
+    Arena* text_arena;
+    InternPool* names;      // NULL to leave identifiers uninterned
+} TokenStream;
+
+void token_stream_init_string(TokenStream* stream, const char* input, InternPool* names);
+// Streams from a descriptor; returns 0 on success. 'names' must copy its
+// text into an arena (see intern_init), as the window is reused.
+int token_stream_init_fd(TokenStream* stream, int fd, Arena* text_arena, InternPool* names);
+void token_stream_close(TokenStream* stream);
+
+// Returns the token k positions ahead without consuming it (k = 0 is the
+// next token). k must be less than TOKEN_RING_SIZE. Past the end of input
+// the EOF token is returned.
+Token token_stream_peek(TokenStream* stream, int k);
+Token token_stream_next(TokenStream* stream);
+
+// Input offset reached by the lexer
+size_t token_stream_offset(const TokenStream* stream);
+
+#endif /* TOKEN_STREAM_H */
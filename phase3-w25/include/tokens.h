@@ -4,7 +4,13 @@
 typedef enum {
     TOKEN_EOF,
     TOKEN_NUMBER,      // e.g., "123", "456"
-    TOKEN_OPERATOR,    // +, -, *, /
+
+    // Arithmetic Operators, kept together for TOKEN_IS_ARITHMETIC
+    TOKEN_PLUS,        // +
+    TOKEN_MINUS,       // -
+    TOKEN_STAR,        // *
+    TOKEN_SLASH,       // /
+
     TOKEN_IDENTIFIER,  // Variable names
     TOKEN_EQUALS,      // =
     TOKEN_SEMICOLON,   // ;
@@ -34,6 +40,8 @@ typedef enum {
     TOKEN_RBRACKET
 } TokenType;
 
+#define TOKEN_IS_ARITHMETIC(type) ((type) >= TOKEN_PLUS && (type) <= TOKEN_SLASH)
+
 typedef enum {
     ERROR_NONE,
     ERROR_INVALID_CHAR,
@@ -43,12 +51,18 @@ typedef enum {
     ERROR_UNEXPECTED_TOKEN
 } ErrorType;
 
+/* Tokens are slices of the source buffer: 'lexeme' points at the token
+   text, which is NOT NUL-terminated, and 'length' gives its size. Print
+   it with "%.*s", token.length, token.lexeme. The source buffer must
+   outlive every token and AST node made from it. */
 typedef struct {
-    TokenType type;
-    char lexeme[100];   // Actual text of the token
-    int line; 
-    int column;          // Line number in source file
-    ErrorType error;    // Error type if any
+    const char* lexeme;     // Start of the token text
+    int length;             // Length of the token text
+    int line;               // Line number in source file
+    int column;             // Column number in source file
+    int id;                 // Interned name ID for identifiers, 0 otherwise
+    unsigned char type;     // TokenType
+    unsigned char error;    // ErrorType, if any
 } Token;
 
 #endif /* TOKENS_H */
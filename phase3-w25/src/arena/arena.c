@@ -0,0 +1,105 @@
+/* arena.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include "../../include/arena.h"
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+/* Enough for any node built from pointers and ints */
+#define ARENA_ALIGNMENT 8
+
+struct ArenaBlock {
+    ArenaBlock* next;
+    size_t size;             // Usable bytes after the header
+};
+
+/* Header size rounded up so the first allocation in a block is aligned */
+#define ARENA_HEADER_SIZE ((sizeof(ArenaBlock) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+/* Process-wide counters, shared by arenas on every thread. They only feed
+   statistics, so relaxed ordering is enough. */
+static atomic_size_t global_allocations;
+static atomic_size_t global_bytes_used;
+static atomic_size_t global_bytes_reserved;
+static atomic_size_t global_block_count;
+static atomic_size_t global_high_water;
+
+#define COUNTER_ADD(counter, n) atomic_fetch_add_explicit(&(counter), (n), memory_order_relaxed)
+#define COUNTER_SUB(counter, n) atomic_fetch_sub_explicit(&(counter), (n), memory_order_relaxed)
+#define COUNTER_GET(counter) atomic_load_explicit(&(counter), memory_order_relaxed)
+
+void arena_init(Arena* arena) {
+    arena->blocks = NULL;
+    arena->cursor = NULL;
+    arena->limit = NULL;
+    arena->allocations = 0;
+    arena->bytes_used = 0;
+    arena->bytes_reserved = 0;
+    arena->block_count = 0;
+}
+
+static int arena_grow(Arena* arena, size_t size) {
+    size_t usable = size > ARENA_BLOCK_SIZE - ARENA_HEADER_SIZE ? size : ARENA_BLOCK_SIZE - ARENA_HEADER_SIZE;
+    ArenaBlock* block = malloc(ARENA_HEADER_SIZE + usable);
+    if (!block) return 0;
+
+    block->next = arena->blocks;
+    block->size = usable;
+    arena->blocks = block;
+    arena->cursor = (char*)block + ARENA_HEADER_SIZE;
+    arena->limit = arena->cursor + usable;
+    arena->bytes_reserved += ARENA_HEADER_SIZE + usable;
+    arena->block_count++;
+
+    size_t reserved = COUNTER_ADD(global_bytes_reserved, ARENA_HEADER_SIZE + usable) + ARENA_HEADER_SIZE + usable;
+    COUNTER_ADD(global_block_count, 1);
+    size_t high_water = COUNTER_GET(global_high_water);
+    while (reserved > high_water &&
+           !atomic_compare_exchange_weak_explicit(&global_high_water, &high_water, reserved,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+    return 1;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    if ((size_t)(arena->limit - arena->cursor) < size) {
+        if (!arena_grow(arena, size)) return NULL;
+    }
+    void* memory = arena->cursor;
+    arena->cursor += size;
+    arena->allocations++;
+    arena->bytes_used += size;
+    COUNTER_ADD(global_allocations, 1);
+    COUNTER_ADD(global_bytes_used, size);
+    return memory;
+}
+
+void arena_release(Arena* arena) {
+    ArenaBlock* block = arena->blocks;
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    COUNTER_SUB(global_bytes_reserved, arena->bytes_reserved);
+    COUNTER_SUB(global_block_count, arena->block_count);
+    arena_init(arena);
+}
+
+void arena_get_stats(const Arena* arena, ArenaStats* stats) {
+    stats->allocations = arena->allocations;
+    stats->bytes_used = arena->bytes_used;
+    stats->bytes_reserved = arena->bytes_reserved;
+    stats->block_count = arena->block_count;
+    stats->high_water = arena->bytes_reserved;
+}
+
+void arena_get_global_stats(ArenaStats* stats) {
+    stats->allocations = COUNTER_GET(global_allocations);
+    stats->bytes_used = COUNTER_GET(global_bytes_used);
+    stats->bytes_reserved = COUNTER_GET(global_bytes_reserved);
+    stats->block_count = COUNTER_GET(global_block_count);
+    stats->high_water = COUNTER_GET(global_high_water);
+}
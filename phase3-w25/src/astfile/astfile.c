@@ -0,0 +1,367 @@
+/* astfile.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../../include/astfile.h"
+
+#define NODES_OFFSET ((sizeof(AstFileHeader) + 7) & ~(size_t)7)
+
+/* Identical token texts are stored once; the table maps a text to its
+   offset in the string table */
+typedef struct {
+    uint32_t* slots;            // Offset + 1, 0 if empty
+    size_t capacity;
+    size_t count;
+} StringIndex;
+
+/* The nodes are built in place in the image, after room for the header;
+   the strings are appended once the nodes are done */
+typedef struct {
+    char* image;
+    AstFileNode* nodes;
+    uint32_t node_count;
+    uint32_t node_capacity;
+    char* strings;
+    size_t strings_size;
+    size_t strings_capacity;
+    StringIndex index;
+} Builder;
+
+/* A node still to be written, and the field of its parent to point at it */
+typedef struct {
+    const ASTNode* node;
+    uint32_t parent;
+    int field;                  // 0 left, 1 right, 2 next
+} Pending;
+
+static uint64_t hash_text(const char* text, size_t length) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)text[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int index_grow(Builder* b) {
+    size_t capacity = b->index.capacity ? b->index.capacity * 2 : 1024;
+    uint32_t* slots = calloc(capacity, sizeof(uint32_t));
+    if (!slots) return 1;
+    for (size_t i = 0; i < b->index.capacity; i++) {
+        uint32_t entry = b->index.slots[i];
+        if (!entry) continue;
+        const char* text = b->strings + entry - 1;
+        size_t slot = hash_text(text, strlen(text)) & (capacity - 1);
+        while (slots[slot]) slot = (slot + 1) & (capacity - 1);
+        slots[slot] = entry;
+    }
+    free(b->index.slots);
+    b->index.slots = slots;
+    b->index.capacity = capacity;
+    return 0;
+}
+
+/* Returns the offset of 'text' in the string table, adding it if needed */
+static int intern_string(Builder* b, const char* text, size_t length, uint32_t* offset) {
+    if ((b->index.count + 1) * 4 > b->index.capacity * 3 && index_grow(b) != 0) return 1;
+    size_t mask = b->index.capacity - 1;
+    size_t slot = hash_text(text, length) & mask;
+    for (; b->index.slots[slot]; slot = (slot + 1) & mask) {
+        const char* existing = b->strings + b->index.slots[slot] - 1;
+        if (memcmp(existing, text, length) == 0 && existing[length] == '\0') {
+            *offset = b->index.slots[slot] - 1;
+            return 0;
+        }
+    }
+
+    if (b->strings_size + length + 1 > b->strings_capacity) {
+        size_t capacity = b->strings_capacity ? b->strings_capacity * 2 : 4096;
+        while (capacity < b->strings_size + length + 1) capacity *= 2;
+        char* grown = realloc(b->strings, capacity);
+        if (!grown) return 1;
+        b->strings = grown;
+        b->strings_capacity = capacity;
+    }
+    /* Offsets and the index's offset + 1 must fit in 32 bits */
+    if (b->strings_size + length + 1 >= AST_FILE_NONE) return 1;
+    memcpy(b->strings + b->strings_size, text, length);
+    b->strings[b->strings_size + length] = '\0';
+    *offset = (uint32_t)b->strings_size;
+    b->index.slots[slot] = *offset + 1;
+    b->index.count++;
+    b->strings_size += length + 1;
+    return 0;
+}
+
+static int add_node(Builder* b, const ASTNode* node) {
+    if (b->node_count == b->node_capacity) {
+        if (b->node_capacity >= AST_FILE_NONE / 2) return 1;
+        uint32_t capacity = b->node_capacity ? b->node_capacity * 2 : 1024;
+        char* grown = realloc(b->image, NODES_OFFSET + (size_t)capacity * sizeof(AstFileNode));
+        if (!grown) return 1;
+        b->image = grown;
+        b->nodes = (AstFileNode*)(grown + NODES_OFFSET);
+        b->node_capacity = capacity;
+    }
+    AstFileNode* out = &b->nodes[b->node_count];
+    memset(out, 0, sizeof(*out));
+    const char* text = node->token.lexeme ? node->token.lexeme : "";
+    size_t length = node->token.lexeme && node->token.length > 0 ? (size_t)node->token.length : 0;
+    if (intern_string(b, text, length, &out->text) != 0) return 1;
+    out->left = out->right = out->next = AST_FILE_NONE;
+    out->length = node->token.length;
+    out->line = node->token.line;
+    out->column = node->token.column;
+    out->id = node->token.id;
+    out->slot = node->slot;
+    out->type = (uint8_t)node->type;
+    out->token_type = node->token.type;
+    out->token_error = node->token.error;
+    out->op = node->op;
+    b->node_count++;
+    return 0;
+}
+
+/* Numbers the nodes in pre-order with an explicit stack, so long statement
+   lists and deep expressions cannot overflow the call stack */
+static int add_tree(Builder* b, const ASTNode* root) {
+    size_t capacity = 256;
+    size_t depth = 0;
+    Pending* stack = malloc(capacity * sizeof(Pending));
+    if (!stack) return 1;
+    stack[depth++] = (Pending){root, AST_FILE_NONE, 0};
+
+    while (depth > 0) {
+        Pending item = stack[--depth];
+        uint32_t index = b->node_count;
+        if (add_node(b, item.node) != 0) {
+            free(stack);
+            return 1;
+        }
+        if (item.parent != AST_FILE_NONE) {
+            AstFileNode* parent = &b->nodes[item.parent];
+            *(item.field == 0 ? &parent->left : item.field == 1 ? &parent->right : &parent->next) = index;
+        }
+        if (depth + 3 > capacity) {
+            capacity *= 2;
+            Pending* grown = realloc(stack, capacity * sizeof(Pending));
+            if (!grown) {
+                free(stack);
+                return 1;
+            }
+            stack = grown;
+        }
+        /* Pushed in reverse, so 'left' is numbered first */
+        if (item.node->next) stack[depth++] = (Pending){item.node->next, index, 2};
+        if (item.node->right) stack[depth++] = (Pending){item.node->right, index, 1};
+        if (item.node->left) stack[depth++] = (Pending){item.node->left, index, 0};
+    }
+    free(stack);
+    return 0;
+}
+
+void* ast_file_build(const ASTNode* root, size_t* size) {
+    Builder b = {0};
+    char* image = NULL;
+    if (add_tree(&b, root) == 0) {
+        AstFileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, AST_FILE_MAGIC, sizeof(header.magic));
+        header.version = AST_FILE_VERSION;
+        header.header_size = sizeof(AstFileHeader);
+        header.node_size = sizeof(AstFileNode);
+        header.node_count = b.node_count;
+        header.nodes_offset = NODES_OFFSET;
+        header.strings_offset = header.nodes_offset + (uint64_t)b.node_count * sizeof(AstFileNode);
+        header.strings_size = b.strings_size;
+        header.file_size = header.strings_offset + b.strings_size;
+
+        image = realloc(b.image, header.file_size);
+        if (image) {
+            b.image = NULL;
+            memset(image, 0, NODES_OFFSET);
+            memcpy(image, &header, sizeof(header));
+            memcpy(image + header.strings_offset, b.strings, b.strings_size);
+            *size = header.file_size;
+        }
+    }
+    if (!image) printf("Error: Could not serialize the AST (out of memory or too large)\n");
+    free(b.image);
+    free(b.strings);
+    free(b.index.slots);
+    return image;
+}
+
+int ast_file_write(const ASTNode* root, const char* path, size_t* size) {
+    size_t image_size;
+    char* image = ast_file_build(root, &image_size);
+    if (!image) return 1;
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("Error: Could not write %s\n", path);
+        free(image);
+        return 1;
+    }
+    /* A regular file takes the image in one write; the loop only covers
+       interruptions and short writes */
+    const char* p = image;
+    size_t left = image_size;
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        p += n;
+        left -= (size_t)n;
+    }
+    int failed = left > 0;
+    if (close(fd) != 0) failed = 1;
+    free(image);
+    if (failed) {
+        printf("Error: Could not write %s\n", path);
+        unlink(path);
+        return 1;
+    }
+    if (size) *size = image_size;
+    return 0;
+}
+
+/* Checks the header, that every section lies inside the image, that every
+   node's children and text do, and that no node is the child of two others:
+   the tree built from the file is freed node by node, so it must not share */
+static int validate(const AstFile* file) {
+    const AstFileHeader* header = file->header;
+    if (file->size < sizeof(AstFileHeader) || memcmp(header->magic, AST_FILE_MAGIC, sizeof(header->magic)) != 0) {
+        return 0;
+    }
+    if (header->version != AST_FILE_VERSION || header->header_size != sizeof(AstFileHeader) ||
+        header->node_size != sizeof(AstFileNode) || header->file_size != file->size ||
+        header->node_count == 0 || header->nodes_offset % 8 != 0 ||
+        header->nodes_offset < sizeof(AstFileHeader) || header->nodes_offset > file->size ||
+        (file->size - header->nodes_offset) / sizeof(AstFileNode) < header->node_count ||
+        header->strings_offset != header->nodes_offset + (uint64_t)header->node_count * sizeof(AstFileNode) ||
+        header->strings_size != file->size - header->strings_offset) {
+        return 0;
+    }
+
+    uint32_t count = header->node_count;
+    if (file->nodes[0].type != AST_PROGRAM) return 0;
+    /* One bit per node, set once the node is taken as a child */
+    unsigned char* seen = calloc(count / 8 + 1, 1);
+    if (!seen) {
+        printf("Error: Memory allocation failed\n");
+        return 0;
+    }
+    int valid = 1;
+    for (uint32_t i = 0; i < count && valid; i++) {
+        const AstFileNode* node = &file->nodes[i];
+        uint32_t children[3] = {node->left, node->right, node->next};
+        for (int c = 0; c < 3 && valid; c++) {
+            uint32_t child = children[c];
+            if (child == AST_FILE_NONE) continue;
+            if (child <= i || child >= count || (seen[child / 8] & (1u << (child % 8)))) {
+                valid = 0;
+            } else {
+                seen[child / 8] |= (unsigned char)(1u << (child % 8));
+            }
+        }
+        /* The engines trust the operator of a binary node */
+        if (node->type == AST_BINOP ? node->op == BINOP_NONE || node->op > BINOP_NOT_EQUAL
+                                    : node->op != BINOP_NONE) {
+            valid = 0;
+        }
+        if (node->type > AST_ARRAYACCESS || node->length < 0 ||
+            node->text >= header->strings_size ||
+            (uint64_t)node->text + (uint64_t)node->length >= header->strings_size ||
+            file->strings[node->text + node->length] != '\0') {
+            valid = 0;
+        }
+    }
+    free(seen);
+    return valid;
+}
+
+int ast_file_load(AstFile* file, const void* data, size_t size) {
+    file->header = data;
+    file->size = size;
+    file->map = NULL;
+    if (size >= sizeof(AstFileHeader) && file->header->nodes_offset <= size &&
+        file->header->strings_offset <= size) {
+        file->nodes = (const AstFileNode*)((const char*)data + file->header->nodes_offset);
+        file->strings = (const char*)data + file->header->strings_offset;
+        if (validate(file)) return 0;
+    }
+    printf("Error: Not a valid AST file (version %d expected)\n", AST_FILE_VERSION);
+    return 1;
+}
+
+int ast_file_open(AstFile* file, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Error: Could not open file %s\n", path);
+        return 1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+        printf("Error: Not a valid AST file: %s\n", path);
+        close(fd);
+        return 1;
+    }
+    void* map = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        printf("Error: Could not map file %s\n", path);
+        return 1;
+    }
+    if (ast_file_load(file, map, (size_t)info.st_size) != 0) {
+        munmap(map, (size_t)info.st_size);
+        return 1;
+    }
+    file->map = map;
+    return 0;
+}
+
+void ast_file_close(AstFile* file) {
+    if (file->map) munmap(file->map, file->size);
+    file->map = NULL;
+}
+
+ASTNode* ast_file_to_tree(const AstFile* file) {
+    uint32_t count = file->header->node_count;
+    ASTNode* root = ast_new_program();
+    if (!root) return NULL;
+    ASTNode* nodes = count > 1 ? ast_alloc(root, (size_t)(count - 1) * sizeof(ASTNode)) : NULL;
+    char* strings = ast_alloc(root, file->header->strings_size);
+    if ((count > 1 && !nodes) || !strings) {
+        printf("Error: Memory allocation failed\n");
+        free_ast(root);
+        return NULL;
+    }
+    memcpy(strings, file->strings, file->header->strings_size);
+
+    /* Children always follow their parent, so indices map straight to the
+       array: node i lives at nodes[i - 1] */
+    for (uint32_t i = 0; i < count; i++) {
+        const AstFileNode* in = &file->nodes[i];
+        ASTNode* out = i == 0 ? root : &nodes[i - 1];
+        out->type = in->type;
+        out->op = in->op;
+        out->slot = in->slot;
+        out->token.lexeme = strings + in->text;
+        out->token.length = in->length;
+        out->token.line = in->line;
+        out->token.column = in->column;
+        out->token.id = in->id;
+        out->token.type = in->token_type;
+        out->token.error = in->token_error;
+        out->left = in->left == AST_FILE_NONE ? NULL : &nodes[in->left - 1];
+        out->right = in->right == AST_FILE_NONE ? NULL : &nodes[in->right - 1];
+        out->next = in->next == AST_FILE_NONE ? NULL : &nodes[in->next - 1];
+    }
+    return root;
+}
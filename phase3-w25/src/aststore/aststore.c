@@ -0,0 +1,414 @@
+/* aststore.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/aststore.h"
+#include "../../include/ast_walk.h"
+#include "../../include/lexer.h"
+
+typedef struct {
+    uint32_t offset;
+    int line;
+    int column;
+} TokenPosition;
+
+typedef struct {
+    AstStore* store;
+    TokenPosition* pending;     // Positions of the current top-level statement
+    size_t pending_count;
+    size_t pending_capacity;
+    size_t scanned;             // Source before this offset has been searched for newlines
+    long line_start;            // Offset after the last newline found, -1 on the first line
+    int failed;
+} Builder;
+
+static int grow_nodes(AstStore* store) {
+    if (store->capacity >= AST_STORE_NONE / 2) return 1;
+    uint32_t capacity = store->capacity ? store->capacity * 2 : 1024;
+    uint8_t* kinds = realloc(store->kinds, capacity);
+    if (!kinds) return 1;
+    store->kinds = kinds;
+    uint32_t* tokens = realloc(store->tokens, capacity * sizeof(uint32_t));
+    if (!tokens) return 1;
+    store->tokens = tokens;
+    uint32_t* extra = realloc(store->extra, capacity * sizeof(uint32_t));
+    if (!extra) return 1;
+    store->extra = extra;
+    store->capacity = capacity;
+    return 0;
+}
+
+static uint32_t append(Builder* b, const ASTNode* node) {
+    AstStore* store = b->store;
+    if (store->count == store->capacity && grow_nodes(store) != 0) {
+        printf("Error: Memory allocation failed\n");
+        b->failed = 1;
+        return AST_STORE_NONE;
+    }
+    size_t offset = (size_t)(node->token.lexeme - store->source);
+    if (node->token.type == TOKEN_EOF) {
+        offset = store->source_size;
+    } else if (node->token.lexeme < store->source || offset + node->token.length > store->source_size) {
+        printf("Error: AST token outside its source; only trees straight from parse() can be stored\n");
+        b->failed = 1;
+        return AST_STORE_NONE;
+    }
+
+    if (b->pending_count == b->pending_capacity) {
+        size_t capacity = b->pending_capacity ? b->pending_capacity * 2 : 256;
+        TokenPosition* grown = realloc(b->pending, capacity * sizeof(TokenPosition));
+        if (!grown) {
+            printf("Error: Memory allocation failed\n");
+            b->failed = 1;
+            return AST_STORE_NONE;
+        }
+        b->pending = grown;
+        b->pending_capacity = capacity;
+    }
+    b->pending[b->pending_count++] = (TokenPosition){(uint32_t)offset, node->token.line, node->token.column};
+
+    uint32_t index = store->count++;
+    store->kinds[index] = (uint8_t)(node->type |
+                                    (node->left ? AST_STORE_HAS_LEFT : 0) |
+                                    (node->right ? AST_STORE_HAS_RIGHT : 0) |
+                                    (node->next ? AST_STORE_HAS_NEXT : 0));
+    store->tokens[index] = (uint32_t)offset;
+    store->extra[index] = 0;
+    if (!node->left && !node->right) {
+        if (node->type == AST_IDENTIFIER) {
+            store->extra[index] = (uint32_t)node->token.id;
+        } else if (node->type == AST_NUMBER) {
+            long long value = ast_number_value(node);
+            store->extra[index] = value >= 0 && value < AST_STORE_NONE ? (uint32_t)value : AST_STORE_NONE;
+        }
+    }
+    return index;
+}
+
+/* Nodes are appended on ast_walk's stack, which visits them in the
+   store's pre-order. A frame's value is the node's index, so once its
+   subtree is in, the index after it can be recorded. */
+static int add_enter(AstWalker* walker, AstWalkFrame* frame) {
+    Builder* b = walker->data;
+    if (b->failed) return AST_WALK_SKIP;
+    frame->value = (int)append(b, frame->node);
+    return b->failed ? AST_WALK_SKIP : AST_WALK_CONTINUE;
+}
+
+static int add_leave(AstWalker* walker, AstWalkFrame* frame) {
+    Builder* b = walker->data;
+    ASTNode* node = frame->node;
+    if (!b->failed && (node->left || node->right)) b->store->extra[frame->value] = b->store->count;
+    return 0;
+}
+
+/* A node and its left and right subtrees, but not its next siblings */
+static void add_node(Builder* b, AstWalker* walker, const ASTNode* node) {
+    if (ast_walk(walker, (ASTNode*)node, 0, 0) != 0) b->failed = 1;
+}
+
+static int compare_positions(const void* a, const void* b) {
+    uint32_t x = ((const TokenPosition*)a)->offset;
+    uint32_t y = ((const TokenPosition*)b)->offset;
+    return (x > y) - (x < y);
+}
+
+/* Column the lexer gives a token at 'offset': it counts bytes, from 0 on
+   the first line and from 1 after each newline */
+static int column_at(long line_start, uint32_t offset) {
+    return line_start < 0 ? (int)offset : (int)(offset - line_start) + 1;
+}
+
+/* Moves the positions of one top-level statement into the table, keeping
+   only those where the line changes. Statements come in source order, so
+   sorting each one's tokens sorts the table. */
+static void flush_positions(Builder* b) {
+    AstStore* store = b->store;
+    qsort(b->pending, b->pending_count, sizeof(TokenPosition), compare_positions);
+    for (size_t i = 0; i < b->pending_count && !b->failed; i++) {
+        TokenPosition position = b->pending[i];
+        if (position.offset < b->scanned) {
+            if (store->position_count > 0 && position.offset < store->positions[store->position_count - 1].offset) {
+                printf("Error: AST statements are not in source order\n");
+                b->failed = 1;
+                break;
+            }
+        } else {
+            const char* newline;
+            while ((newline = memchr(store->source + b->scanned, '\n', position.offset - b->scanned))) {
+                b->line_start = newline - store->source + 1;
+                b->scanned = (size_t)b->line_start;
+            }
+            b->scanned = position.offset;
+        }
+        if (position.column != column_at(b->line_start, position.offset)) {
+            printf("Error: AST token column does not match its source\n");
+            b->failed = 1;
+            break;
+        }
+        if (store->position_count > 0 && store->positions[store->position_count - 1].line == position.line) {
+            continue;
+        }
+        if (store->position_count == store->position_capacity) {
+            uint32_t capacity = store->position_capacity ? store->position_capacity * 2 : 256;
+            AstStorePosition* grown = realloc(store->positions, capacity * sizeof(AstStorePosition));
+            if (!grown) {
+                printf("Error: Memory allocation failed\n");
+                b->failed = 1;
+                break;
+            }
+            store->positions = grown;
+            store->position_capacity = capacity;
+        }
+        store->positions[store->position_count++] = (AstStorePosition){position.offset, position.line};
+    }
+    b->pending_count = 0;
+}
+
+/* Trims an array to its used size; keeps the old one if that fails */
+static void* shrink(void* items, size_t size) {
+    void* shrunk = size ? realloc(items, size) : NULL;
+    return shrunk ? shrunk : items;
+}
+
+int ast_store_build(AstStore* store, const ASTNode* root, const char* source, size_t size) {
+    memset(store, 0, sizeof(*store));
+    store->source = source;
+    store->source_size = size;
+    if (size >= AST_STORE_NONE) {
+        printf("Error: Source too large for an AST store\n");
+        return 1;
+    }
+
+    /* Top-level statements one at a time, so their positions can be sorted
+       in small batches */
+    Builder b = {store, NULL, 0, 0, 0, -1, 0};
+    AstWalker walker;
+    ast_walker_init(&walker, add_enter, add_leave, &b);
+    append(&b, root);
+    if (!b.failed) flush_positions(&b);
+    for (const ASTNode* stmt = root->next; stmt && !b.failed; stmt = stmt->next) {
+        add_node(&b, &walker, stmt);
+        if (!b.failed) flush_positions(&b);
+    }
+    ast_walker_release(&walker);
+    free(b.pending);
+    if (b.failed) {
+        ast_store_free(store);
+        return 1;
+    }
+
+    store->kinds = shrink(store->kinds, store->count);
+    store->tokens = shrink(store->tokens, store->count * sizeof(uint32_t));
+    store->extra = shrink(store->extra, store->count * sizeof(uint32_t));
+    store->capacity = store->count;
+    store->positions = shrink(store->positions, store->position_count * sizeof(AstStorePosition));
+    store->position_capacity = store->position_count;
+
+    /* Entry in effect at the start of each page of source */
+    store->page_count = (uint32_t)(size >> AST_STORE_PAGE_SHIFT) + 1;
+    store->pages = malloc(store->page_count * sizeof(uint32_t));
+    if (!store->pages) {
+        printf("Error: Memory allocation failed\n");
+        ast_store_free(store);
+        return 1;
+    }
+    uint32_t entry = 0;
+    for (uint32_t page = 0; page < store->page_count; page++) {
+        size_t start = (size_t)page << AST_STORE_PAGE_SHIFT;
+        while (entry + 1 < store->position_count && store->positions[entry + 1].offset <= start) entry++;
+        store->pages[page] = entry;
+    }
+    return 0;
+}
+
+void ast_store_free(AstStore* store) {
+    free(store->kinds);
+    free(store->tokens);
+    free(store->extra);
+    free(store->positions);
+    free(store->pages);
+    store->kinds = NULL;
+    store->tokens = NULL;
+    store->extra = NULL;
+    store->positions = NULL;
+    store->pages = NULL;
+    store->page_count = 0;
+    store->count = store->capacity = 0;
+    store->position_count = store->position_capacity = 0;
+}
+
+size_t ast_store_bytes(const AstStore* store) {
+    return (size_t)store->capacity * (sizeof(uint8_t) + 2 * sizeof(uint32_t)) +
+           (size_t)store->position_capacity * sizeof(AstStorePosition) +
+           (size_t)store->page_count * sizeof(uint32_t);
+}
+
+/* Index after the node's left and right subtrees */
+static uint32_t subtree_end(const AstStore* store, uint32_t node) {
+    return store->kinds[node] & (AST_STORE_HAS_LEFT | AST_STORE_HAS_RIGHT) ? store->extra[node] : node + 1;
+}
+
+uint32_t ast_store_next(const AstStore* store, uint32_t node) {
+    return store->kinds[node] & AST_STORE_HAS_NEXT ? subtree_end(store, node) : AST_STORE_NONE;
+}
+
+/* The right subtree starts after the left child and all its siblings */
+uint32_t ast_store_right(const AstStore* store, uint32_t node) {
+    if (!(store->kinds[node] & AST_STORE_HAS_RIGHT)) return AST_STORE_NONE;
+    if (!(store->kinds[node] & AST_STORE_HAS_LEFT)) return node + 1;
+    uint32_t child = node + 1;
+    while (store->kinds[child] & AST_STORE_HAS_NEXT) {
+        child = subtree_end(store, child);
+    }
+    return subtree_end(store, child);
+}
+
+long long ast_store_number(const AstStore* store, uint32_t node) {
+    if (store->extra[node] != AST_STORE_NONE) return store->extra[node];
+    ASTNode number;
+    number.token = ast_store_token_text(store, node);
+    return ast_number_value(&number);
+}
+
+/* Operator of a binary node by the first character of its token */
+static const unsigned char operator_by_char[256] = {
+    ['+'] = BINOP_ADD,
+    ['-'] = BINOP_SUB,
+    ['*'] = BINOP_MUL,
+    ['/'] = BINOP_DIV,
+    ['<'] = BINOP_LESS,
+    ['>'] = BINOP_GREATER,
+    ['='] = BINOP_EQUAL,
+    ['!'] = BINOP_NOT_EQUAL
+};
+
+BinaryOp ast_store_operator(const AstStore* store, uint32_t node) {
+    return (BinaryOp)operator_by_char[(unsigned char)store->source[store->tokens[node]]];
+}
+
+/* A token starts with no whitespace before it, so lexing from its offset
+   yields exactly it */
+Token ast_store_token_text(const AstStore* store, uint32_t node) {
+    LexerState state = {0, 0, 'x'};
+    int pos = (int)store->tokens[node];
+    Token token = get_next_token(&state, store->source, &pos);
+    token.line = 0;
+    token.column = 0;
+    token.id = (store->kinds[node] & (AST_STORE_TYPE_MASK | AST_STORE_HAS_LEFT | AST_STORE_HAS_RIGHT)) == AST_IDENTIFIER
+                   ? (int)store->extra[node] : 0;
+    return token;
+}
+
+Token ast_store_token(const AstStore* store, uint32_t node) {
+    Token token = ast_store_token_text(store, node);
+    uint32_t offset = store->tokens[node];
+    /* Last entry at or before the offset, searched for from the one in
+       effect at the start of its page */
+    uint32_t page = offset >> AST_STORE_PAGE_SHIFT;
+    uint32_t low = store->pages[page];
+    uint32_t high = page + 1 < store->page_count ? store->pages[page + 1] + 1 : store->position_count;
+    while (high - low > 1) {
+        uint32_t middle = low + (high - low) / 2;
+        if (store->positions[middle].offset <= offset) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    if (store->position_count > 0) {
+        token.line = store->positions[low].line;
+    }
+    long line_start = (long)offset - 1;
+    while (line_start >= 0 && store->source[line_start] != '\n') line_start--;
+    token.column = column_at(line_start < 0 ? -1 : line_start + 1, offset);
+    return token;
+}
+
+static void print_node(const AstStore* store, uint32_t node, int level, FILE* out) {
+    for (int i = 0; i < level; i++) fprintf(out, "  ");
+
+    Token token = ast_store_token_text(store, node);
+    uint32_t left = AST_STORE_LEFT(store, node);
+    switch (AST_STORE_TYPE(store, node)) {
+        case AST_PROGRAM:
+            fprintf(out, "Program\n");
+            break;
+        case AST_VARDECL:
+            fprintf(out, "VarDecl: %.*s\n", token.length, token.lexeme);
+            break;
+        case AST_ASSIGN:
+            fprintf(out, "Assign\n");
+            break;
+        case AST_NUMBER:
+            fprintf(out, "Number: %.*s\n", token.length, token.lexeme);
+            break;
+        case AST_IDENTIFIER:
+            fprintf(out, "Identifier: %.*s\n", token.length, token.lexeme);
+            break;
+        case AST_IF:
+            fprintf(out, "If\n");
+            break;
+        case AST_WHILE:
+            fprintf(out, "While\n");
+            break;
+        case AST_BLOCK:
+            fprintf(out, "Block\n");
+            break;
+        case AST_BINOP:
+            fprintf(out, "BinaryOp: %.*s\n", token.length, token.lexeme);
+            break;
+        case AST_PRINT:
+            fprintf(out, "Print\n");
+            break;
+        case AST_REPEAT:
+            fprintf(out, "Repeat\n");
+            break;
+        case AST_FACTORIAL:
+            fprintf(out, "Factorial\n");
+            break;
+        case AST_ARRAYDECL:
+        case AST_ARRAYACCESS:
+            if (left != AST_STORE_NONE) {
+                Token name = ast_store_token_text(store, left);
+                fprintf(out, "%s: %.*s\n", AST_STORE_TYPE(store, node) == AST_ARRAYDECL ? "ArrayDecl" : "ArrayAccess",
+                        name.length, name.lexeme);
+            } else {
+                fprintf(out, "%s: unknown\n", AST_STORE_TYPE(store, node) == AST_ARRAYDECL ? "ArrayDecl" : "ArrayAccess");
+            }
+            break;
+        default:
+            fprintf(out, "Unknown node type\n");
+    }
+}
+
+/* Nodes are stored in the order they print, so each statement's subtree
+   prints front to back. A node's level is the number of enclosing subtrees
+   still open, kept as a stack of where each one ends. */
+void ast_store_print(const AstStore* store, uint32_t node, int level, FILE* out) {
+    uint32_t* ends = NULL;
+    size_t depth = 0, capacity = 0;
+    for (; node != AST_STORE_NONE; node = ast_store_next(store, node)) {
+        uint32_t end = subtree_end(store, node);
+        for (uint32_t i = node; i < end; i++) {
+            while (depth > 0 && ends[depth - 1] <= i) depth--;
+            print_node(store, i, level + (int)depth, out);
+            if (!(store->kinds[i] & (AST_STORE_HAS_LEFT | AST_STORE_HAS_RIGHT))) continue;
+            if (depth == capacity) {
+                size_t grown_capacity = capacity ? capacity * 2 : 64;
+                uint32_t* grown = realloc(ends, grown_capacity * sizeof(uint32_t));
+                if (!grown) {
+                    printf("Error: Memory allocation failed\n");
+                    free(ends);
+                    return;
+                }
+                ends = grown;
+                capacity = grown_capacity;
+            }
+            ends[depth++] = store->extra[i];
+        }
+        depth = 0;
+    }
+    free(ends);
+}
@@ -0,0 +1,929 @@
+/* bench.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../../include/tokens.h"
+#include "../../include/lexer.h"
+#include "../../include/bench.h"
+#include "../../include/parser.h"
+#include "../../include/semantic.h"
+#include "../../include/interpreter.h"
+#include "../../include/bytecode.h"
+#include "../../include/jit.h"
+#include "../../include/astfile.h"
+#include "../../include/aststore.h"
+#include "../../include/ast_walk.h"
+
+/* Inputs smaller than this are repeated so timings are not dominated by noise */
+#define BENCH_MIN_BYTES (8 * 1024 * 1024)
+#define BENCH_ROUNDS 5
+
+typedef Token (*LexFn)(LexerState* state, const char* input, int* pos);
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Reads a file and repeats its contents until the buffer reaches min_bytes */
+static char* load_repeated(const char* filename, size_t min_bytes, size_t* out_size) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        printf("Error: Could not open file %s\n", filename);
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    rewind(file);
+
+    char* chunk = malloc(file_size + 1);
+    if (!chunk || fread(chunk, 1, file_size, file) != (size_t)file_size) {
+        printf("Error: Failed to read file %s\n", filename);
+        free(chunk);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    chunk[file_size] = '\n';
+
+    size_t copies = file_size > 0 ? (min_bytes + file_size) / (file_size + 1) : 0;
+    if (copies == 0) copies = 1;
+    size_t size = copies * (file_size + 1);
+    char* buffer = malloc(size + 1);
+    if (!buffer) {
+        printf("Error: Memory allocation failed\n");
+        free(chunk);
+        return NULL;
+    }
+    for (size_t i = 0; i < copies; i++) {
+        memcpy(buffer + i * (file_size + 1), chunk, file_size + 1);
+    }
+    buffer[size] = '\0';
+    free(chunk);
+    *out_size = size;
+    return buffer;
+}
+
+/* Lexes the whole buffer once and returns the number of tokens */
+static long lex_all(LexFn lex, const char* input) {
+    long count = 0;
+    int pos = 0;
+    Token token;
+    LexerState state;
+    lexer_reset(&state);
+    do {
+        token = lex(&state, input, &pos);
+        count++;
+    } while (token.type != TOKEN_EOF);
+    return count;
+}
+
+/* Best-of-N throughput in MB/s */
+static double measure(LexFn lex, const char* input, size_t size, long* tokens) {
+    double best = 0;
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        double start = now_seconds();
+        *tokens = lex_all(lex, input);
+        double elapsed = now_seconds() - start;
+        if (best == 0 || elapsed < best) best = elapsed;
+    }
+    return (size / (1024.0 * 1024.0)) / best;
+}
+
+/* FNV-1a over every token field, used to compare whole token streams */
+static unsigned long long stream_hash(LexFn lex, const char* input) {
+    unsigned long long hash = 1469598103934665603ULL;
+    int pos = 0;
+    Token token;
+    LexerState state;
+    lexer_reset(&state);
+    do {
+        token = lex(&state, input, &pos);
+        int fields[] = {token.type, token.error, token.line, token.column, pos};
+        const unsigned char* bytes = (const unsigned char*)fields;
+        for (size_t i = 0; i < sizeof(fields); i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        }
+        for (int i = 0; i < token.length; i++) {
+            hash = (hash ^ (unsigned char)token.lexeme[i]) * 1099511628211ULL;
+        }
+    } while (token.type != TOKEN_EOF);
+    return hash;
+}
+
+int bench_lexer(const char* filename) {
+    static const struct {
+        LexerSimdLevel level;
+        const char* name;
+    } variants[] = {
+        {LEXER_SIMD_SCALAR, "table-driven"},
+        {LEXER_SIMD_SSE2, "table+sse2"},
+        {LEXER_SIMD_AVX2, "table+avx2"}
+    };
+    size_t size;
+    char* input = load_repeated(filename, BENCH_MIN_BYTES, &size);
+    if (!input) return 1;
+
+    long ref_tokens, tokens;
+    unsigned long long ref_hash = stream_hash(get_next_token_reference, input);
+    double ref_rate = measure(get_next_token_reference, input, size, &ref_tokens);
+
+    printf("Lexer benchmark: %s (%.1f MB, %ld tokens)\n", filename, size / (1024.0 * 1024.0), ref_tokens);
+    printf("  %-13s %8.1f MB/s\n", "reference", ref_rate);
+
+    int status = 0;
+    for (size_t i = 0; i < sizeof(variants) / sizeof(variants[0]); i++) {
+        if (lexer_set_simd(variants[i].level) != variants[i].level) {
+            printf("  %-13s not supported on this CPU\n", variants[i].name);
+            continue;
+        }
+        if (stream_hash(get_next_token, input) != ref_hash) {
+            printf("Error: %s token stream differs from the reference lexer\n", variants[i].name);
+            status = 1;
+            continue;
+        }
+        double rate = measure(get_next_token, input, size, &tokens);
+        printf("  %-13s %8.1f MB/s  (%.2fx)\n", variants[i].name, rate, rate / ref_rate);
+    }
+    lexer_set_simd(LEXER_SIMD_AUTO);
+
+    free(input);
+    return status;
+}
+
+/* Identifiers chosen to share lengths and first letters with keywords */
+static const char* bench_identifier_words[] = {
+    "i", "x", "count", "index", "printer", "whilst", "repeated", "untill",
+    "fact", "iffy", "integer", "floaty", "chars", "value_1", "_tmp", "result"
+};
+static const char* bench_keyword_words[] = {
+    "if", "int", "float", "char", "print", "while", "repeat", "until", "factorial"
+};
+
+#define KEYWORD_BENCH_WORDS (1 << 20)
+
+int bench_keywords(void) {
+    static const int keyword_percentages[] = {0, 25, 50, 75, 100};
+    const char** words = malloc(KEYWORD_BENCH_WORDS * sizeof(*words));
+    int* lengths = malloc(KEYWORD_BENCH_WORDS * sizeof(*lengths));
+    if (!words || !lengths) {
+        printf("Error: Memory allocation failed\n");
+        free(words);
+        free(lengths);
+        return 1;
+    }
+
+    int identifier_count = sizeof(bench_identifier_words) / sizeof(bench_identifier_words[0]);
+    int keyword_count = sizeof(bench_keyword_words) / sizeof(bench_keyword_words[0]);
+
+    printf("Keyword lookup benchmark (%d words per round)\n", KEYWORD_BENCH_WORDS);
+    printf("  keywords   linear ns/word   hashed ns/word   speedup\n");
+    for (size_t m = 0; m < sizeof(keyword_percentages) / sizeof(keyword_percentages[0]); m++) {
+        unsigned int seed = 12345;
+        for (int i = 0; i < KEYWORD_BENCH_WORDS; i++) {
+            seed = seed * 1103515245u + 12345u;
+            int pick = (seed >> 16) % 100;
+            seed = seed * 1103515245u + 12345u;
+            int which = seed >> 16;
+            words[i] = pick < keyword_percentages[m]
+                ? bench_keyword_words[which % keyword_count]
+                : bench_identifier_words[which % identifier_count];
+            lengths[i] = (int)strlen(words[i]);
+        }
+
+        double linear_best = 0, hashed_best = 0;
+        long linear_sum = 0, hashed_sum = 0;
+        for (int round = 0; round < BENCH_ROUNDS; round++) {
+            double start = now_seconds();
+            linear_sum = 0;
+            for (int i = 0; i < KEYWORD_BENCH_WORDS; i++) {
+                linear_sum += lookup_keyword_linear(words[i]);
+            }
+            double elapsed = now_seconds() - start;
+            if (linear_best == 0 || elapsed < linear_best) linear_best = elapsed;
+
+            start = now_seconds();
+            hashed_sum = 0;
+            for (int i = 0; i < KEYWORD_BENCH_WORDS; i++) {
+                hashed_sum += lookup_keyword(words[i], lengths[i]);
+            }
+            elapsed = now_seconds() - start;
+            if (hashed_best == 0 || elapsed < hashed_best) hashed_best = elapsed;
+        }
+
+        if (linear_sum != hashed_sum) {
+            printf("Error: hashed keyword lookup disagrees with the linear scan\n");
+            free(words);
+            free(lengths);
+            return 1;
+        }
+        printf("  %7d%%   %14.2f   %14.2f   %6.2fx\n", keyword_percentages[m],
+               linear_best * 1e9 / KEYWORD_BENCH_WORDS, hashed_best * 1e9 / KEYWORD_BENCH_WORDS,
+               linear_best / hashed_best);
+    }
+
+    free(words);
+    free(lengths);
+    return 0;
+}
+
+/* Loop kernels: scalar arithmetic, array sweeps, repeat/until, nested
+   loops with compare-and-swap, and factorial calls */
+static const struct {
+    const char* name;
+    const char* source;
+} vm_kernels[] = {
+    {"scalar-loop",
+     "int i; int sum; i = 0; sum = 0;\n"
+     "while (i < 3000000) { sum = sum + i * 3 - i / 7; i = i + 1; }\n"
+     "print sum;\n"},
+    {"array-sweep",
+     "int i; int j; int sum; int a[100]; i = 0; sum = 0;\n"
+     "while (i < 20000) { j = 0;\n"
+     "  while (j < 100) { a[j] = a[j] + i * j; sum = sum + a[j] / 7; j = j + 1; }\n"
+     "  i = i + 1; }\n"
+     "print sum;\n"},
+    {"repeat-until",
+     "int n; int acc; n = 2000000; acc = 1;\n"
+     "repeat { acc = acc * 31 + n; if (acc > 1000000) { acc = acc - 999983; } n = n - 1; } until (n == 0)\n"
+     "print acc;\n"},
+    {"bubble-sort",
+     "int a[400]; int i; int j; int t; int n; n = 400; i = 0;\n"
+     "while (i < n) { a[i] = n - i; i = i + 1; }\n"
+     "i = 0;\n"
+     "while (i < n) { j = 0;\n"
+     "  while (j < n - 1 - i) { if (a[j] > a[j + 1]) { t = a[j]; a[j] = a[j + 1]; a[j + 1] = t; } j = j + 1; }\n"
+     "  i = i + 1; }\n"
+     "print a[0]; print a[399];\n"},
+    {"factorial",
+     "int i; int s; i = 0; s = 0;\n"
+     "while (i < 400000) { s = s + factorial(i / 20000); i = i + 1; }\n"
+     "print s;\n"}
+};
+
+typedef int (*RunFn)(void* program, FILE* out);
+
+static int run_ast(void* program, FILE* out) {
+    return interpret(program, out);
+}
+
+static int run_vm(void* program, FILE* out) {
+    return vm_run(program, out);
+}
+
+/* Counters of the most recent run_jit() */
+static JitStats jit_stats;
+
+static int run_jit(void* program, FILE* out) {
+    return interpret_jit(program, out, &jit_stats);
+}
+
+/* Best-of-N run time; the program's output is kept for comparison */
+static double time_run(RunFn run, void* program, char** output, size_t* output_size) {
+    double best = 0;
+    for (int round = 0; round < 3; round++) {
+        free(*output);
+        *output = NULL;
+        FILE* out = open_memstream(output, output_size);
+        if (!out) return -1;
+        double start = now_seconds();
+        run(program, out);
+        double elapsed = now_seconds() - start;
+        fclose(out);
+        if (best == 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+/* Parses and checks a kernel; returns NULL after reporting a failure */
+static ASTNode* load_kernel(ParserContext* parser, size_t k) {
+    parser_init(parser, vm_kernels[k].source);
+    ASTNode* ast = parse(parser);
+    char* diagnostics = NULL;
+    size_t diagnostics_size = 0;
+    FILE* sink = open_memstream(&diagnostics, &diagnostics_size);
+    int checked = sink && parser->error_count == 0 && analyze_semantics_to(ast, sink);
+    if (sink) fclose(sink);
+    free(diagnostics);
+    if (!checked) {
+        printf("Error: kernel %s does not compile\n", vm_kernels[k].name);
+        free_ast(ast);
+        return NULL;
+    }
+    return ast;
+}
+
+int bench_vm(void) {
+    static ParserContext parser;
+    int status = 0;
+
+    printf("Execution benchmark (best of 3)\n");
+    printf("  %-14s %10s %10s %10s\n", "kernel", "ast ms", "vm ms", "speedup");
+    for (size_t k = 0; k < sizeof(vm_kernels) / sizeof(vm_kernels[0]); k++) {
+        ASTNode* ast = load_kernel(&parser, k);
+        if (!ast) {
+            status = 1;
+            continue;
+        }
+
+        Bytecode bytecode;
+        if (bytecode_compile(ast, &bytecode) != 0) {
+            printf("Error: Memory allocation failed\n");
+            free_ast(ast);
+            return 1;
+        }
+
+        char* ast_output = NULL;
+        char* vm_output = NULL;
+        size_t ast_size = 0, vm_size = 0;
+        double ast_time = time_run(run_ast, ast, &ast_output, &ast_size);
+        double vm_time = time_run(run_vm, &bytecode, &vm_output, &vm_size);
+        if (ast_size != vm_size || memcmp(ast_output, vm_output, ast_size) != 0) {
+            printf("Error: kernel %s prints different output on the VM\n", vm_kernels[k].name);
+            status = 1;
+        } else {
+            printf("  %-14s %10.1f %10.1f %9.1fx\n", vm_kernels[k].name,
+                   ast_time * 1000, vm_time * 1000, ast_time / vm_time);
+        }
+
+        free(ast_output);
+        free(vm_output);
+        bytecode_free(&bytecode);
+        free_ast(ast);
+    }
+    return status;
+}
+
+/* Interpretation against the loop JIT. Every JIT run starts with an empty
+   code cache, so its time includes the warmup: the first iterations of each
+   loop run interpreted, then the loop is compiled. */
+int bench_jit(void) {
+    static ParserContext parser;
+    int status = 0;
+
+    printf("JIT latency benchmark (best of 3, compiled afresh every run)\n");
+    printf("  %-14s %10s %10s %12s %8s %10s\n", "kernel", "ast ms", "jit ms", "warmup us", "bytes", "speedup");
+    for (size_t k = 0; k < sizeof(vm_kernels) / sizeof(vm_kernels[0]); k++) {
+        ASTNode* ast = load_kernel(&parser, k);
+        if (!ast) {
+            status = 1;
+            continue;
+        }
+
+        char* ast_output = NULL;
+        char* jit_output = NULL;
+        size_t ast_size = 0, jit_size = 0;
+        double ast_time = time_run(run_ast, ast, &ast_output, &ast_size);
+        double jit_time = time_run(run_jit, ast, &jit_output, &jit_size);
+        if (ast_size != jit_size || memcmp(ast_output, jit_output, ast_size) != 0) {
+            printf("Error: kernel %s prints different output with the JIT\n", vm_kernels[k].name);
+            status = 1;
+        } else {
+            printf("  %-14s %10.1f %10.1f %12.1f %8zu %9.1fx\n", vm_kernels[k].name,
+                   ast_time * 1000, jit_time * 1000, jit_stats.compile_seconds * 1e6,
+                   jit_stats.code_bytes, ast_time / jit_time);
+        }
+        if (jit_stats.loops_rejected > 0) {
+            printf("  (%d loops in %s stayed interpreted)\n", jit_stats.loops_rejected, vm_kernels[k].name);
+        }
+
+        free(ast_output);
+        free(jit_output);
+        free_ast(ast);
+    }
+    return status;
+}
+
+/* Statement chains still to be compared by same_tree or same_flat. These
+   keep them on the heap, since a long chain such as a + b + ... + z nests
+   as deep as it is long. */
+typedef struct {
+    const ASTNode* node;
+    const ASTNode* other;    // Tree node it must match, for same_tree
+    uint32_t index;          // AST file node it must match, for same_flat
+} NodePair;
+
+typedef struct {
+    NodePair* items;
+    size_t count;
+    size_t capacity;
+} PairStack;
+
+static int push_pair(PairStack* stack, const ASTNode* node, const ASTNode* other, uint32_t index) {
+    if (stack->count == stack->capacity) {
+        size_t capacity = stack->capacity ? stack->capacity * 2 : 64;
+        NodePair* grown = realloc(stack->items, capacity * sizeof(NodePair));
+        if (!grown) {
+            printf("Error: Memory allocation failed\n");
+            return 1;
+        }
+        stack->items = grown;
+        stack->capacity = capacity;
+    }
+    stack->items[stack->count++] = (NodePair){node, other, index};
+    return 0;
+}
+
+/* Compares two trees field by field, including token positions */
+static int same_tree(const ASTNode* a, const ASTNode* b) {
+    PairStack stack = {NULL, 0, 0};
+    int same = push_pair(&stack, a, b, 0) == 0;
+    while (same && stack.count > 0) {
+        NodePair pair = stack.items[--stack.count];
+        for (a = pair.node, b = pair.other; a && b; a = a->next, b = b->next) {
+            if (a->type != b->type || a->op != b->op || a->token.type != b->token.type ||
+                a->token.line != b->token.line || a->token.column != b->token.column ||
+                a->token.length != b->token.length ||
+                memcmp(a->token.lexeme, b->token.lexeme, a->token.length) != 0 ||
+                push_pair(&stack, a->left, b->left, 0) != 0 || push_pair(&stack, a->right, b->right, 0) != 0) {
+                same = 0;
+                break;
+            }
+        }
+        if (a != b) same = 0;
+    }
+    free(stack.items);
+    return same;
+}
+
+static int same_errors(const ParserContext* a, const ParserContext* b) {
+    if (a->error_count != b->error_count) return 0;
+    for (int i = 0; i < a->error_count; i++) {
+        if (a->errors[i].position.line != b->errors[i].position.line ||
+            a->errors[i].position.column != b->errors[i].position.column ||
+            strcmp(a->errors[i].message, b->errors[i].message) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Text typed at random places by the edit benchmark; each one is deleted
+   again by the following edit */
+static const char* bench_edit_snippets[] = {
+    "1", "x", " ", "\n", ";", "+", "-", "=", "==", "{", "}", "(", "\n\n",
+    "int z;\n", "print x;\n", "while (i < 3) { i = i + 1; }\n"
+};
+
+#define BENCH_EDITS 400
+
+typedef struct {
+    double edit_seconds;        // Total time in parse_edit
+    double full_seconds;        // Total time of full parses, when checking
+    double worst_seconds;       // Slowest single edit
+    double kind_seconds[2];     // Edits that keep the line count, and that change it
+    int kind_edits[2];
+} EditTimes;
+
+/* Applies the benchmark's edit sequence to 'source'. With 'check' set every
+   edit is compared against a full parse of the edited text; otherwise only
+   parse_edit runs, so the timing is not disturbed by the full parses. */
+static int run_edits(const char* source, size_t size, int check, EditTimes* times) {
+    static ParserContext parser, reference;
+    size_t snippet_count = sizeof(bench_edit_snippets) / sizeof(bench_edit_snippets[0]);
+    char* text = malloc(size + BENCH_EDITS * 64);
+    char* edited = malloc(size + BENCH_EDITS * 64);
+    if (!text || !edited) {
+        printf("Error: Memory allocation failed\n");
+        free(text);
+        free(edited);
+        return 1;
+    }
+    memcpy(text, source, size + 1);
+    memset(times, 0, sizeof(*times));
+
+    /* The first edit turns the parsed tree into an editable one */
+    parser_init(&parser, text);
+    ASTNode* ast = parse(&parser);
+    TextEdit edit = {0, 0, "", 0};
+    ast = parse_edit(&parser, ast, text, &edit);
+
+    int status = 0;
+    unsigned int seed = 12345;
+    size_t cursor = 0;
+    for (int i = 0; i < BENCH_EDITS && ast; i++) {
+        if (i % 2 == 0) {
+            seed = seed * 1103515245u + 12345u;
+            const char* snippet = bench_edit_snippets[(seed >> 16) % snippet_count];
+            /* Typing stays near the cursor, which jumps now and then */
+            seed = seed * 1103515245u + 12345u;
+            if (i % 32 == 0) {
+                cursor = (size_t)(((unsigned long long)seed << 16) % (size + 1));
+            } else {
+                cursor = cursor + (seed >> 16) % 64;
+                if (cursor > size) cursor = size;
+            }
+            edit = (TextEdit){cursor, 0, snippet, strlen(snippet)};
+        } else {
+            edit = (TextEdit){edit.offset, edit.inserted_length, "", 0};
+        }
+        memcpy(edited, text, edit.offset);
+        memcpy(edited + edit.offset, edit.inserted, edit.inserted_length);
+        memcpy(edited + edit.offset + edit.inserted_length, text + edit.offset + edit.deleted,
+               size - edit.offset - edit.deleted + 1);
+
+        double start = now_seconds();
+        ast = parse_edit(&parser, ast, text, &edit);
+        double elapsed = now_seconds() - start;
+        times->edit_seconds += elapsed;
+        int moves_lines = memchr(edit.inserted, '\n', edit.inserted_length) ||
+                          memchr(text + edit.offset, '\n', edit.deleted);
+        times->kind_seconds[moves_lines] += elapsed;
+        times->kind_edits[moves_lines]++;
+        if (elapsed > times->worst_seconds) times->worst_seconds = elapsed;
+
+        if (check) {
+            start = now_seconds();
+            parser_init(&reference, edited);
+            ASTNode* full = parse(&reference);
+            times->full_seconds += now_seconds() - start;
+            int same = ast && same_tree(ast, full) && same_errors(&parser, &reference);
+            free_ast(full);
+            if (!same) {
+                printf("Error: edit %d at offset %zu gives a different tree than a full parse\n", i, edit.offset);
+                status = 1;
+                break;
+            }
+        }
+
+        char* swap = text;
+        text = edited;
+        edited = swap;
+        size = size + edit.inserted_length - edit.deleted;
+    }
+    if (!ast) status = 1;
+
+    free_ast(ast);
+    free(text);
+    free(edited);
+    return status;
+}
+
+/* Incremental re-parse against a full parse of the edited text. Every
+   edit's tree and errors are checked against the full parse. */
+int bench_edit(const char* filename) {
+    size_t size;
+    char* source = load_repeated(filename, 1024 * 1024, &size);
+    if (!source) return 1;
+
+    EditTimes checked, timed;
+    int status = run_edits(source, size, 1, &checked);
+    if (status == 0) status = run_edits(source, size, 0, &timed);
+    if (status == 0) {
+        printf("Edit benchmark: %s (%.1f MB, %d edits)\n", filename, size / (1024.0 * 1024.0), BENCH_EDITS);
+        printf("  %-26s %10.1f us/edit\n", "full parse", checked.full_seconds / BENCH_EDITS * 1e6);
+        printf("  %-26s %10.1f us/edit  (worst %.1f us, %.0fx)\n", "incremental",
+               timed.edit_seconds / BENCH_EDITS * 1e6, timed.worst_seconds * 1e6,
+               checked.full_seconds / timed.edit_seconds);
+        /* Adding or removing lines renumbers the tokens of every statement after the edit */
+        const char* kinds[] = {"  same line count", "  line count changed"};
+        for (int k = 0; k < 2; k++) {
+            if (timed.kind_edits[k] == 0) continue;
+            printf("  %-26s %10.1f us/edit  (%d edits)\n", kinds[k],
+                   timed.kind_seconds[k] / timed.kind_edits[k] * 1e6, timed.kind_edits[k]);
+        }
+    }
+    free(source);
+    return status;
+}
+
+/* The checked half of bench_edit on the file as it is, without timing:
+   every edit's tree and errors must match a full parse of the edited text */
+int check_edits(const char* filename) {
+    size_t size;
+    char* source = load_repeated(filename, 0, &size);
+    if (!source) return 1;
+    EditTimes times;
+    int status = run_edits(source, size, 1, &times);
+    if (status == 0) {
+        printf("Edit check: %s (%d edits): every re-parse matches a full parse\n", filename, BENCH_EDITS);
+    }
+    free(source);
+    return status;
+}
+
+/* Compares a tree against the nodes of a mapped AST file starting at
+   'index', every field included */
+static int same_flat(const AstFile* file, uint32_t index, const ASTNode* node) {
+    PairStack stack = {NULL, 0, 0};
+    int same = push_pair(&stack, node, NULL, index) == 0;
+    while (same && stack.count > 0) {
+        NodePair pair = stack.items[--stack.count];
+        for (index = pair.index, node = pair.node; index != AST_FILE_NONE && node;
+             index = file->nodes[index].next, node = node->next) {
+            const AstFileNode* flat = &file->nodes[index];
+            if (flat->type != node->type || flat->op != node->op || flat->slot != node->slot ||
+                flat->token_type != node->token.type || flat->token_error != node->token.error ||
+                flat->line != node->token.line || flat->column != node->token.column ||
+                flat->id != node->token.id || flat->length != node->token.length ||
+                memcmp(file->strings + flat->text, node->token.lexeme, node->token.length) != 0 ||
+                push_pair(&stack, node->left, NULL, flat->left) != 0 ||
+                push_pair(&stack, node->right, NULL, flat->right) != 0) {
+                same = 0;
+                break;
+            }
+        }
+        if (index != AST_FILE_NONE || node) same = 0;
+    }
+    free(stack.items);
+    return same;
+}
+
+/* Round trip through the binary AST format: the parse of a file is
+   written, mapped back and rebuilt, and both the mapped nodes and the
+   rebuilt tree are checked against parse() */
+int bench_ast_file(const char* filename) {
+    static ParserContext parser;
+    size_t size;
+    char* source = load_repeated(filename, BENCH_MIN_BYTES, &size);
+    if (!source) return 1;
+    char path[] = "/tmp/compiler-ast-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        printf("Error: Could not create a temporary file\n");
+        free(source);
+        return 1;
+    }
+    close(fd);
+
+    double start = now_seconds();
+    parser_init(&parser, source);
+    ASTNode* ast = parse(&parser);
+    double parse_seconds = now_seconds() - start;
+
+    size_t file_size = 0;
+    AstFile file;
+    ASTNode* loaded = NULL;
+    double write_seconds = 0, open_seconds = 0, tree_seconds = 0;
+    int status = 1;
+    start = now_seconds();
+    if (ast && ast_file_write(ast, path, &file_size) == 0) {
+        write_seconds = now_seconds() - start;
+        start = now_seconds();
+        if (ast_file_open(&file, path) == 0) {
+            open_seconds = now_seconds() - start;
+            if (!same_flat(&file, 0, ast)) {
+                printf("Error: the mapped AST file differs from the parsed tree\n");
+            } else {
+                start = now_seconds();
+                loaded = ast_file_to_tree(&file);
+                tree_seconds = now_seconds() - start;
+                if (loaded && !same_tree(loaded, ast)) {
+                    printf("Error: the tree rebuilt from the AST file differs from the parsed tree\n");
+                } else if (loaded) {
+                    status = 0;
+                }
+            }
+            if (status == 0) {
+                uint32_t nodes = file.header->node_count;
+                printf("AST file round trip: %s (%.1f MB source, %u nodes)\n", filename,
+                       size / (1024.0 * 1024.0), nodes);
+                printf("  %-22s %10.1f MB  (%zu bytes/node, %.1f MB strings)\n", "file size",
+                       file_size / (1024.0 * 1024.0), sizeof(AstFileNode),
+                       file.header->strings_size / (1024.0 * 1024.0));
+                printf("  %-22s %10.2f ms\n", "parse", parse_seconds * 1e3);
+                printf("  %-22s %10.2f ms\n", "serialize + write", write_seconds * 1e3);
+                printf("  %-22s %10.2f ms  (%.0fx faster than parsing)\n", "mmap + validate",
+                       open_seconds * 1e3, parse_seconds / open_seconds);
+                printf("  %-22s %10.2f ms\n", "rebuild pointer tree", tree_seconds * 1e3);
+            }
+            ast_file_close(&file);
+        }
+    }
+    unlink(path);
+    free_ast(loaded);
+    free_ast(ast);
+    free(source);
+    return status;
+}
+
+/* Semantic analysis and print_ast on an AstStore against the same steps on
+   the pointer tree, over a file repeated to 8 MB. The store is checked to
+   give the same printout and the same diagnostics. */
+int bench_ast_store(const char* filename) {
+    static ParserContext parser;
+    size_t size;
+    char* source = load_repeated(filename, BENCH_MIN_BYTES, &size);
+    if (!source) return 1;
+    parser_init(&parser, source);
+    ASTNode* ast = parse(&parser);
+    AstStore store;
+    if (!ast || ast_store_build(&store, ast, source, size) != 0) {
+        free_ast(ast);
+        free(source);
+        return 1;
+    }
+
+    char* outputs[4] = {NULL, NULL, NULL, NULL};
+    size_t output_sizes[4];
+    FILE* streams[4];
+    for (int i = 0; i < 4; i++) streams[i] = open_memstream(&outputs[i], &output_sizes[i]);
+    print_ast_to(ast, 0, streams[0]);
+    ast_store_print(&store, 0, 0, streams[1]);
+
+    /* The store refers to the source rather than to the tree, so it is not
+       affected by folding rewriting the tree */
+    double start = now_seconds();
+    analyze_semantics_to(ast, streams[2]);
+    double tree_seconds = now_seconds() - start;
+    start = now_seconds();
+    analyze_semantics_store(&store, streams[3]);
+    double store_seconds = now_seconds() - start;
+    for (int i = 0; i < 4; i++) fclose(streams[i]);
+
+    int status = 0;
+    if (output_sizes[0] != output_sizes[1] || memcmp(outputs[0], outputs[1], output_sizes[0]) != 0) {
+        printf("Error: ast_store_print differs from print_ast\n");
+        status = 1;
+    } else if (output_sizes[2] != output_sizes[3] || memcmp(outputs[2], outputs[3], output_sizes[2]) != 0) {
+        printf("Error: semantic analysis of the store reports different errors\n");
+        status = 1;
+    } else {
+        ArenaStats tree;
+        ast_get_stats(ast, &tree);
+        size_t store_bytes = ast_store_bytes(&store);
+        printf("AST store benchmark: %s (%.1f MB, %u nodes, %zu diagnostic bytes)\n", filename,
+               size / (1024.0 * 1024.0), store.count, output_sizes[2]);
+        printf("  %-20s %10.1f MB  (%.1f bytes/node)\n", "pointer tree",
+               tree.bytes_used / (1024.0 * 1024.0), (double)tree.bytes_used / store.count);
+        printf("  %-20s %10.1f MB  (%.1f bytes/node, %.1fx smaller, %u positions)\n", "store",
+               store_bytes / (1024.0 * 1024.0), (double)store_bytes / store.count,
+               (double)tree.bytes_used / store_bytes, store.position_count);
+        printf("  %-20s %10.2f ms\n", "check tree", tree_seconds * 1e3);
+        printf("  %-20s %10.2f ms  (%.2fx)\n", "check store", store_seconds * 1e3, tree_seconds / store_seconds);
+    }
+    for (int i = 0; i < 4; i++) free(outputs[i]);
+    ast_store_free(&store);
+    free_ast(ast);
+    free(source);
+    return status;
+}
+
+/* Inputs of the traversal stress test: a long list of top-level
+   statements, and one statement whose expression is a long chain of
+   additions, nested as deep as it is long */
+#define BENCH_WALK_LENGTH 1000000
+/* Stack of the thread the stress test runs on; it is painted beforehand so
+   the bytes used can be measured afterwards */
+#define BENCH_WALK_STACK (256 * 1024)
+#define BENCH_WALK_PAINT 0xA5
+
+typedef struct {
+    int statements;          // Length of the input
+    int chain;               // One expression of this many terms instead
+    double parse_seconds;
+    double check_seconds;
+    double walk_seconds;
+    double print_seconds;    // Not measured for the chain: its printout grows
+                             // with the square of its depth
+    double store_seconds;    // Copying the tree into an AstStore and checking that
+    size_t nodes;
+    int max_depth;
+    int status;
+} WalkRun;
+
+static int count_node(AstWalker* walker, AstWalkFrame* frame) {
+    WalkRun* run = walker->data;
+    run->nodes++;
+    if (frame->depth > run->max_depth) run->max_depth = frame->depth;
+    return AST_WALK_CONTINUE;
+}
+
+static char* walk_source(const WalkRun* run) {
+    size_t size = 32 + (size_t)run->statements * 16 + (size_t)run->chain * 4;
+    char* source = malloc(size);
+    if (!source) return NULL;
+    char* end = source + sprintf(source, "int x;\nx = 1;\n");
+    for (int i = 0; i < run->statements; i++) end += sprintf(end, "x = x + 1;\n");
+    if (run->chain > 0) {
+        end += sprintf(end, "x = x");
+        for (int i = 1; i < run->chain; i++) end += sprintf(end, " + 1");
+        end += sprintf(end, ";\n");
+    }
+    return source;
+}
+
+/* Parses, checks, walks and prints one generated input */
+static void* walk_thread(void* arg) {
+    static ParserContext parser;
+    WalkRun* run = arg;
+    run->status = 1;
+    char* source = walk_source(run);
+    FILE* null = fopen("/dev/null", "w");
+    if (!source || !null) {
+        printf("Error: Memory allocation failed\n");
+        free(source);
+        if (null) fclose(null);
+        return NULL;
+    }
+
+    double start = now_seconds();
+    parser_init(&parser, source);
+    ASTNode* ast = parse(&parser);
+    run->parse_seconds = now_seconds() - start;
+    if (!ast || parser.error_count > 0) {
+        printf("Error: The generated input did not parse\n");
+    } else {
+        AstWalker walker;
+        ast_walker_init(&walker, count_node, NULL, run);
+        start = now_seconds();
+        int walked = ast_walk(&walker, ast, 0, 1);
+        run->walk_seconds = now_seconds() - start;
+        ast_walker_release(&walker);
+
+        if (run->chain == 0) {
+            start = now_seconds();
+            print_ast_to(ast, 0, null);
+            run->print_seconds = now_seconds() - start;
+        }
+
+        /* The store is built first: it refuses trees that checking has folded */
+        AstStore store;
+        start = now_seconds();
+        int stored = ast_store_build(&store, ast, source, strlen(source)) == 0;
+        int store_valid = stored && analyze_semantics_store(&store, null);
+        run->store_seconds = now_seconds() - start;
+        if (stored) {
+            if (run->chain == 0) ast_store_print(&store, 0, 0, null);
+            ast_store_free(&store);
+        }
+
+        start = now_seconds();
+        int valid = analyze_semantics_to(ast, null);
+        run->check_seconds = now_seconds() - start;
+        if (walked == 0 && (!valid || !store_valid)) {
+            printf("Error: Semantic analysis rejected the generated input\n");
+        } else if (walked == 0) {
+            run->status = 0;
+        }
+    }
+    free_ast(ast);
+    fclose(null);
+    free(source);
+    return NULL;
+}
+
+/* Runs one input on a thread with a small painted stack and returns the
+   stack bytes it used, or 0 when the thread could not be started */
+static size_t run_on_small_stack(WalkRun* run) {
+    char* stack = NULL;
+    if (posix_memalign((void**)&stack, 4096, BENCH_WALK_STACK) != 0) return 0;
+    memset(stack, BENCH_WALK_PAINT, BENCH_WALK_STACK);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack, BENCH_WALK_STACK);
+    pthread_t thread;
+    size_t used = 0;
+    if (pthread_create(&thread, &attr, walk_thread, run) == 0) {
+        pthread_join(thread, NULL);
+        /* The stack grows down, so the lowest repainted byte marks its peak */
+        size_t untouched = 0;
+        while (untouched < BENCH_WALK_STACK && (unsigned char)stack[untouched] == BENCH_WALK_PAINT) {
+            untouched++;
+        }
+        used = BENCH_WALK_STACK - untouched;
+    }
+    pthread_attr_destroy(&attr);
+    free(stack);
+    return used;
+}
+
+/* Parses, checks, walks and prints long programs and expressions, as trees
+   and as AST stores, on a 256 KB stack, at two sizes, to show that the stack they take does not
+   grow with the input */
+int bench_walk(void) {
+    printf("AST walk stress test (%d KB stack)\n", BENCH_WALK_STACK / 1024);
+    printf("  %-26s %9s %9s %9s %9s %9s %9s %9s %9s\n", "input", "nodes", "depth",
+           "parse ms", "walk ms", "print ms", "check ms", "store ms", "stack KB");
+    int lengths[2] = {BENCH_WALK_LENGTH / 100, BENCH_WALK_LENGTH};
+    for (int shape = 0; shape < 2; shape++) {
+        for (int i = 0; i < 2; i++) {
+            WalkRun run;
+            memset(&run, 0, sizeof(run));
+            if (shape == 0) {
+                run.statements = lengths[i];
+            } else {
+                run.chain = lengths[i];
+            }
+            size_t used = run_on_small_stack(&run);
+            if (used == 0) {
+                printf("Error: Could not start the benchmark thread\n");
+                return 1;
+            }
+            if (run.status != 0) return 1;
+            char label[64];
+            snprintf(label, sizeof(label), "%d %s", lengths[i], shape == 0 ? "statements" : "term expression");
+            char print_ms[32] = "-";
+            if (shape == 0) snprintf(print_ms, sizeof(print_ms), "%.1f", run.print_seconds * 1e3);
+            printf("  %-26s %9zu %9d %9.1f %9.1f %9s %9.1f %9.1f %9.1f\n", label, run.nodes, run.max_depth,
+                   run.parse_seconds * 1e3, run.walk_seconds * 1e3, print_ms,
+                   run.check_seconds * 1e3, run.store_seconds * 1e3, used / 1024.0);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,417 @@
+/* bytecode.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#include "../../include/bytecode.h"
+#include "../../include/ast_walk.h"
+
+static const int opcode_operands[OP_COUNT] = {
+#define BYTECODE_OPERANDS(name, operands, effect) operands,
+    BYTECODE_OPCODES(BYTECODE_OPERANDS)
+#undef BYTECODE_OPERANDS
+};
+
+static const int opcode_effects[OP_COUNT] = {
+#define BYTECODE_EFFECT(name, operands, effect) effect,
+    BYTECODE_OPCODES(BYTECODE_EFFECT)
+#undef BYTECODE_EFFECT
+};
+
+static const char* opcode_names[OP_COUNT] = {
+#define BYTECODE_NAME(name, operands, effect) #name,
+    BYTECODE_OPCODES(BYTECODE_NAME)
+#undef BYTECODE_NAME
+};
+
+typedef struct {
+    Bytecode* bytecode;
+    int* lengths;           // Array length by first slot
+    int depth;              // Values on the stack at the current point
+    int failed;             // Out of memory
+} Compiler;
+
+static int fits_int(Value value) {
+    return value >= INT_MIN && value <= INT_MAX;
+}
+
+static void emit_word(Compiler* c, int word, int line) {
+    Bytecode* bc = c->bytecode;
+    if (bc->length == bc->capacity) {
+        int capacity = bc->capacity ? bc->capacity * 2 : 256;
+        int* code = realloc(bc->code, sizeof(int) * capacity);
+        int* lines = code ? realloc(bc->lines, sizeof(int) * capacity) : NULL;
+        if (code) bc->code = code;
+        if (lines) bc->lines = lines;
+        if (!code || !lines) {
+            c->failed = 1;
+            return;
+        }
+        bc->capacity = capacity;
+    }
+    bc->code[bc->length] = word;
+    bc->lines[bc->length] = line;
+    bc->length++;
+}
+
+static void emit_op(Compiler* c, Opcode op, int line) {
+    emit_word(c, op, line);
+    c->depth += opcode_effects[op];
+    if (c->depth > c->bytecode->max_stack) {
+        c->bytecode->max_stack = c->depth;
+    }
+}
+
+/* Current code offset, used as a jump target */
+static int here(Compiler* c) {
+    return c->bytecode->length;
+}
+
+/* Emits a jump operand to be filled in later; returns its offset */
+static int emit_placeholder(Compiler* c, int line) {
+    emit_word(c, -1, line);
+    return here(c) - 1;
+}
+
+static void patch(Compiler* c, int operand, int target) {
+    if (!c->failed) c->bytecode->code[operand] = target;
+}
+
+static void emit_constant(Compiler* c, Value value, int line) {
+    if (fits_int(value)) {
+        emit_op(c, OP_CONST, line);
+        emit_word(c, (int)value, line);
+        return;
+    }
+    Bytecode* bc = c->bytecode;
+    if (bc->constant_count == bc->constant_capacity) {
+        int capacity = bc->constant_capacity ? bc->constant_capacity * 2 : 16;
+        Value* constants = realloc(bc->constants, sizeof(Value) * capacity);
+        if (!constants) {
+            c->failed = 1;
+            return;
+        }
+        bc->constants = constants;
+        bc->constant_capacity = capacity;
+    }
+    bc->constants[bc->constant_count] = value;
+    emit_op(c, OP_CONST_WIDE, line);
+    emit_word(c, bc->constant_count++, line);
+}
+
+/* Int immediate for a literal right operand; 0 if it has none */
+static int literal_operand(ASTNode* node, int* imm) {
+    if (!node || node->type != AST_NUMBER) return 0;
+    Value value = ast_number_value(node);
+    if (!fits_int(value)) return 0;
+    *imm = (int)value;
+    return 1;
+}
+
+/* Opcodes of the arithmetic operators, by BinaryOp: on the stack, with an
+   immediate right operand, and with a local right operand. Comparisons
+   have no entry. */
+static const unsigned char arithmetic_opcodes[][3] = {
+    [BINOP_ADD] = {OP_ADD, OP_ADD_K, OP_ADD_L},
+    [BINOP_SUB] = {OP_SUB, OP_SUB_K, OP_SUB_L},
+    [BINOP_MUL] = {OP_MUL, OP_MUL_K, OP_MUL_L},
+    [BINOP_DIV] = {OP_DIV, OP_DIV_K, OP_DIV_L}
+};
+
+static int is_arithmetic(BinaryOp op) {
+    return op >= BINOP_ADD && op <= BINOP_DIV;
+}
+
+/* 1 when an arithmetic node's right operand goes into its instruction as
+   an immediate, 2 as a local, 0 when it is computed on the stack; these
+   index arithmetic_opcodes */
+static int operand_form(const ASTNode* node, int* operand) {
+    BinaryOp op = node->op;
+    if (!is_arithmetic(op)) return 0;
+    if (literal_operand(node->right, operand) && (op != BINOP_DIV || (*operand != 0 && *operand != -1))) {
+        return 1;
+    }
+    if (node->right->type == AST_IDENTIFIER) {
+        *operand = node->right->slot;
+        return 2;
+    }
+    return 0;
+}
+
+/* Expressions are compiled on ast_walk's stack, since a long chain such as
+   a + b + ... + z nests as deep as it is long. Operands are emitted on the
+   way down and operators on the way up. A frame's value is set on
+   children whose code their parent's instruction already covers. */
+static int compile_enter(AstWalker* walker, AstWalkFrame* frame) {
+    Compiler* c = walker->data;
+    ASTNode* node = frame->node;
+    AstWalkFrame* parent = ast_walk_parent(walker);
+    int operand;
+    if (parent && ((parent->node->type == AST_BINOP && node == parent->node->right &&
+                    operand_form(parent->node, &operand)) ||
+                   (parent->node->type == AST_ARRAYACCESS && node == parent->node->left))) {
+        frame->value = 1;
+        return AST_WALK_SKIP;
+    }
+
+    int line = node->token.line;
+    switch (node->type) {
+        case AST_NUMBER:
+            emit_constant(c, ast_number_value(node), line);
+            return AST_WALK_SKIP;
+        case AST_IDENTIFIER:
+            emit_op(c, OP_LOAD, line);
+            emit_word(c, node->slot, line);
+            return AST_WALK_SKIP;
+        case AST_ARRAYACCESS:
+        case AST_FACTORIAL:
+        case AST_BINOP:
+            return AST_WALK_CONTINUE;
+        default:
+            return AST_WALK_SKIP;
+    }
+}
+
+static int compile_leave(AstWalker* walker, AstWalkFrame* frame) {
+    Compiler* c = walker->data;
+    ASTNode* node = frame->node;
+    int line = node->token.line;
+    if (frame->value) return 0;
+    switch (node->type) {
+        case AST_ARRAYACCESS:
+            emit_op(c, OP_LOAD_ELEM, line);
+            emit_word(c, node->left->slot, line);
+            emit_word(c, c->lengths[node->left->slot], line);
+            break;
+        case AST_FACTORIAL:
+            emit_op(c, OP_FACTORIAL, line);
+            break;
+        case AST_BINOP: {
+            int operand;
+            int form = operand_form(node, &operand);
+            if (form) {
+                emit_op(c, arithmetic_opcodes[node->op][form], line);
+                emit_word(c, operand, line);
+                break;
+            }
+            switch (node->op) {
+                case BINOP_LESS:      emit_op(c, OP_LT, line); break;
+                case BINOP_GREATER:   emit_op(c, OP_GT, line); break;
+                case BINOP_EQUAL:     emit_op(c, OP_EQ, line); break;
+                case BINOP_NOT_EQUAL: emit_op(c, OP_NE, line); break;
+                default:              emit_op(c, arithmetic_opcodes[node->op][0], line); break;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return 0;
+}
+
+static void compile_expression(Compiler* c, ASTNode* node) {
+    AstWalker walker;
+    ast_walker_init(&walker, compile_enter, compile_leave, c);
+    if (ast_walk(&walker, node, 0, 0) != 0) c->failed = 1;
+    ast_walker_release(&walker);
+}
+
+/* Comparison a OP b as a branch, optionally negated; -1 if not a comparison */
+static int branch_opcode(ASTNode* cond, int negate) {
+    if (cond->type != AST_BINOP) return -1;
+    switch (cond->op) {
+        case BINOP_LESS:      return negate ? OP_JUMP_IF_GE : OP_JUMP_IF_LT;
+        case BINOP_GREATER:   return negate ? OP_JUMP_IF_LE : OP_JUMP_IF_GT;
+        case BINOP_EQUAL:     return negate ? OP_JUMP_IF_NE : OP_JUMP_IF_EQ;
+        case BINOP_NOT_EQUAL: return negate ? OP_JUMP_IF_EQ : OP_JUMP_IF_NE;
+        default:              return -1;
+    }
+}
+
+/* Emits a branch taken when the condition's truth equals 'when'. Returns
+   the offset of its target operand for patching. */
+static int compile_branch(Compiler* c, ASTNode* cond, int when) {
+    int line = cond->token.line;
+    int op = branch_opcode(cond, !when);
+    int imm;
+
+    if (op < 0) {
+        compile_expression(c, cond);
+        emit_op(c, when ? OP_JUMP_IF_TRUE : OP_JUMP_IF_FALSE, line);
+        return emit_placeholder(c, line);
+    }
+
+    if (cond->left->type == AST_IDENTIFIER && literal_operand(cond->right, &imm)) {
+        emit_op(c, (Opcode)(op - OP_JUMP_IF_LT + OP_JUMP_IF_LT_SK), line);
+        emit_word(c, cond->left->slot, line);
+        emit_word(c, imm, line);
+        return emit_placeholder(c, line);
+    }
+    compile_expression(c, cond->left);
+    if (literal_operand(cond->right, &imm)) {
+        /* The K and SK forms list the comparisons in the same order */
+        emit_op(c, (Opcode)(op - OP_JUMP_IF_LT + OP_JUMP_IF_LT_K), line);
+        emit_word(c, imm, line);
+        return emit_placeholder(c, line);
+    }
+    compile_expression(c, cond->right);
+    emit_op(c, (Opcode)op, line);
+    return emit_placeholder(c, line);
+}
+
+static void compile_statement(Compiler* c, ASTNode* node);
+
+static void compile_body(Compiler* c, ASTNode* body) {
+    if (!body) return;
+    if (body->type != AST_BLOCK) {
+        compile_statement(c, body);
+        return;
+    }
+    for (ASTNode* stmt = body->next; stmt; stmt = stmt->next) {
+        compile_statement(c, stmt);
+    }
+}
+
+/* x = x + K and x = x - K become a single increment */
+static int compile_increment(Compiler* c, ASTNode* node) {
+    ASTNode* value = node->right;
+    int imm;
+    if (value->type != AST_BINOP || !value->left || value->left->type != AST_IDENTIFIER ||
+        value->left->slot != node->left->slot || !literal_operand(value->right, &imm)) {
+        return 0;
+    }
+    BinaryOp op = value->op;
+    if (op != BINOP_ADD && !(op == BINOP_SUB && imm != INT_MIN)) return 0;
+
+    int line = node->token.line;
+    emit_op(c, OP_INC, line);
+    emit_word(c, node->left->slot, line);
+    emit_word(c, op == BINOP_ADD ? imm : -imm, line);
+    return 1;
+}
+
+static void compile_statement(Compiler* c, ASTNode* node) {
+    int line = node->token.line;
+    switch (node->type) {
+        case AST_VARDECL:
+            emit_constant(c, 0, line);
+            emit_op(c, OP_STORE, line);
+            emit_word(c, node->left->slot, line);
+            break;
+        case AST_ARRAYDECL:
+            emit_op(c, OP_CLEAR, line);
+            emit_word(c, node->left->slot, line);
+            emit_word(c, c->lengths[node->left->slot], line);
+            break;
+        case AST_ASSIGN:
+            if (node->left->type == AST_ARRAYACCESS) {
+                ASTNode* access = node->left;
+                compile_expression(c, node->right);
+                compile_expression(c, access->right);
+                emit_op(c, OP_STORE_ELEM, access->token.line);
+                emit_word(c, access->left->slot, access->token.line);
+                emit_word(c, c->lengths[access->left->slot], access->token.line);
+            } else if (!compile_increment(c, node)) {
+                compile_expression(c, node->right);
+                emit_op(c, OP_STORE, line);
+                emit_word(c, node->left->slot, line);
+            }
+            break;
+        case AST_IF: {
+            int skip = compile_branch(c, node->left, 0);
+            compile_body(c, node->right);
+            patch(c, skip, here(c));
+            break;
+        }
+        case AST_WHILE: {
+            /* Condition at the bottom: one branch per iteration */
+            emit_op(c, OP_JUMP, line);
+            int enter = emit_placeholder(c, line);
+            int body = here(c);
+            compile_body(c, node->right);
+            patch(c, enter, here(c));
+            patch(c, compile_branch(c, node->left, 1), body);
+            break;
+        }
+        case AST_REPEAT: {
+            int body = here(c);
+            compile_body(c, node->right);
+            patch(c, compile_branch(c, node->left, 0), body);
+            break;
+        }
+        case AST_PRINT:
+            compile_expression(c, node->left);
+            emit_op(c, OP_PRINT, line);
+            break;
+        case AST_FACTORIAL:
+            compile_expression(c, node);
+            emit_op(c, OP_POP, line);
+            break;
+        case AST_BLOCK:
+            compile_body(c, node);
+            break;
+        default:
+            break;
+    }
+}
+
+int bytecode_compile(ASTNode* program, Bytecode* bytecode) {
+    Compiler c;
+    bytecode->code = NULL;
+    bytecode->length = 0;
+    bytecode->capacity = 0;
+    bytecode->lines = NULL;
+    bytecode->constants = NULL;
+    bytecode->constant_count = 0;
+    bytecode->constant_capacity = 0;
+    bytecode->max_stack = 0;
+    c.bytecode = bytecode;
+    c.depth = 0;
+    c.failed = 0;
+    if (program_frame_layout(program, &bytecode->frame_size, &c.lengths) != 0) {
+        return 1;
+    }
+
+    for (ASTNode* stmt = program->next; stmt; stmt = stmt->next) {
+        compile_statement(&c, stmt);
+    }
+    emit_op(&c, OP_HALT, program->token.line);
+
+    free(c.lengths);
+    if (c.failed) {
+        bytecode_free(bytecode);
+        return 1;
+    }
+    return 0;
+}
+
+void bytecode_free(Bytecode* bytecode) {
+    free(bytecode->code);
+    free(bytecode->lines);
+    free(bytecode->constants);
+    bytecode->code = NULL;
+    bytecode->lines = NULL;
+    bytecode->constants = NULL;
+    bytecode->length = 0;
+    bytecode->capacity = 0;
+    bytecode->constant_count = 0;
+    bytecode->constant_capacity = 0;
+}
+
+void bytecode_disassemble(const Bytecode* bytecode, FILE* out) {
+    fprintf(out, "Bytecode: %d words, %d cells, stack depth %d\n",
+            bytecode->length, bytecode->frame_size, bytecode->max_stack);
+    int pc = 0;
+    while (pc < bytecode->length) {
+        int op = bytecode->code[pc];
+        fprintf(out, "%5d  line %-4d %-14s", pc, bytecode->lines[pc], opcode_names[op]);
+        for (int i = 1; i <= opcode_operands[op]; i++) {
+            fprintf(out, " %d", bytecode->code[pc + i]);
+        }
+        if (op == OP_CONST_WIDE) {
+            fprintf(out, "  ; %lld", bytecode->constants[bytecode->code[pc + 1]]);
+        }
+        fprintf(out, "\n");
+        pc += 1 + opcode_operands[op];
+    }
+}
@@ -0,0 +1,264 @@
+/* vm.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/bytecode.h"
+
+/* Dispatch through a table of label addresses where the compiler supports
+   it (one indirect branch per handler instead of a shared switch branch),
+   and through a switch elsewhere */
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+static int runtime_error(const Bytecode* bytecode, int pc, const char* message, FILE* out) {
+    fprintf(out, "Runtime Error at line %d: %s\n", bytecode->lines[pc], message);
+    return 1;
+}
+
+static Value factorial(Value n) {
+    unsigned long long result = 1;
+    for (Value i = 2; i <= n; i++) {
+        result *= (unsigned long long)i;
+    }
+    return (Value)result;
+}
+
+/* Arithmetic wraps on overflow, as in the tree-walking interpreter */
+#define WRAP(a, op, b) ((Value)((unsigned long long)(a) op (unsigned long long)(b)))
+/* b is non-zero; the one overflowing quotient wraps too. 32-bit division
+   is several times faster than 64-bit, so it is used when both fit. */
+#define FITS_INT(v) ((v) == (Value)(int)(v))
+#define DIVIDE(a, b) ((b) == -1 ? WRAP(0, -, (a)) \
+                      : FITS_INT(a) && FITS_INT(b) ? (Value)((int)(a) / (int)(b)) : (a) / (b))
+
+/* The top of the stack lives in 'tos'; sp points past the cells below it.
+   stack[0] is scratch, written when the first value is pushed. */
+static int execute(const Bytecode* bytecode, Value* frame, Value* stack, FILE* out) {
+    const int* code = bytecode->code;
+    const int* pc = code;
+    Value* sp = stack;
+    Value tos = 0;
+    Value a, b;
+    int status = 0;
+
+#ifdef VM_COMPUTED_GOTO
+    static const void* labels[OP_COUNT] = {
+#define BYTECODE_LABEL(name, operands, effect) &&do_##name,
+        BYTECODE_OPCODES(BYTECODE_LABEL)
+#undef BYTECODE_LABEL
+    };
+#define CASE(name) do_##name:
+#define NEXT goto *labels[*pc]
+    NEXT;
+#else
+#define CASE(name) case OP_##name:
+#define NEXT continue
+    for (;;) switch (*pc) {
+#endif
+
+    CASE(CONST)
+        *sp++ = tos;
+        tos = pc[1];
+        pc += 2;
+        NEXT;
+    CASE(CONST_WIDE)
+        *sp++ = tos;
+        tos = bytecode->constants[pc[1]];
+        pc += 2;
+        NEXT;
+    CASE(LOAD)
+        *sp++ = tos;
+        tos = frame[pc[1]];
+        pc += 2;
+        NEXT;
+    CASE(STORE)
+        frame[pc[1]] = tos;
+        tos = *--sp;
+        pc += 2;
+        NEXT;
+    CASE(LOAD_ELEM)
+        if ((unsigned long long)tos >= (unsigned long long)pc[2]) {
+            status = runtime_error(bytecode, (int)(pc - code), "Array index out of bounds", out);
+            goto done;
+        }
+        tos = frame[pc[1] + tos];
+        pc += 3;
+        NEXT;
+    CASE(STORE_ELEM)
+        /* value below, index on top */
+        if ((unsigned long long)tos >= (unsigned long long)pc[2]) {
+            status = runtime_error(bytecode, (int)(pc - code), "Array index out of bounds", out);
+            goto done;
+        }
+        frame[pc[1] + tos] = sp[-1];
+        sp -= 2;
+        tos = *sp;
+        pc += 3;
+        NEXT;
+    CASE(INC)
+        frame[pc[1]] = WRAP(frame[pc[1]], +, pc[2]);
+        pc += 3;
+        NEXT;
+    CASE(CLEAR)
+        memset(frame + pc[1], 0, sizeof(Value) * pc[2]);
+        pc += 3;
+        NEXT;
+    CASE(ADD)
+        tos = WRAP(*--sp, +, tos);
+        pc++;
+        NEXT;
+    CASE(SUB)
+        tos = WRAP(*--sp, -, tos);
+        pc++;
+        NEXT;
+    CASE(MUL)
+        tos = WRAP(*--sp, *, tos);
+        pc++;
+        NEXT;
+    CASE(DIV)
+        if (tos == 0) {
+            status = runtime_error(bytecode, (int)(pc - code), "Division by zero", out);
+            goto done;
+        }
+        a = *--sp;
+        tos = DIVIDE(a, tos);
+        pc++;
+        NEXT;
+    CASE(LT)
+        tos = *--sp < tos;
+        pc++;
+        NEXT;
+    CASE(GT)
+        tos = *--sp > tos;
+        pc++;
+        NEXT;
+    CASE(EQ)
+        tos = *--sp == tos;
+        pc++;
+        NEXT;
+    CASE(NE)
+        tos = *--sp != tos;
+        pc++;
+        NEXT;
+    CASE(ADD_K)
+        tos = WRAP(tos, +, pc[1]);
+        pc += 2;
+        NEXT;
+    CASE(SUB_K)
+        tos = WRAP(tos, -, pc[1]);
+        pc += 2;
+        NEXT;
+    CASE(MUL_K)
+        tos = WRAP(tos, *, pc[1]);
+        pc += 2;
+        NEXT;
+    CASE(DIV_K)
+        tos = FITS_INT(tos) ? (Value)((int)tos / pc[1]) : tos / pc[1];
+        pc += 2;
+        NEXT;
+    CASE(ADD_L)
+        tos = WRAP(tos, +, frame[pc[1]]);
+        pc += 2;
+        NEXT;
+    CASE(SUB_L)
+        tos = WRAP(tos, -, frame[pc[1]]);
+        pc += 2;
+        NEXT;
+    CASE(MUL_L)
+        tos = WRAP(tos, *, frame[pc[1]]);
+        pc += 2;
+        NEXT;
+    CASE(DIV_L)
+        b = frame[pc[1]];
+        if (b == 0) {
+            status = runtime_error(bytecode, (int)(pc - code), "Division by zero", out);
+            goto done;
+        }
+        tos = DIVIDE(tos, b);
+        pc += 2;
+        NEXT;
+    CASE(FACTORIAL)
+        if (tos < 0) {
+            status = runtime_error(bytecode, (int)(pc - code), "Factorial of a negative number", out);
+            goto done;
+        }
+        tos = factorial(tos);
+        pc++;
+        NEXT;
+    CASE(PRINT)
+        fprintf(out, "%lld\n", tos);
+        tos = *--sp;
+        pc++;
+        NEXT;
+    CASE(POP)
+        tos = *--sp;
+        pc++;
+        NEXT;
+    CASE(JUMP)
+        pc = code + pc[1];
+        NEXT;
+    CASE(JUMP_IF_TRUE)
+        a = tos;
+        tos = *--sp;
+        pc = a ? code + pc[1] : pc + 2;
+        NEXT;
+    CASE(JUMP_IF_FALSE)
+        a = tos;
+        tos = *--sp;
+        pc = a ? pc + 2 : code + pc[1];
+        NEXT;
+
+#define FUSED_BRANCH(name, cmp)                              \
+    CASE(JUMP_IF_##name)                                     \
+        a = sp[-1];                                          \
+        b = tos;                                             \
+        sp -= 2;                                             \
+        tos = *sp;                                           \
+        pc = (a cmp b) ? code + pc[1] : pc + 2;              \
+        NEXT;                                                \
+    CASE(JUMP_IF_##name##_K)                                 \
+        a = tos;                                             \
+        tos = *--sp;                                         \
+        pc = (a cmp pc[1]) ? code + pc[2] : pc + 3;          \
+        NEXT;                                                \
+    CASE(JUMP_IF_##name##_SK)                                \
+        pc = (frame[pc[1]] cmp pc[2]) ? code + pc[3] : pc + 4; \
+        NEXT;
+    FUSED_BRANCH(LT, <)
+    FUSED_BRANCH(GT, >)
+    FUSED_BRANCH(LE, <=)
+    FUSED_BRANCH(GE, >=)
+    FUSED_BRANCH(EQ, ==)
+    FUSED_BRANCH(NE, !=)
+#undef FUSED_BRANCH
+
+    CASE(HALT)
+        goto done;
+
+#ifndef VM_COMPUTED_GOTO
+    }
+#endif
+
+done:
+    return status;
+#undef CASE
+#undef NEXT
+}
+
+int vm_run(const Bytecode* bytecode, FILE* out) {
+    Value* frame = calloc(bytecode->frame_size > 0 ? bytecode->frame_size : 1, sizeof(Value));
+    /* One extra cell for the scratch slot below the cached top */
+    Value* stack = malloc(sizeof(Value) * (bytecode->max_stack + 1));
+    if (!frame || !stack) {
+        fprintf(out, "Error: Memory allocation failed\n");
+        free(frame);
+        free(stack);
+        return 1;
+    }
+    int status = execute(bytecode, frame, stack, out);
+    free(frame);
+    free(stack);
+    return status;
+}
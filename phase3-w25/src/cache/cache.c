@@ -0,0 +1,475 @@
+/* cache.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "../../include/cache.h"
+
+/* Bump when the entry layout changes; it is part of every key */
+#define CACHE_FORMAT_VERSION 2
+/* A trim goes below the limit by this share, so the next few stores do
+   not each trigger another one */
+#define CACHE_TRIM_PERCENT 90
+/* Temporary files younger than this may belong to a running compiler */
+#define CACHE_TEMP_GRACE_SECONDS 60
+
+struct Cache {
+    char* dir;
+    size_t max_bytes;
+    uint64_t build_id;
+    atomic_size_t hits;
+    atomic_size_t misses;
+    atomic_size_t stores;
+    size_t stores_at_trim;
+    size_t evictions;
+    size_t bytes_evicted;
+    size_t size;
+};
+
+/* Entry file layout: this header, then the diagnostics, the code words,
+   their line numbers and the constants */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    int32_t status;
+    uint64_t key;
+    uint64_t source_size;
+    uint64_t diagnostics_size;
+    int32_t has_bytecode;
+    int32_t code_length;
+    int32_t constant_count;
+    int32_t frame_size;
+    int32_t max_stack;
+    int32_t reserved;
+    uint64_t diagnostics_hash;  // Checksums of the body, so a damaged entry
+    uint64_t bytecode_hash;     // is a miss rather than wrong output
+} EntryHeader;
+
+static const char ENTRY_MAGIC[8] = {'C', 'M', 'P', 'C', 'A', 'C', 'H', 'E'};
+
+#define COUNTER_ADD(counter, n) atomic_fetch_add_explicit(&(counter), (n), memory_order_relaxed)
+#define COUNTER_GET(counter) atomic_load_explicit(&(counter), memory_order_relaxed)
+
+/* 64-bit hash (the xxHash64 algorithm): four independent lanes take 32
+   bytes per step, so hashing runs at memory speed */
+#define PRIME1 0x9E3779B185EBCA87ULL
+#define PRIME2 0xC2B2AE3D27D4EB4FULL
+#define PRIME3 0x165667B19E3779F9ULL
+#define PRIME4 0x85EBCA77C2B2AE63ULL
+#define PRIME5 0x27D4EB2F165667C5ULL
+
+static uint64_t rotate_left(uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+static uint64_t read64(const unsigned char* p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t read32(const unsigned char* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint64_t hash_round(uint64_t acc, uint64_t input) {
+    acc += input * PRIME2;
+    acc = rotate_left(acc, 31);
+    return acc * PRIME1;
+}
+
+static uint64_t hash_merge(uint64_t acc, uint64_t lane) {
+    acc ^= hash_round(0, lane);
+    return acc * PRIME1 + PRIME4;
+}
+
+static uint64_t hash64(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* p = data;
+    const unsigned char* end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+        uint64_t v1 = seed + PRIME1 + PRIME2;
+        uint64_t v2 = seed + PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME1;
+        do {
+            v1 = hash_round(v1, read64(p));
+            v2 = hash_round(v2, read64(p + 8));
+            v3 = hash_round(v3, read64(p + 16));
+            v4 = hash_round(v4, read64(p + 24));
+            p += 32;
+        } while (end - p >= 32);
+        h = rotate_left(v1, 1) + rotate_left(v2, 7) + rotate_left(v3, 12) + rotate_left(v4, 18);
+        h = hash_merge(h, v1);
+        h = hash_merge(h, v2);
+        h = hash_merge(h, v3);
+        h = hash_merge(h, v4);
+    } else {
+        h = seed + PRIME5;
+    }
+    h += size;
+
+    while (end - p >= 8) {
+        h ^= hash_round(0, read64(p));
+        h = rotate_left(h, 27) * PRIME1 + PRIME4;
+        p += 8;
+    }
+    if (end - p >= 4) {
+        h ^= read32(p) * PRIME1;
+        h = rotate_left(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= *p * PRIME5;
+        h = rotate_left(h, 11) * PRIME1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+/* The build ID is a hash of the running executable, so any rebuild that
+   changes the compiler's code starts from an empty cache */
+static uint64_t build_id(void) {
+    uint64_t id = CACHE_FORMAT_VERSION;
+    int fd = open("/proc/self/exe", O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+        char* image = malloc((size_t)st.st_size);
+        if (image && read(fd, image, (size_t)st.st_size) == st.st_size) {
+            id = hash64(image, (size_t)st.st_size, id);
+            free(image);
+            close(fd);
+            return id;
+        }
+        free(image);
+    }
+    if (fd >= 0) close(fd);
+    /* Without the executable, fall back to when this file was compiled */
+    const char* stamp = __DATE__ " " __TIME__;
+    return hash64(stamp, strlen(stamp), id);
+}
+
+Cache* cache_open(const char* dir, size_t max_bytes) {
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        printf("Error: Could not create cache directory %s\n", dir);
+        return NULL;
+    }
+    struct stat st;
+    if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        printf("Error: Cache directory %s is not a directory\n", dir);
+        return NULL;
+    }
+
+    Cache* cache = calloc(1, sizeof(Cache));
+    if (!cache || !(cache->dir = strdup(dir))) {
+        printf("Error: Memory allocation failed\n");
+        free(cache);
+        return NULL;
+    }
+    cache->max_bytes = max_bytes;
+    cache->build_id = build_id();
+    atomic_init(&cache->hits, 0);
+    atomic_init(&cache->misses, 0);
+    atomic_init(&cache->stores, 0);
+    return cache;
+}
+
+void cache_close(Cache* cache) {
+    if (!cache) return;
+    if (COUNTER_GET(cache->stores) != cache->stores_at_trim) cache_trim(cache);
+    free(cache->dir);
+    free(cache);
+}
+
+uint64_t cache_key(const Cache* cache, const char* source, size_t size) {
+    return hash64(source, size, cache->build_id);
+}
+
+/* Path of the entry for 'key'; the caller frees it */
+static char* entry_path(const Cache* cache, uint64_t key) {
+    size_t length = strlen(cache->dir) + 18;
+    char* path = malloc(length);
+    if (path) snprintf(path, length, "%s/%016llx", cache->dir, (unsigned long long)key);
+    return path;
+}
+
+static int read_all(int fd, void* buffer, size_t size) {
+    char* p = buffer;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 1;
+        p += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+static int write_all(int fd, const void* buffer, size_t size) {
+    const char* p = buffer;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 1;
+        p += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Checksum of the bytecode part of an entry, taken array by array in the
+   order they are written */
+static uint64_t bytecode_hash(const Bytecode* bytecode) {
+    uint64_t h = hash64(bytecode->code, (size_t)bytecode->length * sizeof(int), 0);
+    h = hash64(bytecode->lines, (size_t)bytecode->length * sizeof(int), h);
+    return hash64(bytecode->constants, (size_t)bytecode->constant_count * sizeof(Value), h);
+}
+
+/* Bytes an entry takes after its header */
+static size_t body_size(const EntryHeader* header) {
+    size_t size = header->diagnostics_size;
+    if (header->has_bytecode) {
+        size += (size_t)header->code_length * 2 * sizeof(int);
+        size += (size_t)header->constant_count * sizeof(Value);
+    }
+    return size;
+}
+
+/* Copies 'count' items of 'size' bytes out of the entry into a new array */
+static void* take_array(const char** p, size_t count, size_t size) {
+    void* array = malloc(count ? count * size : 1);
+    if (array) memcpy(array, *p, count * size);
+    *p += count * size;
+    return array;
+}
+
+/* Reads the entry in 'fd'; the bytecode is skipped unless 'need_bytecode'
+   is set, so checking reads little more than the diagnostics */
+static int read_entry(int fd, uint64_t key, size_t source_size, int need_bytecode, CacheEntry* entry) {
+    EntryHeader header;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(header) ||
+        read_all(fd, &header, sizeof(header)) != 0) {
+        return 0;
+    }
+    /* A file that does not describe exactly this source is ignored */
+    if (memcmp(header.magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC)) != 0 || header.version != CACHE_FORMAT_VERSION ||
+        header.key != key || header.source_size != source_size || header.code_length < 0 ||
+        header.constant_count < 0 || header.diagnostics_size > (uint64_t)st.st_size ||
+        sizeof(header) + body_size(&header) != (size_t)st.st_size) {
+        return 0;
+    }
+
+    if (!need_bytecode) header.has_bytecode = 0;
+    size_t size = body_size(&header);
+    char* body = malloc(size ? size : 1);
+    if (!body || read_all(fd, body, size) != 0) {
+        free(body);
+        return 0;
+    }
+    const char* p = body;
+    memset(entry, 0, sizeof(*entry));
+    entry->status = header.status;
+    entry->diagnostics_size = header.diagnostics_size;
+    entry->diagnostics = take_array(&p, header.diagnostics_size, 1);
+    int ok = entry->diagnostics != NULL &&
+             hash64(entry->diagnostics, entry->diagnostics_size, 0) == header.diagnostics_hash;
+    if (header.has_bytecode) {
+        Bytecode* bytecode = &entry->bytecode;
+        bytecode->length = bytecode->capacity = header.code_length;
+        bytecode->constant_count = bytecode->constant_capacity = header.constant_count;
+        bytecode->frame_size = header.frame_size;
+        bytecode->max_stack = header.max_stack;
+        bytecode->code = take_array(&p, header.code_length, sizeof(int));
+        bytecode->lines = take_array(&p, header.code_length, sizeof(int));
+        bytecode->constants = take_array(&p, header.constant_count, sizeof(Value));
+        entry->has_bytecode = 1;
+        ok = ok && bytecode->code && bytecode->lines && bytecode->constants &&
+             bytecode_hash(bytecode) == header.bytecode_hash;
+    }
+    free(body);
+    if (!ok) cache_entry_free(entry);
+    return ok;
+}
+
+int cache_lookup(Cache* cache, uint64_t key, size_t source_size, int need_bytecode, CacheEntry* entry) {
+    char* path = entry_path(cache, key);
+    int fd = path ? open(path, O_RDONLY) : -1;
+    int hit = fd >= 0 && read_entry(fd, key, source_size, need_bytecode, entry);
+    if (hit && need_bytecode && entry->status > 0 && !entry->has_bytecode) {
+        cache_entry_free(entry);
+        hit = 0;
+    }
+    /* The modification time records the last use, for cache_trim */
+    if (hit) futimens(fd, NULL);
+    if (fd >= 0) close(fd);
+    free(path);
+    if (hit) {
+        COUNTER_ADD(cache->hits, 1);
+    } else {
+        COUNTER_ADD(cache->misses, 1);
+    }
+    return hit;
+}
+
+void cache_store(Cache* cache, uint64_t key, size_t source_size, const CacheEntry* entry) {
+    EntryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC));
+    header.version = CACHE_FORMAT_VERSION;
+    header.status = entry->status;
+    header.key = key;
+    header.source_size = source_size;
+    header.diagnostics_size = entry->diagnostics_size;
+    header.diagnostics_hash = hash64(entry->diagnostics, entry->diagnostics_size, 0);
+    if (entry->has_bytecode) {
+        header.has_bytecode = 1;
+        header.code_length = entry->bytecode.length;
+        header.constant_count = entry->bytecode.constant_count;
+        header.frame_size = entry->bytecode.frame_size;
+        header.max_stack = entry->bytecode.max_stack;
+        header.bytecode_hash = bytecode_hash(&entry->bytecode);
+    }
+
+    char* path = entry_path(cache, key);
+    size_t temp_length = strlen(cache->dir) + 16;
+    char* temp = malloc(temp_length);
+    if (!path || !temp) {
+        free(path);
+        free(temp);
+        return;
+    }
+    /* Written under a temporary name so readers never see half an entry */
+    snprintf(temp, temp_length, "%s/tmp.XXXXXX", cache->dir);
+    int fd = mkstemp(temp);
+    if (fd >= 0) {
+        const Bytecode* bytecode = &entry->bytecode;
+        int failed = write_all(fd, &header, sizeof(header)) ||
+                     write_all(fd, entry->diagnostics, entry->diagnostics_size);
+        if (entry->has_bytecode) {
+            failed = failed || write_all(fd, bytecode->code, (size_t)bytecode->length * sizeof(int)) ||
+                     write_all(fd, bytecode->lines, (size_t)bytecode->length * sizeof(int)) ||
+                     write_all(fd, bytecode->constants, (size_t)bytecode->constant_count * sizeof(Value));
+        }
+        failed = close(fd) != 0 || failed;
+        if (failed || rename(temp, path) != 0) {
+            unlink(temp);
+        } else {
+            COUNTER_ADD(cache->stores, 1);
+        }
+    }
+    free(path);
+    free(temp);
+}
+
+void cache_entry_free(CacheEntry* entry) {
+    free(entry->diagnostics);
+    entry->diagnostics = NULL;
+    if (entry->has_bytecode) bytecode_free(&entry->bytecode);
+    entry->has_bytecode = 0;
+}
+
+typedef struct {
+    char* name;
+    size_t size;
+    time_t used;
+} CacheFile;
+
+static int by_last_use(const void* a, const void* b) {
+    const CacheFile* x = a;
+    const CacheFile* y = b;
+    return (x->used > y->used) - (x->used < y->used);
+}
+
+void cache_trim(Cache* cache) {
+    cache->stores_at_trim = COUNTER_GET(cache->stores);
+    DIR* dir = opendir(cache->dir);
+    if (!dir) return;
+
+    CacheFile* files = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    size_t total = 0;
+    time_t now = time(NULL);
+    struct dirent* item;
+    while ((item = readdir(dir)) != NULL) {
+        /* Only entries and temporary files belong to the cache */
+        int is_temp = strncmp(item->d_name, "tmp.", 4) == 0;
+        if (!is_temp && strspn(item->d_name, "0123456789abcdef") != 16) continue;
+        struct stat st;
+        if (fstatat(dirfd(dir), item->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode)) continue;
+        total += (size_t)st.st_size;
+        if (is_temp && now - st.st_mtime < CACHE_TEMP_GRACE_SECONDS) continue;
+
+        if (count == capacity) {
+            size_t grown = capacity ? capacity * 2 : 256;
+            CacheFile* list = realloc(files, grown * sizeof(CacheFile));
+            if (!list) break;
+            files = list;
+            capacity = grown;
+        }
+        files[count].name = strdup(item->d_name);
+        if (!files[count].name) break;
+        files[count].size = (size_t)st.st_size;
+        files[count].used = st.st_mtime;
+        count++;
+    }
+
+    if (total > cache->max_bytes) {
+        size_t target = cache->max_bytes / 100 * CACHE_TRIM_PERCENT;
+        qsort(files, count, sizeof(CacheFile), by_last_use);
+        for (size_t i = 0; i < count && total > target; i++) {
+            if (unlinkat(dirfd(dir), files[i].name, 0) == 0) {
+                total -= files[i].size;
+                cache->evictions++;
+                cache->bytes_evicted += files[i].size;
+            }
+        }
+    }
+    cache->size = total;
+
+    for (size_t i = 0; i < count; i++) free(files[i].name);
+    free(files);
+    closedir(dir);
+}
+
+void cache_get_stats(Cache* cache, CacheStats* stats) {
+    stats->hits = COUNTER_GET(cache->hits);
+    stats->misses = COUNTER_GET(cache->misses);
+    stats->stores = COUNTER_GET(cache->stores);
+    stats->evictions = cache->evictions;
+    stats->bytes_evicted = cache->bytes_evicted;
+    stats->size = cache->size;
+}
+
+size_t cache_parse_size(const char* text) {
+    char* end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text || errno != 0 || text[0] == '-') return 0;
+    int shift = 0;
+    switch (*end) {
+        case 'k': case 'K': shift = 10; end++; break;
+        case 'm': case 'M': shift = 20; end++; break;
+        case 'g': case 'G': shift = 30; end++; break;
+        default: break;
+    }
+    if (*end != '\0' || value > (SIZE_MAX >> shift)) return 0;
+    return (size_t)value << shift;
+}
@@ -0,0 +1,348 @@
+/* regalloc.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/codegen.h"
+
+/* Allocation order: caller-saved registers first, so that the callee-saved
+   ones (which cost a push and pop) stay free for values live across calls */
+static const int allocatable[] = {
+    X86_RSI, X86_RDI, X86_R8, X86_R9, X86_R10, X86_R11,
+    X86_RBX, X86_R12, X86_R13, X86_R14, X86_R15
+};
+
+#define ALLOCATABLE_COUNT ((int)(sizeof(allocatable) / sizeof(allocatable[0])))
+#define CALLEE_SAVED ((1u << X86_RBX) | (1u << X86_R12) | (1u << X86_R13) | (1u << X86_R14) | (1u << X86_R15))
+
+typedef struct {
+    int value;
+    int start;
+    int end;
+    int crosses_call;
+} Interval;
+
+/* Natural loops, found from back edges in reverse postorder */
+typedef struct {
+    int* loop_of;           // Innermost loop of each block, or -1
+    int* parent;            // Enclosing loop of each loop, or -1
+    int* header;            // Header block of each loop
+    int* low;               // First and last position of each loop's blocks
+    int* high;
+    int count;
+} Loops;
+
+typedef struct {
+    IrProgram* ir;
+    int* position;          // Position of each instruction in the layout
+    int* block_start;       // Position of each block's first and last instruction
+    int* block_end;
+    Loops loops;
+    Interval* intervals;    // Indexed by value until sorted
+    int* calls;             // Positions of calls, in increasing order
+    int call_count;
+} Liveness;
+
+/* rt_factorial only clobbers the scratch registers, so PRINT is the one
+   instruction that calls into libc */
+static int is_call(IrOpcode op) {
+    return op == IR_PRINT;
+}
+
+/* Whether loop 'loop' contains the block whose innermost loop is 'inner' */
+static int loop_contains(const Loops* loops, int loop, int inner) {
+    for (; inner >= 0; inner = loops->parent[inner]) {
+        if (inner == loop) return 1;
+    }
+    return 0;
+}
+
+static int find_loops(Liveness* live) {
+    IrProgram* ir = live->ir;
+    Loops* loops = &live->loops;
+    int blocks = ir->block_count > 0 ? ir->block_count : 1;
+    loops->loop_of = malloc(sizeof(int) * blocks);
+    loops->parent = malloc(sizeof(int) * blocks);
+    loops->header = malloc(sizeof(int) * blocks);
+    loops->low = malloc(sizeof(int) * blocks);
+    loops->high = malloc(sizeof(int) * blocks);
+    int* stack = malloc(sizeof(int) * blocks);
+    int* seen = calloc(blocks, sizeof(int));
+    if (!loops->loop_of || !loops->parent || !loops->header || !loops->low || !loops->high || !stack || !seen) {
+        free(stack);
+        free(seen);
+        return 1;
+    }
+    for (int b = 0; b < ir->block_count; b++) loops->loop_of[b] = -1;
+    loops->count = 0;
+
+    /* Headers in layout order, so enclosing loops are marked before the
+       loops nested in them and the inner marks win */
+    for (int i = 0; i < ir->rpo_count; i++) {
+        int header = ir->rpo[i];
+        IrBlock* block = &ir->blocks[header];
+        int loop = -1;
+        for (int p = 0; p < block->pred_count; p++) {
+            int latch = block->preds[p];
+            if (ir->blocks[latch].rpo_index < i) continue;
+            if (loop < 0) {
+                loop = loops->count++;
+                loops->header[loop] = header;
+                loops->parent[loop] = loops->loop_of[header];
+                loops->low[loop] = live->block_start[header];
+                loops->high[loop] = live->block_end[header];
+                loops->loop_of[header] = loop;
+                seen[header] = loop + 1;
+            }
+            /* Everything that reaches the latch without passing the header */
+            int depth = 0;
+            if (seen[latch] != loop + 1) {
+                seen[latch] = loop + 1;
+                stack[depth++] = latch;
+            }
+            while (depth > 0) {
+                int b = stack[--depth];
+                loops->loop_of[b] = loop;
+                if (live->block_start[b] < loops->low[loop]) loops->low[loop] = live->block_start[b];
+                if (live->block_end[b] > loops->high[loop]) loops->high[loop] = live->block_end[b];
+                for (int q = 0; q < ir->blocks[b].pred_count; q++) {
+                    int pred = ir->blocks[b].preds[q];
+                    if (seen[pred] == loop + 1 || ir->blocks[pred].rpo_index < 0) continue;
+                    seen[pred] = loop + 1;
+                    stack[depth++] = pred;
+                }
+            }
+        }
+    }
+    free(stack);
+    free(seen);
+    return 0;
+}
+
+/* Records a use of 'value' at 'position' in block 'block' */
+static void add_use(Liveness* live, int value, int block, int position) {
+    IrInstr* def = &live->ir->instrs[value];
+    if (def->op == IR_CONST) return;
+    Interval* interval = &live->intervals[value];
+    if (position > interval->end) interval->end = position;
+
+    /* Live across every loop around the use that does not contain the
+       definition: the value must survive all of its iterations */
+    Loops* loops = &live->loops;
+    int def_loop = loops->loop_of[def->block];
+    for (int loop = loops->loop_of[block]; loop >= 0; loop = loops->parent[loop]) {
+        if (loop_contains(loops, loop, def_loop)) break;
+        if (loops->high[loop] > interval->end) interval->end = loops->high[loop];
+    }
+}
+
+static int compare_intervals(const void* a, const void* b) {
+    const Interval* x = a;
+    const Interval* y = b;
+    if (x->start != y->start) return x->start < y->start ? -1 : 1;
+    return x->value - y->value;
+}
+
+/* Whether a call happens strictly inside the interval */
+static int crosses_call(const Liveness* live, const Interval* interval) {
+    int low = 0;
+    int high = live->call_count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (live->calls[mid] <= interval->start) low = mid + 1;
+        else high = mid;
+    }
+    return low < live->call_count && live->calls[low] < interval->end;
+}
+
+static int build_intervals(Liveness* live, Allocation* allocation) {
+    IrProgram* ir = live->ir;
+    int values = ir->instr_count > 0 ? ir->instr_count : 1;
+    int blocks = ir->block_count > 0 ? ir->block_count : 1;
+    live->position = malloc(sizeof(int) * values);
+    live->block_start = malloc(sizeof(int) * blocks);
+    live->block_end = malloc(sizeof(int) * blocks);
+    live->intervals = malloc(sizeof(Interval) * values);
+    live->calls = malloc(sizeof(int) * values);
+    if (!live->position || !live->block_start || !live->block_end || !live->intervals || !live->calls) return 1;
+
+    int position = 0;
+    live->call_count = 0;
+    for (int i = 0; i < allocation->block_count; i++) {
+        int b = allocation->order[i];
+        IrBlock* block = &ir->blocks[b];
+        live->block_start[b] = position;
+        for (int j = 0; j < block->count; j++) {
+            int id = block->instrs[j];
+            live->position[id] = position;
+            if (is_call(ir->instrs[id].op)) live->calls[live->call_count++] = position;
+            position += 2;
+        }
+        live->block_end[b] = position - 2;
+    }
+    if (find_loops(live) != 0) return 1;
+
+    for (int id = 0; id < ir->instr_count; id++) {
+        live->intervals[id].value = id;
+        live->intervals[id].start = -1;
+        live->intervals[id].end = -1;
+        IrInstr* instr = &ir->instrs[id];
+        if (instr->block < 0 || ir->blocks[instr->block].rpo_index < 0) continue;
+        if (!ir_opcode_has_value(instr->op) || instr->op == IR_CONST) continue;
+        /* Phis are written on the incoming edges, before the block starts */
+        int start = instr->op == IR_PHI ? live->block_start[instr->block] : live->position[id];
+        live->intervals[id].start = start;
+        live->intervals[id].end = start;
+    }
+    for (int i = 0; i < allocation->block_count; i++) {
+        int b = allocation->order[i];
+        IrBlock* block = &ir->blocks[b];
+        for (int j = 0; j < block->count; j++) {
+            int id = block->instrs[j];
+            IrInstr* instr = &ir->instrs[id];
+            if (instr->op == IR_PHI) {
+                /* Operands are read by the copies at the end of each predecessor */
+                for (int p = 0; p < block->pred_count; p++) {
+                    int pred = block->preds[p];
+                    if (ir->blocks[pred].rpo_index < 0) continue;
+                    add_use(live, instr->phi_args[p], pred, live->block_end[pred]);
+                }
+                continue;
+            }
+            for (int a = 0; a < ir_opcode_operands(instr->op); a++) {
+                add_use(live, instr->args[a], b, live->position[id]);
+            }
+        }
+    }
+    return 0;
+}
+
+/* Active intervals, kept sorted by increasing end */
+typedef struct {
+    Interval** items;
+    int count;
+} Active;
+
+static void active_insert(Active* active, Interval* interval) {
+    int i = active->count++;
+    while (i > 0 && active->items[i - 1]->end > interval->end) {
+        active->items[i] = active->items[i - 1];
+        i--;
+    }
+    active->items[i] = interval;
+}
+
+static void active_remove(Active* active, int index) {
+    memmove(&active->items[index], &active->items[index + 1], sizeof(Interval*) * (active->count - index - 1));
+    active->count--;
+}
+
+static void linear_scan(Interval* sorted, int count, Allocation* allocation, Interval** buffer) {
+    Location* locations = allocation->locations;
+    Active active = {buffer, 0};
+    unsigned free_registers = 0;
+    for (int r = 0; r < ALLOCATABLE_COUNT; r++) free_registers |= 1u << allocatable[r];
+
+    for (int i = 0; i < count; i++) {
+        Interval* interval = &sorted[i];
+        /* Expire intervals that ended before this one starts */
+        while (active.count > 0 && active.items[0]->end < interval->start) {
+            free_registers |= 1u << locations[active.items[0]->value].reg;
+            active_remove(&active, 0);
+        }
+
+        unsigned usable = interval->crosses_call ? CALLEE_SAVED : ~0u;
+        int reg = -1;
+        for (int r = 0; r < ALLOCATABLE_COUNT && reg < 0; r++) {
+            if ((free_registers & usable) & (1u << allocatable[r])) reg = allocatable[r];
+        }
+        if (reg >= 0) {
+            free_registers &= ~(1u << reg);
+            locations[interval->value].reg = reg;
+            active_insert(&active, interval);
+            continue;
+        }
+
+        /* No register: spill whichever usable interval ends last */
+        int victim = -1;
+        for (int a = active.count - 1; a >= 0; a--) {
+            if (usable & (1u << locations[active.items[a]->value].reg)) {
+                victim = a;
+                break;
+            }
+        }
+        if (victim >= 0 && active.items[victim]->end > interval->end) {
+            Interval* spilled = active.items[victim];
+            locations[interval->value].reg = locations[spilled->value].reg;
+            locations[spilled->value].reg = -1;
+            locations[spilled->value].slot = allocation->spill_slots++;
+            active_remove(&active, victim);
+            active_insert(&active, interval);
+        } else {
+            locations[interval->value].slot = allocation->spill_slots++;
+        }
+    }
+}
+
+int regalloc_linear_scan(IrProgram* ir, Allocation* allocation) {
+    Liveness live;
+    memset(&live, 0, sizeof(live));
+    memset(allocation, 0, sizeof(Allocation));
+    live.ir = ir;
+    int values = ir->instr_count > 0 ? ir->instr_count : 1;
+    allocation->order = malloc(sizeof(int) * (ir->rpo_count > 0 ? ir->rpo_count : 1));
+    allocation->locations = malloc(sizeof(Location) * values);
+    Interval** buffer = malloc(sizeof(Interval*) * values);
+    Interval* sorted = malloc(sizeof(Interval) * values);
+    int failed = !allocation->order || !allocation->locations || !buffer || !sorted;
+
+    if (!failed) {
+        memcpy(allocation->order, ir->rpo, sizeof(int) * ir->rpo_count);
+        allocation->block_count = ir->rpo_count;
+        for (int v = 0; v < ir->instr_count; v++) {
+            allocation->locations[v].reg = -1;
+            allocation->locations[v].slot = -1;
+        }
+        failed = build_intervals(&live, allocation) != 0;
+    }
+    if (!failed) {
+        int count = 0;
+        for (int v = 0; v < ir->instr_count; v++) {
+            if (live.intervals[v].start < 0) continue;
+            sorted[count] = live.intervals[v];
+            sorted[count].crosses_call = crosses_call(&live, &sorted[count]);
+            count++;
+        }
+        qsort(sorted, count, sizeof(Interval), compare_intervals);
+        linear_scan(sorted, count, allocation, buffer);
+        for (int v = 0; v < ir->instr_count; v++) {
+            int reg = allocation->locations[v].reg;
+            if (reg >= 0 && (CALLEE_SAVED & (1u << reg))) allocation->callee_saved |= 1u << reg;
+        }
+    }
+
+    free(buffer);
+    free(sorted);
+    free(live.position);
+    free(live.block_start);
+    free(live.block_end);
+    free(live.intervals);
+    free(live.calls);
+    free(live.loops.loop_of);
+    free(live.loops.parent);
+    free(live.loops.header);
+    free(live.loops.low);
+    free(live.loops.high);
+    if (failed) {
+        regalloc_free(allocation);
+        return 1;
+    }
+    return 0;
+}
+
+void regalloc_free(Allocation* allocation) {
+    free(allocation->order);
+    free(allocation->locations);
+    allocation->order = NULL;
+    allocation->locations = NULL;
+}
@@ -0,0 +1,667 @@
+/* x86_64.c */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../../include/codegen.h"
+
+static const char* register_names[X86_REGISTER_COUNT] = {
+    "%rax", "%rcx", "%rdx", "%rbx", "%rsi", "%rdi", "%r8", "%r9",
+    "%r10", "%r11", "%r12", "%r13", "%r14", "%r15", "%rsp", "%rbp"
+};
+
+static const char* dword_names[X86_REGISTER_COUNT] = {
+    "%eax", "%ecx", "%edx", "%ebx", "%esi", "%edi", "%r8d", "%r9d",
+    "%r10d", "%r11d", "%r12d", "%r13d", "%r14d", "%r15d", "%esp", "%ebp"
+};
+
+/* Callee-saved registers in push order */
+static const int saved_registers[] = {X86_RBX, X86_R12, X86_R13, X86_R14, X86_R15};
+#define SAVED_REGISTER_COUNT ((int)(sizeof(saved_registers) / sizeof(saved_registers[0])))
+
+/* Runtime error messages, as reported by the interpreters */
+enum { MESSAGE_DIVISION, MESSAGE_FACTORIAL, MESSAGE_BOUNDS, MESSAGE_COUNT };
+
+static const char* messages[MESSAGE_COUNT] = {
+    "Division by zero",
+    "Factorial of a negative number",
+    "Array index out of bounds"
+};
+
+/* A value's home: a register (below X86_REGISTER_COUNT), a spill slot
+   (X86_REGISTER_COUNT + slot), or NO_LOCATION for constants */
+#define NO_LOCATION -1
+#define OPERAND_SIZE 32
+
+typedef struct {
+    int destination;
+    int source;             // Location, or NO_LOCATION to load 'value'
+    int value;
+} Move;
+
+typedef struct {
+    int line;
+    int message;
+} ErrorStub;
+
+typedef struct {
+    IrProgram* ir;
+    Allocation allocation;
+    FILE* out;
+    int* uses;              // Number of uses of each value
+    Move* moves;            // Scratch space for phi copies
+    ErrorStub* stubs;
+    int stub_count;
+    int stub_capacity;
+    int saved_bytes;        // Size of the callee-saved register area
+    int failed;
+} Codegen;
+
+static int is_constant(const Codegen* cg, int value) {
+    return cg->ir->instrs[value].op == IR_CONST;
+}
+
+static int fits_imm32(Value value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+static int location_of(const Codegen* cg, int value) {
+    const Location* location = &cg->allocation.locations[value];
+    if (location->reg >= 0) return location->reg;
+    if (location->slot >= 0) return X86_REGISTER_COUNT + location->slot;
+    return NO_LOCATION;
+}
+
+static void location_text(const Codegen* cg, int location, char* text) {
+    if (location < X86_REGISTER_COUNT) {
+        snprintf(text, OPERAND_SIZE, "%s", register_names[location]);
+    } else {
+        int slot = location - X86_REGISTER_COUNT;
+        snprintf(text, OPERAND_SIZE, "%d(%%rbp)", -(cg->saved_bytes + 8 * (slot + 1)));
+    }
+}
+
+/* Formats 'value' as a source operand. Constants become immediates; those
+   that need more than 32 bits are first loaded into 'scratch'. */
+static void operand_text(Codegen* cg, int value, int scratch, char* text) {
+    if (is_constant(cg, value)) {
+        Value imm = cg->ir->instrs[value].imm;
+        if (fits_imm32(imm)) {
+            snprintf(text, OPERAND_SIZE, "$%lld", imm);
+            return;
+        }
+        fprintf(cg->out, "    movabsq $%lld, %s\n", imm, register_names[scratch]);
+        snprintf(text, OPERAND_SIZE, "%s", register_names[scratch]);
+        return;
+    }
+    int location = location_of(cg, value);
+    if (location == NO_LOCATION) {
+        snprintf(text, OPERAND_SIZE, "$0");
+    } else {
+        location_text(cg, location, text);
+    }
+}
+
+static void move_locations(Codegen* cg, int destination, int source) {
+    if (destination == source) return;
+    char to[OPERAND_SIZE], from[OPERAND_SIZE];
+    location_text(cg, destination, to);
+    location_text(cg, source, from);
+    if (destination >= X86_REGISTER_COUNT && source >= X86_REGISTER_COUNT) {
+        fprintf(cg->out, "    movq %s, %%rdx\n", from);
+        fprintf(cg->out, "    movq %%rdx, %s\n", to);
+    } else {
+        fprintf(cg->out, "    movq %s, %s\n", from, to);
+    }
+}
+
+/* Copies 'value' to a location; RCX and RDX may be used on the way */
+static void move_value(Codegen* cg, int destination, int value) {
+    if (!is_constant(cg, value)) {
+        int source = location_of(cg, value);
+        if (source != NO_LOCATION) move_locations(cg, destination, source);
+        return;
+    }
+    Value imm = cg->ir->instrs[value].imm;
+    char to[OPERAND_SIZE];
+    location_text(cg, destination, to);
+    if (destination < X86_REGISTER_COUNT && imm == 0) {
+        fprintf(cg->out, "    xorl %s, %s\n", dword_names[destination], dword_names[destination]);
+    } else if (fits_imm32(imm)) {
+        fprintf(cg->out, "    movq $%lld, %s\n", imm, to);
+    } else if (destination < X86_REGISTER_COUNT) {
+        fprintf(cg->out, "    movabsq $%lld, %s\n", imm, to);
+    } else {
+        fprintf(cg->out, "    movabsq $%lld, %%rcx\n", imm);
+        fprintf(cg->out, "    movq %%rcx, %s\n", to);
+    }
+}
+
+/* Register holding 'value' for use as an address index: its own register,
+   or 'scratch' after loading it */
+static int value_in_register(Codegen* cg, int value, int scratch) {
+    int location = is_constant(cg, value) ? NO_LOCATION : location_of(cg, value);
+    if (location != NO_LOCATION && location < X86_REGISTER_COUNT) return location;
+    move_value(cg, scratch, value);
+    return scratch;
+}
+
+/* Returns the label number of a new runtime error stub */
+static int error_stub(Codegen* cg, int line, int message) {
+    if (cg->stub_count == cg->stub_capacity) {
+        int capacity = cg->stub_capacity ? cg->stub_capacity * 2 : 16;
+        ErrorStub* stubs = realloc(cg->stubs, sizeof(ErrorStub) * capacity);
+        if (!stubs) {
+            cg->failed = 1;
+            return 0;
+        }
+        cg->stubs = stubs;
+        cg->stub_capacity = capacity;
+    }
+    cg->stubs[cg->stub_count].line = line;
+    cg->stubs[cg->stub_count].message = message;
+    return cg->stub_count++;
+}
+
+/* Index of the edge from -> to in the successor's predecessor list; phis
+   take the operand of the first matching edge, as in ir_execute() */
+static int edge_index(const IrProgram* ir, int from, int to) {
+    const IrBlock* block = &ir->blocks[to];
+    int index = 0;
+    while (index < block->pred_count && block->preds[index] != from) index++;
+    return index;
+}
+
+static int has_phis(const IrProgram* ir, int block) {
+    const IrBlock* b = &ir->blocks[block];
+    return b->count > 0 && ir->instrs[b->instrs[0]].op == IR_PHI;
+}
+
+/* Emits the phi copies of an edge as one parallel move: a copy is emitted
+   once no pending copy still reads its destination, and a cycle is broken
+   by parking one destination in RAX */
+static void emit_edge_copies(Codegen* cg, int from, int to) {
+    IrProgram* ir = cg->ir;
+    IrBlock* block = &ir->blocks[to];
+    int index = edge_index(ir, from, to);
+    int count = 0;
+    for (int i = 0; i < block->count; i++) {
+        IrInstr* phi = &ir->instrs[block->instrs[i]];
+        if (phi->op != IR_PHI) break;
+        int destination = location_of(cg, block->instrs[i]);
+        int value = phi->phi_args[index];
+        int source = is_constant(cg, value) ? NO_LOCATION : location_of(cg, value);
+        if (destination == NO_LOCATION || destination == source) continue;
+        cg->moves[count].destination = destination;
+        cg->moves[count].source = source;
+        cg->moves[count].value = value;
+        count++;
+    }
+
+    while (count > 0) {
+        int ready = -1;
+        for (int i = 0; i < count && ready < 0; i++) {
+            int read = 0;
+            for (int j = 0; j < count && !read; j++) {
+                read = j != i && cg->moves[j].source == cg->moves[i].destination;
+            }
+            if (!read) ready = i;
+        }
+        if (ready < 0) {
+            int parked = cg->moves[0].destination;
+            move_locations(cg, X86_RAX, parked);
+            for (int j = 0; j < count; j++) {
+                if (cg->moves[j].source == parked) cg->moves[j].source = X86_RAX;
+            }
+            continue;
+        }
+        Move* move = &cg->moves[ready];
+        if (move->source == NO_LOCATION) {
+            move_value(cg, move->destination, move->value);
+        } else {
+            move_locations(cg, move->destination, move->source);
+        }
+        cg->moves[ready] = cg->moves[--count];
+    }
+}
+
+static const char* condition_code(IrOpcode op, int negate) {
+    switch (op) {
+        case IR_LT: return negate ? "ge" : "l";
+        case IR_GT: return negate ? "le" : "g";
+        case IR_EQ: return negate ? "ne" : "e";
+        default:    return negate ? "e" : "ne";
+    }
+}
+
+static int is_compare(IrOpcode op) {
+    return op == IR_LT || op == IR_GT || op == IR_EQ || op == IR_NE;
+}
+
+/* A compare used only by the branch right after it sets the flags for
+   that branch instead of materialising a 0/1 value */
+static int is_fused_compare(const Codegen* cg, const IrBlock* block, int index) {
+    int id = block->instrs[index];
+    if (!is_compare(cg->ir->instrs[id].op) || cg->uses[id] != 1 || index + 1 >= block->count) return 0;
+    const IrInstr* next = &cg->ir->instrs[block->instrs[index + 1]];
+    return next->op == IR_BRANCH && next->args[0] == id;
+}
+
+static void emit_compare(Codegen* cg, const IrInstr* instr) {
+    int left = instr->args[0];
+    int right = instr->args[1];
+    char a[OPERAND_SIZE], b[OPERAND_SIZE];
+    int location = is_constant(cg, left) ? NO_LOCATION : location_of(cg, left);
+    int right_in_memory = !is_constant(cg, right) && location_of(cg, right) >= X86_REGISTER_COUNT;
+    if (location == NO_LOCATION || (location >= X86_REGISTER_COUNT && right_in_memory)) {
+        move_value(cg, X86_RAX, left);
+        location = X86_RAX;
+    }
+    location_text(cg, location, a);
+    operand_text(cg, right, X86_RCX, b);
+    fprintf(cg->out, "    cmpq %s, %s\n", b, a);
+}
+
+/* ADD, SUB and MUL: computed in the destination register when there is
+   one, otherwise in RAX */
+static void emit_arithmetic(Codegen* cg, int id, const char* mnemonic, int commutative) {
+    const IrInstr* instr = &cg->ir->instrs[id];
+    int left = instr->args[0];
+    int right = instr->args[1];
+    int destination = location_of(cg, id);
+    if (destination == NO_LOCATION) return;
+    int target = destination < X86_REGISTER_COUNT ? destination : X86_RAX;
+    if (!is_constant(cg, right) && location_of(cg, right) == target && left != right) {
+        if (commutative) {
+            int swap = left;
+            left = right;
+            right = swap;
+        } else {
+            target = X86_RAX;
+        }
+    }
+    char b[OPERAND_SIZE];
+    move_value(cg, target, left);
+    operand_text(cg, right, X86_RCX, b);
+    fprintf(cg->out, "    %s %s, %s\n", mnemonic, b, register_names[target]);
+    move_locations(cg, destination, target);
+}
+
+static void emit_divide(Codegen* cg, int id) {
+    const IrInstr* instr = &cg->ir->instrs[id];
+    int right = instr->args[1];
+    move_value(cg, X86_RAX, instr->args[0]);
+    if (is_constant(cg, right)) {
+        Value divisor = cg->ir->instrs[right].imm;
+        if (divisor == 0) {
+            fprintf(cg->out, "    jmp .Lerror%d\n", error_stub(cg, instr->line, MESSAGE_DIVISION));
+            return;
+        }
+        if (divisor == -1) {
+            fprintf(cg->out, "    negq %%rax\n");
+        } else {
+            move_value(cg, X86_RCX, right);
+            fprintf(cg->out, "    cqto\n");
+            fprintf(cg->out, "    idivq %%rcx\n");
+        }
+    } else {
+        /* INT64_MIN / -1 would trap, so -1 negates like the interpreters */
+        move_value(cg, X86_RCX, right);
+        fprintf(cg->out, "    testq %%rcx, %%rcx\n");
+        fprintf(cg->out, "    je .Lerror%d\n", error_stub(cg, instr->line, MESSAGE_DIVISION));
+        fprintf(cg->out, "    cmpq $-1, %%rcx\n");
+        fprintf(cg->out, "    jne .Ldivide%d\n", id);
+        fprintf(cg->out, "    negq %%rax\n");
+        fprintf(cg->out, "    jmp .Ldivided%d\n", id);
+        fprintf(cg->out, ".Ldivide%d:\n", id);
+        fprintf(cg->out, "    cqto\n");
+        fprintf(cg->out, "    idivq %%rcx\n");
+        fprintf(cg->out, ".Ldivided%d:\n", id);
+    }
+    int destination = location_of(cg, id);
+    if (destination != NO_LOCATION) move_locations(cg, destination, X86_RAX);
+}
+
+/* Emits a bounds check on an element index and returns the register to
+   address the cell with, or -1 for a constant index (in *cell) */
+static int element_index(Codegen* cg, const IrInstr* instr, int* cell) {
+    int index = instr->args[0];
+    if (is_constant(cg, index)) {
+        Value value = cg->ir->instrs[index].imm;
+        if (value < 0 || value >= instr->length) {
+            fprintf(cg->out, "    jmp .Lerror%d\n", error_stub(cg, instr->line, MESSAGE_BOUNDS));
+            *cell = instr->base;
+        } else {
+            *cell = instr->base + (int)value;
+        }
+        return -1;
+    }
+    int reg = value_in_register(cg, index, X86_RCX);
+    /* Unsigned, so negative indices fail the same check */
+    fprintf(cg->out, "    cmpq $%d, %s\n", instr->length, register_names[reg]);
+    fprintf(cg->out, "    jae .Lerror%d\n", error_stub(cg, instr->line, MESSAGE_BOUNDS));
+    fprintf(cg->out, "    leaq cells(%%rip), %%rdx\n");
+    return reg;
+}
+
+static void emit_load_element(Codegen* cg, int id) {
+    const IrInstr* instr = &cg->ir->instrs[id];
+    int destination = location_of(cg, id);
+    int target = destination != NO_LOCATION && destination < X86_REGISTER_COUNT ? destination : X86_RAX;
+    int cell;
+    int reg = element_index(cg, instr, &cell);
+    if (reg < 0) {
+        fprintf(cg->out, "    movq cells+%lld(%%rip), %s\n", 8LL * cell, register_names[target]);
+    } else {
+        fprintf(cg->out, "    movq %lld(%%rdx,%s,8), %s\n", 8LL * instr->base, register_names[reg], register_names[target]);
+    }
+    if (destination != NO_LOCATION) move_locations(cg, destination, target);
+}
+
+static void emit_store_element(Codegen* cg, int id) {
+    const IrInstr* instr = &cg->ir->instrs[id];
+    int value = instr->args[1];
+    char source[OPERAND_SIZE];
+    if (is_constant(cg, value) && fits_imm32(cg->ir->instrs[value].imm)) {
+        operand_text(cg, value, X86_RAX, source);
+    } else {
+        snprintf(source, OPERAND_SIZE, "%s", register_names[value_in_register(cg, value, X86_RAX)]);
+    }
+    int cell;
+    int reg = element_index(cg, instr, &cell);
+    if (reg < 0) {
+        fprintf(cg->out, "    movq %s, cells+%lld(%%rip)\n", source, 8LL * cell);
+    } else {
+        fprintf(cg->out, "    movq %s, %lld(%%rdx,%s,8)\n", source, 8LL * instr->base, register_names[reg]);
+    }
+}
+
+static void emit_clear(Codegen* cg, int id) {
+    const IrInstr* instr = &cg->ir->instrs[id];
+    if (instr->length <= 8) {
+        for (int cell = 0; cell < instr->length; cell++) {
+            fprintf(cg->out, "    movq $0, cells+%lld(%%rip)\n", 8LL * (instr->base + cell));
+        }
+        return;
+    }
+    fprintf(cg->out, "    leaq cells+%lld(%%rip), %%rax\n", 8LL * instr->base);
+    fprintf(cg->out, "    movl $%d, %%ecx\n", instr->length);
+    fprintf(cg->out, ".Lclear%d:\n", id);
+    fprintf(cg->out, "    movq $0, (%%rax)\n");
+    fprintf(cg->out, "    addq $8, %%rax\n");
+    fprintf(cg->out, "    decq %%rcx\n");
+    fprintf(cg->out, "    jnz .Lclear%d\n", id);
+}
+
+/* Jump target of an edge: the successor itself, or a stub that performs
+   the edge's phi copies first */
+static void edge_label(const Codegen* cg, int from, int to, char* text) {
+    if (has_phis(cg->ir, to)) {
+        snprintf(text, OPERAND_SIZE, ".Ledge%d_%d", from, to);
+    } else {
+        snprintf(text, OPERAND_SIZE, ".Lblock%d", to);
+    }
+}
+
+static void emit_jump(Codegen* cg, int from, int to, int next) {
+    emit_edge_copies(cg, from, to);
+    if (to != next) fprintf(cg->out, "    jmp .Lblock%d\n", to);
+}
+
+static void emit_branch(Codegen* cg, int b, int index, int next) {
+    const IrBlock* block = &cg->ir->blocks[b];
+    const IrInstr* instr = &cg->ir->instrs[block->instrs[index]];
+    int cond = instr->args[0];
+    int taken = instr->targets[0];
+    int other = instr->targets[1];
+    if (taken == other) {
+        emit_jump(cg, b, taken, next);
+        return;
+    }
+
+    IrOpcode op = IR_NE;
+    if (is_constant(cg, cond)) {
+        emit_jump(cg, b, cg->ir->instrs[cond].imm ? taken : other, next);
+        return;
+    } else if (index > 0 && is_fused_compare(cg, block, index - 1)) {
+        op = cg->ir->instrs[cond].op;
+        emit_compare(cg, &cg->ir->instrs[cond]);
+    } else {
+        char text[OPERAND_SIZE];
+        operand_text(cg, cond, X86_RCX, text);
+        fprintf(cg->out, "    cmpq $0, %s\n", text);
+    }
+
+    int stub_taken = has_phis(cg->ir, taken);
+    int stub_other = has_phis(cg->ir, other);
+    if (!stub_taken && !stub_other && taken == next) {
+        fprintf(cg->out, "    j%s .Lblock%d\n", condition_code(op, 1), other);
+        return;
+    }
+    char label[OPERAND_SIZE];
+    edge_label(cg, b, taken, label);
+    fprintf(cg->out, "    j%s %s\n", condition_code(op, 0), label);
+    emit_edge_copies(cg, b, other);
+    if (other != next || stub_taken) fprintf(cg->out, "    jmp .Lblock%d\n", other);
+    if (stub_taken) {
+        fprintf(cg->out, "%s:\n", label);
+        emit_jump(cg, b, taken, next);
+    }
+}
+
+static void emit_return(Codegen* cg) {
+    fprintf(cg->out, "    xorl %%eax, %%eax\n");
+    fprintf(cg->out, "    leaq %d(%%rbp), %%rsp\n", -cg->saved_bytes);
+    for (int i = SAVED_REGISTER_COUNT - 1; i >= 0; i--) {
+        if (cg->allocation.callee_saved & (1u << saved_registers[i])) {
+            fprintf(cg->out, "    popq %s\n", register_names[saved_registers[i]]);
+        }
+    }
+    fprintf(cg->out, "    popq %%rbp\n");
+    fprintf(cg->out, "    ret\n");
+}
+
+static void emit_block(Codegen* cg, int position) {
+    IrProgram* ir = cg->ir;
+    int b = cg->allocation.order[position];
+    int next = position + 1 < cg->allocation.block_count ? cg->allocation.order[position + 1] : -1;
+    IrBlock* block = &ir->blocks[b];
+    fprintf(cg->out, ".Lblock%d:\n", b);
+    for (int i = 0; i < block->count; i++) {
+        int id = block->instrs[i];
+        IrInstr* instr = &ir->instrs[id];
+        switch (instr->op) {
+            case IR_CONST:
+            case IR_PHI:
+                break;
+            case IR_ADD: emit_arithmetic(cg, id, "addq", 1); break;
+            case IR_SUB: emit_arithmetic(cg, id, "subq", 0); break;
+            case IR_MUL: emit_arithmetic(cg, id, "imulq", 1); break;
+            case IR_DIV: emit_divide(cg, id); break;
+            case IR_LT:
+            case IR_GT:
+            case IR_EQ:
+            case IR_NE: {
+                int destination = location_of(cg, id);
+                if (is_fused_compare(cg, block, i) || destination == NO_LOCATION) break;
+                emit_compare(cg, instr);
+                fprintf(cg->out, "    set%s %%al\n", condition_code(instr->op, 0));
+                fprintf(cg->out, "    movzbl %%al, %%eax\n");
+                move_locations(cg, destination, X86_RAX);
+                break;
+            }
+            case IR_FACTORIAL: {
+                /* rt_factorial takes RCX and only clobbers RAX and RCX */
+                move_value(cg, X86_RCX, instr->args[0]);
+                fprintf(cg->out, "    testq %%rcx, %%rcx\n");
+                fprintf(cg->out, "    js .Lerror%d\n", error_stub(cg, instr->line, MESSAGE_FACTORIAL));
+                fprintf(cg->out, "    call rt_factorial\n");
+                int destination = location_of(cg, id);
+                if (destination != NO_LOCATION) move_locations(cg, destination, X86_RAX);
+                break;
+            }
+            case IR_LOAD_ELEM: emit_load_element(cg, id); break;
+            case IR_STORE_ELEM: emit_store_element(cg, id); break;
+            case IR_CLEAR: emit_clear(cg, id); break;
+            case IR_PRINT:
+                move_value(cg, X86_RDI, instr->args[0]);
+                fprintf(cg->out, "    call rt_print\n");
+                break;
+            case IR_JUMP: emit_jump(cg, b, instr->targets[0], next); break;
+            case IR_BRANCH: emit_branch(cg, b, i, next); break;
+            case IR_RETURN: emit_return(cg); break;
+            case IR_OPCODE_COUNT: break;
+        }
+    }
+}
+
+static void emit_prologue(Codegen* cg) {
+    int saved = 0;
+    fprintf(cg->out, "    .text\n");
+    fprintf(cg->out, "    .globl main\n");
+    fprintf(cg->out, "    .type main, @function\n");
+    fprintf(cg->out, "main:\n");
+    fprintf(cg->out, "    pushq %%rbp\n");
+    fprintf(cg->out, "    movq %%rsp, %%rbp\n");
+    for (int i = 0; i < SAVED_REGISTER_COUNT; i++) {
+        if (cg->allocation.callee_saved & (1u << saved_registers[i])) {
+            fprintf(cg->out, "    pushq %s\n", register_names[saved_registers[i]]);
+            saved++;
+        }
+    }
+    /* Keep RSP 16-byte aligned for the calls into libc */
+    int words = saved + cg->allocation.spill_slots;
+    int frame = 8 * cg->allocation.spill_slots + (words % 2 ? 8 : 0);
+    if (frame > 0) fprintf(cg->out, "    subq $%d, %%rsp\n", frame);
+}
+
+/* print, factorial and runtime errors. rt_factorial returns 0 from 66 on,
+   where the product has at least 64 factors of two. */
+static void emit_runtime(Codegen* cg) {
+    fprintf(cg->out,
+        "\n"
+        "rt_print:\n"
+        "    subq $8, %%rsp\n"
+        "    movq %%rdi, %%rsi\n"
+        "    leaq .Lprint_format(%%rip), %%rdi\n"
+        "    xorl %%eax, %%eax\n"
+        "    call printf@PLT\n"
+        "    addq $8, %%rsp\n"
+        "    ret\n"
+        "\n"
+        "rt_factorial:\n"
+        "    movl $1, %%eax\n"
+        "    cmpq $66, %%rcx\n"
+        "    jl .Lfactorial_loop\n"
+        "    xorl %%eax, %%eax\n"
+        "    ret\n"
+        ".Lfactorial_loop:\n"
+        "    cmpq $1, %%rcx\n"
+        "    jle .Lfactorial_done\n"
+        "    imulq %%rcx, %%rax\n"
+        "    decq %%rcx\n"
+        "    jmp .Lfactorial_loop\n"
+        ".Lfactorial_done:\n"
+        "    ret\n"
+        "\n"
+        "rt_error:\n"
+        "    subq $8, %%rsp\n"
+        "    movq %%rsi, %%rdx\n"
+        "    movl %%edi, %%esi\n"
+        "    leaq .Lerror_format(%%rip), %%rdi\n"
+        "    xorl %%eax, %%eax\n"
+        "    call printf@PLT\n"
+        "    movl $1, %%edi\n"
+        "    call exit@PLT\n");
+
+    fprintf(cg->out, "\n    .section .rodata\n");
+    fprintf(cg->out, ".Lprint_format:\n    .string \"%%lld\\n\"\n");
+    fprintf(cg->out, ".Lerror_format:\n    .string \"Runtime Error at line %%d: %%s\\n\"\n");
+    for (int i = 0; i < MESSAGE_COUNT; i++) {
+        fprintf(cg->out, ".Lmessage%d:\n    .string \"%s\"\n", i, messages[i]);
+    }
+    long long size = cg->ir->frame_size > 0 ? 8LL * cg->ir->frame_size : 8;
+    fprintf(cg->out, "\n    .local cells\n");
+    fprintf(cg->out, "    .comm cells, %lld, 8\n", size);
+    fprintf(cg->out, "    .section .note.GNU-stack,\"\",@progbits\n");
+}
+
+int codegen_x86_64(IrProgram* ir, FILE* out) {
+    if (8LL * ir->frame_size > CODEGEN_MAX_CELL_BYTES) {
+        printf("Error: The program's %d storage cells take %lld bytes; native code addresses at most %lld\n",
+               ir->frame_size, 8LL * ir->frame_size, CODEGEN_MAX_CELL_BYTES);
+        return 1;
+    }
+    Codegen cg;
+    memset(&cg, 0, sizeof(cg));
+    cg.ir = ir;
+    cg.out = out;
+    ir_cleanup(ir);
+    if (regalloc_linear_scan(ir, &cg.allocation) != 0) return 1;
+
+    int values = ir->instr_count > 0 ? ir->instr_count : 1;
+    cg.uses = calloc(values, sizeof(int));
+    cg.moves = malloc(sizeof(Move) * values);
+    if (!cg.uses || !cg.moves) {
+        cg.failed = 1;
+    } else {
+        for (int i = 0; i < cg.allocation.block_count; i++) {
+            IrBlock* block = &ir->blocks[cg.allocation.order[i]];
+            for (int j = 0; j < block->count; j++) {
+                IrInstr* instr = &ir->instrs[block->instrs[j]];
+                for (int a = 0; a < ir_opcode_operands(instr->op); a++) {
+                    cg.uses[instr->args[a]]++;
+                }
+                for (int p = 0; instr->op == IR_PHI && p < block->pred_count; p++) {
+                    cg.uses[instr->phi_args[p]]++;
+                }
+            }
+        }
+        for (int i = 0; i < SAVED_REGISTER_COUNT; i++) {
+            if (cg.allocation.callee_saved & (1u << saved_registers[i])) cg.saved_bytes += 8;
+        }
+
+        fprintf(out, "# Generated by the CMPE458 compiler: %d blocks, %d spill slots\n",
+                cg.allocation.block_count, cg.allocation.spill_slots);
+        emit_prologue(&cg);
+        for (int i = 0; i < cg.allocation.block_count; i++) {
+            emit_block(&cg, i);
+        }
+        for (int i = 0; i < cg.stub_count; i++) {
+            fprintf(out, ".Lerror%d:\n", i);
+            fprintf(out, "    movl $%d, %%edi\n", cg.stubs[i].line);
+            fprintf(out, "    leaq .Lmessage%d(%%rip), %%rsi\n", cg.stubs[i].message);
+            fprintf(out, "    call rt_error\n");
+        }
+        emit_runtime(&cg);
+    }
+
+    free(cg.uses);
+    free(cg.moves);
+    free(cg.stubs);
+    regalloc_free(&cg.allocation);
+    return cg.failed;
+}
+
+int codegen_link(const char* assembly, const char* executable) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        printf("Error: Could not run the system compiler\n");
+        return 1;
+    }
+    if (pid == 0) {
+        execlp("cc", "cc", "-o", executable, assembly, (char*)NULL);
+        _exit(127);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("Error: Could not assemble and link %s\n", executable);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,220 @@
+/* driver.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/driver.h"
+#include "../../include/thread_pool.h"
+#include "../../include/parser.h"
+#include "../../include/semantic.h"
+#include "../../include/source.h"
+#include "../../include/cache.h"
+
+typedef struct {
+    char* output;           // Everything printed while compiling the file
+    size_t size;
+    int passed;
+} FileResult;
+
+typedef struct {
+    char** files;
+    FileResult* results;
+    ParserContext** parsers;    // One per worker, reused for each of its files
+    Cache* cache;
+} DriverJob;
+
+int driver_check_source(ParserContext* parser, const SourceBuffer* source, Cache* cache,
+                        FILE* out, Bytecode* bytecode) {
+    CacheEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    uint64_t key = 0;
+    if (cache) {
+        key = cache_key(cache, source->data, source->size);
+        if (cache_lookup(cache, key, source->size, bytecode != NULL, &entry)) {
+            fwrite(entry.diagnostics, 1, entry.diagnostics_size, out);
+            if (bytecode && entry.status > 0) {
+                *bytecode = entry.bytecode;
+                entry.has_bytecode = 0;
+            }
+            int status = entry.status;
+            cache_entry_free(&entry);
+            return status;
+        }
+    }
+
+    /* Diagnostics that are to be stored are collected in memory first */
+    FILE* collected = cache ? open_memstream(&entry.diagnostics, &entry.diagnostics_size) : NULL;
+    FILE* report = collected ? collected : out;
+    parser_init_source(parser, source);
+    ASTNode* ast = parse(parser);
+
+    int status = -1;
+    if (parser->error_count > 0) {
+        fprintf(report, "\nParsing failed with %d errors. Semantic analysis aborted.\n", parser->error_count);
+        print_errors_to(parser, report);
+    } else {
+        fprintf(report, "AST created. Performing semantic analysis...\n\n");
+        status = analyze_semantics_to(ast, report);
+        if (status) {
+            fprintf(report, "Semantic analysis successful. No errors found.\n");
+        } else {
+            fprintf(report, "Semantic analysis failed. Errors detected.\n");
+        }
+    }
+    /* Bytecode is only compiled, and so only stored, when the caller runs
+       it; a checked-only entry misses for a later --run, which stores the
+       bytecode then */
+    if (status > 0 && bytecode) {
+        entry.has_bytecode = bytecode_compile(ast, &entry.bytecode) == 0;
+    }
+    free_ast(ast);
+
+    if (collected) {
+        if (fclose(collected) != 0) {
+            /* The diagnostics were lost, so check the source again uncached */
+            cache_entry_free(&entry);
+            return driver_check_source(parser, source, NULL, out, bytecode);
+        }
+        fwrite(entry.diagnostics, 1, entry.diagnostics_size, out);
+        entry.status = status;
+        cache_store(cache, key, source->size, &entry);
+    }
+    if (bytecode && status > 0) {
+        memset(bytecode, 0, sizeof(*bytecode));
+        if (entry.has_bytecode) {
+            *bytecode = entry.bytecode;
+            entry.has_bytecode = 0;
+        }
+    }
+    cache_entry_free(&entry);
+    return status;
+}
+
+/* Same steps and messages as compiling a single file without echo */
+static int compile_file(ParserContext* parser, const char* filename, Cache* cache, FILE* out) {
+    SourceBuffer source = {0};
+    if (source_open_to(&source, filename, out) != 0) {
+        return 0;
+    }
+
+    fprintf(out, "Analyzing input from file %s:\n\n", filename);
+    int passed = driver_check_source(parser, &source, cache, out, NULL) > 0;
+    source_close(&source);
+    return passed;
+}
+
+static void compile_task(void* arg, int task, int worker) {
+    DriverJob* job = arg;
+    FileResult* result = &job->results[task];
+
+    FILE* out = open_memstream(&result->output, &result->size);
+    if (!out) {
+        result->passed = 0;
+        return;
+    }
+    result->passed = compile_file(job->parsers[worker], job->files[task], job->cache, out);
+    fclose(out);
+}
+
+int driver_run(char** files, int count, int jobs, Cache* cache) {
+    if (jobs <= 0) jobs = thread_pool_default_workers();
+    if (jobs > count) jobs = count;
+    if (jobs < 1) jobs = 1;
+
+    DriverJob job;
+    job.files = files;
+    job.cache = cache;
+    job.results = calloc(count > 0 ? count : 1, sizeof(FileResult));
+    job.parsers = calloc(jobs, sizeof(ParserContext*));
+    int ok = job.results && job.parsers;
+    for (int i = 0; ok && i < jobs; i++) {
+        job.parsers[i] = calloc(1, sizeof(ParserContext));
+        if (!job.parsers[i]) ok = 0;
+    }
+    if (!ok) {
+        printf("Error: Memory allocation failed\n");
+        if (job.parsers) {
+            for (int i = 0; i < jobs; i++) free(job.parsers[i]);
+        }
+        free(job.parsers);
+        free(job.results);
+        return 1;
+    }
+
+    thread_pool_run(jobs, count, compile_task, &job);
+
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        FileResult* result = &job.results[i];
+        if (i > 0) printf("\n");
+        if (result->output) {
+            fwrite(result->output, 1, result->size, stdout);
+            free(result->output);
+        } else {
+            printf("Error: Memory allocation failed while compiling %s\n", files[i]);
+        }
+        if (!result->passed) failed++;
+    }
+    printf("\n%d of %d files passed.\n", count - failed, count);
+
+    for (int i = 0; i < jobs; i++) free(job.parsers[i]);
+    free(job.parsers);
+    free(job.results);
+    return failed > 0;
+}
+
+int driver_add_file(char*** files, int* count, int* capacity, const char* name) {
+    if (*count == *capacity) {
+        int grown = *capacity ? *capacity * 2 : 16;
+        char** list = realloc(*files, sizeof(char*) * grown);
+        if (!list) {
+            printf("Error: Memory allocation failed\n");
+            return 1;
+        }
+        *files = list;
+        *capacity = grown;
+    }
+    char* copy = strdup(name);
+    if (!copy) {
+        printf("Error: Memory allocation failed\n");
+        return 1;
+    }
+    (*files)[(*count)++] = copy;
+    return 0;
+}
+
+void driver_free_files(char** files, int count) {
+    for (int i = 0; i < count; i++) free(files[i]);
+    free(files);
+}
+
+int driver_read_response_file(const char* path, char*** files, int* count, int* capacity) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        printf("Error: Could not open response file %s\n", path);
+        return 1;
+    }
+
+    char* line = NULL;
+    size_t line_capacity = 0;
+    ssize_t length;
+    int status = 0;
+    while ((length = getline(&line, &line_capacity, file)) >= 0) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r' ||
+                              line[length - 1] == ' ' || line[length - 1] == '\t')) {
+            line[--length] = '\0';
+        }
+        char* start = line;
+        while (*start == ' ' || *start == '\t') start++;
+        if (*start == '\0') continue;
+
+        if (driver_add_file(files, count, capacity, start) != 0) {
+            status = 1;
+            break;
+        }
+    }
+
+    free(line);
+    fclose(file);
+    return status;
+}
@@ -0,0 +1,128 @@
+/* thread_pool.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "../../include/thread_pool.h"
+
+/* Tasks not yet started by a worker. The owner takes tasks from the front;
+   a thief takes the back half. */
+typedef struct {
+    pthread_mutex_t lock;
+    int begin;
+    int end;
+} WorkQueue;
+
+typedef struct {
+    WorkQueue* queues;
+    int workers;
+    ThreadPoolTask fn;
+    void* arg;
+} ThreadPool;
+
+typedef struct {
+    ThreadPool* pool;
+    int id;
+    pthread_t thread;
+} Worker;
+
+static int pop_task(WorkQueue* queue, int* task) {
+    int found = 0;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->begin < queue->end) {
+        *task = queue->begin++;
+        found = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+/* Moves the back half of another worker's queue into our own. Tasks are
+   never added once the pool runs, so finding every queue empty means all
+   work has been handed out. */
+static int steal_tasks(ThreadPool* pool, int thief) {
+    for (int i = 1; i < pool->workers; i++) {
+        WorkQueue* victim = &pool->queues[(thief + i) % pool->workers];
+        int begin = 0, end = 0;
+
+        pthread_mutex_lock(&victim->lock);
+        int remaining = victim->end - victim->begin;
+        if (remaining > 0) {
+            end = victim->end;
+            begin = end - (remaining + 1) / 2;
+            victim->end = begin;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (begin < end) {
+            WorkQueue* own = &pool->queues[thief];
+            pthread_mutex_lock(&own->lock);
+            own->begin = begin;
+            own->end = end;
+            pthread_mutex_unlock(&own->lock);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void* worker_main(void* data) {
+    Worker* worker = data;
+    ThreadPool* pool = worker->pool;
+    int task;
+
+    do {
+        while (pop_task(&pool->queues[worker->id], &task)) {
+            pool->fn(pool->arg, task, worker->id);
+        }
+    } while (steal_tasks(pool, worker->id));
+    return NULL;
+}
+
+int thread_pool_run(int workers, int task_count, ThreadPoolTask fn, void* arg) {
+    if (task_count <= 0) return 0;
+    if (workers > task_count) workers = task_count;
+    if (workers < 1) workers = 1;
+
+    ThreadPool pool = { NULL, workers, fn, arg };
+    pool.queues = malloc(sizeof(WorkQueue) * workers);
+    Worker* threads = malloc(sizeof(Worker) * workers);
+    if (!pool.queues || !threads) {
+        free(pool.queues);
+        free(threads);
+        for (int i = 0; i < task_count; i++) fn(arg, i, 0);
+        return 1;
+    }
+
+    for (int i = 0; i < workers; i++) {
+        pthread_mutex_init(&pool.queues[i].lock, NULL);
+        pool.queues[i].begin = (int)((long long)task_count * i / workers);
+        pool.queues[i].end = (int)((long long)task_count * (i + 1) / workers);
+        threads[i].pool = &pool;
+        threads[i].id = i;
+    }
+
+    /* A worker that fails to start leaves its share to be stolen */
+    int started = 0;
+    for (int i = 1; i < workers; i++) {
+        if (pthread_create(&threads[i].thread, NULL, worker_main, &threads[i]) != 0) break;
+        started = i;
+    }
+    worker_main(&threads[0]);
+    for (int i = 1; i <= started; i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
+
+    for (int i = 0; i < workers; i++) {
+        pthread_mutex_destroy(&pool.queues[i].lock);
+    }
+    free(pool.queues);
+    free(threads);
+    return (workers > 1 && started == 0) ? 1 : 0;
+}
+
+int thread_pool_default_workers(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
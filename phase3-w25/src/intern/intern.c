@@ -0,0 +1,98 @@
+/* intern.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/intern.h"
+
+#define INTERN_INITIAL_SLOTS 256
+
+void intern_init(InternPool* pool, Arena* text_arena) {
+    pool->slots = NULL;
+    pool->slot_capacity = 0;
+    pool->names = NULL;
+    pool->count = 0;
+    pool->name_capacity = 0;
+    pool->text_arena = text_arena;
+}
+
+void intern_release(InternPool* pool) {
+    free(pool->slots);
+    free(pool->names);
+    intern_init(pool, pool->text_arena);
+}
+
+/* FNV-1a over the name's bytes */
+static unsigned int hash_text(const char* text, int length) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static int grow_slots(InternPool* pool) {
+    int capacity = pool->slot_capacity ? pool->slot_capacity * 2 : INTERN_INITIAL_SLOTS;
+    int* slots = calloc(capacity, sizeof(int));
+    if (!slots) return 0;
+
+    unsigned int mask = (unsigned int)capacity - 1;
+    for (int id = 1; id <= pool->count; id++) {
+        unsigned int index = pool->names[id - 1].hash & mask;
+        while (slots[index]) index = (index + 1) & mask;
+        slots[index] = id;
+    }
+    free(pool->slots);
+    pool->slots = slots;
+    pool->slot_capacity = capacity;
+    return 1;
+}
+
+static int add_name(InternPool* pool, const char* text, int length, unsigned int hash) {
+    if (pool->count == pool->name_capacity) {
+        int capacity = pool->name_capacity ? pool->name_capacity * 2 : INTERN_INITIAL_SLOTS / 2;
+        InternName* names = realloc(pool->names, sizeof(InternName) * capacity);
+        if (!names) return 0;
+        pool->names = names;
+        pool->name_capacity = capacity;
+    }
+    if (pool->text_arena) {
+        char* copy = arena_alloc(pool->text_arena, length);
+        if (!copy) return 0;
+        memcpy(copy, text, length);
+        text = copy;
+    }
+    InternName* name = &pool->names[pool->count];
+    name->text = text;
+    name->length = length;
+    name->hash = hash;
+    return ++pool->count;
+}
+
+int intern(InternPool* pool, const char* text, int length) {
+    if ((pool->count + 1) * 2 > pool->slot_capacity && !grow_slots(pool)) {
+        return 0;
+    }
+
+    unsigned int hash = hash_text(text, length);
+    unsigned int mask = (unsigned int)pool->slot_capacity - 1;
+    unsigned int index = hash & mask;
+    int id;
+    while ((id = pool->slots[index]) != 0) {
+        const InternName* name = &pool->names[id - 1];
+        if (name->hash == hash && name->length == length && memcmp(name->text, text, length) == 0) {
+            return id;
+        }
+        index = (index + 1) & mask;
+    }
+
+    id = add_name(pool, text, length, hash);
+    if (id) pool->slots[index] = id;
+    return id;
+}
+
+const char* intern_text(const InternPool* pool, int id, int* length) {
+    const InternName* name = &pool->names[id - 1];
+    if (length) *length = name->length;
+    return name->text;
+}
@@ -0,0 +1,383 @@
+/* interpreter.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/interpreter.h"
+#include "../../include/jit.h"
+#include "../../include/ast_walk.h"
+
+/* Expressions nested deeper than this are finished on ast_walk's stack
+   instead of the C stack */
+#define MAX_EVALUATE_DEPTH 256
+
+typedef struct {
+    Value* frame;           // One cell per scalar, consecutive cells per array
+    int* lengths;           // Array length by first cell, 0 for scalars
+    FILE* out;
+    Jit* jit;               // Compiles hot loops, or NULL
+    Value* values;          // Operand stack of evaluate_deep
+    size_t value_count;
+    size_t value_capacity;
+    int failed;             // Set by the first runtime error; stops execution
+} Interpreter;
+
+static Value runtime_error(Interpreter* interp, const char* message, int line) {
+    if (!interp->failed) {
+        fprintf(interp->out, "Runtime Error at line %d: %s\n", line, message);
+        interp->failed = 1;
+    }
+    return 0;
+}
+
+typedef struct {
+    int frame_size;
+    int* lengths;           // Filled on the second walk
+} FrameLayout;
+
+/* Layout walk: every declaration owns cells from its slot on. Declarations
+   are statements, so expressions, however deep, are not entered. */
+static int measure_declaration(AstWalker* walker, AstWalkFrame* frame) {
+    FrameLayout* layout = walker->data;
+    ASTNode* node = frame->node;
+    switch (node->type) {
+        case AST_VARDECL:
+        case AST_ARRAYDECL:
+            if (node->left && node->left->slot >= 0) {
+                int cells = 1;
+                if (node->type == AST_ARRAYDECL) {
+                    cells = (int)ast_number_value(node->right);
+                    if (layout->lengths) layout->lengths[node->left->slot] = cells;
+                }
+                if (node->left->slot + cells > layout->frame_size) {
+                    layout->frame_size = node->left->slot + cells;
+                }
+            }
+            return AST_WALK_SKIP;
+        case AST_PROGRAM:
+        case AST_BLOCK:
+        case AST_IF:
+        case AST_WHILE:
+        case AST_REPEAT:
+            return AST_WALK_CONTINUE;
+        default:
+            return AST_WALK_SKIP;
+    }
+}
+
+int program_frame_layout(ASTNode* program, int* frame_size, int** lengths) {
+    FrameLayout layout = {0, NULL};
+    AstWalker walker;
+    ast_walker_init(&walker, measure_declaration, NULL, &layout);
+    int failed = ast_walk(&walker, program, 0, 1);
+    if (!failed) {
+        layout.lengths = calloc(layout.frame_size > 0 ? layout.frame_size : 1, sizeof(int));
+        failed = !layout.lengths || ast_walk(&walker, program, 0, 1);
+    }
+    ast_walker_release(&walker);
+    if (failed) {
+        free(layout.lengths);
+        return 1;
+    }
+    *frame_size = layout.frame_size;
+    *lengths = layout.lengths;
+    return 0;
+}
+
+/* Cell of an array element, or NULL after reporting a bad index */
+static Value* element(Interpreter* interp, ASTNode* access, Value index) {
+    int base = access->left->slot;
+    if (index < 0 || index >= interp->lengths[base]) {
+        runtime_error(interp, "Array index out of bounds", access->token.line);
+        return NULL;
+    }
+    return &interp->frame[base + index];
+}
+
+static Value factorial(Value n) {
+    unsigned long long result = 1;
+    for (Value i = 2; i <= n; i++) {
+        result *= (unsigned long long)i;
+    }
+    return (Value)result;
+}
+
+static Value binary_operation(Interpreter* interp, ASTNode* node, Value left, Value right) {
+    switch (node->op) {
+        case BINOP_LESS:      return left < right;
+        case BINOP_GREATER:   return left > right;
+        case BINOP_EQUAL:     return left == right;
+        case BINOP_NOT_EQUAL: return left != right;
+        case BINOP_ADD: return (Value)((unsigned long long)left + (unsigned long long)right);
+        case BINOP_SUB: return (Value)((unsigned long long)left - (unsigned long long)right);
+        case BINOP_MUL: return (Value)((unsigned long long)left * (unsigned long long)right);
+        case BINOP_DIV:
+            if (right == 0) return runtime_error(interp, "Division by zero", node->token.line);
+            /* The one overflowing quotient wraps like the other operators */
+            if (right == -1) return (Value)(0ULL - (unsigned long long)left);
+            return left / right;
+        default: break;
+    }
+    return runtime_error(interp, "Unknown operator", node->token.line);
+}
+
+static Value checked_factorial(Interpreter* interp, ASTNode* node, Value n) {
+    if (n < 0) return runtime_error(interp, "Factorial of a negative number", node->token.line);
+    return factorial(n);
+}
+
+static Value evaluate_deep(Interpreter* interp, ASTNode* node);
+
+static Value evaluate_at(Interpreter* interp, ASTNode* node, int depth) {
+    if (depth > MAX_EVALUATE_DEPTH) return evaluate_deep(interp, node);
+    switch (node->type) {
+        case AST_NUMBER:
+            return ast_number_value(node);
+        case AST_IDENTIFIER:
+            return interp->frame[node->slot];
+        case AST_ARRAYACCESS: {
+            Value index = evaluate_at(interp, node->right, depth + 1);
+            if (interp->failed) return 0;
+            Value* cell = element(interp, node, index);
+            return cell ? *cell : 0;
+        }
+        case AST_FACTORIAL:
+            return checked_factorial(interp, node, evaluate_at(interp, node->left, depth + 1));
+        case AST_BINOP: {
+            Value left = evaluate_at(interp, node->left, depth + 1);
+            Value right = evaluate_at(interp, node->right, depth + 1);
+            if (interp->failed) return 0;
+            return binary_operation(interp, node, left, right);
+        }
+        default:
+            return runtime_error(interp, "Invalid expression", node->token.line);
+    }
+}
+
+static Value evaluate(Interpreter* interp, ASTNode* node) {
+    return evaluate_at(interp, node, 0);
+}
+
+static void push_value(Interpreter* interp, Value value) {
+    if (interp->value_count == interp->value_capacity) {
+        size_t capacity = interp->value_capacity ? interp->value_capacity * 2 : 64;
+        Value* values = realloc(interp->values, sizeof(Value) * capacity);
+        if (!values) {
+            if (!interp->failed) fprintf(interp->out, "Error: Memory allocation failed\n");
+            interp->failed = 1;
+            return;
+        }
+        interp->values = values;
+        interp->value_capacity = capacity;
+    }
+    interp->values[interp->value_count++] = value;
+}
+
+static Value pop_value(Interpreter* interp) {
+    return interp->value_count > 0 ? interp->values[--interp->value_count] : 0;
+}
+
+/* Operands are pushed on the way up and taken by their parent. A frame's
+   value is 1 for the name of an array access, which has no value, and 2
+   for a node skipped after a runtime error, which stands for 0. */
+static int evaluate_enter(AstWalker* walker, AstWalkFrame* frame) {
+    Interpreter* interp = walker->data;
+    AstWalkFrame* parent = ast_walk_parent(walker);
+    if (parent && parent->node->type == AST_ARRAYACCESS && frame->node == parent->node->left) {
+        frame->value = 1;
+        return AST_WALK_SKIP;
+    }
+    if (interp->failed) {
+        frame->value = 2;
+        return AST_WALK_SKIP;
+    }
+    return AST_WALK_CONTINUE;
+}
+
+static int evaluate_leave(AstWalker* walker, AstWalkFrame* frame) {
+    Interpreter* interp = walker->data;
+    ASTNode* node = frame->node;
+    Value value = 0;
+    if (frame->value == 1) return 0;
+    if (frame->value == 0) {
+        switch (node->type) {
+            case AST_NUMBER:
+                value = ast_number_value(node);
+                break;
+            case AST_IDENTIFIER:
+                value = interp->frame[node->slot];
+                break;
+            case AST_ARRAYACCESS: {
+                Value index = pop_value(interp);
+                Value* cell = interp->failed ? NULL : element(interp, node, index);
+                value = cell ? *cell : 0;
+                break;
+            }
+            case AST_FACTORIAL: {
+                Value n = pop_value(interp);
+                value = interp->failed ? 0 : checked_factorial(interp, node, n);
+                break;
+            }
+            case AST_BINOP: {
+                Value right = pop_value(interp);
+                Value left = pop_value(interp);
+                value = interp->failed ? 0 : binary_operation(interp, node, left, right);
+                break;
+            }
+            default:
+                value = runtime_error(interp, "Invalid expression", node->token.line);
+        }
+    }
+    push_value(interp, value);
+    return 0;
+}
+
+/* Evaluates a deeply nested expression, such as a long chain a + b + ... + z,
+   without recursing */
+static Value evaluate_deep(Interpreter* interp, ASTNode* node) {
+    AstWalker walker;
+    ast_walker_init(&walker, evaluate_enter, evaluate_leave, interp);
+    size_t base = interp->value_count;
+    if (ast_walk(&walker, node, 0, 0) != 0) interp->failed = 1;
+    ast_walker_release(&walker);
+    Value value = interp->value_count > base ? interp->values[interp->value_count - 1] : 0;
+    interp->value_count = base;
+    return interp->failed ? 0 : value;
+}
+
+static void execute(Interpreter* interp, ASTNode* node);
+
+/* Hands the rest of a hot loop to the JIT; returns 1 if it ran there */
+static int run_compiled(Interpreter* interp, ASTNode* loop) {
+    if (!interp->jit || interp->failed) return 0;
+    int line;
+    const char* message;
+    JitStatus status = jit_run_loop(interp->jit, loop, interp->frame, interp->lengths, &line, &message);
+    if (status == JIT_UNSUPPORTED) return 0;
+    if (status == JIT_FAILED) runtime_error(interp, message, line);
+    return 1;
+}
+
+/* Runs a block's statements, which hang off its 'next' pointer */
+static void execute_body(Interpreter* interp, ASTNode* body) {
+    if (!body) return;
+    if (body->type != AST_BLOCK) {
+        execute(interp, body);
+        return;
+    }
+    for (ASTNode* stmt = body->next; stmt && !interp->failed; stmt = stmt->next) {
+        execute(interp, stmt);
+    }
+}
+
+static void execute(Interpreter* interp, ASTNode* node) {
+    switch (node->type) {
+        case AST_VARDECL:
+            interp->frame[node->left->slot] = 0;
+            break;
+        case AST_ARRAYDECL: {
+            int base = node->left->slot;
+            for (int i = 0; i < interp->lengths[base]; i++) {
+                interp->frame[base + i] = 0;
+            }
+            break;
+        }
+        case AST_ASSIGN: {
+            Value value = evaluate(interp, node->right);
+            if (interp->failed) break;
+            if (node->left->type == AST_ARRAYACCESS) {
+                Value index = evaluate(interp, node->left->right);
+                if (interp->failed) break;
+                Value* cell = element(interp, node->left, index);
+                if (cell) *cell = value;
+            } else {
+                interp->frame[node->left->slot] = value;
+            }
+            break;
+        }
+        case AST_IF:
+            if (evaluate(interp, node->left) && !interp->failed) {
+                execute_body(interp, node->right);
+            }
+            break;
+        case AST_WHILE: {
+            int iterations = 0;
+            while (!interp->failed && evaluate(interp, node->left) && !interp->failed) {
+                execute_body(interp, node->right);
+                if (++iterations == JIT_HOT_ITERATIONS && run_compiled(interp, node)) break;
+            }
+            break;
+        }
+        case AST_REPEAT: {
+            /* Checked after the condition, so compiled code resumes with the body */
+            int iterations = 0;
+            for (;;) {
+                execute_body(interp, node->right);
+                if (interp->failed || evaluate(interp, node->left) || interp->failed) break;
+                if (++iterations == JIT_HOT_ITERATIONS && run_compiled(interp, node)) break;
+            }
+            break;
+        }
+        case AST_PRINT: {
+            Value value = evaluate(interp, node->left);
+            if (!interp->failed) fprintf(interp->out, "%lld\n", value);
+            break;
+        }
+        case AST_FACTORIAL:
+            evaluate(interp, node);
+            break;
+        case AST_BLOCK:
+            execute_body(interp, node);
+            break;
+        default:
+            runtime_error(interp, "Invalid statement", node->token.line);
+    }
+}
+
+static int run(ASTNode* program, FILE* out, Jit* jit) {
+    Interpreter interp;
+    int frame_size;
+    if (program_frame_layout(program, &frame_size, &interp.lengths) != 0) {
+        fprintf(out, "Error: Memory allocation failed\n");
+        return 1;
+    }
+    interp.frame = calloc(frame_size > 0 ? frame_size : 1, sizeof(Value));
+    if (!interp.frame) {
+        fprintf(out, "Error: Memory allocation failed\n");
+        free(interp.lengths);
+        return 1;
+    }
+    interp.out = out;
+    interp.jit = jit;
+    interp.values = NULL;
+    interp.value_count = 0;
+    interp.value_capacity = 0;
+    interp.failed = 0;
+
+    for (ASTNode* stmt = program->next; stmt && !interp.failed; stmt = stmt->next) {
+        execute(&interp, stmt);
+    }
+
+    free(interp.frame);
+    free(interp.lengths);
+    free(interp.values);
+    return interp.failed;
+}
+
+int interpret(ASTNode* program, FILE* out) {
+    return run(program, out, NULL);
+}
+
+int interpret_jit(ASTNode* program, FILE* out, JitStats* stats) {
+    Jit* jit = jit_create(out);
+    int status = run(program, out, jit);
+    if (stats) {
+        if (jit) {
+            jit_get_stats(jit, stats);
+        } else {
+            memset(stats, 0, sizeof(JitStats));
+        }
+    }
+    jit_free(jit);
+    return status;
+}
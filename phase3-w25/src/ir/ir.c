@@ -0,0 +1,370 @@
+/* ir.c */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/ir.h"
+
+static const int opcode_operands[IR_OPCODE_COUNT] = {
+#define IR_OPERANDS(name, operands, value) operands,
+    IR_OPCODES(IR_OPERANDS)
+#undef IR_OPERANDS
+};
+
+static const int opcode_values[IR_OPCODE_COUNT] = {
+#define IR_VALUE(name, operands, value) value,
+    IR_OPCODES(IR_VALUE)
+#undef IR_VALUE
+};
+
+static const char* opcode_names[IR_OPCODE_COUNT] = {
+#define IR_NAME(name, operands, value) #name,
+    IR_OPCODES(IR_NAME)
+#undef IR_NAME
+};
+
+int ir_opcode_operands(IrOpcode op) {
+    return opcode_operands[op];
+}
+
+int ir_opcode_has_value(IrOpcode op) {
+    return opcode_values[op];
+}
+
+const char* ir_opcode_name(IrOpcode op) {
+    return opcode_names[op];
+}
+
+/* Grows an int list to hold one more entry; returns 0 if out of memory */
+static int reserve(int** items, int count, int* capacity) {
+    if (count < *capacity) return 1;
+    int grown = *capacity ? *capacity * 2 : 4;
+    int* resized = realloc(*items, sizeof(int) * grown);
+    if (!resized) return 0;
+    *items = resized;
+    *capacity = grown;
+    return 1;
+}
+
+int ir_add_block(IrProgram* ir) {
+    if (ir->block_count == ir->block_capacity) {
+        int capacity = ir->block_capacity ? ir->block_capacity * 2 : 16;
+        IrBlock* blocks = realloc(ir->blocks, sizeof(IrBlock) * capacity);
+        if (!blocks) {
+            ir->failed = 1;
+            return -1;
+        }
+        ir->blocks = blocks;
+        ir->block_capacity = capacity;
+    }
+    IrBlock* block = &ir->blocks[ir->block_count];
+    memset(block, 0, sizeof(IrBlock));
+    block->rpo_index = -1;
+    block->idom = -1;
+    ir->analyses = 0;
+    return ir->block_count++;
+}
+
+int ir_add_instr(IrProgram* ir, int block, IrOpcode op, int line) {
+    if (ir->failed || block < 0) return -1;
+    if (ir->instr_count == ir->instr_capacity) {
+        int capacity = ir->instr_capacity ? ir->instr_capacity * 2 : 256;
+        IrInstr* instrs = realloc(ir->instrs, sizeof(IrInstr) * capacity);
+        if (!instrs) {
+            ir->failed = 1;
+            return -1;
+        }
+        ir->instrs = instrs;
+        ir->instr_capacity = capacity;
+    }
+    IrBlock* b = &ir->blocks[block];
+    if (!reserve(&b->instrs, b->count, &b->capacity)) {
+        ir->failed = 1;
+        return -1;
+    }
+    int id = ir->instr_count++;
+    IrInstr* instr = &ir->instrs[id];
+    memset(instr, 0, sizeof(IrInstr));
+    instr->op = op;
+    instr->block = block;
+    instr->line = line;
+    instr->args[0] = instr->args[1] = -1;
+    instr->targets[0] = instr->targets[1] = -1;
+    instr->forward = -1;
+    b->instrs[b->count++] = id;
+    return id;
+}
+
+void ir_add_edge(IrProgram* ir, int from, int to) {
+    IrBlock* b = &ir->blocks[to];
+    if (!reserve(&b->preds, b->pred_count, &b->pred_capacity)) {
+        ir->failed = 1;
+        return;
+    }
+    b->preds[b->pred_count++] = from;
+    ir->analyses = 0;
+}
+
+/* Drops one from -> to edge, with the matching operand of every phi */
+void ir_remove_edge(IrProgram* ir, int from, int to) {
+    IrBlock* b = &ir->blocks[to];
+    int index = 0;
+    while (index < b->pred_count && b->preds[index] != from) index++;
+    if (index == b->pred_count) return;
+
+    for (int i = 0; i < b->count; i++) {
+        IrInstr* phi = &ir->instrs[b->instrs[i]];
+        if (phi->op != IR_PHI) break;
+        if (phi->block < 0) continue;
+        memmove(&phi->phi_args[index], &phi->phi_args[index + 1], sizeof(int) * (b->pred_count - index - 1));
+    }
+    memmove(&b->preds[index], &b->preds[index + 1], sizeof(int) * (b->pred_count - index - 1));
+    b->pred_count--;
+    ir->analyses = 0;
+}
+
+int ir_successors(const IrProgram* ir, int block, int succs[2]) {
+    const IrBlock* b = &ir->blocks[block];
+    if (b->count == 0) return 0;
+    const IrInstr* last = &ir->instrs[b->instrs[b->count - 1]];
+    switch (last->op) {
+        case IR_JUMP:
+            succs[0] = last->targets[0];
+            return 1;
+        case IR_BRANCH:
+            succs[0] = last->targets[0];
+            succs[1] = last->targets[1];
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+/* The value that now stands for 'value', following replacements */
+int ir_value(const IrProgram* ir, int value) {
+    while (value >= 0 && ir->instrs[value].forward >= 0) {
+        value = ir->instrs[value].forward;
+    }
+    return value;
+}
+
+/* Deletes 'value'; its uses read 'replacement' from now on */
+void ir_replace(IrProgram* ir, int value, int replacement) {
+    IrInstr* instr = &ir->instrs[value];
+    instr->forward = replacement;
+    instr->block = -1;
+}
+
+/* A phi whose operands are all one value (or the phi itself) is that value.
+   Removing one phi can make another trivial, so this runs to a fixpoint.
+   Returns the number of phis removed. */
+int ir_remove_trivial_phis(IrProgram* ir) {
+    int removed = 0;
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int id = 0; id < ir->instr_count; id++) {
+            IrInstr* phi = &ir->instrs[id];
+            if (phi->op != IR_PHI || phi->block < 0) continue;
+            int pred_count = ir->blocks[phi->block].pred_count;
+            int same = -1;
+            int trivial = 1;
+            for (int i = 0; i < pred_count; i++) {
+                int arg = ir_value(ir, phi->phi_args[i]);
+                phi->phi_args[i] = arg;
+                if (arg == id || arg == same) continue;
+                if (same >= 0) {
+                    trivial = 0;
+                    break;
+                }
+                same = arg;
+            }
+            if (!trivial || same < 0) continue;
+            ir_replace(ir, id, same);
+            removed++;
+            changed = 1;
+        }
+    }
+    return removed;
+}
+
+/* Drops deleted instructions from their blocks and points every operand at
+   the value it was replaced by */
+void ir_cleanup(IrProgram* ir) {
+    for (int b = 0; b < ir->block_count; b++) {
+        IrBlock* block = &ir->blocks[b];
+        int kept = 0;
+        for (int i = 0; i < block->count; i++) {
+            int id = block->instrs[i];
+            IrInstr* instr = &ir->instrs[id];
+            if (block->dead || instr->block != b) continue;
+            for (int a = 0; a < opcode_operands[instr->op]; a++) {
+                instr->args[a] = ir_value(ir, instr->args[a]);
+            }
+            if (instr->op == IR_PHI) {
+                for (int p = 0; p < block->pred_count; p++) {
+                    instr->phi_args[p] = ir_value(ir, instr->phi_args[p]);
+                }
+            }
+            block->instrs[kept++] = id;
+        }
+        block->count = kept;
+    }
+}
+
+void ir_free(IrProgram* ir) {
+    for (int i = 0; i < ir->instr_count; i++) {
+        free(ir->instrs[i].phi_args);
+    }
+    for (int b = 0; b < ir->block_count; b++) {
+        free(ir->blocks[b].instrs);
+        free(ir->blocks[b].preds);
+    }
+    free(ir->instrs);
+    free(ir->blocks);
+    free(ir->rpo);
+    memset(ir, 0, sizeof(IrProgram));
+}
+
+/* Successors are visited last-first so that a branch's taken side is
+   ordered before the code after it */
+int ir_reverse_postorder(const IrProgram* ir, int* order) {
+    char* visited = calloc(ir->block_count, 1);
+    int* stack = malloc(sizeof(int) * ir->block_count);
+    if (!visited || !stack) {
+        free(visited);
+        free(stack);
+        return 0;
+    }
+    int count = 0;
+    int depth = 0;
+    int post = ir->block_count;
+    stack[depth++] = 0;
+    visited[0] = 1;
+    while (depth > 0) {
+        int block = stack[depth - 1];
+        int succs[2];
+        int n = ir_successors(ir, block, succs);
+        int next = -1;
+        for (int i = n - 1; i >= 0; i--) {
+            if (!visited[succs[i]]) {
+                next = succs[i];
+                break;
+            }
+        }
+        if (next < 0) {
+            order[--post] = block;
+            count++;
+            depth--;
+            continue;
+        }
+        visited[next] = 1;
+        stack[depth++] = next;
+    }
+    memmove(order, order + post, sizeof(int) * count);
+    free(visited);
+    free(stack);
+    return count;
+}
+
+static void print_instr(IrProgram* ir, int id, FILE* out) {
+    IrInstr* instr = &ir->instrs[id];
+    const char* name = opcode_names[instr->op];
+    fprintf(out, "  ");
+    if (opcode_values[instr->op]) fprintf(out, "%%%d = ", id);
+    for (const char* c = name; *c; c++) fputc(tolower((unsigned char)*c), out);
+    switch (instr->op) {
+        case IR_CONST:
+            fprintf(out, " %lld", instr->imm);
+            break;
+        case IR_PHI: {
+            IrBlock* block = &ir->blocks[instr->block];
+            for (int i = 0; i < block->pred_count; i++) {
+                fprintf(out, "%s[%%%d, b%d]", i ? ", " : " ", instr->phi_args[i], block->preds[i]);
+            }
+            fprintf(out, "  ; slot %d", instr->base);
+            break;
+        }
+        case IR_LOAD_ELEM:
+            fprintf(out, " @%d[%%%d]  ; length %d", instr->base, instr->args[0], instr->length);
+            break;
+        case IR_STORE_ELEM:
+            fprintf(out, " @%d[%%%d], %%%d  ; length %d", instr->base, instr->args[0], instr->args[1], instr->length);
+            break;
+        case IR_CLEAR:
+            fprintf(out, " @%d  ; length %d", instr->base, instr->length);
+            break;
+        case IR_JUMP:
+            fprintf(out, " b%d", instr->targets[0]);
+            break;
+        case IR_BRANCH:
+            fprintf(out, " %%%d, b%d, b%d", instr->args[0], instr->targets[0], instr->targets[1]);
+            break;
+        default:
+            for (int i = 0; i < opcode_operands[instr->op]; i++) {
+                fprintf(out, "%s%%%d", i ? ", " : " ", instr->args[i]);
+            }
+    }
+    fprintf(out, "\n");
+}
+
+void ir_print(IrProgram* ir, FILE* out) {
+    int* order = malloc(sizeof(int) * (ir->block_count > 0 ? ir->block_count : 1));
+    if (!order) return;
+    int count = ir->block_count > 0 ? ir_reverse_postorder(ir, order) : 0;
+    int instrs = 0;
+    for (int i = 0; i < count; i++) {
+        instrs += ir->blocks[order[i]].count;
+    }
+    fprintf(out, "IR: %d blocks, %d instructions, %d memory cells\n", count, instrs, ir->frame_size);
+    for (int i = 0; i < count; i++) {
+        IrBlock* block = &ir->blocks[order[i]];
+        fprintf(out, "b%d:", order[i]);
+        for (int p = 0; p < block->pred_count; p++) {
+            fprintf(out, "%s b%d", p ? "," : "  ; preds", block->preds[p]);
+        }
+        fprintf(out, "\n");
+        for (int j = 0; j < block->count; j++) {
+            print_instr(ir, block->instrs[j], out);
+        }
+    }
+    free(order);
+}
+
+/* Appends block 'from' to block 'into', which must end in a jump to it and be
+   its only predecessor. 'from' is left dead. */
+void ir_merge_blocks(IrProgram* ir, int into, int from) {
+    IrBlock* source = &ir->blocks[from];
+    IrBlock* target = &ir->blocks[into];
+    /* The jump into 'from' is replaced by the moved code */
+    ir->instrs[target->instrs[target->count - 1]].block = -1;
+    for (int i = 0; i < source->count; i++) {
+        int id = source->instrs[i];
+        IrInstr* instr = &ir->instrs[id];
+        if (instr->block != from) continue;
+        if (instr->op == IR_PHI) {
+            ir_replace(ir, id, instr->phi_args[0]);
+            continue;
+        }
+        if (!reserve(&target->instrs, target->count, &target->capacity)) {
+            ir->failed = 1;
+            return;
+        }
+        target->instrs[target->count++] = id;
+        instr->block = into;
+    }
+
+    int succs[2];
+    int n = ir_successors(ir, into, succs);
+    for (int s = 0; s < n; s++) {
+        IrBlock* succ = &ir->blocks[succs[s]];
+        for (int p = 0; p < succ->pred_count; p++) {
+            if (succ->preds[p] == from) succ->preds[p] = into;
+        }
+    }
+    source->count = 0;
+    source->pred_count = 0;
+    source->dead = 1;
+    ir->analyses = 0;
+}
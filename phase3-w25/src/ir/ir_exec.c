@@ -0,0 +1,128 @@
+/* ir_exec.c */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../../include/ir.h"
+
+static int runtime_error(FILE* out, const char* message, int line) {
+    fprintf(out, "Runtime Error at line %d: %s\n", line, message);
+    return 1;
+}
+
+static Value factorial(Value n) {
+    unsigned long long result = 1;
+    for (Value i = 2; i <= n; i++) {
+        result *= (unsigned long long)i;
+    }
+    return (Value)result;
+}
+
+/* Takes the edge pred -> block: the block's phis all read their operand for
+   that edge before any of them is written */
+static void enter_block(const IrProgram* ir, int block, int pred, Value* values, Value* scratch) {
+    const IrBlock* b = &ir->blocks[block];
+    int index = 0;
+    while (index < b->pred_count && b->preds[index] != pred) index++;
+    int phis = 0;
+    while (phis < b->count && ir->instrs[b->instrs[phis]].op == IR_PHI) {
+        scratch[phis] = values[ir->instrs[b->instrs[phis]].phi_args[index]];
+        phis++;
+    }
+    for (int i = 0; i < phis; i++) {
+        values[b->instrs[i]] = scratch[i];
+    }
+}
+
+int ir_execute(const IrProgram* ir, FILE* out) {
+    Value* values = calloc(ir->instr_count > 0 ? ir->instr_count : 1, sizeof(Value));
+    Value* scratch = malloc(sizeof(Value) * (ir->instr_count > 0 ? ir->instr_count : 1));
+    Value* frame = calloc(ir->frame_size > 0 ? ir->frame_size : 1, sizeof(Value));
+    if (!values || !scratch || !frame) {
+        fprintf(out, "Error: Memory allocation failed\n");
+        free(values);
+        free(scratch);
+        free(frame);
+        return 1;
+    }
+
+    int failed = 0;
+    int block = 0;
+    int pred = -1;
+    while (!failed) {
+        if (pred >= 0) enter_block(ir, block, pred, values, scratch);
+        const IrBlock* b = &ir->blocks[block];
+        int next = -1;
+        for (int i = 0; i < b->count && !failed; i++) {
+            int id = b->instrs[i];
+            const IrInstr* instr = &ir->instrs[id];
+            Value left = instr->args[0] >= 0 ? values[instr->args[0]] : 0;
+            Value right = instr->args[1] >= 0 ? values[instr->args[1]] : 0;
+            unsigned long long a = (unsigned long long)left;
+            unsigned long long c = (unsigned long long)right;
+            switch (instr->op) {
+                case IR_CONST:  values[id] = instr->imm; break;
+                case IR_PHI:    break;
+                case IR_ADD:    values[id] = (Value)(a + c); break;
+                case IR_SUB:    values[id] = (Value)(a - c); break;
+                case IR_MUL:    values[id] = (Value)(a * c); break;
+                case IR_DIV:
+                    if (right == 0) {
+                        failed = runtime_error(out, "Division by zero", instr->line);
+                    } else {
+                        values[id] = right == -1 ? (Value)(0ULL - a) : left / right;
+                    }
+                    break;
+                case IR_LT:     values[id] = left < right; break;
+                case IR_GT:     values[id] = left > right; break;
+                case IR_EQ:     values[id] = left == right; break;
+                case IR_NE:     values[id] = left != right; break;
+                case IR_FACTORIAL:
+                    if (left < 0) {
+                        failed = runtime_error(out, "Factorial of a negative number", instr->line);
+                    } else {
+                        values[id] = factorial(left);
+                    }
+                    break;
+                case IR_LOAD_ELEM:
+                    if (left < 0 || left >= instr->length) {
+                        failed = runtime_error(out, "Array index out of bounds", instr->line);
+                    } else {
+                        values[id] = frame[instr->base + left];
+                    }
+                    break;
+                case IR_STORE_ELEM:
+                    if (left < 0 || left >= instr->length) {
+                        failed = runtime_error(out, "Array index out of bounds", instr->line);
+                    } else {
+                        frame[instr->base + left] = right;
+                    }
+                    break;
+                case IR_CLEAR:
+                    for (int cell = 0; cell < instr->length; cell++) {
+                        frame[instr->base + cell] = 0;
+                    }
+                    break;
+                case IR_PRINT:
+                    fprintf(out, "%lld\n", left);
+                    break;
+                case IR_JUMP:
+                    next = instr->targets[0];
+                    break;
+                case IR_BRANCH:
+                    next = instr->targets[left ? 0 : 1];
+                    break;
+                case IR_RETURN:
+                case IR_OPCODE_COUNT:
+                    break;
+            }
+        }
+        if (next < 0) break;
+        pred = block;
+        block = next;
+    }
+
+    free(values);
+    free(scratch);
+    free(frame);
+    return failed;
+}
@@ -0,0 +1,486 @@
+/* lower.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/ir.h"
+#include "../../include/ast_walk.h"
+
+/* Scalar variables are renamed into SSA values as the structured AST is
+   walked. 'defs' holds each variable's current value; every write is also
+   logged with the value it replaced, so the end of an if-body can tell
+   which variables it changed and give them phis in the join block. Loops
+   get header phis up front for the variables their body assigns. */
+typedef struct {
+    int slot;
+    int previous;
+} DefLog;
+
+typedef struct {
+    IrProgram* ir;
+    int* lengths;           // Array length by first slot, 0 for scalars
+    int* defs;              // Current value of each slot, -1 if out of scope
+    DefLog* log;
+    int log_count;
+    int log_capacity;
+    int* marks;             // Per-slot stamps for set operations
+    int stamp;
+    int current;            // Block being filled
+    int* values;            // Operand stack of lower_expression
+    int value_count;
+    int value_capacity;
+    int failed;
+} Lowering;
+
+static int emit(Lowering* l, IrOpcode op, int line) {
+    int id = ir_add_instr(l->ir, l->current, op, line);
+    if (id < 0) l->failed = 1;
+    return id;
+}
+
+static int emit_constant(Lowering* l, Value value, int line) {
+    int id = emit(l, IR_CONST, line);
+    if (id >= 0) l->ir->instrs[id].imm = value;
+    return id;
+}
+
+static int emit_binary(Lowering* l, IrOpcode op, int left, int right, int line) {
+    int id = emit(l, op, line);
+    if (id >= 0) {
+        l->ir->instrs[id].args[0] = left;
+        l->ir->instrs[id].args[1] = right;
+    }
+    return id;
+}
+
+static int new_block(Lowering* l) {
+    int block = ir_add_block(l->ir);
+    if (block < 0) l->failed = 1;
+    return block;
+}
+
+/* Ends the current block with a jump */
+static void emit_jump(Lowering* l, int target, int line) {
+    int id = emit(l, IR_JUMP, line);
+    if (id < 0) return;
+    l->ir->instrs[id].targets[0] = target;
+    ir_add_edge(l->ir, l->current, target);
+}
+
+static void emit_branch(Lowering* l, int cond, int when_true, int when_false, int line) {
+    int id = emit(l, IR_BRANCH, line);
+    if (id < 0) return;
+    IrInstr* instr = &l->ir->instrs[id];
+    instr->args[0] = cond;
+    instr->targets[0] = when_true;
+    instr->targets[1] = when_false;
+    ir_add_edge(l->ir, l->current, when_true);
+    ir_add_edge(l->ir, l->current, when_false);
+}
+
+static void write_variable(Lowering* l, int slot, int value) {
+    if (l->log_count == l->log_capacity) {
+        int capacity = l->log_capacity ? l->log_capacity * 2 : 64;
+        DefLog* log = realloc(l->log, sizeof(DefLog) * capacity);
+        if (!log) {
+            l->failed = 1;
+            return;
+        }
+        l->log = log;
+        l->log_capacity = capacity;
+    }
+    l->log[l->log_count].slot = slot;
+    l->log[l->log_count].previous = l->defs[slot];
+    l->log_count++;
+    l->defs[slot] = value;
+}
+
+static int read_variable(Lowering* l, int slot, int line) {
+    if (l->defs[slot] >= 0) return l->defs[slot];
+    /* Semantic analysis rules this out; memory starts zeroed */
+    return emit_constant(l, 0, line);
+}
+
+/* A phi in the current block for 'slot', with room for 'preds' operands */
+static int emit_phi(Lowering* l, int slot, int preds, int line) {
+    int id = emit(l, IR_PHI, line);
+    if (id < 0) return -1;
+    int* args = malloc(sizeof(int) * preds);
+    if (!args) {
+        l->failed = 1;
+        return -1;
+    }
+    for (int i = 0; i < preds; i++) args[i] = -1;
+    l->ir->instrs[id].phi_args = args;
+    l->ir->instrs[id].base = slot;
+    return id;
+}
+
+static void push_value(Lowering* l, int value) {
+    if (l->value_count == l->value_capacity) {
+        int capacity = l->value_capacity ? l->value_capacity * 2 : 64;
+        int* values = realloc(l->values, sizeof(int) * capacity);
+        if (!values) {
+            l->failed = 1;
+            return;
+        }
+        l->values = values;
+        l->value_capacity = capacity;
+    }
+    l->values[l->value_count++] = value;
+}
+
+static int pop_value(Lowering* l) {
+    return l->value_count > 0 ? l->values[--l->value_count] : -1;
+}
+
+/* Expressions are lowered on ast_walk's stack, since a long chain such as
+   a + b + ... + z nests as deep as it is long. Each node pushes its value
+   on the way up and operators pop their operands'. The name of an
+   accessed array is not an operand. */
+static int lower_enter(AstWalker* walker, AstWalkFrame* frame) {
+    AstWalkFrame* parent = ast_walk_parent(walker);
+    if (parent && parent->node->type == AST_ARRAYACCESS && frame->node == parent->node->left) {
+        frame->value = 1;
+        return AST_WALK_SKIP;
+    }
+    switch (frame->node->type) {
+        case AST_ARRAYACCESS:
+        case AST_FACTORIAL:
+        case AST_BINOP:
+            return AST_WALK_CONTINUE;
+        default:
+            return AST_WALK_SKIP;
+    }
+}
+
+static int lower_leave(AstWalker* walker, AstWalkFrame* frame) {
+    Lowering* l = walker->data;
+    ASTNode* node = frame->node;
+    int line = node->token.line;
+    int id;
+    if (frame->value) return 0;
+    switch (node->type) {
+        case AST_NUMBER:
+            id = emit_constant(l, ast_number_value(node), line);
+            break;
+        case AST_IDENTIFIER:
+            id = read_variable(l, node->slot, line);
+            break;
+        case AST_ARRAYACCESS: {
+            int index = pop_value(l);
+            id = emit(l, IR_LOAD_ELEM, line);
+            if (id >= 0) {
+                IrInstr* instr = &l->ir->instrs[id];
+                instr->args[0] = index;
+                instr->base = node->left->slot;
+                instr->length = l->lengths[node->left->slot];
+            }
+            break;
+        }
+        case AST_FACTORIAL: {
+            int n = pop_value(l);
+            id = emit(l, IR_FACTORIAL, line);
+            if (id >= 0) l->ir->instrs[id].args[0] = n;
+            break;
+        }
+        case AST_BINOP: {
+            int right = pop_value(l);
+            int left = pop_value(l);
+            IrOpcode op;
+            switch (node->op) {
+                case BINOP_LESS:      op = IR_LT; break;
+                case BINOP_GREATER:   op = IR_GT; break;
+                case BINOP_EQUAL:     op = IR_EQ; break;
+                case BINOP_NOT_EQUAL: op = IR_NE; break;
+                case BINOP_ADD:       op = IR_ADD; break;
+                case BINOP_SUB:       op = IR_SUB; break;
+                case BINOP_MUL:       op = IR_MUL; break;
+                default:              op = IR_DIV; break;
+            }
+            id = emit_binary(l, op, left, right, line);
+            break;
+        }
+        default:
+            id = emit_constant(l, 0, line);
+            break;
+    }
+    push_value(l, id);
+    return 0;
+}
+
+static int lower_expression(Lowering* l, ASTNode* node) {
+    AstWalker walker;
+    ast_walker_init(&walker, lower_enter, lower_leave, l);
+    int base = l->value_count;
+    if (ast_walk(&walker, node, 0, 0) != 0) l->failed = 1;
+    ast_walker_release(&walker);
+    int id = l->value_count > base ? pop_value(l) : -1;
+    l->value_count = base;
+    return id;
+}
+
+typedef struct {
+    Lowering* l;
+    int* slots;
+    int count;
+    int capacity;
+} AssignedSlots;
+
+/* Collects the scalars a loop body assigns but does not declare: they are
+   the loop-carried variables that need a header phi. Assigned slots are
+   stamped and listed; a declaration in the body negates the stamp. Only
+   statements assign, so the walk skips expressions. */
+static int mark_assigned(AstWalker* walker, AstWalkFrame* frame) {
+    AssignedSlots* assigned = walker->data;
+    Lowering* l = assigned->l;
+    ASTNode* node = frame->node;
+    if (l->failed) return AST_WALK_SKIP;
+    switch (node->type) {
+        case AST_ASSIGN:
+            if (node->left && node->left->type == AST_IDENTIFIER) {
+                int slot = node->left->slot;
+                if (l->marks[slot] != l->stamp && l->marks[slot] != -l->stamp) {
+                    if (assigned->count == assigned->capacity) {
+                        assigned->capacity = assigned->capacity ? assigned->capacity * 2 : 8;
+                        int* grown = realloc(assigned->slots, sizeof(int) * assigned->capacity);
+                        if (!grown) {
+                            l->failed = 1;
+                            return AST_WALK_SKIP;
+                        }
+                        assigned->slots = grown;
+                    }
+                    assigned->slots[assigned->count++] = slot;
+                    l->marks[slot] = l->stamp;
+                }
+            }
+            return AST_WALK_SKIP;
+        case AST_VARDECL:
+            if (node->left) l->marks[node->left->slot] = -l->stamp;
+            return AST_WALK_SKIP;
+        case AST_BLOCK:
+        case AST_IF:
+        case AST_WHILE:
+        case AST_REPEAT:
+            return AST_WALK_CONTINUE;
+        default:
+            return AST_WALK_SKIP;
+    }
+}
+
+/* Creates header phis for the loop body's carried variables, with the value
+   on entry as the first operand. Returns how many; 'phis' is malloc'd. */
+static int loop_phis(Lowering* l, ASTNode* body, int** phis, int line) {
+    AssignedSlots assigned = {l, NULL, 0, 0};
+    AstWalker walker;
+    ast_walker_init(&walker, mark_assigned, NULL, &assigned);
+    l->stamp++;
+    if (ast_walk(&walker, body, 0, 1) != 0) l->failed = 1;
+    ast_walker_release(&walker);
+    *phis = assigned.slots;
+    int count = assigned.count;
+    int kept = 0;
+    for (int i = 0; i < count && !l->failed; i++) {
+        int slot = (*phis)[i];
+        if (l->marks[slot] != l->stamp || l->defs[slot] < 0) continue;
+        int phi = emit_phi(l, slot, 2, line);
+        if (phi < 0) break;
+        l->ir->instrs[phi].phi_args[0] = l->defs[slot];
+        write_variable(l, slot, phi);
+        (*phis)[kept++] = phi;
+    }
+    return kept;
+}
+
+/* Fills in the back-edge operand of each loop phi */
+static void close_loop_phis(Lowering* l, int* phis, int count) {
+    for (int i = 0; i < count; i++) {
+        IrInstr* phi = &l->ir->instrs[phis[i]];
+        phi->phi_args[1] = l->defs[phi->base];
+    }
+}
+
+/* Joins the then-path (the writes logged since 'mark') with the path that
+   skipped it. The join block's predecessors are [skip, then]. */
+static void join_if(Lowering* l, int mark, int line) {
+    int entries = l->log_count - mark;
+    DefLog* changed = malloc(sizeof(DefLog) * (entries > 0 ? entries : 1));
+    if (!changed) {
+        l->failed = 1;
+        return;
+    }
+    /* Undo the writes newest first; the first entry seen for a slot is where
+       its value at the end of the then-path is still current */
+    int count = 0;
+    l->stamp++;
+    for (int i = l->log_count - 1; i >= mark; i--) {
+        int slot = l->log[i].slot;
+        if (l->marks[slot] != l->stamp) {
+            l->marks[slot] = l->stamp;
+            changed[count].slot = slot;
+            changed[count].previous = l->defs[slot];
+            count++;
+        }
+        l->defs[slot] = l->log[i].previous;
+    }
+    l->log_count = mark;
+
+    for (int i = 0; i < count; i++) {
+        int slot = changed[i].slot;
+        int then_value = changed[i].previous;
+        int skip_value = l->defs[slot];
+        /* Declared inside the body, or unchanged: nothing to join */
+        if (skip_value < 0 || skip_value == then_value) continue;
+        int phi = emit_phi(l, slot, 2, line);
+        if (phi < 0) break;
+        l->ir->instrs[phi].phi_args[0] = skip_value;
+        l->ir->instrs[phi].phi_args[1] = then_value;
+        write_variable(l, slot, phi);
+    }
+    free(changed);
+}
+
+static void lower_statement(Lowering* l, ASTNode* node);
+
+static void lower_body(Lowering* l, ASTNode* body) {
+    if (!body) return;
+    if (body->type != AST_BLOCK) {
+        lower_statement(l, body);
+        return;
+    }
+    for (ASTNode* stmt = body->next; stmt && !l->failed; stmt = stmt->next) {
+        lower_statement(l, stmt);
+    }
+}
+
+static void lower_statement(Lowering* l, ASTNode* node) {
+    int line = node->token.line;
+    switch (node->type) {
+        case AST_VARDECL:
+            write_variable(l, node->left->slot, emit_constant(l, 0, line));
+            break;
+        case AST_ARRAYDECL: {
+            int id = emit(l, IR_CLEAR, line);
+            if (id >= 0) {
+                l->ir->instrs[id].base = node->left->slot;
+                l->ir->instrs[id].length = l->lengths[node->left->slot];
+            }
+            break;
+        }
+        case AST_ASSIGN: {
+            int value = lower_expression(l, node->right);
+            if (node->left->type == AST_ARRAYACCESS) {
+                ASTNode* access = node->left;
+                int index = lower_expression(l, access->right);
+                int id = emit_binary(l, IR_STORE_ELEM, index, value, access->token.line);
+                if (id >= 0) {
+                    l->ir->instrs[id].base = access->left->slot;
+                    l->ir->instrs[id].length = l->lengths[access->left->slot];
+                }
+            } else {
+                write_variable(l, node->left->slot, value);
+            }
+            break;
+        }
+        case AST_IF: {
+            int cond = lower_expression(l, node->left);
+            int then_block = new_block(l);
+            int join = new_block(l);
+            emit_branch(l, cond, then_block, join, line);
+            int mark = l->log_count;
+            l->current = then_block;
+            lower_body(l, node->right);
+            emit_jump(l, join, line);
+            l->current = join;
+            join_if(l, mark, line);
+            break;
+        }
+        case AST_WHILE: {
+            int header = new_block(l);
+            emit_jump(l, header, line);
+            l->current = header;
+            int* phis;
+            int count = loop_phis(l, node->right, &phis, line);
+            int cond = lower_expression(l, node->left);
+            int body = new_block(l);
+            int exit = new_block(l);
+            emit_branch(l, cond, body, exit, line);
+            l->current = body;
+            lower_body(l, node->right);
+            emit_jump(l, header, line);
+            close_loop_phis(l, phis, count);
+            /* The loop leaves from the header, where the phis hold */
+            for (int i = 0; i < count; i++) {
+                write_variable(l, l->ir->instrs[phis[i]].base, phis[i]);
+            }
+            free(phis);
+            l->current = exit;
+            break;
+        }
+        case AST_REPEAT: {
+            int body = new_block(l);
+            emit_jump(l, body, line);
+            l->current = body;
+            int* phis;
+            int count = loop_phis(l, node->right, &phis, line);
+            lower_body(l, node->right);
+            int cond = lower_expression(l, node->left);
+            int exit = new_block(l);
+            emit_branch(l, cond, exit, body, line);
+            close_loop_phis(l, phis, count);
+            free(phis);
+            l->current = exit;
+            break;
+        }
+        case AST_PRINT: {
+            int value = lower_expression(l, node->left);
+            int id = emit(l, IR_PRINT, line);
+            if (id >= 0) l->ir->instrs[id].args[0] = value;
+            break;
+        }
+        case AST_FACTORIAL:
+            lower_expression(l, node);
+            break;
+        case AST_BLOCK:
+            lower_body(l, node);
+            break;
+        default:
+            break;
+    }
+}
+
+int ir_lower(ASTNode* program, IrProgram* ir) {
+    Lowering l;
+    memset(ir, 0, sizeof(IrProgram));
+    memset(&l, 0, sizeof(Lowering));
+    l.ir = ir;
+    if (program_frame_layout(program, &ir->frame_size, &l.lengths) != 0) {
+        return 1;
+    }
+    int cells = ir->frame_size > 0 ? ir->frame_size : 1;
+    l.defs = malloc(sizeof(int) * cells);
+    l.marks = calloc(cells, sizeof(int));
+    if (!l.defs || !l.marks) {
+        l.failed = 1;
+    } else {
+        for (int i = 0; i < cells; i++) l.defs[i] = -1;
+        l.current = new_block(&l);
+        for (ASTNode* stmt = program->next; stmt && !l.failed; stmt = stmt->next) {
+            lower_statement(&l, stmt);
+        }
+        emit(&l, IR_RETURN, program->token.line);
+    }
+
+    free(l.lengths);
+    free(l.defs);
+    free(l.marks);
+    free(l.log);
+    free(l.values);
+    if (l.failed || ir->failed) {
+        ir_free(ir);
+        return 1;
+    }
+    ir_remove_trivial_phis(ir);
+    ir_cleanup(ir);
+    return 0;
+}
@@ -0,0 +1,670 @@
+/* passes.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../include/ir.h"
+
+/* A pass either computes an analysis (provides) or transforms the IR. run
+   returns 1 if it changed the IR, 0 if not and -1 if it failed. */
+typedef struct {
+    const char* name;
+    const char* description;
+    unsigned requires;      // Analyses that must be valid before it runs
+    unsigned provides;      // Analysis it computes
+    unsigned preserves;     // Analyses still valid after it changes the IR
+    int (*run)(IrProgram* ir, FILE* out);
+} IrPass;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int is_constant(const IrProgram* ir, int value, Value* result) {
+    if (value < 0 || ir->instrs[value].op != IR_CONST) return 0;
+    *result = ir->instrs[value].imm;
+    return 1;
+}
+
+/* Whether block a dominates block b; needs the dominator tree */
+static int dominates(const IrProgram* ir, int a, int b) {
+    const IrBlock* x = &ir->blocks[a];
+    const IrBlock* y = &ir->blocks[b];
+    return x->dom_pre <= y->dom_pre && y->dom_post <= x->dom_post;
+}
+
+/* cfg: reverse postorder of the reachable blocks */
+static int compute_cfg(IrProgram* ir, FILE* out) {
+    (void)out;
+    free(ir->rpo);
+    ir->rpo = malloc(sizeof(int) * (ir->block_count > 0 ? ir->block_count : 1));
+    if (!ir->rpo) {
+        ir->failed = 1;
+        ir->rpo_count = 0;
+        return -1;
+    }
+    ir->rpo_count = ir_reverse_postorder(ir, ir->rpo);
+    for (int b = 0; b < ir->block_count; b++) {
+        ir->blocks[b].rpo_index = -1;
+    }
+    for (int i = 0; i < ir->rpo_count; i++) {
+        ir->blocks[ir->rpo[i]].rpo_index = i;
+    }
+    return 0;
+}
+
+/* domtree: immediate dominators by the Cooper-Harvey-Kennedy iteration over
+   reverse postorder, then a pre/post numbering of the tree */
+static int compute_domtree(IrProgram* ir, FILE* out) {
+    (void)out;
+    IrBlock* blocks = ir->blocks;
+    for (int b = 0; b < ir->block_count; b++) {
+        blocks[b].idom = -1;
+    }
+    if (ir->rpo_count == 0) return 0;
+    int entry = ir->rpo[0];
+    blocks[entry].idom = entry;
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i = 1; i < ir->rpo_count; i++) {
+            IrBlock* block = &blocks[ir->rpo[i]];
+            int idom = -1;
+            for (int p = 0; p < block->pred_count; p++) {
+                int pred = block->preds[p];
+                if (blocks[pred].idom < 0) continue;
+                if (idom < 0) {
+                    idom = pred;
+                    continue;
+                }
+                int a = pred;
+                int b = idom;
+                while (a != b) {
+                    while (blocks[a].rpo_index > blocks[b].rpo_index) a = blocks[a].idom;
+                    while (blocks[b].rpo_index > blocks[a].rpo_index) b = blocks[b].idom;
+                }
+                idom = a;
+            }
+            if (idom != block->idom) {
+                block->idom = idom;
+                changed = 1;
+            }
+        }
+    }
+
+    /* Children lists, then an iterative depth-first numbering */
+    int* cursor = malloc(sizeof(int) * ir->block_count);
+    int* stack = malloc(sizeof(int) * ir->block_count);
+    if (!cursor || !stack) {
+        free(cursor);
+        free(stack);
+        ir->failed = 1;
+        return -1;
+    }
+    for (int b = 0; b < ir->block_count; b++) {
+        blocks[b].dom_child = -1;
+        blocks[b].dom_sibling = -1;
+        blocks[b].dom_pre = 1;
+        blocks[b].dom_post = 0;
+    }
+    for (int i = ir->rpo_count - 1; i > 0; i--) {
+        int b = ir->rpo[i];
+        blocks[b].dom_sibling = blocks[blocks[b].idom].dom_child;
+        blocks[blocks[b].idom].dom_child = b;
+    }
+    blocks[entry].idom = -1;
+
+    int counter = 0;
+    int depth = 0;
+    stack[depth++] = entry;
+    cursor[entry] = blocks[entry].dom_child;
+    blocks[entry].dom_pre = counter++;
+    while (depth > 0) {
+        int b = stack[depth - 1];
+        int child = cursor[b];
+        if (child < 0) {
+            blocks[b].dom_post = counter++;
+            depth--;
+            continue;
+        }
+        cursor[b] = blocks[child].dom_sibling;
+        cursor[child] = blocks[child].dom_child;
+        blocks[child].dom_pre = counter++;
+        stack[depth++] = child;
+    }
+    free(cursor);
+    free(stack);
+    return 0;
+}
+
+static Value factorial(Value n) {
+    unsigned long long result = 1;
+    for (Value i = 2; i <= n; i++) {
+        result *= (unsigned long long)i;
+    }
+    return (Value)result;
+}
+
+/* Evaluates an operator on constants; 0 if it would trap */
+static int evaluate(IrOpcode op, Value left, Value right, Value* result) {
+    unsigned long long a = (unsigned long long)left;
+    unsigned long long b = (unsigned long long)right;
+    switch (op) {
+        case IR_ADD: *result = (Value)(a + b); return 1;
+        case IR_SUB: *result = (Value)(a - b); return 1;
+        case IR_MUL: *result = (Value)(a * b); return 1;
+        case IR_DIV:
+            if (right == 0) return 0;
+            *result = right == -1 ? (Value)(0ULL - a) : left / right;
+            return 1;
+        case IR_LT: *result = left < right; return 1;
+        case IR_GT: *result = left > right; return 1;
+        case IR_EQ: *result = left == right; return 1;
+        case IR_NE: *result = left != right; return 1;
+        case IR_FACTORIAL:
+            if (left < 0) return 0;
+            /* From 66! on the product has 64 factors of two */
+            *result = left >= 66 ? 0 : factorial(left);
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static void make_constant(IrInstr* instr, Value value) {
+    instr->op = IR_CONST;
+    instr->imm = value;
+    instr->args[0] = instr->args[1] = -1;
+}
+
+/* fold: evaluates operators on constants, applies x+0, x-0, x*1, x*0 and
+   x/1, and turns branches on a constant into jumps */
+static int fold(IrProgram* ir, FILE* out) {
+    (void)out;
+    int changed = 0;
+    for (int i = 0; i < ir->rpo_count; i++) {
+        int b = ir->rpo[i];
+        for (int j = 0; j < ir->blocks[b].count; j++) {
+            int id = ir->blocks[b].instrs[j];
+            IrInstr* instr = &ir->instrs[id];
+            if (instr->block != b) continue;
+            int operands = ir_opcode_operands(instr->op);
+            for (int a = 0; a < operands; a++) {
+                instr->args[a] = ir_value(ir, instr->args[a]);
+            }
+            Value left = 0, right = 0, result;
+            int left_constant = operands > 0 && is_constant(ir, instr->args[0], &left);
+            int right_constant = operands > 1 && is_constant(ir, instr->args[1], &right);
+
+            if (instr->op == IR_BRANCH) {
+                if (!left_constant) continue;
+                int taken = instr->targets[left ? 0 : 1];
+                int dropped = instr->targets[left ? 1 : 0];
+                instr->op = IR_JUMP;
+                instr->args[0] = -1;
+                instr->targets[0] = taken;
+                instr->targets[1] = -1;
+                ir_remove_edge(ir, b, dropped);
+                changed = 1;
+                continue;
+            }
+            if (instr->op < IR_ADD || instr->op > IR_FACTORIAL) continue;
+
+            if (left_constant && (instr->op == IR_FACTORIAL || right_constant)) {
+                if (evaluate(instr->op, left, right_constant ? right : 0, &result)) {
+                    make_constant(instr, result);
+                    changed = 1;
+                }
+                continue;
+            }
+            int keep = -1;
+            switch (instr->op) {
+                case IR_ADD:
+                    if (right_constant && right == 0) keep = instr->args[0];
+                    else if (left_constant && left == 0) keep = instr->args[1];
+                    break;
+                case IR_SUB:
+                    if (right_constant && right == 0) keep = instr->args[0];
+                    break;
+                case IR_MUL:
+                    if ((right_constant && right == 0) || (left_constant && left == 0)) {
+                        make_constant(instr, 0);
+                        changed = 1;
+                    } else if (right_constant && right == 1) {
+                        keep = instr->args[0];
+                    } else if (left_constant && left == 1) {
+                        keep = instr->args[1];
+                    }
+                    break;
+                case IR_DIV:
+                    if (right_constant && right == 1) keep = instr->args[0];
+                    break;
+                default:
+                    break;
+            }
+            if (keep >= 0) {
+                ir_replace(ir, id, keep);
+                changed = 1;
+            }
+        }
+    }
+    if (changed) ir_remove_trivial_phis(ir);
+    return changed;
+}
+
+/* simplify-cfg: deletes unreachable blocks and merges a block into its
+   predecessor when that is its only way in and the predecessor only jumps */
+static int simplify_cfg(IrProgram* ir, FILE* out) {
+    (void)out;
+    int changed = 0;
+    for (int b = 0; b < ir->block_count; b++) {
+        IrBlock* block = &ir->blocks[b];
+        if (block->dead || block->rpo_index >= 0) continue;
+        int succs[2];
+        int n = ir_successors(ir, b, succs);
+        for (int s = 0; s < n; s++) {
+            ir_remove_edge(ir, b, succs[s]);
+        }
+        for (int i = 0; i < block->count; i++) {
+            ir->instrs[block->instrs[i]].block = -1;
+        }
+        block->count = 0;
+        block->pred_count = 0;
+        block->dead = 1;
+        changed = 1;
+    }
+    if (changed) ir_remove_trivial_phis(ir);
+
+    int merged = 1;
+    while (merged && !ir->failed) {
+        merged = 0;
+        for (int b = 1; b < ir->block_count; b++) {
+            IrBlock* block = &ir->blocks[b];
+            if (block->dead || block->pred_count != 1) continue;
+            int pred = block->preds[0];
+            int succs[2];
+            if (pred == b || ir_successors(ir, pred, succs) != 1) continue;
+            ir_merge_blocks(ir, pred, b);
+            merged = changed = 1;
+        }
+    }
+    return changed;
+}
+
+/* cse: replaces an operation by an identical one that dominates it.
+   Trapping operators qualify too: if the first one trapped, the second is
+   never reached. Array loads are left alone since memory can change. The
+   dominator tree is walked depth first with a scoped hash table, so only
+   operations in dominating blocks are ever visible. */
+static unsigned long long cse_hash(const IrInstr* instr) {
+    unsigned long long h = (unsigned long long)instr->op;
+    h = h * 0x100000001B3ULL ^ (unsigned)instr->args[0];
+    h = h * 0x100000001B3ULL ^ (unsigned)instr->args[1];
+    h = h * 0x100000001B3ULL ^ (unsigned long long)instr->imm;
+    /* splitmix64 finaliser, so the low bits used for the index mix well */
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBULL;
+    return h ^ (h >> 31);
+}
+
+static int cse_equal(const IrInstr* a, const IrInstr* b) {
+    return a->op == b->op && a->args[0] == b->args[0] && a->args[1] == b->args[1] && a->imm == b->imm;
+}
+
+/* Numbers the operations of one block; returns 1 if any was replaced.
+   Slots filled are pushed on 'scope' so they can be emptied afterwards. */
+static int cse_block(IrProgram* ir, int b, int* table, int mask, int* scope, int* scope_count) {
+    int changed = 0;
+    for (int j = 0; j < ir->blocks[b].count; j++) {
+        int id = ir->blocks[b].instrs[j];
+        IrInstr* instr = &ir->instrs[id];
+        if (instr->block != b) continue;
+        for (int a = 0; a < ir_opcode_operands(instr->op); a++) {
+            instr->args[a] = ir_value(ir, instr->args[a]);
+        }
+        if (instr->op != IR_CONST && (instr->op < IR_ADD || instr->op > IR_FACTORIAL)) continue;
+        if ((instr->op == IR_ADD || instr->op == IR_MUL || instr->op == IR_EQ || instr->op == IR_NE) &&
+            instr->args[0] > instr->args[1]) {
+            int swap = instr->args[0];
+            instr->args[0] = instr->args[1];
+            instr->args[1] = swap;
+        }
+
+        int index = (int)(cse_hash(instr) & (unsigned long long)mask);
+        while (table[index] >= 0 && !cse_equal(&ir->instrs[table[index]], instr)) {
+            index = (index + 1) & mask;
+        }
+        if (table[index] >= 0) {
+            ir_replace(ir, id, table[index]);
+            changed = 1;
+        } else {
+            table[index] = id;
+            scope[(*scope_count)++] = index;
+        }
+    }
+    return changed;
+}
+
+static int cse(IrProgram* ir, FILE* out) {
+    (void)out;
+    int capacity = 16;
+    while (capacity < ir->instr_count * 2) capacity *= 2;
+    int* table = malloc(sizeof(int) * capacity);
+    int* scope = malloc(sizeof(int) * (ir->instr_count > 0 ? ir->instr_count : 1));
+    /* Per open block: its child cursor and where its table entries start */
+    int* stack = malloc(sizeof(int) * 3 * (ir->block_count > 0 ? ir->block_count : 1));
+    if (!table || !scope || !stack) {
+        free(table);
+        free(scope);
+        free(stack);
+        ir->failed = 1;
+        return -1;
+    }
+    for (int i = 0; i < capacity; i++) table[i] = -1;
+
+    int changed = 0;
+    int scope_count = 0;
+    int depth = 0;
+    if (ir->rpo_count > 0) {
+        int entry = ir->rpo[0];
+        stack[0] = entry;
+        stack[1] = ir->blocks[entry].dom_child;
+        stack[2] = scope_count;
+        depth = 1;
+        changed |= cse_block(ir, entry, table, capacity - 1, scope, &scope_count);
+    }
+    while (depth > 0) {
+        int* top = &stack[(depth - 1) * 3];
+        int child = top[1];
+        if (child < 0) {
+            /* Leaving the subtree: its entries go out of scope, newest first */
+            while (scope_count > top[2]) table[scope[--scope_count]] = -1;
+            depth--;
+            continue;
+        }
+        top[1] = ir->blocks[child].dom_sibling;
+        int* next = &stack[depth * 3];
+        next[0] = child;
+        next[1] = ir->blocks[child].dom_child;
+        next[2] = scope_count;
+        depth++;
+        changed |= cse_block(ir, child, table, capacity - 1, scope, &scope_count);
+    }
+    free(table);
+    free(scope);
+    free(stack);
+    if (changed) ir_remove_trivial_phis(ir);
+    return changed;
+}
+
+/* Whether an instruction must stay even if its value is unused */
+static int has_effect(const IrProgram* ir, const IrInstr* instr) {
+    Value value;
+    switch (instr->op) {
+        case IR_STORE_ELEM:
+        case IR_CLEAR:
+        case IR_PRINT:
+        case IR_JUMP:
+        case IR_BRANCH:
+        case IR_RETURN:
+            return 1;
+        case IR_DIV:
+            return !is_constant(ir, instr->args[1], &value) || value == 0;
+        case IR_FACTORIAL:
+            return !is_constant(ir, instr->args[0], &value) || value < 0;
+        case IR_LOAD_ELEM:
+            return !is_constant(ir, instr->args[0], &value) || value < 0 || value >= instr->length;
+        default:
+            return 0;
+    }
+}
+
+/* dce: deletes instructions whose values are never used and that cannot
+   trap or touch memory */
+static int dce(IrProgram* ir, FILE* out) {
+    (void)out;
+    char* live = calloc(ir->instr_count > 0 ? ir->instr_count : 1, 1);
+    int* worklist = malloc(sizeof(int) * (ir->instr_count > 0 ? ir->instr_count : 1));
+    if (!live || !worklist) {
+        free(live);
+        free(worklist);
+        ir->failed = 1;
+        return -1;
+    }
+    int count = 0;
+    for (int id = 0; id < ir->instr_count; id++) {
+        IrInstr* instr = &ir->instrs[id];
+        if (instr->block >= 0 && has_effect(ir, instr)) {
+            live[id] = 1;
+            worklist[count++] = id;
+        }
+    }
+    while (count > 0) {
+        IrInstr* instr = &ir->instrs[worklist[--count]];
+        int operands = ir_opcode_operands(instr->op);
+        for (int a = 0; a < operands; a++) {
+            int value = ir_value(ir, instr->args[a]);
+            if (!live[value]) {
+                live[value] = 1;
+                worklist[count++] = value;
+            }
+        }
+        if (instr->op == IR_PHI) {
+            for (int p = 0; p < ir->blocks[instr->block].pred_count; p++) {
+                int value = ir_value(ir, instr->phi_args[p]);
+                if (!live[value]) {
+                    live[value] = 1;
+                    worklist[count++] = value;
+                }
+            }
+        }
+    }
+    int changed = 0;
+    for (int id = 0; id < ir->instr_count; id++) {
+        if (ir->instrs[id].block >= 0 && !live[id]) {
+            ir->instrs[id].block = -1;
+            changed = 1;
+        }
+    }
+    free(live);
+    free(worklist);
+    return changed;
+}
+
+static int verify_failed(FILE* out, const char* message, int block, int id) {
+    fprintf(out, "Error: IR verification failed: %s (b%d, %%%d)\n", message, block, id);
+    return -1;
+}
+
+/* Whether 'value' is available at position 'index' of block 'b' */
+static int defined_before(const IrProgram* ir, int value, int b, int index) {
+    if (value < 0 || value >= ir->instr_count) return 0;
+    const IrInstr* def = &ir->instrs[value];
+    if (def->block < 0 || def->forward >= 0 || !ir_opcode_has_value(def->op)) return 0;
+    if (def->block != b) return dominates(ir, def->block, b);
+    for (int i = 0; i < index; i++) {
+        if (ir->blocks[b].instrs[i] == value) return 1;
+    }
+    return 0;
+}
+
+/* verify: block structure, edge lists and the SSA property that every
+   definition dominates its uses */
+static int verify(IrProgram* ir, FILE* out) {
+    for (int i = 0; i < ir->rpo_count; i++) {
+        int b = ir->rpo[i];
+        IrBlock* block = &ir->blocks[b];
+        if (block->count == 0) return verify_failed(out, "empty block", b, -1);
+
+        int in_phis = 1;
+        for (int j = 0; j < block->count; j++) {
+            int id = block->instrs[j];
+            IrInstr* instr = &ir->instrs[id];
+            int terminator = instr->op == IR_JUMP || instr->op == IR_BRANCH || instr->op == IR_RETURN;
+            if (instr->block != b) return verify_failed(out, "instruction listed in the wrong block", b, id);
+            if (terminator != (j == block->count - 1)) return verify_failed(out, "misplaced terminator", b, id);
+            if (instr->op == IR_PHI) {
+                if (!in_phis) return verify_failed(out, "phi after other instructions", b, id);
+                for (int p = 0; p < block->pred_count; p++) {
+                    int pred = block->preds[p];
+                    if (ir->blocks[pred].rpo_index < 0) continue;
+                    if (!defined_before(ir, instr->phi_args[p], pred, ir->blocks[pred].count)) {
+                        return verify_failed(out, "phi operand does not reach its edge", b, id);
+                    }
+                }
+                continue;
+            }
+            in_phis = 0;
+            for (int a = 0; a < ir_opcode_operands(instr->op); a++) {
+                if (!defined_before(ir, instr->args[a], b, j)) {
+                    return verify_failed(out, "operand does not dominate its use", b, id);
+                }
+            }
+        }
+
+        /* Every edge appears once in the successor's predecessor list */
+        int succs[2];
+        int n = ir_successors(ir, b, succs);
+        for (int s = 0; s < n; s++) {
+            IrBlock* succ = &ir->blocks[succs[s]];
+            int edges = 0;
+            int listed = 0;
+            for (int t = 0; t < n; t++) edges += succs[t] == succs[s];
+            for (int p = 0; p < succ->pred_count; p++) listed += succ->preds[p] == b;
+            if (succ->dead || edges != listed) return verify_failed(out, "edge missing from predecessor list", b, -1);
+        }
+        for (int p = 0; p < block->pred_count; p++) {
+            int pred = block->preds[p];
+            int found = 0;
+            n = ir_successors(ir, pred, succs);
+            for (int s = 0; s < n; s++) found |= succs[s] == b;
+            if (ir->blocks[pred].dead || !found) return verify_failed(out, "predecessor without an edge", b, -1);
+        }
+    }
+    return 0;
+}
+
+static const IrPass passes[] = {
+    {"cfg", "reverse postorder of the reachable blocks (analysis)",
+     0, IR_ANALYSIS_CFG, 0, compute_cfg},
+    {"domtree", "dominator tree (analysis)",
+     IR_ANALYSIS_CFG, IR_ANALYSIS_DOMTREE, 0, compute_domtree},
+    {"fold", "constant folding and algebraic identities; constant branches become jumps",
+     IR_ANALYSIS_CFG, 0, 0, fold},
+    {"simplify-cfg", "remove unreachable blocks and merge straight-line blocks",
+     IR_ANALYSIS_CFG, 0, 0, simplify_cfg},
+    {"cse", "dominator-based common subexpression elimination",
+     IR_ANALYSIS_DOMTREE, 0, IR_ANALYSIS_CFG | IR_ANALYSIS_DOMTREE, cse},
+    {"dce", "dead code elimination",
+     0, 0, IR_ANALYSIS_CFG | IR_ANALYSIS_DOMTREE, dce},
+    {"verify", "check block structure and SSA dominance",
+     IR_ANALYSIS_DOMTREE, 0, IR_ANALYSIS_CFG | IR_ANALYSIS_DOMTREE, verify},
+};
+
+#define PASS_COUNT ((int)(sizeof(passes) / sizeof(passes[0])))
+
+typedef struct {
+    double seconds[PASS_COUNT];
+    int runs[PASS_COUNT];
+    FILE* out;
+} PassRun;
+
+static int find_pass(const char* name, size_t length) {
+    for (int i = 0; i < PASS_COUNT; i++) {
+        if (strlen(passes[i].name) == length && strncmp(passes[i].name, name, length) == 0) return i;
+    }
+    return -1;
+}
+
+/* Runs one pass, first computing any analysis it needs that is not valid */
+static int run_pass(IrProgram* ir, int index, PassRun* run) {
+    const IrPass* pass = &passes[index];
+    for (int i = 0; i < PASS_COUNT; i++) {
+        if ((pass->requires & passes[i].provides) && !(ir->analyses & passes[i].provides)) {
+            if (run_pass(ir, i, run) < 0) return -1;
+        }
+    }
+
+    double start = now_seconds();
+    int status = pass->run(ir, run->out);
+    if (status > 0) ir_cleanup(ir);
+    run->seconds[index] += now_seconds() - start;
+    run->runs[index]++;
+
+    if (ir->failed) {
+        fprintf(run->out, "Error: Memory allocation failed\n");
+        return -1;
+    }
+    if (status < 0) return -1;
+    if (pass->provides) {
+        ir->analyses |= pass->provides;
+    } else if (status > 0) {
+        ir->analyses &= pass->preserves;
+    }
+    return 0;
+}
+
+static void dump(IrProgram* ir, const IrPassOptions* options, const char* name) {
+    if (!options->dump_after) return;
+    if (strcmp(options->dump_after, "all") != 0 && strcmp(options->dump_after, name) != 0) return;
+    fprintf(options->out, "\n; IR after %s\n", name);
+    ir_print(ir, options->out);
+}
+
+void ir_list_passes(FILE* out) {
+    fprintf(out, "IR passes (default pipeline: %s):\n", IR_DEFAULT_PIPELINE);
+    for (int i = 0; i < PASS_COUNT; i++) {
+        fprintf(out, "  %-14s %s\n", passes[i].name, passes[i].description);
+    }
+}
+
+int ir_run_passes(IrProgram* ir, const IrPassOptions* options) {
+    const char* pipeline = options->pipeline ? options->pipeline : IR_DEFAULT_PIPELINE;
+    PassRun run;
+    memset(&run, 0, sizeof(run));
+    run.out = options->out;
+
+    /* Check every name before running anything */
+    for (const char* name = pipeline; *name; ) {
+        size_t length = strcspn(name, ",");
+        if (length > 0 && find_pass(name, length) < 0) {
+            fprintf(options->out, "Error: Unknown IR pass '%.*s'\n", (int)length, name);
+            ir_list_passes(options->out);
+            return 1;
+        }
+        name += length;
+        if (*name == ',') name++;
+    }
+
+    dump(ir, options, "lower");
+    int status = 0;
+    for (const char* name = pipeline; *name && status == 0; ) {
+        size_t length = strcspn(name, ",");
+        if (length > 0) {
+            int index = find_pass(name, length);
+            status = run_pass(ir, index, &run);
+            if (status == 0) dump(ir, options, passes[index].name);
+        }
+        name += length;
+        if (*name == ',') name++;
+    }
+
+    if (options->time_passes) {
+        double total = 0;
+        fprintf(options->out, "\nPass timing:\n");
+        fprintf(options->out, "  %-14s %6s %12s\n", "pass", "runs", "time (ms)");
+        for (int i = 0; i < PASS_COUNT; i++) {
+            if (run.runs[i] == 0) continue;
+            fprintf(options->out, "  %-14s %6d %12.3f\n", passes[i].name, run.runs[i], run.seconds[i] * 1000);
+            total += run.seconds[i];
+        }
+        fprintf(options->out, "  %-14s %6s %12.3f\n", "total", "", total * 1000);
+    }
+    return status != 0;
+}
@@ -0,0 +1,577 @@
+/* jit.c */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "../../include/jit.h"
+
+/* Compiled loops follow the System V ABI: int code(Value* frame, FILE* out).
+   RBX holds the frame and R12 the output stream; expressions are evaluated
+   into RAX, with RCX for the right operand and the machine stack for
+   intermediate values. The result is 0, or 1 + the index of the error site
+   that failed. */
+typedef int (*JitCode)(Value* frame, FILE* out);
+
+/* Loops with expressions nested deeper than this stay interpreted, so
+   compiling an expression never recurses far */
+#define MAX_EXPRESSION_DEPTH 256
+
+typedef struct {
+    int line;
+    const char* message;
+} JitSite;
+
+typedef struct {
+    ASTNode* loop;          // NULL for an empty hash slot
+    JitCode code;           // NULL if the loop could not be compiled
+    void* memory;
+    size_t memory_size;
+    JitSite* sites;
+} JitEntry;
+
+struct Jit {
+    JitEntry* entries;      // Open addressing on the loop node
+    int capacity;
+    int count;
+    FILE* out;
+    JitStats stats;
+};
+
+/* x86-64 condition codes, as the low nibble of Jcc (0F 80+cc) and SETcc */
+enum {
+    CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_S = 0x8,
+    CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF
+};
+
+typedef struct {
+    unsigned char* code;
+    size_t size;
+    size_t capacity;
+    JitSite* sites;
+    int site_count;
+    int site_capacity;
+    size_t* site_jumps;     // rel32 fields that jump to each site's exit stub
+    const int* lengths;
+    int depth;              // Values pushed on the machine stack
+    int nesting;            // Expressions being compiled, innermost last
+    int failed;             // Unsupported construct or out of memory
+} Compiler;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void emit(Compiler* c, const void* bytes, size_t count) {
+    if (c->size + count > c->capacity) {
+        size_t capacity = c->capacity ? c->capacity * 2 : 4096;
+        while (capacity < c->size + count) capacity *= 2;
+        unsigned char* code = realloc(c->code, capacity);
+        if (!code) {
+            c->failed = 1;
+            return;
+        }
+        c->code = code;
+        c->capacity = capacity;
+    }
+    memcpy(c->code + c->size, bytes, count);
+    c->size += count;
+}
+
+#define EMIT(c, ...) do {                                           \
+        static const unsigned char bytes_[] = {__VA_ARGS__};        \
+        emit((c), bytes_, sizeof(bytes_));                          \
+    } while (0)
+
+static void emit_u32(Compiler* c, uint32_t value) {
+    unsigned char bytes[4] = {value, value >> 8, value >> 16, value >> 24};
+    emit(c, bytes, 4);
+}
+
+static void emit_u64(Compiler* c, uint64_t value) {
+    emit_u32(c, (uint32_t)value);
+    emit_u32(c, (uint32_t)(value >> 32));
+}
+
+/* Points the rel32 field at 'at' to 'target' */
+static void patch(Compiler* c, size_t at, size_t target) {
+    if (c->failed) return;
+    uint32_t rel = (uint32_t)(target - (at + 4));
+    for (int i = 0; i < 4; i++) c->code[at + i] = rel >> (8 * i);
+}
+
+/* jcc rel32 (or jmp for cc < 0); returns the rel32 field to patch */
+static size_t emit_jump(Compiler* c, int cc) {
+    if (cc < 0) {
+        EMIT(c, 0xE9);
+    } else {
+        unsigned char jcc[2] = {0x0F, 0x80 | cc};
+        emit(c, jcc, 2);
+    }
+    size_t at = c->size;
+    emit_u32(c, 0);
+    return at;
+}
+
+/* Conditional jump to a new error stub reporting 'message' */
+static void emit_check(Compiler* c, int cc, int line, const char* message) {
+    if (c->site_count == c->site_capacity) {
+        int capacity = c->site_capacity ? c->site_capacity * 2 : 16;
+        JitSite* sites = realloc(c->sites, sizeof(JitSite) * capacity);
+        size_t* jumps = sites ? realloc(c->site_jumps, sizeof(size_t) * capacity) : NULL;
+        if (sites) c->sites = sites;
+        if (!sites || !jumps) {
+            c->failed = 1;
+            return;
+        }
+        c->site_jumps = jumps;
+        c->site_capacity = capacity;
+    }
+    c->sites[c->site_count].line = line;
+    c->sites[c->site_count].message = message;
+    c->site_jumps[c->site_count++] = emit_jump(c, cc);
+}
+
+/* mov rax/rcx, imm */
+static void emit_constant(Compiler* c, int rcx, Value value) {
+    if (value >= INT32_MIN && value <= INT32_MAX) {
+        unsigned char mov[3] = {0x48, 0xC7, rcx ? 0xC1 : 0xC0};
+        emit(c, mov, 3);
+        emit_u32(c, (uint32_t)value);
+    } else {
+        unsigned char movabs[2] = {0x48, rcx ? 0xB9 : 0xB8};
+        emit(c, movabs, 2);
+        emit_u64(c, (uint64_t)value);
+    }
+}
+
+/* Displacement of a cell from RBX. Cells past the reach of a signed
+   disp32 leave the loop interpreted. */
+static void emit_cell_offset(Compiler* c, int slot) {
+    if (slot < 0 || slot > INT32_MAX / 8) {
+        c->failed = 1;
+        return;
+    }
+    emit_u32(c, (uint32_t)(8 * slot));
+}
+
+/* mov rax/rcx, [rbx + 8*slot] */
+static void emit_load_slot(Compiler* c, int rcx, int slot) {
+    unsigned char mov[3] = {0x48, 0x8B, rcx ? 0x8B : 0x83};
+    emit(c, mov, 3);
+    emit_cell_offset(c, slot);
+}
+
+/* mov [rbx + 8*slot], rax */
+static void emit_store_slot(Compiler* c, int slot) {
+    EMIT(c, 0x48, 0x89, 0x83);
+    emit_cell_offset(c, slot);
+}
+
+/* Calls a C function with the stack 16-byte aligned; arguments are already
+   in RDI and RSI */
+static void emit_call(Compiler* c, void* function) {
+    if (c->depth % 2) EMIT(c, 0x48, 0x83, 0xEC, 0x08);      /* sub rsp, 8 */
+    EMIT(c, 0x48, 0xB8);                                    /* mov rax, function */
+    emit_u64(c, (uint64_t)(uintptr_t)function);
+    EMIT(c, 0xFF, 0xD0);                                    /* call rax */
+    if (c->depth % 2) EMIT(c, 0x48, 0x83, 0xC4, 0x08);      /* add rsp, 8 */
+}
+
+static void jit_print(FILE* out, Value value) {
+    fprintf(out, "%lld\n", value);
+}
+
+static Value jit_factorial(Value n) {
+    unsigned long long result = 1;
+    for (Value i = 2; i <= n; i++) {
+        result *= (unsigned long long)i;
+    }
+    return (Value)result;
+}
+
+static int is_simple(const ASTNode* node) {
+    return node->type == AST_NUMBER || (node->type == AST_IDENTIFIER && node->slot >= 0);
+}
+
+/* Loads a number or variable without touching RAX (into RCX) or RCX */
+static void load_simple(Compiler* c, int rcx, ASTNode* node) {
+    if (node->type == AST_NUMBER) {
+        emit_constant(c, rcx, ast_number_value(node));
+    } else {
+        emit_load_slot(c, rcx, node->slot);
+    }
+}
+
+static void compile_expression(Compiler* c, ASTNode* node);
+
+/* Left operand into RAX, right operand into RCX. The interpreter evaluates
+   left first, which only matters when both sides can fail. */
+static void compile_operands(Compiler* c, ASTNode* left, ASTNode* right) {
+    if (is_simple(right)) {
+        compile_expression(c, left);
+        load_simple(c, 1, right);
+    } else if (is_simple(left)) {
+        compile_expression(c, right);
+        EMIT(c, 0x48, 0x89, 0xC1);                          /* mov rcx, rax */
+        load_simple(c, 0, left);
+    } else {
+        compile_expression(c, left);
+        EMIT(c, 0x50);                                      /* push rax */
+        c->depth++;
+        compile_expression(c, right);
+        EMIT(c, 0x48, 0x89, 0xC1);                          /* mov rcx, rax */
+        EMIT(c, 0x58);                                      /* pop rax */
+        c->depth--;
+    }
+}
+
+/* Condition code of a comparison operator, or -1 for arithmetic */
+static int comparison(const ASTNode* node) {
+    switch (node->op) {
+        case BINOP_LESS:      return CC_L;
+        case BINOP_GREATER:   return CC_G;
+        case BINOP_EQUAL:     return CC_E;
+        case BINOP_NOT_EQUAL: return CC_NE;
+        default:              return -1;
+    }
+}
+
+/* Bounds-checks the index in RAX or RCX against an array's length; the
+   unsigned compare also rejects negative indices */
+static void compile_bounds_check(Compiler* c, int rcx, ASTNode* access) {
+    int base = access->left->slot;
+    if (base < 0) {
+        c->failed = 1;
+        return;
+    }
+    if (rcx) {
+        EMIT(c, 0x48, 0x81, 0xF9);                          /* cmp rcx, imm32 */
+    } else {
+        EMIT(c, 0x48, 0x3D);                                /* cmp rax, imm32 */
+    }
+    emit_u32(c, (uint32_t)c->lengths[base]);
+    emit_check(c, CC_AE, access->token.line, "Array index out of bounds");
+}
+
+static void compile_binop(Compiler* c, ASTNode* node) {
+    compile_operands(c, node->left, node->right);
+    int cc = comparison(node);
+    if (cc >= 0) {
+        EMIT(c, 0x48, 0x39, 0xC8);                          /* cmp rax, rcx */
+        unsigned char set[3] = {0x0F, 0x90 | cc, 0xC0};     /* setcc al */
+        emit(c, set, 3);
+        EMIT(c, 0x0F, 0xB6, 0xC0);                          /* movzx eax, al */
+        return;
+    }
+    switch (node->op) {
+        case BINOP_ADD: EMIT(c, 0x48, 0x01, 0xC8); break;       /* add rax, rcx */
+        case BINOP_SUB: EMIT(c, 0x48, 0x29, 0xC8); break;       /* sub rax, rcx */
+        case BINOP_MUL: EMIT(c, 0x48, 0x0F, 0xAF, 0xC1); break; /* imul rax, rcx */
+        case BINOP_DIV:
+            /* Zero traps; -1 negates, so INT64_MIN / -1 wraps instead of
+               raising SIGFPE */
+            EMIT(c, 0x48, 0x85, 0xC9);                      /* test rcx, rcx */
+            emit_check(c, CC_E, node->token.line, "Division by zero");
+            EMIT(c, 0x48, 0x83, 0xF9, 0xFF,                 /* cmp rcx, -1 */
+                    0x75, 0x05,                             /* jne divide */
+                    0x48, 0xF7, 0xD8,                       /* neg rax */
+                    0xEB, 0x05,                             /* jmp done */
+                    0x48, 0x99,                             /* divide: cqo */
+                    0x48, 0xF7, 0xF9);                      /* idiv rcx; done: */
+            break;
+        default:
+            c->failed = 1;
+    }
+}
+
+static void compile_expression(Compiler* c, ASTNode* node) {
+    if (!node || c->failed || c->nesting == MAX_EXPRESSION_DEPTH) {
+        c->failed = 1;
+        return;
+    }
+    c->nesting++;
+    switch (node->type) {
+        case AST_NUMBER:
+        case AST_IDENTIFIER:
+            if (!is_simple(node)) {
+                c->failed = 1;
+                break;
+            }
+            load_simple(c, 0, node);
+            break;
+        case AST_ARRAYACCESS:
+            compile_expression(c, node->right);
+            compile_bounds_check(c, 0, node);
+            EMIT(c, 0x48, 0x8B, 0x84, 0xC3);                /* mov rax, [rbx + rax*8 + disp] */
+            emit_cell_offset(c, node->left->slot);
+            break;
+        case AST_FACTORIAL:
+            compile_expression(c, node->left);
+            EMIT(c, 0x48, 0x85, 0xC0);                      /* test rax, rax */
+            emit_check(c, CC_S, node->token.line, "Factorial of a negative number");
+            EMIT(c, 0x48, 0x89, 0xC7);                      /* mov rdi, rax */
+            emit_call(c, (void*)jit_factorial);
+            break;
+        case AST_BINOP:
+            compile_binop(c, node);
+            break;
+        default:
+            c->failed = 1;
+    }
+    c->nesting--;
+}
+
+/* Jumps when the condition is true (or false, with 'when' = 0); returns the
+   rel32 field to patch */
+static size_t compile_condition(Compiler* c, ASTNode* node, int when) {
+    if (node && node->type == AST_BINOP && comparison(node) >= 0) {
+        compile_operands(c, node->left, node->right);
+        EMIT(c, 0x48, 0x39, 0xC8);                          /* cmp rax, rcx */
+        /* Every condition code's negation differs in the lowest bit */
+        return emit_jump(c, when ? comparison(node) : comparison(node) ^ 1);
+    }
+    compile_expression(c, node);
+    EMIT(c, 0x48, 0x85, 0xC0);                              /* test rax, rax */
+    return emit_jump(c, when ? CC_NE : CC_E);
+}
+
+static void compile_statement(Compiler* c, ASTNode* node);
+
+static void compile_body(Compiler* c, ASTNode* body) {
+    if (!body) return;
+    if (body->type != AST_BLOCK) {
+        compile_statement(c, body);
+        return;
+    }
+    for (ASTNode* stmt = body->next; stmt && !c->failed; stmt = stmt->next) {
+        compile_statement(c, stmt);
+    }
+}
+
+static void compile_statement(Compiler* c, ASTNode* node) {
+    if (c->failed) return;
+    switch (node->type) {
+        case AST_VARDECL:
+            if (!node->left || node->left->slot < 0) {
+                c->failed = 1;
+                break;
+            }
+            EMIT(c, 0x48, 0xC7, 0x83);                      /* mov qword [rbx + disp], 0 */
+            emit_cell_offset(c, node->left->slot);
+            emit_u32(c, 0);
+            break;
+        case AST_ARRAYDECL: {
+            if (!node->left || node->left->slot < 0) {
+                c->failed = 1;
+                break;
+            }
+            int base = node->left->slot;
+            if (c->lengths[base] <= 0) break;
+            EMIT(c, 0x48, 0x8D, 0x83);                      /* lea rax, [rbx + disp] */
+            emit_cell_offset(c, base);
+            EMIT(c, 0xB9);                                  /* mov ecx, length */
+            emit_u32(c, (uint32_t)c->lengths[base]);
+            EMIT(c, 0x48, 0xC7, 0x00, 0x00, 0x00, 0x00, 0x00,   /* clear: mov qword [rax], 0 */
+                    0x48, 0x83, 0xC0, 0x08,                 /* add rax, 8 */
+                    0x48, 0xFF, 0xC9,                       /* dec rcx */
+                    0x75, 0xF0);                            /* jnz clear */
+            break;
+        }
+        case AST_ASSIGN: {
+            ASTNode* target = node->left;
+            compile_expression(c, node->right);
+            if (target->type == AST_ARRAYACCESS) {
+                /* Value before index, as in the interpreter */
+                if (is_simple(target->right)) {
+                    load_simple(c, 1, target->right);
+                } else {
+                    EMIT(c, 0x50);                          /* push rax */
+                    c->depth++;
+                    compile_expression(c, target->right);
+                    EMIT(c, 0x48, 0x89, 0xC1);              /* mov rcx, rax */
+                    EMIT(c, 0x58);                          /* pop rax */
+                    c->depth--;
+                }
+                compile_bounds_check(c, 1, target);
+                EMIT(c, 0x48, 0x89, 0x84, 0xCB);            /* mov [rbx + rcx*8 + disp], rax */
+                emit_cell_offset(c, target->left->slot);
+            } else if (target->slot >= 0) {
+                emit_store_slot(c, target->slot);
+            } else {
+                c->failed = 1;
+            }
+            break;
+        }
+        case AST_IF: {
+            size_t skip = compile_condition(c, node->left, 0);
+            compile_body(c, node->right);
+            patch(c, skip, c->size);
+            break;
+        }
+        case AST_WHILE: {
+            /* Condition at the bottom: one conditional jump per iteration */
+            size_t enter = emit_jump(c, -1);
+            size_t body = c->size;
+            compile_body(c, node->right);
+            patch(c, enter, c->size);
+            patch(c, compile_condition(c, node->left, 1), body);
+            break;
+        }
+        case AST_REPEAT: {
+            size_t body = c->size;
+            compile_body(c, node->right);
+            patch(c, compile_condition(c, node->left, 0), body);
+            break;
+        }
+        case AST_PRINT:
+            compile_expression(c, node->left);
+            EMIT(c, 0x48, 0x89, 0xC6);                      /* mov rsi, rax */
+            EMIT(c, 0x4C, 0x89, 0xE7);                      /* mov rdi, r12 */
+            emit_call(c, (void*)jit_print);
+            break;
+        case AST_FACTORIAL:
+            compile_expression(c, node);
+            break;
+        case AST_BLOCK:
+            compile_body(c, node);
+            break;
+        default:
+            c->failed = 1;
+    }
+}
+
+/* Compiles a loop into 'entry'; leaves entry->code NULL on failure */
+static void compile_loop(Jit* jit, JitEntry* entry, const int* lengths) {
+    Compiler c;
+    memset(&c, 0, sizeof(c));
+    c.lengths = lengths;
+
+    EMIT(&c, 0x55,                                          /* push rbp */
+             0x48, 0x89, 0xE5,                              /* mov rbp, rsp */
+             0x53,                                          /* push rbx */
+             0x41, 0x54,                                    /* push r12 */
+             0x48, 0x89, 0xFB,                              /* mov rbx, rdi */
+             0x49, 0x89, 0xF4);                             /* mov r12, rsi */
+    compile_statement(&c, entry->loop);
+    EMIT(&c, 0x31, 0xC0);                                   /* xor eax, eax */
+    size_t epilogue = c.size;
+    EMIT(&c, 0x48, 0x8D, 0x65, 0xF0,                        /* lea rsp, [rbp - 16] */
+             0x41, 0x5C,                                    /* pop r12 */
+             0x5B,                                          /* pop rbx */
+             0x5D,                                          /* pop rbp */
+             0xC3);                                         /* ret */
+    for (int i = 0; i < c.site_count && !c.failed; i++) {
+        patch(&c, c.site_jumps[i], c.size);
+        EMIT(&c, 0xB8);                                     /* mov eax, site + 1 */
+        emit_u32(&c, (uint32_t)(i + 1));
+        patch(&c, emit_jump(&c, -1), epilogue);
+    }
+
+    if (!c.failed) {
+        /* Written while writable, then flipped to read+execute */
+        size_t page = 4096;
+        size_t size = (c.size + page - 1) / page * page;
+        void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            c.failed = 1;
+        } else {
+            memcpy(memory, c.code, c.size);
+            if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+                munmap(memory, size);
+                c.failed = 1;
+            } else {
+                entry->memory = memory;
+                entry->memory_size = size;
+                entry->code = (JitCode)memory;
+                entry->sites = c.sites;
+                c.sites = NULL;
+                jit->stats.code_bytes += c.size;
+            }
+        }
+    }
+    if (c.failed) {
+        jit->stats.loops_rejected++;
+    } else {
+        jit->stats.loops_compiled++;
+    }
+    free(c.code);
+    free(c.sites);
+    free(c.site_jumps);
+}
+
+static unsigned hash_node(const ASTNode* node) {
+    uint64_t key = (uint64_t)(uintptr_t)node;
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (unsigned)key;
+}
+
+/* The cache slot for 'loop', inserting an empty one if needed */
+static JitEntry* find_entry(Jit* jit, ASTNode* loop) {
+    if (2 * (jit->count + 1) > jit->capacity) {
+        int capacity = jit->capacity ? jit->capacity * 2 : 16;
+        JitEntry* entries = calloc(capacity, sizeof(JitEntry));
+        if (!entries) return NULL;
+        for (int i = 0; i < jit->capacity; i++) {
+            if (!jit->entries[i].loop) continue;
+            unsigned h = hash_node(jit->entries[i].loop) & (capacity - 1);
+            while (entries[h].loop) h = (h + 1) & (capacity - 1);
+            entries[h] = jit->entries[i];
+        }
+        free(jit->entries);
+        jit->entries = entries;
+        jit->capacity = capacity;
+    }
+    unsigned h = hash_node(loop) & (jit->capacity - 1);
+    while (jit->entries[h].loop && jit->entries[h].loop != loop) {
+        h = (h + 1) & (jit->capacity - 1);
+    }
+    return &jit->entries[h];
+}
+
+Jit* jit_create(FILE* out) {
+    Jit* jit = calloc(1, sizeof(Jit));
+    if (jit) jit->out = out;
+    return jit;
+}
+
+void jit_free(Jit* jit) {
+    if (!jit) return;
+    for (int i = 0; i < jit->capacity; i++) {
+        JitEntry* entry = &jit->entries[i];
+        if (entry->memory) munmap(entry->memory, entry->memory_size);
+        free(entry->sites);
+    }
+    free(jit->entries);
+    free(jit);
+}
+
+JitStatus jit_run_loop(Jit* jit, ASTNode* loop, Value* frame, const int* lengths,
+                       int* line, const char** message) {
+    JitEntry* entry = find_entry(jit, loop);
+    if (!entry) return JIT_UNSUPPORTED;
+    if (!entry->loop) {
+        double start = now_seconds();
+        entry->loop = loop;
+        jit->count++;
+        compile_loop(jit, entry, lengths);
+        jit->stats.compile_seconds += now_seconds() - start;
+    }
+    if (!entry->code) return JIT_UNSUPPORTED;
+
+    int result = entry->code(frame, jit->out);
+    if (result == 0) return JIT_COMPLETED;
+    *line = entry->sites[result - 1].line;
+    *message = entry->sites[result - 1].message;
+    return JIT_FAILED;
+}
+
+void jit_get_stats(const Jit* jit, JitStats* stats) {
+    *stats = jit->stats;
+}
@@ -3,20 +3,31 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LEXER_HAVE_X86_SIMD 1
+#endif
 
 #include "../../include/tokens.h"
 #include "../../include/lexer.h"
 
-/* Static lexer state */
-static int current_line;
-static int current_column;
-static char last_token_type;
+static void init_tables(void);
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+/* Builds the shared lookup tables; safe to call from any thread */
+void lexer_init(void) {
+    pthread_once(&tables_once, init_tables);
+}
 
 /* Resets lexer state; call this before lexing a new input */
-void lexer_reset(void) {
-    current_line = 1;
-    current_column = 1;
-    last_token_type = 'x';
+void lexer_reset(LexerState* state) {
+    lexer_init();
+    state->line = 1;
+    state->column = 1;
+    state->last_token_type = 'x';
 }
 
 /* Keywords table */
@@ -35,8 +46,63 @@ static struct {
     {"factorial", TOKEN_FACTORIAL}
 };
 
-static int is_keyword(const char* word) {
-    for (int i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+#define KEYWORD_COUNT ((int)(sizeof(keywords) / sizeof(keywords[0])))
+#define KEYWORD_MAX_SLOTS 256
+
+/* Perfect hash over keywords[], built once from the table above so the
+   keyword list stays the only place keywords are spelled out. */
+static signed char keyword_slots[KEYWORD_MAX_SLOTS];
+static unsigned char keyword_lengths[KEYWORD_COUNT];
+static unsigned int keyword_mask;
+static unsigned int keyword_multiplier;
+
+static unsigned int keyword_hash(const unsigned char* word, int length) {
+    return ((unsigned int)word[0] * keyword_multiplier + (unsigned int)word[length - 1] * 3 + length) & keyword_mask;
+}
+
+/* Searches for a table size and multiplier that give every keyword its own slot */
+static void build_keyword_table(void) {
+    for (int i = 0; i < KEYWORD_COUNT; i++) {
+        keyword_lengths[i] = (unsigned char)strlen(keywords[i].word);
+    }
+    for (unsigned int size = 16; size <= KEYWORD_MAX_SLOTS; size *= 2) {
+        keyword_mask = size - 1;
+        for (keyword_multiplier = 1; keyword_multiplier < 256; keyword_multiplier++) {
+            memset(keyword_slots, -1, sizeof(keyword_slots));
+            int i;
+            for (i = 0; i < KEYWORD_COUNT; i++) {
+                unsigned int slot = keyword_hash((const unsigned char*)keywords[i].word, keyword_lengths[i]);
+                if (keyword_slots[slot] >= 0) break;
+                keyword_slots[slot] = (signed char)i;
+            }
+            if (i == KEYWORD_COUNT) {
+                return;
+            }
+        }
+    }
+    fprintf(stderr, "Internal error: no perfect hash found for the keyword table\n");
+    exit(1);
+}
+
+/* One probe and one memcmp; returns the keyword's token type or 0.
+   The table must already be built (lexer_reset does this). */
+static TokenType find_keyword(const char* word, int length) {
+    int index = keyword_slots[keyword_hash((const unsigned char*)word, length)];
+    if (index >= 0 && keyword_lengths[index] == length && memcmp(word, keywords[index].word, length) == 0) {
+        return keywords[index].type;
+    }
+    return 0;
+}
+
+TokenType lookup_keyword(const char* word, int length) {
+    lexer_init();
+    if (length <= 0) return 0;
+    return find_keyword(word, length);
+}
+
+/* Linear scan used by the reference lexer */
+TokenType lookup_keyword_linear(const char* word) {
+    for (int i = 0; i < KEYWORD_COUNT; i++) {
         if (strcmp(word, keywords[i].word) == 0) {
             return keywords[i].type;
         }
@@ -44,11 +110,11 @@ static int is_keyword(const char* word) {
     return 0;
 }
 
-void print_error(ErrorType error, int line, const char* lexeme) {
+void print_error(ErrorType error, int line, const char* lexeme, int length) {
     printf("Lexical Error at line %d: ", line);
     switch(error) {
         case ERROR_INVALID_CHAR:
-            printf("Invalid character '%s'\n", lexeme);
+            printf("Invalid character '%.*s'\n", length, lexeme);
             break;
         case ERROR_INVALID_NUMBER:
             printf("Invalid number format\n");
@@ -60,7 +126,7 @@ void print_error(ErrorType error, int line, const char* lexeme) {
             printf("Invalid identifier\n");
             break;
         case ERROR_UNEXPECTED_TOKEN:
-            printf("Unexpected token '%s'\n", lexeme);
+            printf("Unexpected token '%.*s'\n", length, lexeme);
             break;
         default:
             printf("Unknown error\n");
@@ -69,14 +135,17 @@ void print_error(ErrorType error, int line, const char* lexeme) {
 
 void print_token(Token token) {
     if (token.error != ERROR_NONE) {
-        print_error(token.error, token.line, token.lexeme);
+        print_error(token.error, token.line, token.lexeme, token.length);
         return;
     }
 
     printf("Token: ");
     switch(token.type) {
         case TOKEN_NUMBER:     printf("NUMBER"); break;
-        case TOKEN_OPERATOR:   printf("OPERATOR"); break;
+        case TOKEN_PLUS:
+        case TOKEN_MINUS:
+        case TOKEN_STAR:
+        case TOKEN_SLASH:      printf("OPERATOR"); break;
         case TOKEN_IDENTIFIER: printf("IDENTIFIER"); break;
         case TOKEN_EQUALS:     printf("EQUALS"); break;
         case TOKEN_SEMICOLON:  printf("SEMICOLON"); break;
@@ -98,30 +167,426 @@ void print_token(Token token) {
         case TOKEN_RBRACKET:   printf("RBRACKET"); break;
         default:               printf("UNKNOWN");
     }
-    printf(" | Lexeme: '%s' | Line: %d\n", token.lexeme, token.line);
+    printf(" | Lexeme: '%.*s' | Line: %d\n", token.length, token.lexeme, token.line);
+}
+
+/* Character classes used by the table-driven lexer */
+enum {
+    CC_OTHER,       // Anything not valid in the language
+    CC_NUL,         // End of input
+    CC_SPACE,       // Whitespace other than newline
+    CC_NEWLINE,     // '\n'
+    CC_DIGIT,       // 0-9
+    CC_ALPHA,       // a-z, A-Z, _
+    CC_EQUALS,      // =
+    CC_BANG,        // !
+    CC_OPERATOR,    // + - * /
+    CC_LESS,        // <
+    CC_GREATER,     // >
+    CC_SEMICOLON,   // ;
+    CC_LPAREN,      // (
+    CC_RPAREN,      // )
+    CC_LBRACE,      // {
+    CC_RBRACE,      // }
+    CC_LBRACKET,    // [
+    CC_RBRACKET,    // ]
+    CC_COUNT
+};
+
+#define CC_DIGITS \
+    ['0'] = CC_DIGIT, ['1'] = CC_DIGIT, ['2'] = CC_DIGIT, ['3'] = CC_DIGIT, ['4'] = CC_DIGIT, \
+    ['5'] = CC_DIGIT, ['6'] = CC_DIGIT, ['7'] = CC_DIGIT, ['8'] = CC_DIGIT, ['9'] = CC_DIGIT
+#define CC_LETTERS(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p, q, r, s, t, u, v, w, x, y, z) \
+    [a] = CC_ALPHA, [b] = CC_ALPHA, [c] = CC_ALPHA, [d] = CC_ALPHA, [e] = CC_ALPHA, [f] = CC_ALPHA, \
+    [g] = CC_ALPHA, [h] = CC_ALPHA, [i] = CC_ALPHA, [j] = CC_ALPHA, [k] = CC_ALPHA, [l] = CC_ALPHA, \
+    [m] = CC_ALPHA, [n] = CC_ALPHA, [o] = CC_ALPHA, [p] = CC_ALPHA, [q] = CC_ALPHA, [r] = CC_ALPHA, \
+    [s] = CC_ALPHA, [t] = CC_ALPHA, [u] = CC_ALPHA, [v] = CC_ALPHA, [w] = CC_ALPHA, [x] = CC_ALPHA, \
+    [y] = CC_ALPHA, [z] = CC_ALPHA
+
+/* Byte -> character class. Matches isspace/isdigit/isalpha in the C locale. */
+static const unsigned char char_class[256] = {
+    ['\0'] = CC_NUL,
+    [' '] = CC_SPACE, ['\t'] = CC_SPACE, ['\v'] = CC_SPACE, ['\f'] = CC_SPACE, ['\r'] = CC_SPACE,
+    ['\n'] = CC_NEWLINE,
+    CC_DIGITS,
+    CC_LETTERS('a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm',
+               'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z'),
+    CC_LETTERS('A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M',
+               'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z'),
+    ['_'] = CC_ALPHA,
+    ['='] = CC_EQUALS,
+    ['!'] = CC_BANG,
+    ['+'] = CC_OPERATOR, ['-'] = CC_OPERATOR, ['*'] = CC_OPERATOR, ['/'] = CC_OPERATOR,
+    ['<'] = CC_LESS,
+    ['>'] = CC_GREATER,
+    [';'] = CC_SEMICOLON,
+    ['('] = CC_LPAREN,
+    [')'] = CC_RPAREN,
+    ['{'] = CC_LBRACE,
+    ['}'] = CC_RBRACE,
+    ['['] = CC_LBRACKET,
+    [']'] = CC_RBRACKET
+};
+
+/* Token type produced when a class is lexed as a single-character token */
+static const TokenType class_token_type[CC_COUNT] = {
+    [CC_OTHER] = TOKEN_ERROR,
+    [CC_EQUALS] = TOKEN_EQUALS,
+    [CC_BANG] = TOKEN_ERROR,
+    [CC_OPERATOR] = TOKEN_ERROR,    // Typed by operator_token_type
+    [CC_LESS] = TOKEN_LESS,
+    [CC_GREATER] = TOKEN_GREATER,
+    [CC_SEMICOLON] = TOKEN_SEMICOLON,
+    [CC_LPAREN] = TOKEN_LPAREN,
+    [CC_RPAREN] = TOKEN_RPAREN,
+    [CC_LBRACE] = TOKEN_LBRACE,
+    [CC_RBRACE] = TOKEN_RBRACE,
+    [CC_LBRACKET] = TOKEN_LBRACKET,
+    [CC_RBRACKET] = TOKEN_RBRACKET
+};
+
+/* Each operator character has its own token type */
+static const unsigned char operator_token_type[256] = {
+    ['+'] = TOKEN_PLUS,
+    ['-'] = TOKEN_MINUS,
+    ['*'] = TOKEN_STAR,
+    ['/'] = TOKEN_SLASH
+};
+
+/* DFA states. Values >= S_COUNT in the transition table are accept actions. */
+enum {
+    S_START,        // Between tokens
+    S_NUMBER,       // Inside a number
+    S_IDENT,        // Inside an identifier or keyword
+    S_EQUALS,       // Seen '='
+    S_BANG,         // Seen '!'
+    S_COUNT
+};
+
+enum {
+    A_SKIP = S_COUNT,   // Whitespace, stay in S_START
+    A_EOF,              // End of input
+    A_NUMBER,           // Number ends before the current byte
+    A_IDENT,            // Identifier ends before the current byte
+    A_SINGLE,           // One-byte token
+    A_DOUBLE            // Two-byte token (== or !=)
+};
+
+/* Transition table, one row per state and one column per character class:
+   OTHER NUL SPACE NEWLINE DIGIT ALPHA EQUALS BANG OPERATOR LESS GREATER
+   SEMICOLON LPAREN RPAREN LBRACE RBRACE LBRACKET RBRACKET */
+#define SGL A_SINGLE
+#define NUM A_NUMBER
+#define IDN A_IDENT
+static const unsigned char transitions[S_COUNT][CC_COUNT] = {
+    [S_START]  = { SGL, A_EOF, A_SKIP, A_SKIP, S_NUMBER, S_IDENT, S_EQUALS, S_BANG,
+                   SGL, SGL, SGL, SGL, SGL, SGL, SGL, SGL, SGL, SGL },
+    [S_NUMBER] = { NUM, NUM, NUM, NUM, S_NUMBER, NUM, NUM, NUM,
+                   NUM, NUM, NUM, NUM, NUM, NUM, NUM, NUM, NUM, NUM },
+    [S_IDENT]  = { IDN, IDN, IDN, IDN, S_IDENT, S_IDENT, IDN, IDN,
+                   IDN, IDN, IDN, IDN, IDN, IDN, IDN, IDN, IDN, IDN },
+    [S_EQUALS] = { SGL, SGL, SGL, SGL, SGL, SGL, A_DOUBLE, SGL,
+                   SGL, SGL, SGL, SGL, SGL, SGL, SGL, SGL, SGL, SGL },
+    [S_BANG]   = { SGL, SGL, SGL, SGL, SGL, SGL, A_DOUBLE, SGL,
+                   SGL, SGL, SGL, SGL, SGL, SGL, SGL, SGL, SGL, SGL }
+};
+#undef SGL
+#undef NUM
+#undef IDN
+
+/* Whitespace skipping.
+   Runs of whitespace are skipped 16 or 32 bytes at a time when the CPU
+   supports it. Newlines in the run are counted with a popcount over the
+   comparison mask, and the column is recomputed from the last newline, so
+   the line/column bookkeeping matches the byte-at-a-time loop exactly. */
+typedef const unsigned char* (*SkipFn)(const unsigned char* c, int* line, int* column);
+
+static const unsigned char* skip_whitespace_scalar(const unsigned char* c, int* line, int* column) {
+    unsigned char cls;
+    while ((cls = char_class[*c]) == CC_SPACE || cls == CC_NEWLINE) {
+        if (cls == CC_NEWLINE) {
+            (*line)++;
+            *column = 1;
+        } else {
+            (*column)++;
+        }
+        c++;
+    }
+    return c;
+}
+
+#ifdef LEXER_HAVE_X86_SIMD
+
+/* Finishes a run that ended at 'end'; 'line_start' is the byte after the last newline or NULL */
+static const unsigned char* finish_run(const unsigned char* start, const unsigned char* end,
+                                       const unsigned char* line_start, int newlines,
+                                       int* line, int* column) {
+    *line += newlines;
+    if (line_start) {
+        *column = (int)(end - line_start) + 1;
+    } else {
+        *column += (int)(end - start);
+    }
+    return end;
+}
+
+/* Blocks are loaded aligned so a load never crosses into an unmapped page;
+   bytes before the run start are masked out of the first block. */
+static const unsigned char* skip_whitespace_sse2(const unsigned char* c, int* line, int* column) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i four = _mm_set1_epi8(4);
+    const unsigned char* start = c;
+    const unsigned char* line_start = NULL;
+    int newlines = 0;
+    uintptr_t offset = (uintptr_t)c & 15;
+    const unsigned char* block = c - offset;
+    unsigned int valid = 0xFFFFu << offset;
+
+    for (;;) {
+        __m128i v = _mm_load_si128((const __m128i*)block);
+        /* \t \n \v \f \r are the contiguous range 9..13 */
+        __m128i control = _mm_sub_epi8(v, tab);
+        __m128i in_range = _mm_cmpeq_epi8(_mm_min_epu8(control, four), control);
+        __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(v, space), in_range);
+        unsigned int ws_mask = (unsigned int)_mm_movemask_epi8(ws);
+        unsigned int nl_mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)) & valid;
+        unsigned int stop = ~ws_mask & valid & 0xFFFFu;
+
+        if (stop) {
+            int end = __builtin_ctz(stop);
+            nl_mask &= (1u << end) - 1;
+            if (nl_mask) {
+                newlines += __builtin_popcount(nl_mask);
+                line_start = block + (31 - __builtin_clz(nl_mask)) + 1;
+            }
+            return finish_run(start, block + end, line_start, newlines, line, column);
+        }
+        if (nl_mask) {
+            newlines += __builtin_popcount(nl_mask);
+            line_start = block + (31 - __builtin_clz(nl_mask)) + 1;
+        }
+        block += 16;
+        valid = 0xFFFFu;
+    }
+}
+
+__attribute__((target("avx2")))
+static const unsigned char* skip_whitespace_avx2(const unsigned char* c, int* line, int* column) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i four = _mm256_set1_epi8(4);
+    const unsigned char* start = c;
+    const unsigned char* line_start = NULL;
+    int newlines = 0;
+    uintptr_t offset = (uintptr_t)c & 31;
+    const unsigned char* block = c - offset;
+    unsigned int valid = 0xFFFFFFFFu << offset;
+
+    for (;;) {
+        __m256i v = _mm256_load_si256((const __m256i*)block);
+        __m256i control = _mm256_sub_epi8(v, tab);
+        __m256i in_range = _mm256_cmpeq_epi8(_mm256_min_epu8(control, four), control);
+        __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(v, space), in_range);
+        unsigned int ws_mask = (unsigned int)_mm256_movemask_epi8(ws);
+        unsigned int nl_mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline)) & valid;
+        unsigned int stop = ~ws_mask & valid;
+
+        if (stop) {
+            int end = __builtin_ctz(stop);
+            nl_mask &= (1u << end) - 1;
+            if (nl_mask) {
+                newlines += __builtin_popcount(nl_mask);
+                line_start = block + (31 - __builtin_clz(nl_mask)) + 1;
+            }
+            return finish_run(start, block + end, line_start, newlines, line, column);
+        }
+        if (nl_mask) {
+            newlines += __builtin_popcount(nl_mask);
+            line_start = block + (31 - __builtin_clz(nl_mask)) + 1;
+        }
+        block += 32;
+        valid = 0xFFFFFFFFu;
+    }
+}
+
+#endif /* LEXER_HAVE_X86_SIMD */
+
+static SkipFn skip_whitespace = skip_whitespace_scalar;
+
+LexerSimdLevel lexer_set_simd(LexerSimdLevel level) {
+#ifdef LEXER_HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (level == LEXER_SIMD_AUTO) {
+        level = __builtin_cpu_supports("avx2") ? LEXER_SIMD_AVX2 : LEXER_SIMD_SSE2;
+    }
+    if (level == LEXER_SIMD_AVX2 && !__builtin_cpu_supports("avx2")) {
+        level = LEXER_SIMD_SSE2;
+    }
+    if (level == LEXER_SIMD_SSE2 && !__builtin_cpu_supports("sse2")) {
+        level = LEXER_SIMD_SCALAR;
+    }
+    switch (level) {
+        case LEXER_SIMD_AVX2: skip_whitespace = skip_whitespace_avx2; break;
+        case LEXER_SIMD_SSE2: skip_whitespace = skip_whitespace_sse2; break;
+        default:              skip_whitespace = skip_whitespace_scalar; break;
+    }
+    return level;
+#else
+    (void)level;
+    skip_whitespace = skip_whitespace_scalar;
+    return LEXER_SIMD_SCALAR;
+#endif
+}
+
+/* Builds the keyword hash and picks the whitespace skipper, once per process */
+static void init_tables(void) {
+    build_keyword_table();
+    lexer_set_simd(LEXER_SIMD_AUTO);
+}
+
+/* Table-driven lexer. Produces the same token stream as get_next_token_reference. */
+Token get_next_token(LexerState* state, const char* input, int* pos) {
+    const unsigned char* s = (const unsigned char*)input;
+    int p = *pos;
+    unsigned char cls = char_class[s[p]];
+    unsigned char next = transitions[S_START][cls];
+
+    /* The start state loops on whitespace. A lone separator is handled
+       inline; longer runs go to the vectorised skipper. */
+    if (next == A_SKIP) {
+        if (cls == CC_NEWLINE) {
+            state->line++;
+            state->column = 1;
+        } else {
+            state->column++;
+        }
+        cls = char_class[s[++p]];
+        next = transitions[S_START][cls];
+        if (next == A_SKIP) {
+            p = (int)(skip_whitespace(s + p, &state->line, &state->column) - s);
+            cls = char_class[s[p]];
+            next = transitions[S_START][cls];
+        }
+    }
+
+    Token token;
+    token.type = TOKEN_ERROR;
+    token.line = state->line;
+    token.column = state->column;
+    token.id = 0;
+    token.error = ERROR_NONE;
+
+    int start = p;
+    int first_class = cls;
+    token.lexeme = input + start;
+
+    /* Run the DFA until it reaches an accept action */
+    if (next < S_COUNT) {
+        const unsigned char* c = s + p;
+        int dfa_state;
+        do {
+            dfa_state = next;
+            const unsigned char* row = transitions[dfa_state];
+            do {
+                c++;
+                next = row[char_class[*c]];
+            } while (next == dfa_state);
+        } while (next < S_COUNT);
+        p = (int)(c - s);
+    }
+
+    switch (next) {
+        case A_EOF:
+            token.type = TOKEN_EOF;
+            token.lexeme = "EOF";
+            token.length = 3;
+            *pos = p;
+            return token;
+
+        case A_NUMBER:
+        case A_IDENT: {
+            int length = p - start;
+            token.length = length;
+            if (next == A_NUMBER) {
+                token.type = TOKEN_NUMBER;
+            } else {
+                TokenType keyword_type = find_keyword(input + start, length);
+                token.type = keyword_type ? keyword_type : TOKEN_IDENTIFIER;
+            }
+            state->column += length;
+            state->last_token_type = 'x';
+            *pos = p;
+            return token;
+        }
+
+        case A_DOUBLE:
+            token.type = (first_class == CC_EQUALS) ? TOKEN_EQUAL_EQUAL : TOKEN_NOT_EQUAL;
+            token.length = 2;
+            state->column += 2;
+            *pos = start + 2;
+            return token;
+
+        default:
+            break;
+    }
+
+    /* Single-character token */
+    token.length = 1;
+    p = start + 1;
+    *pos = p;
+    state->column++;
+
+    if (first_class == CC_OPERATOR) {
+        if (state->last_token_type == 'o') {
+            token.error = ERROR_CONSECUTIVE_OPERATORS;
+            return token;
+        }
+        state->last_token_type = 'o';
+        token.type = operator_token_type[s[start]];
+    } else {
+        state->last_token_type = 'x';
+        token.type = class_token_type[first_class];
+    }
+    if (token.type == TOKEN_ERROR) {
+        token.error = ERROR_INVALID_CHAR;
+    }
+
+    /* If the next character is a newline, update line and column */
+    if (input[p] == '\n') {
+        state->line++;
+        state->column = 1;
+    }
+
+    return token;
 }
 
-Token get_next_token(const char* input, int* pos) {
+/* Reference lexer: the original per-character branch chain. It is kept so
+   the table-driven lexer above can be checked and benchmarked against it. */
+Token get_next_token_reference(LexerState* state, const char* input, int* pos) {
     char c;
     /* Skip whitespace using isspace() */
     while (input[*pos] != '\0' && isspace(input[*pos])) {
         if (input[*pos] == '\n') {
-            current_line++;
-            current_column = 1;
+            state->line++;
+            state->column = 1;
         } else {
-            current_column++;
+            state->column++;
         }
         (*pos)++;
     }
 
-    int token_line = current_line;
-    int token_column = current_column;
+    int token_line = state->line;
+    int token_column = state->column;
     
-    Token token = {TOKEN_ERROR, "", token_line, token_column, ERROR_NONE};
+    Token token = {input + *pos, 0, token_line, token_column, 0, TOKEN_ERROR, ERROR_NONE};
 
     if (input[*pos] == '\0') {
         token.type = TOKEN_EOF;
-        strcpy(token.lexeme, "EOF");
+        token.lexeme = "EOF";
+        token.length = 3;
         return token;
     }
 
@@ -131,119 +596,125 @@ Token get_next_token(const char* input, int* pos) {
     if (isdigit(c)) {
         int i = 0;
         do {
-            token.lexeme[i++] = c;
+            i++;
             (*pos)++;
-            current_column++;
+            state->column++;
             c = input[*pos];
-        } while (isdigit(c) && i < (int)(sizeof(token.lexeme) - 1));
-        token.lexeme[i] = '\0';
+        } while (isdigit(c));
+        token.length = i;
         token.type = TOKEN_NUMBER;
-        last_token_type = 'x';
+        state->last_token_type = 'x';
         return token;
     }
 
     /* Handle identifiers and keywords */
     if (isalpha(c) || c == '_') {
+        char text[16];
         int i = 0;
         do {
-            token.lexeme[i++] = c;
+            if (i < (int)sizeof(text)) text[i] = c;
+            i++;
             (*pos)++;
-            current_column++;
+            state->column++;
             c = input[*pos];
-        } while ((isalnum(c) || c == '_') && i < (int)(sizeof(token.lexeme) - 1));
-        token.lexeme[i] = '\0';
-        TokenType keyword_type = is_keyword(token.lexeme);
+        } while (isalnum(c) || c == '_');
+        token.length = i;
+        /* Keywords are short, so longer identifiers never need the compare */
+        TokenType keyword_type = 0;
+        if (i < (int)sizeof(text)) {
+            text[i] = '\0';
+            keyword_type = lookup_keyword_linear(text);
+        }
         if (keyword_type) {
             token.type = keyword_type;
         } else {
             token.type = TOKEN_IDENTIFIER;
         }
-        last_token_type = 'x';
+        state->last_token_type = 'x';
         return token;
     }
 
     /* Handle multi-character operators */
     if (c == '=' && input[*pos + 1] == '=') {
         token.type = TOKEN_EQUAL_EQUAL;
-        strcpy(token.lexeme, "==");
+        token.length = 2;
         (*pos) += 2;
-        current_column += 2;
+        state->column += 2;
         return token;
     }
     
     if (c == '!' && input[*pos + 1] == '=') {
         token.type = TOKEN_NOT_EQUAL;
-        strcpy(token.lexeme, "!=");
+        token.length = 2;
         (*pos) += 2;
-        current_column += 2;
+        state->column += 2;
         return token;
     }
 
     /* Handle single-character tokens */
-    token.lexeme[0] = c;
-    token.lexeme[1] = '\0';
+    token.length = 1;
     (*pos)++;
-    current_column++;
+    state->column++;
 
     switch (c) {
         case '+': case '-': case '*': case '/':
-            if (last_token_type == 'o') {
+            if (state->last_token_type == 'o') {
                 token.error = ERROR_CONSECUTIVE_OPERATORS;
                 return token;
             }
-            token.type = TOKEN_OPERATOR;
-            last_token_type = 'o';
+            token.type = c == '+' ? TOKEN_PLUS : c == '-' ? TOKEN_MINUS : c == '*' ? TOKEN_STAR : TOKEN_SLASH;
+            state->last_token_type = 'o';
             break;
         case '=':
             token.type = TOKEN_EQUALS;
-            last_token_type = 'x';
+            state->last_token_type = 'x';
             break;
         case '<':
             token.type = TOKEN_LESS;
-            last_token_type = 'x';
+            state->last_token_type = 'x';
             break;
         case '>':
             token.type = TOKEN_GREATER;
-            last_token_type = 'x';
+            state->last_token_type = 'x';
             break;
         case ';':
             token.type = TOKEN_SEMICOLON;
-            last_token_type = 'x';
+            state->last_token_type = 'x';
             break;
         case '(':
             token.type = TOKEN_LPAREN;
-            last_token_type = 'x';
+            state->last_token_type = 'x';
             break;
         case ')':
             token.type = TOKEN_RPAREN;
-            last_token_type = 'x';
+            state->last_token_type = 'x';
             break;
         case '{':
             token.type = TOKEN_LBRACE;
-            last_token_type = 'x';
+            state->last_token_type = 'x';
             break;
         case '}':
             token.type = TOKEN_RBRACE;
-            last_token_type = 'x';
+            state->last_token_type = 'x';
             break;
         case '[':
             token.type = TOKEN_LBRACKET;
-            last_token_type = 'x';
+            state->last_token_type = 'x';
             break;
         case ']':
             token.type = TOKEN_RBRACKET;
-            last_token_type = 'x';
+            state->last_token_type = 'x';
             break;
         default:
             token.error = ERROR_INVALID_CHAR;
-            last_token_type = 'x';
+            state->last_token_type = 'x';
             break;
     }
 
     /* If the next character is a newline, update line and column */
     if (input[*pos] == '\n') {
-        current_line++;
-        current_column = 1;
+        state->line++;
+        state->column = 1;
     }
 
     return token;
@@ -263,12 +734,13 @@ int main() {
         "x = 3 + 4 * 5;";
         
     printf("Analyzing input:\n%s\n\n", input);
-    lexer_reset();  // Reset lexer state before lexing
+    LexerState state;
+    lexer_reset(&state);  // Reset lexer state before lexing
     int position = 0;
     Token token;
     
     do {
-        token = get_next_token(input, &position);
+        token = get_next_token(&state, input, &position);
         print_token(token);
     } while (token.type != TOKEN_EOF);
     
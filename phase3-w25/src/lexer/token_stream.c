@@ -0,0 +1,190 @@
+/* token_stream.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../../include/tokens.h"
+#include "../../include/lexer.h"
+#include "../../include/token_stream.h"
+
+#define TOKEN_RING_MASK (TOKEN_RING_SIZE - 1)
+/* Slack after the window so vectorised whitespace skipping stays in bounds */
+#define CHUNK_PADDING 64
+
+/* Refills the window. The bytes after the previous window move to the
+   front, then more input is read until the buffer holds a complete line
+   or the input ends. Returns 0 once the input is exhausted. */
+static int chunk_reader_fill(ChunkReader* reader) {
+    reader->buffer[reader->window] = reader->saved;
+    size_t carried = reader->filled - reader->window;
+    memmove(reader->buffer, reader->buffer + reader->window, carried);
+    reader->base += reader->window;
+    reader->filled = carried;
+    reader->window = 0;
+
+    for (;;) {
+        /* Cut after the last newline so the window holds whole lines */
+        char* newline = NULL;
+        for (size_t i = reader->filled; i > 0; i--) {
+            if (reader->buffer[i - 1] == '\n') {
+                newline = reader->buffer + i - 1;
+                break;
+            }
+        }
+        if (newline && (reader->eof || reader->filled == reader->capacity)) {
+            reader->window = (size_t)(newline - reader->buffer) + 1;
+            break;
+        }
+        if (reader->eof) {
+            reader->window = reader->filled;
+            break;
+        }
+
+        /* A line longer than the buffer: grow it */
+        if (reader->filled == reader->capacity) {
+            size_t capacity = reader->capacity * 2;
+            char* grown = realloc(reader->buffer, capacity + CHUNK_PADDING);
+            if (!grown) {
+                printf("Error: Memory allocation failed\n");
+                reader->window = reader->filled;
+                break;
+            }
+            reader->buffer = grown;
+            reader->capacity = capacity;
+        }
+
+        ssize_t n = read(reader->fd, reader->buffer + reader->filled, reader->capacity - reader->filled);
+        if (n <= 0) {
+            reader->eof = 1;
+        } else {
+            reader->filled += n;
+        }
+    }
+
+    /* The lexer stops at a NUL terminator placed just after the window;
+       the byte it overwrites is put back on the next fill */
+    memset(reader->buffer + reader->filled, 0, CHUNK_PADDING);
+    reader->saved = reader->buffer[reader->window];
+    reader->buffer[reader->window] = '\0';
+    return reader->window > 0;
+}
+
+void token_stream_init_string(TokenStream* stream, const char* input, InternPool* names) {
+    /* The parser has always lexed from a zeroed state; keep its line numbering */
+    lexer_init();
+    memset(&stream->lexer, 0, sizeof(stream->lexer));
+    stream->head = 0;
+    stream->count = 0;
+    stream->at_eof = 0;
+    stream->text = input;
+    stream->position = 0;
+    stream->reader = NULL;
+    stream->text_arena = NULL;
+    stream->names = names;
+}
+
+int token_stream_init_fd(TokenStream* stream, int fd, Arena* text_arena, InternPool* names) {
+    ChunkReader* reader = malloc(sizeof(ChunkReader));
+    char* buffer = malloc(TOKEN_STREAM_CHUNK_SIZE + CHUNK_PADDING);
+    if (!reader || !buffer) {
+        printf("Error: Memory allocation failed\n");
+        free(reader);
+        free(buffer);
+        return 1;
+    }
+    reader->fd = fd;
+    reader->buffer = buffer;
+    reader->capacity = TOKEN_STREAM_CHUNK_SIZE;
+    reader->window = 0;
+    reader->filled = 0;
+    reader->base = 0;
+    reader->eof = 0;
+    reader->saved = '\0';
+
+    token_stream_init_string(stream, "", names);
+    stream->reader = reader;
+    stream->text_arena = text_arena;
+    return 0;
+}
+
+void token_stream_close(TokenStream* stream) {
+    if (stream->reader) {
+        free(stream->reader->buffer);
+        free(stream->reader);
+        stream->reader = NULL;
+    }
+}
+
+/* Gives an identifier its ID; in chunked mode the token then points at the
+   pool's copy of the name instead of the window */
+static void intern_identifier(TokenStream* stream, Token* token) {
+    token->id = intern(stream->names, token->lexeme, token->length);
+    if (token->id && stream->reader) {
+        token->lexeme = intern_text(stream->names, token->id, NULL);
+    }
+}
+
+/* Copies token text out of the reusable window */
+static void keep_text(TokenStream* stream, Token* token) {
+    if (token->type == TOKEN_EOF || token->id) return;
+    char* copy = arena_alloc(stream->text_arena, token->length);
+    if (copy) {
+        memcpy(copy, token->lexeme, token->length);
+        token->lexeme = copy;
+    }
+}
+
+/* Lexes the next token, moving to the next window when one runs out */
+static Token lex_one(TokenStream* stream) {
+    for (;;) {
+        Token token = get_next_token(&stream->lexer, stream->text, &stream->position);
+        if (token.type != TOKEN_EOF || !stream->reader) {
+            return token;
+        }
+        ChunkReader* reader = stream->reader;
+        /* An embedded NUL ends the input, as it does for in-memory text */
+        if ((size_t)stream->position < reader->window || !chunk_reader_fill(reader)) {
+            return token;
+        }
+        stream->text = reader->buffer;
+        stream->position = 0;
+    }
+}
+
+/* Lexes ahead until at least 'needed' tokens are buffered or the input ends.
+   Tokens are produced in a batch to fill the free part of the ring. */
+static void fill_ring(TokenStream* stream, unsigned int needed) {
+    if (stream->count >= needed || stream->at_eof) return;
+    while (stream->count < TOKEN_RING_SIZE && !stream->at_eof) {
+        Token token = lex_one(stream);
+        if (token.type == TOKEN_IDENTIFIER && stream->names) intern_identifier(stream, &token);
+        if (stream->reader) keep_text(stream, &token);
+        stream->ring[(stream->head + stream->count) & TOKEN_RING_MASK] = token;
+        stream->count++;
+        if (token.type == TOKEN_EOF) stream->at_eof = 1;
+    }
+}
+
+Token token_stream_peek(TokenStream* stream, int k) {
+    fill_ring(stream, (unsigned int)k + 1);
+    if ((unsigned int)k >= stream->count) {
+        /* Only reachable past EOF: the last buffered token is EOF */
+        return stream->ring[(stream->head + stream->count - 1) & TOKEN_RING_MASK];
+    }
+    return stream->ring[(stream->head + k) & TOKEN_RING_MASK];
+}
+
+Token token_stream_next(TokenStream* stream) {
+    Token token = token_stream_peek(stream, 0);
+    /* EOF stays in the ring so later calls keep returning it */
+    if (token.type != TOKEN_EOF) {
+        stream->head = (stream->head + 1) & TOKEN_RING_MASK;
+        stream->count--;
+    }
+    return token;
+}
+
+size_t token_stream_offset(const TokenStream* stream) {
+    return (stream->reader ? stream->reader->base : 0) + (size_t)stream->position;
+}
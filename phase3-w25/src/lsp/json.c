@@ -0,0 +1,318 @@
+/* json.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../include/json.h"
+
+/* Deeper nesting is rejected rather than risking the C stack */
+#define JSON_MAX_DEPTH 256
+
+typedef struct {
+    Arena* arena;
+    const char* text;
+    const char* end;
+    int depth;
+} JsonReader;
+
+static JsonValue* parse_value(JsonReader* reader);
+
+static void skip_space(JsonReader* reader) {
+    while (reader->text < reader->end &&
+           (*reader->text == ' ' || *reader->text == '\t' || *reader->text == '\n' || *reader->text == '\r')) {
+        reader->text++;
+    }
+}
+
+static JsonValue* new_value(JsonReader* reader, JsonType type) {
+    JsonValue* value = arena_alloc(reader->arena, sizeof(JsonValue));
+    if (value) memset(value, 0, sizeof(JsonValue));
+    if (value) value->type = type;
+    return value;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* Reads the four hex digits of a \u escape */
+static long read_hex4(JsonReader* reader) {
+    if (reader->end - reader->text < 4) return -1;
+    long code = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = hex_digit(reader->text[i]);
+        if (digit < 0) return -1;
+        code = code * 16 + digit;
+    }
+    reader->text += 4;
+    return code;
+}
+
+static char* put_utf8(char* out, long code) {
+    if (code < 0x80) {
+        *out++ = (char)code;
+    } else if (code < 0x800) {
+        *out++ = (char)(0xC0 | (code >> 6));
+        *out++ = (char)(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        *out++ = (char)(0xE0 | (code >> 12));
+        *out++ = (char)(0x80 | ((code >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (code & 0x3F));
+    } else {
+        *out++ = (char)(0xF0 | (code >> 18));
+        *out++ = (char)(0x80 | ((code >> 12) & 0x3F));
+        *out++ = (char)(0x80 | ((code >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (code & 0x3F));
+    }
+    return out;
+}
+
+/* Reads a string after its opening quote. The unescaped text is never
+   longer than the escaped one, so the copy is sized from the raw text. */
+static const char* parse_string(JsonReader* reader, size_t* length) {
+    const char* close = reader->text;
+    while (close < reader->end && *close != '"') {
+        if (*close == '\\') close++;
+        close++;
+    }
+    if (close >= reader->end) return NULL;
+
+    char* copy = arena_alloc(reader->arena, (size_t)(close - reader->text) + 1);
+    if (!copy) return NULL;
+    char* out = copy;
+    while (reader->text < close) {
+        char c = *reader->text++;
+        if ((unsigned char)c < 0x20) return NULL;
+        if (c != '\\') {
+            *out++ = c;
+            continue;
+        }
+        c = *reader->text++;
+        switch (c) {
+            case '"': case '\\': case '/': *out++ = c; break;
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case 't': *out++ = '\t'; break;
+            case 'u': {
+                long code = read_hex4(reader);
+                if (code < 0) return NULL;
+                /* A high surrogate combines with the low one after it */
+                if (code >= 0xD800 && code < 0xDC00 && close - reader->text >= 6 &&
+                    reader->text[0] == '\\' && reader->text[1] == 'u') {
+                    reader->text += 2;
+                    long low = read_hex4(reader);
+                    if (low < 0xDC00 || low >= 0xE000) return NULL;
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                out = put_utf8(out, code);
+                break;
+            }
+            default:
+                return NULL;
+        }
+    }
+    reader->text = close + 1;
+    *out = '\0';
+    *length = (size_t)(out - copy);
+    return copy;
+}
+
+static int match_word(JsonReader* reader, const char* word) {
+    size_t length = strlen(word);
+    if ((size_t)(reader->end - reader->text) < length || memcmp(reader->text, word, length) != 0) return 0;
+    reader->text += length;
+    return 1;
+}
+
+static JsonValue* parse_number(JsonReader* reader) {
+    char buffer[64];
+    size_t length = 0;
+    while (reader->text + length < reader->end && length < sizeof(buffer) - 1 &&
+           strchr("+-0123456789.eE", reader->text[length])) {
+        length++;
+    }
+    memcpy(buffer, reader->text, length);
+    buffer[length] = '\0';
+    char* stop;
+    double number = strtod(buffer, &stop);
+    if (length == 0 || stop != buffer + length) return NULL;
+    reader->text += length;
+    JsonValue* value = new_value(reader, JSON_NUMBER);
+    if (value) value->number = number;
+    return value;
+}
+
+/* Items of an array or members of an object, after the opening bracket */
+static JsonValue* parse_container(JsonReader* reader, JsonType type) {
+    char close = type == JSON_ARRAY ? ']' : '}';
+    JsonValue* container = new_value(reader, type);
+    if (!container) return NULL;
+    JsonValue** link = &container->children;
+    skip_space(reader);
+    if (reader->text < reader->end && *reader->text == close) {
+        reader->text++;
+        return container;
+    }
+    for (;;) {
+        const char* key = NULL;
+        if (type == JSON_OBJECT) {
+            size_t key_length;
+            skip_space(reader);
+            if (reader->text >= reader->end || *reader->text != '"') return NULL;
+            reader->text++;
+            key = parse_string(reader, &key_length);
+            skip_space(reader);
+            if (!key || reader->text >= reader->end || *reader->text != ':') return NULL;
+            reader->text++;
+        }
+        JsonValue* item = parse_value(reader);
+        if (!item) return NULL;
+        item->key = key;
+        *link = item;
+        link = &item->next;
+
+        skip_space(reader);
+        if (reader->text >= reader->end) return NULL;
+        char c = *reader->text++;
+        if (c == close) return container;
+        if (c != ',') return NULL;
+    }
+}
+
+static JsonValue* parse_value(JsonReader* reader) {
+    skip_space(reader);
+    if (reader->text >= reader->end) return NULL;
+    JsonValue* value = NULL;
+    char c = *reader->text;
+    if (c == '{' || c == '[') {
+        if (++reader->depth > JSON_MAX_DEPTH) return NULL;
+        reader->text++;
+        value = parse_container(reader, c == '{' ? JSON_OBJECT : JSON_ARRAY);
+        reader->depth--;
+    } else if (c == '"') {
+        size_t length;
+        reader->text++;
+        const char* text = parse_string(reader, &length);
+        if (text && (value = new_value(reader, JSON_STRING))) {
+            value->string = text;
+            value->length = length;
+        }
+    } else if (match_word(reader, "true") || match_word(reader, "false")) {
+        if ((value = new_value(reader, JSON_BOOL))) value->boolean = reader->text[-1] == 'e' && reader->text[-2] == 'u';
+    } else if (match_word(reader, "null")) {
+        value = new_value(reader, JSON_NULL);
+    } else {
+        value = parse_number(reader);
+    }
+    return value;
+}
+
+JsonValue* json_parse(Arena* arena, const char* text, size_t length) {
+    JsonReader reader = {arena, text, text + length, 0};
+    JsonValue* value = parse_value(&reader);
+    skip_space(&reader);
+    return reader.text == reader.end ? value : NULL;
+}
+
+JsonValue* json_get(const JsonValue* object, const char* key) {
+    if (!object || object->type != JSON_OBJECT) return NULL;
+    for (JsonValue* member = object->children; member; member = member->next) {
+        if (strcmp(member->key, key) == 0) return member;
+    }
+    return NULL;
+}
+
+const char* json_string(const JsonValue* value) {
+    return value && value->type == JSON_STRING ? value->string : NULL;
+}
+
+long json_int(const JsonValue* value, long fallback) {
+    return value && value->type == JSON_NUMBER ? (long)value->number : fallback;
+}
+
+/* Length of the valid UTF-8 sequence at 'text', or 0 */
+static size_t utf8_sequence(const char* text, size_t length) {
+    unsigned char c = (unsigned char)text[0];
+    size_t bytes = 0;
+    if (c >= 0xC2 && c <= 0xDF) {
+        bytes = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        bytes = 3;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        bytes = 4;
+    }
+    if (bytes == 0 || bytes > length) return 0;
+    for (size_t i = 1; i < bytes; i++) {
+        if (((unsigned char)text[i] & 0xC0) != 0x80) return 0;
+    }
+    return bytes;
+}
+
+void json_write_string(FILE* out, const char* text, size_t length) {
+    fputc('"', out);
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)text[i];
+        switch (c) {
+            case '"':  fputs("\\\"", out); break;
+            case '\\': fputs("\\\\", out); break;
+            case '\n': fputs("\\n", out); break;
+            case '\r': fputs("\\r", out); break;
+            case '\t': fputs("\\t", out); break;
+            default:
+                if (c < 0x20) {
+                    fprintf(out, "\\u%04x", c);
+                } else if (c < 0x80) {
+                    fputc(c, out);
+                } else {
+                    /* Compiler messages can quote one byte of a multi-byte
+                       character; broken sequences become U+FFFD */
+                    size_t bytes = utf8_sequence(text + i, length - i);
+                    if (bytes) {
+                        fwrite(text + i, 1, bytes, out);
+                        i += bytes - 1;
+                    } else {
+                        fputs("\\ufffd", out);
+                    }
+                }
+        }
+    }
+    fputc('"', out);
+}
+
+void json_write_value(FILE* out, const JsonValue* value) {
+    if (!value) {
+        fputs("null", out);
+        return;
+    }
+    switch (value->type) {
+        case JSON_NULL:
+            fputs("null", out);
+            break;
+        case JSON_BOOL:
+            fputs(value->boolean ? "true" : "false", out);
+            break;
+        case JSON_NUMBER:
+            fprintf(out, "%.17g", value->number);
+            break;
+        case JSON_STRING:
+            json_write_string(out, value->string, value->length);
+            break;
+        case JSON_ARRAY:
+        case JSON_OBJECT:
+            fputc(value->type == JSON_ARRAY ? '[' : '{', out);
+            for (JsonValue* item = value->children; item; item = item->next) {
+                if (item != value->children) fputc(',', out);
+                if (value->type == JSON_OBJECT) {
+                    json_write_string(out, item->key, strlen(item->key));
+                    fputc(':', out);
+                }
+                json_write_value(out, item);
+            }
+            fputc(value->type == JSON_ARRAY ? ']' : '}', out);
+            break;
+    }
+}
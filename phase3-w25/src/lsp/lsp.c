@@ -0,0 +1,886 @@
+/* lsp.c */
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include "../../include/lsp.h"
+#include "../../include/json.h"
+#include "../../include/lexer.h"
+#include "../../include/parser.h"
+#include "../../include/semantic.h"
+#include "../../include/ast_walk.h"
+
+/* Zeroed bytes after a line copied out for the lexer, whose vectorised
+   whitespace skipping reads whole blocks past the end of a run */
+#define LINE_PADDING 64
+
+/* One line of a document. The lexer does not count lines the way an editor
+   does: a one-character token right before a newline moves it to the next
+   line early, and the newline itself moves it again, so every token after
+   such a line carries a line number one higher. The table records where
+   that happens so token positions can be mapped back to real lines. */
+typedef struct {
+    size_t start;           /* Offset of the line's first byte */
+    int token_line;         /* Line number the lexer gives tokens on this line */
+    char extra;             /* 1 if the lexer counts this line's newline twice */
+    char end_type;          /* Lexer operator state at the end of the line */
+} LineInfo;
+
+typedef struct Document {
+    char* uri;
+    char* text;             /* NUL-terminated */
+    size_t length;
+    size_t capacity;
+    LineInfo* lines;
+    int line_count;
+    int line_capacity;
+    ASTNode* ast;           /* Editable tree of the text; NULL if out of memory */
+    ParseErrorInfo* errors; /* Parse errors of the text */
+    int error_count;
+    SymbolTable* symbols;   /* From the last analysis; NULL after parse errors */
+    int dirty;              /* Changed since diagnostics were last published */
+    struct Document* next;
+} Document;
+
+typedef struct {
+    int in;
+    int out;
+    char* input;            /* Bytes read but not yet handled */
+    size_t input_start;
+    size_t input_end;
+    size_t input_capacity;
+    char* scratch;          /* One line copied out for the lexer */
+    size_t scratch_capacity;
+    Document* documents;
+    int utf8;               /* Positions count bytes, not UTF-16 code units */
+    int shutdown;
+    ParserContext parser;
+    long edits;             /* Changes applied, with their time */
+    double edit_seconds;
+    double edit_worst;
+    long analyses;          /* Semantic analyses and diagnostics published */
+    double analysis_seconds;
+    double analysis_worst;
+} Server;
+
+/* A message being written; the body goes to memory so its length is known
+   before the header is sent */
+typedef struct {
+    FILE* out;
+    char* body;
+    size_t size;
+} Message;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int is_word_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+/* Input */
+
+/* Reads more input; returns 0 at end of input or on a read error */
+static int fill_input(Server* server) {
+    if (server->input_start > 0) {
+        memmove(server->input, server->input + server->input_start, server->input_end - server->input_start);
+        server->input_end -= server->input_start;
+        server->input_start = 0;
+    }
+    if (server->input_end == server->input_capacity) {
+        size_t capacity = server->input_capacity ? server->input_capacity * 2 : 65536;
+        char* input = realloc(server->input, capacity);
+        if (!input) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            return 0;
+        }
+        server->input = input;
+        server->input_capacity = capacity;
+    }
+    ssize_t count;
+    do {
+        count = read(server->in, server->input + server->input_end, server->input_capacity - server->input_end);
+    } while (count < 0 && errno == EINTR);
+    if (count <= 0) return 0;
+    server->input_end += (size_t)count;
+    return 1;
+}
+
+static int input_pending(const Server* server) {
+    struct pollfd fd = {server->in, POLLIN, 0};
+    return server->input_end > server->input_start || poll(&fd, 1, 0) > 0;
+}
+
+/* Returns the body of the next message, valid until the next read, or NULL
+   at end of input */
+static char* read_message(Server* server, size_t* length) {
+    for (;;) {
+        char* header = server->input ? server->input + server->input_start : NULL;
+        size_t available = server->input_end - server->input_start;
+        size_t header_length = 0;
+        for (size_t i = 0; i + 4 <= available; i++) {
+            if (memcmp(header + i, "\r\n\r\n", 4) == 0) {
+                header_length = i + 4;
+                break;
+            }
+        }
+        if (header_length) {
+            long content_length = -1;
+            for (size_t i = 0; i < header_length; ) {
+                size_t end = i;
+                while (header[end] != '\r') end++;
+                if (end - i > 15 && strncasecmp(header + i, "Content-Length:", 15) == 0) {
+                    content_length = strtol(header + i + 15, NULL, 10);
+                }
+                i = end + 2;
+            }
+            if (content_length < 0) {
+                fprintf(stderr, "Error: Message header without Content-Length\n");
+                server->input_start += header_length;
+                continue;
+            }
+            if (available - header_length >= (size_t)content_length) {
+                server->input_start += header_length + (size_t)content_length;
+                *length = (size_t)content_length;
+                return header + header_length;
+            }
+        }
+        if (!fill_input(server)) return NULL;
+    }
+}
+
+/* Output */
+
+static int begin_message(Message* message) {
+    message->body = NULL;
+    message->size = 0;
+    message->out = open_memstream(&message->body, &message->size);
+    if (!message->out) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 0;
+    }
+    fputs("{\"jsonrpc\":\"2.0\",", message->out);
+    return 1;
+}
+
+static void write_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t count = write(fd, data, size);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return;
+        data += count;
+        size -= (size_t)count;
+    }
+}
+
+static void send_message(Server* server, Message* message) {
+    if (fclose(message->out) == 0) {
+        char header[64];
+        int length = snprintf(header, sizeof(header), "Content-Length: %zu\r\n\r\n", message->size);
+        write_all(server->out, header, (size_t)length);
+        write_all(server->out, message->body, message->size);
+    }
+    free(message->body);
+}
+
+/* Starts a response to the request with 'id'; the caller writes the result
+   member and the closing brace */
+static int begin_response(Message* message, const JsonValue* id) {
+    if (!begin_message(message)) return 0;
+    fputs("\"id\":", message->out);
+    json_write_value(message->out, id);
+    fputc(',', message->out);
+    return 1;
+}
+
+static void send_error(Server* server, const JsonValue* id, int code, const char* text) {
+    Message message;
+    if (!begin_response(&message, id)) return;
+    fprintf(message.out, "\"error\":{\"code\":%d,\"message\":", code);
+    json_write_string(message.out, text, strlen(text));
+    fputs("}}", message.out);
+    send_message(server, &message);
+}
+
+/* Positions. A position is a line and a column within it in the units the
+   client asked for; internally columns are byte offsets in the line. */
+
+/* Position units in the first 'bytes' bytes of 'text' */
+static int units_of(const Server* server, const char* text, size_t bytes) {
+    if (server->utf8) return (int)bytes;
+    int units = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        unsigned char c = (unsigned char)text[i];
+        /* Characters past U+FFFF take a surrogate pair */
+        if ((c & 0xC0) != 0x80) units += c >= 0xF0 ? 2 : 1;
+    }
+    return units;
+}
+
+/* Bytes of 'text', at most 'bytes', that 'units' position units cover */
+static size_t bytes_of(const Server* server, const char* text, size_t bytes, long units) {
+    if (server->utf8) return units < 0 ? 0 : (size_t)units < bytes ? (size_t)units : bytes;
+    size_t i = 0;
+    while (i < bytes && units > 0) {
+        units -= (unsigned char)text[i] >= 0xF0 ? 2 : 1;
+        i++;
+        while (i < bytes && ((unsigned char)text[i] & 0xC0) == 0x80) i++;
+    }
+    return i;
+}
+
+/* Bytes in 'line', without its newline */
+static size_t line_length(const Document* doc, int line) {
+    size_t end = line + 1 < doc->line_count ? doc->lines[line + 1].start - 1 : doc->length;
+    return end - doc->lines[line].start;
+}
+
+/* Line holding the byte at 'offset' */
+static int line_of_offset(const Document* doc, size_t offset) {
+    int low = 0;
+    int high = doc->line_count - 1;
+    while (low < high) {
+        int mid = low + (high - low + 1) / 2;
+        if (doc->lines[mid].start <= offset) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+/* Maps a token's line and column to a line of the document and a byte
+   column in it. The lexer starts the first line at column 0 and every
+   later one at column 1. */
+static int from_token(const Document* doc, int token_line, int token_column, size_t* column) {
+    int low = 0;
+    int high = doc->line_count - 1;
+    while (low < high) {
+        int mid = low + (high - low + 1) / 2;
+        if (doc->lines[mid].token_line <= token_line) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    long byte = token_column - (low > 0 ? 1 : 0);
+    size_t length = line_length(doc, low);
+    *column = byte < 0 ? 0 : (size_t)byte > length ? length : (size_t)byte;
+    return low;
+}
+
+/* Byte offset of an LSP position object, clamped to the text */
+static size_t offset_of(const Server* server, const Document* doc, const JsonValue* position) {
+    long line = json_int(json_get(position, "line"), 0);
+    long character = json_int(json_get(position, "character"), 0);
+    if (line < 0) return 0;
+    if (line >= doc->line_count) return doc->length;
+    const char* text = doc->text + doc->lines[line].start;
+    return doc->lines[line].start + bytes_of(server, text, line_length(doc, (int)line), character);
+}
+
+static void write_position(FILE* out, const Server* server, const Document* doc, int line, size_t column) {
+    size_t length = line_length(doc, line);
+    if (column > length) column = length;
+    fprintf(out, "{\"line\":%d,\"character\":%d}", line,
+            units_of(server, doc->text + doc->lines[line].start, column));
+}
+
+static void write_range(FILE* out, const Server* server, const Document* doc, int line, size_t start, size_t end) {
+    fputs("{\"start\":", out);
+    write_position(out, server, doc, line, start);
+    fputs(",\"end\":", out);
+    write_position(out, server, doc, line, end);
+    fputc('}', out);
+}
+
+/* Line table */
+
+static int reserve_lines(Document* doc, int count) {
+    if (count <= doc->line_capacity) return 1;
+    int capacity = doc->line_capacity ? doc->line_capacity : 64;
+    while (capacity < count) capacity *= 2;
+    LineInfo* lines = realloc(doc->lines, (size_t)capacity * sizeof(LineInfo));
+    if (!lines) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 0;
+    }
+    doc->lines = lines;
+    doc->line_capacity = capacity;
+    return 1;
+}
+
+/* Lexes 'line' on its own, starting in the state the line before it ends
+   in, to find its end state and whether its newline counts twice */
+static void scan_line(Server* server, Document* doc, int line) {
+    LineInfo* info = &doc->lines[line];
+    size_t end = line + 1 < doc->line_count ? doc->lines[line + 1].start : doc->length;
+    size_t size = end - info->start;
+    char start_type = line > 0 ? doc->lines[line - 1].end_type : 0;
+    info->extra = 0;
+    info->end_type = start_type;
+
+    if (size + LINE_PADDING > server->scratch_capacity) {
+        char* scratch = realloc(server->scratch, size + LINE_PADDING);
+        if (!scratch) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            return;
+        }
+        server->scratch = scratch;
+        server->scratch_capacity = size + LINE_PADDING;
+    }
+    memcpy(server->scratch, doc->text + info->start, size);
+    memset(server->scratch + size, 0, LINE_PADDING);
+
+    LexerState state = {0, 0, start_type};
+    int pos = 0;
+    while (get_next_token(&state, server->scratch, &pos).type != TOKEN_EOF) {
+    }
+    info->extra = state.line > 1;
+    info->end_type = state.last_token_type;
+}
+
+/* Numbers the lines from 'from' on; past 'stable' it stops at the first
+   line whose old number is still right, as all later ones then are too */
+static void number_lines(Document* doc, int from, int stable) {
+    if (from == 0) {
+        doc->lines[0].token_line = 0;
+        from = 1;
+    }
+    for (int line = from; line < doc->line_count; line++) {
+        const LineInfo* previous = &doc->lines[line - 1];
+        int token_line = previous->token_line + 1 + previous->extra;
+        if (line >= stable && doc->lines[line].token_line == token_line) break;
+        doc->lines[line].token_line = token_line;
+    }
+}
+
+static int build_lines(Server* server, Document* doc) {
+    int count = 1;
+    for (size_t i = 0; i < doc->length; i++) {
+        if (doc->text[i] == '\n') count++;
+    }
+    if (!reserve_lines(doc, count)) return 0;
+    doc->lines[0].start = 0;
+    int line = 1;
+    for (size_t i = 0; i < doc->length; i++) {
+        if (doc->text[i] == '\n') doc->lines[line++].start = i + 1;
+    }
+    doc->line_count = count;
+    for (line = 0; line < count; line++) {
+        scan_line(server, doc, line);
+    }
+    number_lines(doc, 0, count);
+    return 1;
+}
+
+/* Updates the table after 'deleted' bytes at 'offset' were replaced by
+   'inserted' bytes; doc->text already holds the new text. The lines the
+   edit touched are split again and re-lexed, and the ones after them only
+   while the lexer state they start in differs from before. */
+static int update_lines(Server* server, Document* doc, size_t offset, size_t deleted, size_t inserted) {
+    int first = line_of_offset(doc, offset);
+    int last = line_of_offset(doc, offset + deleted);
+    long shift = (long)inserted - (long)deleted;
+    int at_end = last + 1 == doc->line_count;
+    size_t region_end = at_end ? doc->length : (size_t)((long)doc->lines[last + 1].start + shift);
+
+    /* The newline ending 'last' starts a line that is already in the table */
+    int added = 0;
+    for (size_t i = doc->lines[first].start; i < region_end; i++) {
+        if (doc->text[i] == '\n' && (i + 1 < region_end || at_end)) added++;
+    }
+    int count = doc->line_count - (last - first) + added;
+    if (!reserve_lines(doc, count)) return 0;
+
+    char old_end = doc->lines[last].end_type;
+    memmove(&doc->lines[first + added + 1], &doc->lines[last + 1],
+            (size_t)(doc->line_count - last - 1) * sizeof(LineInfo));
+    for (int line = first + added + 1; line < count; line++) {
+        doc->lines[line].start = (size_t)((long)doc->lines[line].start + shift);
+    }
+    int line = first + 1;
+    for (size_t i = doc->lines[first].start; line <= first + added; i++) {
+        if (doc->text[i] == '\n') doc->lines[line++].start = i + 1;
+    }
+    doc->line_count = count;
+
+    for (line = first; line <= first + added; line++) {
+        scan_line(server, doc, line);
+    }
+    char old_start = old_end;
+    while (line < count && doc->lines[line - 1].end_type != old_start) {
+        old_start = doc->lines[line].end_type;
+        scan_line(server, doc, line);
+        line++;
+    }
+    number_lines(doc, first, line);
+    return 1;
+}
+
+/* Documents */
+
+static Document* find_document(Server* server, const char* uri) {
+    for (Document* doc = server->documents; uri && doc; doc = doc->next) {
+        if (strcmp(doc->uri, uri) == 0) return doc;
+    }
+    return NULL;
+}
+
+static void free_document(Document* doc) {
+    if (doc->ast) free_ast(doc->ast);
+    if (doc->symbols) free_symbol_table(doc->symbols);
+    free(doc->errors);
+    free(doc->lines);
+    free(doc->text);
+    free(doc->uri);
+    free(doc);
+}
+
+static int reserve_text(Document* doc, size_t length) {
+    if (length + 1 <= doc->capacity) return 1;
+    size_t capacity = doc->capacity ? doc->capacity : 4096;
+    while (capacity < length + 1) capacity *= 2;
+    char* text = realloc(doc->text, capacity);
+    if (!text) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 0;
+    }
+    doc->text = text;
+    doc->capacity = capacity;
+    return 1;
+}
+
+/* Parses 'text' into an editable tree; the tree keeps its own copy of the
+   text, so the document buffer is free to change */
+static ASTNode* parse_text(Server* server, const char* text, size_t length) {
+    TextEdit edit = {0, 0, text, length};
+    parser_init(&server->parser, "");
+    ASTNode* empty = parse(&server->parser);
+    if (!empty) return NULL;
+    ASTNode* ast = parse_edit(&server->parser, empty, "", &edit);
+    if (!ast) free_ast(empty);
+    return ast;
+}
+
+static void keep_errors(Server* server, Document* doc) {
+    int count = doc->ast ? server->parser.error_count : 0;
+    doc->error_count = 0;
+    if (count == 0) return;
+    ParseErrorInfo* errors = realloc(doc->errors, (size_t)count * sizeof(ParseErrorInfo));
+    if (!errors) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return;
+    }
+    memcpy(errors, server->parser.errors, (size_t)count * sizeof(ParseErrorInfo));
+    doc->errors = errors;
+    doc->error_count = count;
+}
+
+static Document* open_document(Server* server, const char* uri, const char* text, size_t length) {
+    Document* doc = calloc(1, sizeof(Document));
+    if (!doc || !(doc->uri = strdup(uri)) || !reserve_text(doc, length)) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        if (doc) free_document(doc);
+        return NULL;
+    }
+    memcpy(doc->text, text, length);
+    doc->text[length] = '\0';
+    doc->length = length;
+    if (!build_lines(server, doc)) {
+        free_document(doc);
+        return NULL;
+    }
+    doc->ast = parse_text(server, doc->text, doc->length);
+    keep_errors(server, doc);
+    doc->dirty = 1;
+    doc->next = server->documents;
+    server->documents = doc;
+    return doc;
+}
+
+/* Replaces 'deleted' bytes at 'offset' with 'inserted', bringing the tree
+   and the line table along */
+static void change_document(Server* server, Document* doc, size_t offset, size_t deleted,
+                            const char* inserted, size_t inserted_length) {
+    double start = now_seconds();
+    size_t length = doc->length - deleted + inserted_length;
+    if (!reserve_text(doc, length)) return;
+
+    /* parse_edit wants the text the tree was built from */
+    TextEdit edit = {offset, deleted, inserted, inserted_length};
+    ASTNode* ast = doc->ast ? parse_edit(&server->parser, doc->ast, doc->text, &edit) : NULL;
+
+    memmove(doc->text + offset + inserted_length, doc->text + offset + deleted, doc->length - offset - deleted + 1);
+    memcpy(doc->text + offset, inserted, inserted_length);
+    doc->length = length;
+    update_lines(server, doc, offset, deleted, inserted_length);
+
+    if (!ast) {
+        if (doc->ast) free_ast(doc->ast);
+        ast = parse_text(server, doc->text, doc->length);
+    }
+    doc->ast = ast;
+    keep_errors(server, doc);
+    doc->dirty = 1;
+
+    double seconds = now_seconds() - start;
+    server->edits++;
+    server->edit_seconds += seconds;
+    if (seconds > server->edit_worst) server->edit_worst = seconds;
+}
+
+/* Diagnostics */
+
+static void write_diagnostic(FILE* out, const Server* server, const Document* doc, int* count,
+                             int line, size_t start, size_t end, const char* text) {
+    fputs((*count)++ ? ",{\"range\":" : "{\"range\":", out);
+    write_range(out, server, doc, line, start, end);
+    fputs(",\"severity\":1,\"source\":\"compiler\",\"message\":", out);
+    json_write_string(out, text, strlen(text));
+    fputc('}', out);
+}
+
+/* Semantic analysis only sets the slot of nodes it reaches, so the slots a
+   previous run left are cleared first */
+static int clear_slot(AstWalker* walker, AstWalkFrame* frame) {
+    (void)walker;
+    frame->node->slot = -1;
+    return AST_WALK_CONTINUE;
+}
+
+static void clear_slots(ASTNode* node) {
+    AstWalker walker;
+    ast_walker_init(&walker, clear_slot, NULL, NULL);
+    ast_walk(&walker, node, 0, 1);
+    ast_walker_release(&walker);
+}
+
+/* Runs semantic analysis if the text parsed cleanly, as the command line
+   does, and publishes the errors of both stages */
+static void publish_diagnostics(Server* server, Document* doc) {
+    double start = now_seconds();
+    if (doc->symbols) free_symbol_table(doc->symbols);
+    doc->symbols = NULL;
+    doc->dirty = 0;
+
+    char* report = NULL;
+    size_t report_size = 0;
+    if (doc->ast && doc->error_count == 0) {
+        FILE* out = open_memstream(&report, &report_size);
+        if (out) {
+            clear_slots(doc->ast);
+            doc->symbols = analyze_semantics_keep(doc->ast, out);
+            fclose(out);
+        }
+    }
+
+    Message message;
+    if (!begin_message(&message)) {
+        free(report);
+        return;
+    }
+    FILE* out = message.out;
+    fputs("\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":", out);
+    json_write_string(out, doc->uri, strlen(doc->uri));
+    fputs(",\"diagnostics\":[", out);
+    int count = 0;
+
+    /* A parse error covers the word at its position */
+    for (int i = 0; i < doc->error_count; i++) {
+        const ParseErrorInfo* error = &doc->errors[i];
+        size_t column;
+        int line = from_token(doc, error->position.line, error->position.column, &column);
+        const char* text = doc->text + doc->lines[line].start;
+        size_t length = line_length(doc, line);
+        size_t end = column;
+        while (end < length && is_word_char(text[end])) end++;
+        if (end == column && end < length) end++;
+        write_diagnostic(out, server, doc, &count, line, column, end, error->message);
+    }
+
+    /* Semantic errors carry only a line, so they cover all of it */
+    for (char* text = report; text && *text; ) {
+        char* end = strchr(text, '\n');
+        if (end) *end = '\0';
+        int token_line;
+        int skip = 0;
+        if (sscanf(text, "Semantic Error at line %d: %n", &token_line, &skip) == 1 && skip > 0) {
+            size_t column;
+            int line = from_token(doc, token_line, 0, &column);
+            const char* line_text = doc->text + doc->lines[line].start;
+            size_t length = line_length(doc, line);
+            size_t first = 0;
+            while (first < length && (line_text[first] == ' ' || line_text[first] == '\t')) first++;
+            write_diagnostic(out, server, doc, &count, line, first, length, text + skip);
+        }
+        text = end ? end + 1 : text + strlen(text);
+    }
+    fputs("]}}", out);
+    send_message(server, &message);
+    free(report);
+
+    double seconds = now_seconds() - start;
+    server->analyses++;
+    server->analysis_seconds += seconds;
+    if (seconds > server->analysis_worst) server->analysis_worst = seconds;
+}
+
+static void publish_changed(Server* server) {
+    for (Document* doc = server->documents; doc; doc = doc->next) {
+        if (doc->dirty) publish_diagnostics(server, doc);
+    }
+}
+
+/* Go to definition */
+
+typedef struct {
+    int line;
+    int column;
+    ASTNode* found;
+} IdentifierSearch;
+
+static int match_identifier(AstWalker* walker, AstWalkFrame* frame) {
+    IdentifierSearch* search = walker->data;
+    ASTNode* node = frame->node;
+    if (search->found) return AST_WALK_SKIP;
+    if (node->type == AST_IDENTIFIER && node->token.line == search->line &&
+        node->token.column == search->column) {
+        search->found = node;
+        return AST_WALK_SKIP;
+    }
+    return AST_WALK_CONTINUE;
+}
+
+/* The identifier token at 'line' and 'column', found on ast_walk's stack
+   since expressions can nest as deep as they are long */
+static ASTNode* find_identifier(ASTNode* node, int line, int column) {
+    IdentifierSearch search = {line, column, NULL};
+    AstWalker walker;
+    ast_walker_init(&walker, match_identifier, NULL, &search);
+    ast_walk(&walker, node, 0, 1);
+    ast_walker_release(&walker);
+    return search.found;
+}
+
+/* Declaration the identifier at 'offset' resolves to, or NULL */
+static const Symbol* find_declaration(const Document* doc, size_t offset, int* name_length) {
+    const char* text = doc->text;
+    /* The cursor may sit just past the end of the name */
+    if (!is_word_char(text[offset]) && offset > 0 && is_word_char(text[offset - 1])) offset--;
+    if (!doc->symbols || !is_word_char(text[offset])) return NULL;
+    while (offset > 0 && is_word_char(text[offset - 1])) offset--;
+
+    int line = line_of_offset(doc, offset);
+    int column = (int)(offset - doc->lines[line].start) + (line > 0 ? 1 : 0);
+    ASTNode* node = find_identifier(doc->ast, doc->lines[line].token_line, column);
+    if (!node || node->slot < 0) return NULL;
+
+    /* Slots are never reused, so the slot names one declaration */
+    const Symbol* lists[] = {doc->symbols->head, doc->symbols->retired};
+    for (int i = 0; i < 2; i++) {
+        for (const Symbol* symbol = lists[i]; symbol; symbol = symbol->next) {
+            if (symbol->slot == node->slot && symbol->name_id == node->token.id) {
+                *name_length = node->token.length;
+                return symbol;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void handle_definition(Server* server, const JsonValue* id, const JsonValue* params) {
+    Document* doc = find_document(server, json_string(json_get(json_get(params, "textDocument"), "uri")));
+    /* The answer needs the symbol table of the current text */
+    if (doc && doc->dirty) publish_diagnostics(server, doc);
+
+    Message message;
+    if (!begin_response(&message, id)) return;
+    FILE* out = message.out;
+    fputs("\"result\":", out);
+    const Symbol* symbol = NULL;
+    int name_length = 0;
+    if (doc) symbol = find_declaration(doc, offset_of(server, doc, json_get(params, "position")), &name_length);
+    if (symbol) {
+        size_t column;
+        int line = from_token(doc, symbol->line_declared, symbol->column_declared, &column);
+        fputs("{\"uri\":", out);
+        json_write_string(out, doc->uri, strlen(doc->uri));
+        fputs(",\"range\":", out);
+        write_range(out, server, doc, line, column, column + (size_t)name_length);
+        fputc('}', out);
+    } else {
+        fputs("null", out);
+    }
+    fputc('}', out);
+    send_message(server, &message);
+}
+
+/* Messages */
+
+static void handle_initialize(Server* server, const JsonValue* id, const JsonValue* params) {
+    /* UTF-8 positions match the text as stored, so take them if offered */
+    const JsonValue* encodings = json_get(json_get(json_get(params, "capabilities"), "general"), "positionEncodings");
+    for (const JsonValue* item = encodings ? encodings->children : NULL; item; item = item->next) {
+        const char* name = json_string(item);
+        if (name && strcmp(name, "utf-8") == 0) server->utf8 = 1;
+    }
+
+    Message message;
+    if (!begin_response(&message, id)) return;
+    fprintf(message.out,
+            "\"result\":{\"capabilities\":{\"positionEncoding\":\"%s\","
+            "\"textDocumentSync\":{\"openClose\":true,\"change\":2},\"definitionProvider\":true},"
+            "\"serverInfo\":{\"name\":\"compiler\"}}}",
+            server->utf8 ? "utf-8" : "utf-16");
+    send_message(server, &message);
+}
+
+static void handle_did_open(Server* server, const JsonValue* params) {
+    const JsonValue* item = json_get(params, "textDocument");
+    const char* uri = json_string(json_get(item, "uri"));
+    const JsonValue* text = json_get(item, "text");
+    if (!uri || !text || text->type != JSON_STRING) return;
+
+    Document** link = &server->documents;
+    while (*link && strcmp((*link)->uri, uri) != 0) link = &(*link)->next;
+    if (*link) {
+        Document* old = *link;
+        *link = old->next;
+        free_document(old);
+    }
+    open_document(server, uri, text->string, text->length);
+}
+
+static void handle_did_change(Server* server, const JsonValue* params) {
+    Document* doc = find_document(server, json_string(json_get(json_get(params, "textDocument"), "uri")));
+    const JsonValue* changes = json_get(params, "contentChanges");
+    if (!doc || !changes || changes->type != JSON_ARRAY) return;
+
+    for (const JsonValue* change = changes->children; change; change = change->next) {
+        const JsonValue* text = json_get(change, "text");
+        const JsonValue* range = json_get(change, "range");
+        if (!text || text->type != JSON_STRING) continue;
+        size_t start = 0;
+        size_t end = doc->length;
+        if (range) {
+            start = offset_of(server, doc, json_get(range, "start"));
+            end = offset_of(server, doc, json_get(range, "end"));
+            if (end < start) end = start;
+        }
+        change_document(server, doc, start, end - start, text->string, text->length);
+    }
+}
+
+static void handle_did_close(Server* server, const JsonValue* params) {
+    const char* uri = json_string(json_get(json_get(params, "textDocument"), "uri"));
+    Document** link = &server->documents;
+    while (uri && *link && strcmp((*link)->uri, uri) != 0) link = &(*link)->next;
+    if (!uri || !*link) return;
+    Document* doc = *link;
+    *link = doc->next;
+
+    /* Clear the closed document's diagnostics in the client */
+    Message message;
+    if (begin_message(&message)) {
+        fputs("\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":", message.out);
+        json_write_string(message.out, doc->uri, strlen(doc->uri));
+        fputs(",\"diagnostics\":[]}}", message.out);
+        send_message(server, &message);
+    }
+    free_document(doc);
+}
+
+static void handle_message(Server* server, const JsonValue* message) {
+    const char* method = json_string(json_get(message, "method"));
+    const JsonValue* id = json_get(message, "id");
+    const JsonValue* params = json_get(message, "params");
+    /* The server sends no requests, so there are no responses to handle */
+    if (!method) return;
+
+    if (server->shutdown) {
+        if (id) send_error(server, id, -32600, "Server is shut down");
+    } else if (strcmp(method, "initialize") == 0) {
+        handle_initialize(server, id, params);
+    } else if (strcmp(method, "shutdown") == 0) {
+        Message reply;
+        server->shutdown = 1;
+        if (begin_response(&reply, id)) {
+            fputs("\"result\":null}", reply.out);
+            send_message(server, &reply);
+        }
+    } else if (strcmp(method, "textDocument/didOpen") == 0) {
+        handle_did_open(server, params);
+    } else if (strcmp(method, "textDocument/didChange") == 0) {
+        handle_did_change(server, params);
+    } else if (strcmp(method, "textDocument/didClose") == 0) {
+        handle_did_close(server, params);
+    } else if (strcmp(method, "textDocument/definition") == 0) {
+        handle_definition(server, id, params);
+    } else if (id) {
+        send_error(server, id, -32601, "Method not found");
+    }
+}
+
+int lsp_serve(int in, int out, int show_stats) {
+    Server* server = calloc(1, sizeof(Server));
+    if (!server) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 1;
+    }
+    server->in = in;
+    server->out = out;
+    lexer_init();
+
+    int status = 1;
+    for (;;) {
+        /* Analysis waits until no input is pending, so a burst of
+           keystrokes is analysed once */
+        if (!input_pending(server)) publish_changed(server);
+
+        size_t length;
+        char* body = read_message(server, &length);
+        if (!body) break;
+        Arena arena;
+        arena_init(&arena);
+        JsonValue* message = json_parse(&arena, body, length);
+        const char* method = json_string(json_get(message, "method"));
+        if (!message) {
+            send_error(server, NULL, -32700, "Invalid JSON");
+        } else if (method && strcmp(method, "exit") == 0) {
+            status = server->shutdown ? 0 : 1;
+            arena_release(&arena);
+            break;
+        } else {
+            handle_message(server, message);
+        }
+        arena_release(&arena);
+    }
+
+    if (show_stats) {
+        fprintf(stderr, "LSP: %ld edits, %.1f us average, %.1f us worst; "
+                "%ld analyses, %.1f us average, %.1f us worst\n",
+                server->edits, server->edits ? server->edit_seconds / server->edits * 1e6 : 0.0,
+                server->edit_worst * 1e6,
+                server->analyses, server->analyses ? server->analysis_seconds / server->analyses * 1e6 : 0.0,
+                server->analysis_worst * 1e6);
+    }
+
+    while (server->documents) {
+        Document* doc = server->documents;
+        server->documents = doc->next;
+        free_document(doc);
+    }
+    free(server->input);
+    free(server->scratch);
+    free(server);
+    return status;
+}
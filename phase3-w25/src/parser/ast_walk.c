@@ -0,0 +1,103 @@
+/* ast_walk.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/parser.h"
+#include "../../include/ast_walk.h"
+
+/* Progress of a frame through its node */
+enum {
+    WALK_ENTER,
+    WALK_LEFT,
+    WALK_RIGHT,
+    WALK_LEAVE
+};
+
+void ast_walker_init(AstWalker* walker, AstVisitFn pre, AstVisitFn post, void* data) {
+    walker->pre = pre;
+    walker->post = post;
+    walker->data = data;
+    walker->frames = walker->local;
+    walker->count = 0;
+    walker->capacity = AST_WALK_LOCAL_FRAMES;
+}
+
+void ast_walker_release(AstWalker* walker) {
+    if (walker->frames != walker->local) free(walker->frames);
+    walker->frames = walker->local;
+    walker->count = 0;
+    walker->capacity = AST_WALK_LOCAL_FRAMES;
+}
+
+static int push_frame(AstWalker* walker, ASTNode* node, int depth, int follow_next) {
+    if (walker->count == walker->capacity) {
+        size_t capacity = walker->capacity * 2;
+        AstWalkFrame* frames = walker->frames == walker->local
+            ? malloc(capacity * sizeof(AstWalkFrame))
+            : realloc(walker->frames, capacity * sizeof(AstWalkFrame));
+        if (!frames) {
+            printf("Error: Memory allocation failed\n");
+            return 1;
+        }
+        if (walker->frames == walker->local) {
+            memcpy(frames, walker->local, sizeof(walker->local));
+        }
+        walker->frames = frames;
+        walker->capacity = capacity;
+    }
+    AstWalkFrame* frame = &walker->frames[walker->count++];
+    frame->node = node;
+    frame->depth = depth;
+    frame->value = 0;
+    frame->state = WALK_ENTER;
+    frame->follow_next = follow_next;
+    return 0;
+}
+
+int ast_walk(AstWalker* walker, ASTNode* node, int depth, int siblings) {
+    walker->count = 0;
+    if (!node) return 0;
+    if (push_frame(walker, node, depth, siblings)) return 1;
+
+    while (walker->count > 0) {
+        AstWalkFrame* frame = &walker->frames[walker->count - 1];
+        ASTNode* child;
+        switch (frame->state) {
+            case WALK_ENTER:
+                frame->state = WALK_LEFT;
+                if (walker->pre && walker->pre(walker, frame) == AST_WALK_SKIP) {
+                    frame->state = WALK_LEAVE;
+                    continue;
+                }
+                child = frame->node->left;
+                break;
+            case WALK_LEFT:
+                frame->state = WALK_RIGHT;
+                child = frame->node->right;
+                break;
+            default:
+                /* The next statement takes over the frame, so a long list
+                   does not deepen the stack */
+                if (walker->post) walker->post(walker, frame);
+                if (frame->follow_next && frame->node->next) {
+                    frame->node = frame->node->next;
+                    frame->value = 0;
+                    frame->state = WALK_ENTER;
+                } else {
+                    walker->count--;
+                }
+                continue;
+        }
+        /* Pushing may move the frames, so 'frame' is not used after it */
+        if (child && push_frame(walker, child, frame->depth + 1, 1)) {
+            walker->count = 0;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+AstWalkFrame* ast_walk_parent(AstWalker* walker) {
+    return walker->count > 1 ? &walker->frames[walker->count - 2] : NULL;
+}
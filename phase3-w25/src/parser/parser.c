@@ -2,9 +2,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 #include "../../include/parser.h"
 #include "../../include/lexer.h"
 #include "../../include/tokens.h"
+#include "../../include/token_stream.h"
+#include "../../include/ast_walk.h"
 
 /*
    Assumption: The ASTNode structure is updated to include a 'next' pointer,
@@ -20,43 +23,106 @@
 */
 
 /* Function declarations for statement parsing */
-static ASTNode* parse_if_statement();
-static ASTNode* parse_while_statement();
-static ASTNode* parse_repeat_statement();
-static ASTNode* parse_print_statement();
-static ASTNode* parse_block_statement();
-static ASTNode* parse_factorial();
-static ASTNode* parse_declaration();
-static ASTNode* parse_assignment();
-static ASTNode* parse_statement();
+static ASTNode* parse_if_statement(ParserContext *ctx);
+static ASTNode* parse_while_statement(ParserContext *ctx);
+static ASTNode* parse_repeat_statement(ParserContext *ctx);
+static ASTNode* parse_print_statement(ParserContext *ctx);
+static ASTNode* parse_block_statement(ParserContext *ctx);
+static ASTNode* parse_factorial(ParserContext *ctx);
+static ASTNode* parse_declaration(ParserContext *ctx);
+static ASTNode* parse_assignment(ParserContext *ctx);
+static ASTNode* parse_statement(ParserContext *ctx);
 
 /* New expression parsing functions */
-static ASTNode *parse_expression(void);
-static ASTNode *parse_equality(void);
-static ASTNode *parse_comparison(void);
-static ASTNode *parse_additive(void);
-static ASTNode *parse_multiplicative(void);
-static ASTNode *parse_primary(void);
-
-/* Global variables for token management */
-static Token current_token;
-static Token previous_token;
-static int position = 0;
-static const char *source;
+static ASTNode *parse_expression(ParserContext *ctx);
+static ASTNode *parse_binary(ParserContext *ctx, int min_power);
+static ASTNode *parse_primary(ParserContext *ctx);
+
+/* Consumed pages of a mapped input are released every this many bytes */
+#define SOURCE_RELEASE_INTERVAL (16 * 1024 * 1024)
+
+/* One top-level statement of an editable tree: where parse_program started
+   it and what it produced */
+typedef struct {
+    size_t start;           // Text offset of its first token
+    int length;             // Length of that token
+    int line;               // Lexer position at that token
+    int column;
+    char last_type;         // Lexer operator state before it; 0 if unknown
+    ASTNode *stmt;          // NULL when the statement failed to parse
+    int errors;             // Parse errors reported while parsing it
+} Segment;
+
+typedef struct {
+    Segment *items;
+    int count;
+    int capacity;
+} SegmentList;
+
+typedef struct {
+    ParseErrorInfo *items;
+    int count;
+    int capacity;
+} ErrorList;
+
+/* Kept with trees built by parse_edit so later edits can reuse statements.
+   The statement table is a gap buffer with the gap at the last edit:
+   statements after it store their offset and line less back_shift and
+   back_line_shift, so an edit only updates those two. */
+typedef struct {
+    Segment *segments;      // [0, front) and [capacity - back, capacity)
+    int front;
+    int back;
+    int capacity;
+    size_t back_shift;      // Added (mod 2^64) to a back statement's start
+    int back_line_shift;
+    int front_errors;       // Errors of the statements before the gap
+    SegmentList region;     // Re-parsed statements of the current edit
+    ErrorList errors;       // Every error in source order, past MAX_ERRORS too
+    ErrorList region_errors;
+    size_t text_length;
+    size_t compact_limit;   // Arena bytes after which the tree is rebuilt
+} EditState;
+
+/* All nodes of one parse live in the unit's arena. The root node is stored
+   inside the unit so free_ast can get back to the arena from the tree. */
+struct ASTUnit {
+    Arena arena;
+    InternPool names;       // Identifier IDs used by the tree's tokens
+    EditState *edit;        // NULL unless the tree came from parse_edit
+    ASTNode root;
+};
+
+static struct ASTUnit *unit_of(const ASTNode *root) {
+    return (struct ASTUnit *)((char *)root - offsetof(struct ASTUnit, root));
+}
 
 /* Error handling */
-static ParseErrorInfo errors[MAX_ERRORS];
-int error_count = 0;
+static void error_push(ErrorList *list, const ParseErrorInfo *error) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 16;
+        ParseErrorInfo *items = realloc(list->items, capacity * sizeof(ParseErrorInfo));
+        if (!items) {
+            printf("Error: Memory allocation failed\n");
+            return;
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = *error;
+}
 
-static void parse_error(ParseError error, Token token) {
-    if (error_count >= MAX_ERRORS) return;
+static void parse_error(ParserContext *ctx, ParseError error, Token token) {
+    /* An editable tree keeps every error, so later edits can reuse them */
+    EditState *edit = ctx->unit->edit;
+    if (ctx->error_count >= MAX_ERRORS && !edit) return;
 
     int column = token.column;
     if (error == PARSE_ERROR_MISSING_SEMICOLON) {
-        column += strlen(token.lexeme);
+        column += token.length;
     }
 
-    errors[error_count] = (ParseErrorInfo){
+    ParseErrorInfo info = (ParseErrorInfo){
         .type = error,
         .position = {token.line, token.column},
         .message = ""
@@ -64,61 +130,72 @@ static void parse_error(ParseError error, Token token) {
 
     switch (error) {
         case PARSE_ERROR_MISSING_SEMICOLON:
-            snprintf(errors[error_count].message, sizeof(errors[error_count].message), "Missing semicolon after '%s'", token.lexeme);
+            snprintf(info.message, sizeof(info.message), "Missing semicolon after '%.*s'", token.length, token.lexeme);
             break;
         case PARSE_ERROR_MISSING_IDENTIFIER:
-            snprintf(errors[error_count].message, sizeof(errors[error_count].message), "Missing identifier after '%s'", token.lexeme);
+            snprintf(info.message, sizeof(info.message), "Missing identifier after '%.*s'", token.length, token.lexeme);
             break;
         case PARSE_ERROR_UNEXPECTED_TOKEN:
-            snprintf(errors[error_count].message, sizeof(errors[error_count].message), "Unexpected '%s'", token.lexeme);
+            snprintf(info.message, sizeof(info.message), "Unexpected '%.*s'", token.length, token.lexeme);
             break;
         case PARSE_ERROR_MISSING_EQUALS:
-            snprintf(errors[error_count].message, sizeof(errors[error_count].message), "Expected '=' after '%s'", token.lexeme);
+            snprintf(info.message, sizeof(info.message), "Expected '=' after '%.*s'", token.length, token.lexeme);
             break;
         case PARSE_ERROR_INVALID_EXPRESSION:
-            snprintf(errors[error_count].message, sizeof(errors[error_count].message), "Invalid expression starting with '%s'", token.lexeme);
+            snprintf(info.message, sizeof(info.message), "Invalid expression starting with '%.*s'", token.length, token.lexeme);
             break;
         case PARSE_ERROR_MISSING_PARENTHESES:
-            snprintf(errors[error_count].message, sizeof(errors[error_count].message), "Missing parentheses for '%s'", token.lexeme);
+            snprintf(info.message, sizeof(info.message), "Missing parentheses for '%.*s'", token.length, token.lexeme);
             break;
         case PARSE_ERROR_MISSING_CONDITION_STATEMENT:
-            snprintf(errors[error_count].message, sizeof(errors[error_count].message), "Expected condition after '%s'", token.lexeme);
+            snprintf(info.message, sizeof(info.message), "Expected condition after '%.*s'", token.length, token.lexeme);
             break;
         case PARSE_ERROR_MISSING_BLOCK_BRACES:
-            snprintf(errors[error_count].message, sizeof(errors[error_count].message), "Expected '{}' block after '%s'", token.lexeme);
+            snprintf(info.message, sizeof(info.message), "Expected '{}' block after '%.*s'", token.length, token.lexeme);
             break;
         case PARSE_ERROR_INVALID_OPERATOR:
-            snprintf(errors[error_count].message, sizeof(errors[error_count].message), "Invalid operator '%s'", token.lexeme);
+            snprintf(info.message, sizeof(info.message), "Invalid operator '%.*s'", token.length, token.lexeme);
             break;
         case PARSE_ERROR_FUNCTION_CALL:
-            snprintf(errors[error_count].message, sizeof(errors[error_count].message), "Invalid function call '%s'", token.lexeme);
+            snprintf(info.message, sizeof(info.message), "Invalid function call '%.*s'", token.length, token.lexeme);
             break;
         default:
-            snprintf(errors[error_count].message, sizeof(errors[error_count].message), "Unknown error at %d:%d", token.line, token.column);
+            snprintf(info.message, sizeof(info.message), "Unknown error at %d:%d", token.line, token.column);
     }
-    error_count++;
+    if (edit) error_push(&edit->region_errors, &info);
+    if (ctx->error_count < MAX_ERRORS) ctx->errors[ctx->error_count++] = info;
+}
+
+void print_errors(ParserContext *ctx) {
+    print_errors_to(ctx, stdout);
 }
 
-void print_errors(void) {
-    for (int i = 0; i < error_count; i++) {
-        printf("Error %d:%d: %s\n", 
-               errors[i].position.line,
-               errors[i].position.column,
-               errors[i].message);
+void print_errors_to(ParserContext *ctx, FILE *out) {
+    for (int i = 0; i < ctx->error_count; i++) {
+        fprintf(out, "Error %d:%d: %s\n", 
+               ctx->errors[i].position.line,
+               ctx->errors[i].position.column,
+               ctx->errors[i].message);
     }
 }
 
 /* Token management functions */
-static void advance(void) {
-    previous_token = current_token;
-    current_token = get_next_token(source, &position);
+static void advance(ParserContext *ctx) {
+    ctx->previous_token = ctx->current_token;
+    ctx->current_token = token_stream_next(&ctx->stream);
+    if (ctx->source_buffer && token_stream_offset(&ctx->stream) - ctx->released_offset >= SOURCE_RELEASE_INTERVAL) {
+        ctx->released_offset = token_stream_offset(&ctx->stream);
+        source_release(ctx->source_buffer, ctx->released_offset);
+    }
 }
 
-static ASTNode *create_node(ASTNodeType type) {
-    ASTNode *node = malloc(sizeof(ASTNode));
+static ASTNode *create_node(ParserContext *ctx, ASTNodeType type) {
+    ASTNode *node = arena_alloc(&ctx->unit->arena, sizeof(ASTNode));
     if (node) {
         node->type = type;
-        node->token = current_token;
+        node->op = BINOP_NONE;
+        node->slot = -1;
+        node->token = ctx->current_token;
         node->left = NULL;
         node->right = NULL;
         node->next = NULL;
@@ -126,547 +203,1007 @@ static ASTNode *create_node(ASTNodeType type) {
     return node;
 }
 
-static int match(TokenType type) {
-    return current_token.type == type;
+static int match(ParserContext *ctx, TokenType type) {
+    return ctx->current_token.type == type;
 }
 
-static void synchronize(void) {
-    while (!match(TOKEN_SEMICOLON) &&
-           !match(TOKEN_RBRACE) &&
-           !match(TOKEN_LBRACE) &&
-           !match(TOKEN_IF) &&
-           !match(TOKEN_WHILE) &&
-           !match(TOKEN_REPEAT) &&
-           !match(TOKEN_INT) &&
-           !match(TOKEN_FLOAT) &&
-           !match(TOKEN_CHAR) &&
-           !match(TOKEN_PRINT) &&
-           !match(TOKEN_EOF)) {
-        advance();
+static void synchronize(ParserContext *ctx) {
+    while (!match(ctx, TOKEN_SEMICOLON) &&
+           !match(ctx, TOKEN_RBRACE) &&
+           !match(ctx, TOKEN_LBRACE) &&
+           !match(ctx, TOKEN_IF) &&
+           !match(ctx, TOKEN_WHILE) &&
+           !match(ctx, TOKEN_REPEAT) &&
+           !match(ctx, TOKEN_INT) &&
+           !match(ctx, TOKEN_FLOAT) &&
+           !match(ctx, TOKEN_CHAR) &&
+           !match(ctx, TOKEN_PRINT) &&
+           !match(ctx, TOKEN_EOF)) {
+        advance(ctx);
     }
-    if (match(TOKEN_SEMICOLON)) advance();
+    if (match(ctx, TOKEN_SEMICOLON)) advance(ctx);
 }
 
-static void expect(TokenType type) {
-    if (!match(type)) {
-        parse_error(PARSE_ERROR_UNEXPECTED_TOKEN, current_token);
-        synchronize();
+static void expect(ParserContext *ctx, TokenType type) {
+    if (!match(ctx, type)) {
+        parse_error(ctx, PARSE_ERROR_UNEXPECTED_TOKEN, ctx->current_token);
+        synchronize(ctx);
     }
-    advance();
+    advance(ctx);
 }
 
 /* Parsing functions */
 
-static ASTNode *parse_declaration(void) {
-    Token type_token = current_token;
-    advance();
+static ASTNode *parse_declaration(ParserContext *ctx) {
+    Token type_token = ctx->current_token;
+    advance(ctx);
 
-    if (!match(TOKEN_IDENTIFIER)) {
-        parse_error(PARSE_ERROR_MISSING_IDENTIFIER, previous_token);
-        synchronize();
+    if (!match(ctx, TOKEN_IDENTIFIER)) {
+        parse_error(ctx, PARSE_ERROR_MISSING_IDENTIFIER, ctx->previous_token);
+        synchronize(ctx);
 
-        ASTNode *node = create_node(AST_VARDECL);
+        ASTNode *node = create_node(ctx, AST_VARDECL);
         node->token = type_token;
         return node;
     }
 
-    Token identifier_token = current_token;
-    advance();
+    Token identifier_token = ctx->current_token;
+    advance(ctx);
 
     // Check for array declaration
-    if (match(TOKEN_LBRACKET)) {
-        advance();
+    if (match(ctx, TOKEN_LBRACKET)) {
+        advance(ctx);
         
-        if (!match(TOKEN_NUMBER)) {
-            parse_error(PARSE_ERROR_INVALID_EXPRESSION, current_token);
-            synchronize();
+        if (!match(ctx, TOKEN_NUMBER)) {
+            parse_error(ctx, PARSE_ERROR_INVALID_EXPRESSION, ctx->current_token);
+            synchronize(ctx);
             
-            ASTNode *node = create_node(AST_ARRAYDECL);
+            ASTNode *node = create_node(ctx, AST_ARRAYDECL);
             node->token = type_token;
             return node;
         }
         
-        Token size_token = current_token;
-        advance();
+        Token size_token = ctx->current_token;
+        advance(ctx);
         
-        if (!match(TOKEN_RBRACKET)) {
-            parse_error(PARSE_ERROR_MISSING_PARENTHESES, current_token);
+        if (!match(ctx, TOKEN_RBRACKET)) {
+            parse_error(ctx, PARSE_ERROR_MISSING_PARENTHESES, ctx->current_token);
         } else {
-            advance();
+            advance(ctx);
         }
 
-        if (!match(TOKEN_SEMICOLON)) {
-            parse_error(PARSE_ERROR_MISSING_SEMICOLON, previous_token);
+        if (!match(ctx, TOKEN_SEMICOLON)) {
+            parse_error(ctx, PARSE_ERROR_MISSING_SEMICOLON, ctx->previous_token);
         } else {
-            advance();
+            advance(ctx);
         }
-        ASTNode *node = create_node(AST_ARRAYDECL);
+        ASTNode *node = create_node(ctx, AST_ARRAYDECL);
         node->token = type_token;
-        node->left = create_node(AST_IDENTIFIER);
+        node->left = create_node(ctx, AST_IDENTIFIER);
         node->left->token = identifier_token;
-        node->right = create_node(AST_NUMBER);
+        node->right = create_node(ctx, AST_NUMBER);
         node->right->token = size_token;
         
         return node;
     }
     
-    if (!match(TOKEN_SEMICOLON)) {
-        parse_error(PARSE_ERROR_MISSING_SEMICOLON, previous_token);
+    if (!match(ctx, TOKEN_SEMICOLON)) {
+        parse_error(ctx, PARSE_ERROR_MISSING_SEMICOLON, ctx->previous_token);
     } else {
-        advance();
+        advance(ctx);
     }
 
-    ASTNode *node = create_node(AST_VARDECL);
+    ASTNode *node = create_node(ctx, AST_VARDECL);
     node->token = type_token;
-    node->left = create_node(AST_IDENTIFIER);
+    node->left = create_node(ctx, AST_IDENTIFIER);
     node->left->token = identifier_token;
     
     return node;
 }
 
 
-static ASTNode *parse_assignment(void) {
-    Token identifier_token = current_token;
-    advance();
+static ASTNode *parse_assignment(ParserContext *ctx) {
+    Token identifier_token = ctx->current_token;
+    advance(ctx);
     
     ASTNode *lhs = NULL;
     
-    if (match(TOKEN_LBRACKET)) {
-        advance(); 
-        ASTNode *index_expr = parse_expression();
+    if (match(ctx, TOKEN_LBRACKET)) {
+        advance(ctx); 
+        ASTNode *index_expr = parse_expression(ctx);
         
-        if (!match(TOKEN_RBRACKET)) {
-            parse_error(PARSE_ERROR_MISSING_PARENTHESES, current_token);
+        if (!match(ctx, TOKEN_RBRACKET)) {
+            parse_error(ctx, PARSE_ERROR_MISSING_PARENTHESES, ctx->current_token);
         } else {
-            advance();
+            advance(ctx);
         }
-        lhs = create_node(AST_ARRAYACCESS);
+        lhs = create_node(ctx, AST_ARRAYACCESS);
         lhs->token = identifier_token;
-        lhs->left = create_node(AST_IDENTIFIER);
+        lhs->left = create_node(ctx, AST_IDENTIFIER);
         lhs->left->token = identifier_token;
         lhs->right = index_expr;
     } else {
-        lhs = create_node(AST_IDENTIFIER);
+        lhs = create_node(ctx, AST_IDENTIFIER);
         lhs->token = identifier_token;
     }
 
-    ASTNode *node = create_node(AST_ASSIGN);
+    ASTNode *node = create_node(ctx, AST_ASSIGN);
     node->left = lhs;
 
-    if (!match(TOKEN_EQUALS)) {
-        parse_error(PARSE_ERROR_MISSING_EQUALS, previous_token);
-        free_ast(node);
-        synchronize();
+    if (!match(ctx, TOKEN_EQUALS)) {
+        parse_error(ctx, PARSE_ERROR_MISSING_EQUALS, ctx->previous_token);
+        synchronize(ctx);
         return NULL;
     }
-    advance();
+    advance(ctx);
 
-    node->right = parse_expression();
+    node->right = parse_expression(ctx);
     if (!node->right) {
-        parse_error(PARSE_ERROR_INVALID_EXPRESSION, current_token);
-        free_ast(node);
-        synchronize();
+        parse_error(ctx, PARSE_ERROR_INVALID_EXPRESSION, ctx->current_token);
+        synchronize(ctx);
         return NULL;
     }
 
-    if (!match(TOKEN_SEMICOLON)) {
-        parse_error(PARSE_ERROR_MISSING_SEMICOLON, previous_token);
+    if (!match(ctx, TOKEN_SEMICOLON)) {
+        parse_error(ctx, PARSE_ERROR_MISSING_SEMICOLON, ctx->previous_token);
     } else {
-        advance();
+        advance(ctx);
     }
     
     return node;
 }
 
 
-static ASTNode *parse_primary(void) {
-    if (match(TOKEN_NUMBER)) {
-        ASTNode *node = create_node(AST_NUMBER);
-        node->token = current_token;
-        advance();
+static ASTNode *parse_primary(ParserContext *ctx) {
+    if (match(ctx, TOKEN_NUMBER)) {
+        ASTNode *node = create_node(ctx, AST_NUMBER);
+        node->token = ctx->current_token;
+        advance(ctx);
         return node;
-    } else if (match(TOKEN_IDENTIFIER)) {
-        Token identifier_token = current_token;
-        advance();
+    } else if (match(ctx, TOKEN_IDENTIFIER)) {
+        Token identifier_token = ctx->current_token;
+        advance(ctx);
         
-        if (match(TOKEN_LBRACKET)) {
-            advance();
+        if (match(ctx, TOKEN_LBRACKET)) {
+            advance(ctx);
             
-            ASTNode *index_expr = parse_expression();
+            ASTNode *index_expr = parse_expression(ctx);
             
-            if (!match(TOKEN_RBRACKET)) {
-                parse_error(PARSE_ERROR_MISSING_PARENTHESES, current_token);
+            if (!match(ctx, TOKEN_RBRACKET)) {
+                parse_error(ctx, PARSE_ERROR_MISSING_PARENTHESES, ctx->current_token);
             } else {
-                advance();
+                advance(ctx);
             }
         
-            ASTNode *node = create_node(AST_ARRAYACCESS);
+            ASTNode *node = create_node(ctx, AST_ARRAYACCESS);
             node->token = identifier_token;
-            node->left = create_node(AST_IDENTIFIER);
+            node->left = create_node(ctx, AST_IDENTIFIER);
             node->left->token = identifier_token;
             node->right = index_expr;
             
             return node;
         }
         
-        ASTNode *node = create_node(AST_IDENTIFIER);
+        ASTNode *node = create_node(ctx, AST_IDENTIFIER);
         node->token = identifier_token;
         return node;
-    } else if (match(TOKEN_LPAREN)) {
-        advance();
-        ASTNode *node = parse_expression();
-        if (!match(TOKEN_RPAREN)) {
-            parse_error(PARSE_ERROR_MISSING_PARENTHESES, current_token);
+    } else if (match(ctx, TOKEN_FACTORIAL)) {
+        return parse_factorial(ctx);
+    } else if (match(ctx, TOKEN_LPAREN)) {
+        advance(ctx);
+        ASTNode *node = parse_expression(ctx);
+        if (!match(ctx, TOKEN_RPAREN)) {
+            parse_error(ctx, PARSE_ERROR_MISSING_PARENTHESES, ctx->current_token);
         } else {
-            advance();
+            advance(ctx);
         }
         return node;
     } else {
-        parse_error(PARSE_ERROR_INVALID_EXPRESSION, current_token);
+        parse_error(ctx, PARSE_ERROR_INVALID_EXPRESSION, ctx->current_token);
         return NULL;
     }
 }
 
 
-static ASTNode *parse_multiplicative(void) {
-    ASTNode *node = parse_primary();
-    while (match(TOKEN_OPERATOR) && 
-           (strcmp(current_token.lexeme, "*") == 0 || strcmp(current_token.lexeme, "/") == 0)) {
-        ASTNode *new_node = create_node(AST_BINOP);
-        new_node->token = current_token;
-        new_node->left = node;
-        advance(); // consume operator
-        new_node->right = parse_primary();
-        node = new_node;
-    }
-    return node;
-}
+/* Binding power of the binary operators: a higher power binds tighter and
+   0 ends an expression. Equal powers associate to the left. A new operator
+   needs an entry here and nothing else in the parser. */
+enum {
+    POWER_NONE,
+    POWER_EQUALITY,         // == !=
+    POWER_COMPARISON,       // < >
+    POWER_ADDITIVE,         // + -
+    POWER_MULTIPLICATIVE    // * /
+};
 
-static ASTNode *parse_additive(void) {
-    ASTNode *node = parse_multiplicative();
-    while (match(TOKEN_OPERATOR) &&
-           (strcmp(current_token.lexeme, "+") == 0 || strcmp(current_token.lexeme, "-") == 0)) {
-        ASTNode *new_node = create_node(AST_BINOP);
-        new_node->token = current_token;
-        new_node->left = node;
-        advance(); // consume operator
-        new_node->right = parse_multiplicative();
-        node = new_node;
-    }
-    return node;
-}
-
-static ASTNode *parse_comparison(void) {
-    ASTNode *node = parse_additive();
-    while (match(TOKEN_LESS) || match(TOKEN_GREATER)) {
-        ASTNode *new_node = create_node(AST_BINOP);
-        new_node->token = current_token;
-        new_node->left = node;
-        advance(); // consume operator
-        new_node->right = parse_additive();
-        node = new_node;
-    }
-    return node;
-}
+/* Indexed by token type; tokens that are not binary operators get 0 */
+static const struct {
+    unsigned char power;
+    unsigned char op;       // BinaryOp
+} binary_operators[256] = {
+    [TOKEN_EQUAL_EQUAL] = {POWER_EQUALITY, BINOP_EQUAL},
+    [TOKEN_NOT_EQUAL] = {POWER_EQUALITY, BINOP_NOT_EQUAL},
+    [TOKEN_LESS] = {POWER_COMPARISON, BINOP_LESS},
+    [TOKEN_GREATER] = {POWER_COMPARISON, BINOP_GREATER},
+    [TOKEN_PLUS] = {POWER_ADDITIVE, BINOP_ADD},
+    [TOKEN_MINUS] = {POWER_ADDITIVE, BINOP_SUB},
+    [TOKEN_STAR] = {POWER_MULTIPLICATIVE, BINOP_MUL},
+    [TOKEN_SLASH] = {POWER_MULTIPLICATIVE, BINOP_DIV}
+};
 
-static ASTNode *parse_equality(void) {
-    ASTNode *node = parse_comparison();
-    while (match(TOKEN_EQUAL_EQUAL) || match(TOKEN_NOT_EQUAL)) {
-        ASTNode *new_node = create_node(AST_BINOP);
-        new_node->token = current_token;
+/* Operators binding tighter than 'min_power' and their operands. Runs of
+   operators of one power are built in the loop, so a + b + c takes one
+   call per operand rather than one per precedence level. */
+static ASTNode *parse_binary(ParserContext *ctx, int min_power) {
+    ASTNode *node = parse_primary(ctx);
+    int power;
+    while ((power = binary_operators[ctx->current_token.type].power) > min_power) {
+        ASTNode *new_node = create_node(ctx, AST_BINOP);
+        new_node->token = ctx->current_token;
+        new_node->op = binary_operators[ctx->current_token.type].op;
         new_node->left = node;
-        advance(); // consume operator
-        new_node->right = parse_comparison();
+        advance(ctx); // consume operator
+        new_node->right = parse_binary(ctx, power);
         node = new_node;
     }
     return node;
 }
 
-static ASTNode *parse_expression(void) {
-    return parse_equality();
+static ASTNode *parse_expression(ParserContext *ctx) {
+    return parse_binary(ctx, POWER_NONE);
 }
 
-static ASTNode *parse_if_statement(void) {
-    ASTNode *node = create_node(AST_IF);
-    advance(); // consume 'if'
+static ASTNode *parse_if_statement(ParserContext *ctx) {
+    ASTNode *node = create_node(ctx, AST_IF);
+    advance(ctx); // consume 'if'
 
-    if (match(TOKEN_LPAREN)) {
-        advance(); // consume '('
-        node->left = parse_expression();
-        if (!match(TOKEN_RPAREN)) {
-            parse_error(PARSE_ERROR_MISSING_PARENTHESES, previous_token);
+    if (match(ctx, TOKEN_LPAREN)) {
+        advance(ctx); // consume '('
+        node->left = parse_expression(ctx);
+        if (!match(ctx, TOKEN_RPAREN)) {
+            parse_error(ctx, PARSE_ERROR_MISSING_PARENTHESES, ctx->previous_token);
         } else {
-            advance(); // consume ')'
+            advance(ctx); // consume ')'
         }
     } else {
-        parse_error(PARSE_ERROR_MISSING_PARENTHESES, current_token);
+        parse_error(ctx, PARSE_ERROR_MISSING_PARENTHESES, ctx->current_token);
     }
 
-    if (match(TOKEN_LBRACE)) {
-        node->right = parse_block_statement();
+    if (match(ctx, TOKEN_LBRACE)) {
+        node->right = parse_block_statement(ctx);
     } else {
-        node->right = parse_statement();
+        node->right = parse_statement(ctx);
     }
     
     return node;
 }
 
-static ASTNode *parse_while_statement(void) {
-    ASTNode *node = create_node(AST_WHILE);
-    advance(); // consume 'while'
+static ASTNode *parse_while_statement(ParserContext *ctx) {
+    ASTNode *node = create_node(ctx, AST_WHILE);
+    advance(ctx); // consume 'while'
 
-    if (!match(TOKEN_LPAREN)) {
-        parse_error(PARSE_ERROR_MISSING_PARENTHESES, current_token);
+    if (!match(ctx, TOKEN_LPAREN)) {
+        parse_error(ctx, PARSE_ERROR_MISSING_PARENTHESES, ctx->current_token);
     }
-    advance();
-    node->left = parse_expression();
+    advance(ctx);
+    node->left = parse_expression(ctx);
     if (node->left == NULL) {
-        parse_error(PARSE_ERROR_MISSING_CONDITION_STATEMENT, current_token);
+        parse_error(ctx, PARSE_ERROR_MISSING_CONDITION_STATEMENT, ctx->current_token);
     }
-    if (!match(TOKEN_RPAREN)) {
-        parse_error(PARSE_ERROR_MISSING_PARENTHESES, current_token);
+    if (!match(ctx, TOKEN_RPAREN)) {
+        parse_error(ctx, PARSE_ERROR_MISSING_PARENTHESES, ctx->current_token);
     }
-    advance();
+    advance(ctx);
 
-    if (!match(TOKEN_LBRACE)) {
-        parse_error(PARSE_ERROR_MISSING_BLOCK_BRACES, current_token);
-    }
-    advance();
-    node->right = parse_block_statement();
-    if (!match(TOKEN_RBRACE)) {
-        parse_error(PARSE_ERROR_MISSING_BLOCK_BRACES, current_token);
-    }
-    advance();
+    node->right = parse_block_statement(ctx);  // consumes '{' and '}'
     return node;
 }
 
-static ASTNode *parse_repeat_statement(void) {
-    ASTNode *node = create_node(AST_REPEAT);
-    advance(); // consume 'repeat'
+static ASTNode *parse_repeat_statement(ParserContext *ctx) {
+    ASTNode *node = create_node(ctx, AST_REPEAT);
+    advance(ctx); // consume 'repeat'
 
-    if (!match(TOKEN_LBRACE)) {
-        parse_error(PARSE_ERROR_MISSING_BLOCK_BRACES, current_token);
-    }
-    advance(); // consume '{'
-    node->right = parse_block_statement();
-    if (!match(TOKEN_RBRACE)) {
-        parse_error(PARSE_ERROR_MISSING_BLOCK_BRACES, current_token);
-    }
-    advance(); // consume '}'
+    node->right = parse_block_statement(ctx);  // consumes '{' and '}'
 
-    if (!match(TOKEN_UNTIL)) {
-        parse_error(PARSE_ERROR_INVALID_EXPRESSION, current_token);
+    if (!match(ctx, TOKEN_UNTIL)) {
+        parse_error(ctx, PARSE_ERROR_INVALID_EXPRESSION, ctx->current_token);
     }
-    advance(); // consume 'until'
+    advance(ctx); // consume 'until'
 
-    if (!match(TOKEN_LPAREN)) {
-        parse_error(PARSE_ERROR_MISSING_PARENTHESES, current_token);
+    if (!match(ctx, TOKEN_LPAREN)) {
+        parse_error(ctx, PARSE_ERROR_MISSING_PARENTHESES, ctx->current_token);
     }
-    advance(); // consume '('
-    node->left = parse_expression();
+    advance(ctx); // consume '('
+    node->left = parse_expression(ctx);
     if (node->left == NULL) {
-        parse_error(PARSE_ERROR_MISSING_CONDITION_STATEMENT, current_token);
+        parse_error(ctx, PARSE_ERROR_MISSING_CONDITION_STATEMENT, ctx->current_token);
     }
-    if (!match(TOKEN_RPAREN)) {
-        parse_error(PARSE_ERROR_MISSING_PARENTHESES, current_token);
+    if (!match(ctx, TOKEN_RPAREN)) {
+        parse_error(ctx, PARSE_ERROR_MISSING_PARENTHESES, ctx->current_token);
     }
-    advance(); // consume ')'
+    advance(ctx); // consume ')'
     return node;
 }
 
-static ASTNode* parse_print_statement(void) {
-    ASTNode *node = create_node(AST_PRINT);
-    advance(); // consume 'print'
+static ASTNode* parse_print_statement(ParserContext *ctx) {
+    ASTNode *node = create_node(ctx, AST_PRINT);
+    advance(ctx); // consume 'print'
 
-    if (!match(TOKEN_IDENTIFIER) && !match(TOKEN_NUMBER)) {
-        parse_error(PARSE_ERROR_MISSING_IDENTIFIER, previous_token);
-        synchronize();
+    if (!match(ctx, TOKEN_IDENTIFIER) && !match(ctx, TOKEN_NUMBER) && !match(ctx, TOKEN_FACTORIAL)) {
+        parse_error(ctx, PARSE_ERROR_MISSING_IDENTIFIER, ctx->previous_token);
+        synchronize(ctx);
         return node;
     }
-    node->left = parse_expression();
-    if (!match(TOKEN_SEMICOLON)) {
-        parse_error(PARSE_ERROR_MISSING_SEMICOLON, current_token);
-        synchronize();
+    node->left = parse_expression(ctx);
+    if (!match(ctx, TOKEN_SEMICOLON)) {
+        parse_error(ctx, PARSE_ERROR_MISSING_SEMICOLON, ctx->current_token);
+        synchronize(ctx);
     } else {
-        advance(); // consume ';'
+        advance(ctx); // consume ';'
     }
     return node;
 }
 
-static ASTNode* parse_block_statement(void) {
-    ASTNode *node = create_node(AST_BLOCK);
+static ASTNode* parse_block_statement(ParserContext *ctx) {
+    ASTNode *node = create_node(ctx, AST_BLOCK);
     /* Link statements using the 'next' pointer for block contents */
     ASTNode **current = &node->next;
     
-    if (!match(TOKEN_LBRACE)) {
-        parse_error(PARSE_ERROR_MISSING_BLOCK_BRACES, current_token);
+    if (!match(ctx, TOKEN_LBRACE)) {
+        parse_error(ctx, PARSE_ERROR_MISSING_BLOCK_BRACES, ctx->current_token);
     } else {
-        advance(); // consume '{'
+        advance(ctx); // consume '{'
     }
     
-    while (!match(TOKEN_RBRACE) && !match(TOKEN_EOF)) {
-        ASTNode *stmt = parse_statement();
+    while (!match(ctx, TOKEN_RBRACE) && !match(ctx, TOKEN_EOF)) {
+        ASTNode *stmt = parse_statement(ctx);
         if (stmt) {
             *current = stmt;
             current = &stmt->next;
         }
-        if (match(TOKEN_SEMICOLON)) {
-            advance();
+        if (match(ctx, TOKEN_SEMICOLON)) {
+            advance(ctx);
         }
     }
     
-    if (match(TOKEN_RBRACE)) {
-        advance(); // consume '}'
+    if (match(ctx, TOKEN_RBRACE)) {
+        advance(ctx); // consume '}'
     }
     
     return node;
 }
 
-static ASTNode* parse_factorial(void) {
-    ASTNode *node = create_node(AST_FACTORIAL);
-    advance(); // consume 'factorial'
+static ASTNode* parse_factorial(ParserContext *ctx) {
+    ASTNode *node = create_node(ctx, AST_FACTORIAL);
+    advance(ctx); // consume 'factorial'
     
-    if (!match(TOKEN_LPAREN)) {
-        parse_error(PARSE_ERROR_MISSING_PARENTHESES, current_token);
+    if (!match(ctx, TOKEN_LPAREN)) {
+        parse_error(ctx, PARSE_ERROR_MISSING_PARENTHESES, ctx->current_token);
     }
-    advance(); // consume '('
+    advance(ctx); // consume '('
     
-    if (!match(TOKEN_NUMBER) && !match(TOKEN_IDENTIFIER)) {
-        parse_error(PARSE_ERROR_INVALID_EXPRESSION, current_token);
+    if (!match(ctx, TOKEN_NUMBER) && !match(ctx, TOKEN_IDENTIFIER)) {
+        parse_error(ctx, PARSE_ERROR_INVALID_EXPRESSION, ctx->current_token);
+        advance(ctx);
+    } else {
+        node->left = parse_expression(ctx);
     }
-    advance();
     
-    if (!match(TOKEN_RPAREN)) {
-        parse_error(PARSE_ERROR_MISSING_PARENTHESES, current_token);
+    if (!match(ctx, TOKEN_RPAREN)) {
+        parse_error(ctx, PARSE_ERROR_MISSING_PARENTHESES, ctx->current_token);
     }
-    advance(); // consume ')'
+    advance(ctx); // consume ')'
     
     return node;
 }
 
-static ASTNode *parse_statement(void) {
+static ASTNode *parse_statement(ParserContext *ctx) {
     ASTNode *stmt = NULL;
-    if (match(TOKEN_INT)) {
-        stmt = parse_declaration();
-    } else if (match(TOKEN_FLOAT)) {
-        stmt = parse_declaration();
-    } else if (match(TOKEN_CHAR)) {
-        stmt = parse_declaration();
-    } else if (match(TOKEN_IDENTIFIER)) {
-        stmt = parse_assignment();
-    } else if (match(TOKEN_IF)) {
-        stmt = parse_if_statement();
-    } else if (match(TOKEN_WHILE)) {
-        stmt = parse_while_statement();
-    } else if (match(TOKEN_REPEAT)) {
-        stmt = parse_repeat_statement();
-    } else if (match(TOKEN_PRINT)) {
-        stmt = parse_print_statement();
-    } else if (match(TOKEN_FACTORIAL)) {
-        stmt = parse_factorial();
+    if (match(ctx, TOKEN_INT)) {
+        stmt = parse_declaration(ctx);
+    } else if (match(ctx, TOKEN_FLOAT)) {
+        stmt = parse_declaration(ctx);
+    } else if (match(ctx, TOKEN_CHAR)) {
+        stmt = parse_declaration(ctx);
+    } else if (match(ctx, TOKEN_IDENTIFIER)) {
+        stmt = parse_assignment(ctx);
+    } else if (match(ctx, TOKEN_IF)) {
+        stmt = parse_if_statement(ctx);
+    } else if (match(ctx, TOKEN_WHILE)) {
+        stmt = parse_while_statement(ctx);
+    } else if (match(ctx, TOKEN_REPEAT)) {
+        stmt = parse_repeat_statement(ctx);
+    } else if (match(ctx, TOKEN_PRINT)) {
+        stmt = parse_print_statement(ctx);
+    } else if (match(ctx, TOKEN_FACTORIAL)) {
+        stmt = parse_factorial(ctx);
     } else {
-        parse_error(PARSE_ERROR_UNEXPECTED_TOKEN, current_token);
-        advance(); // consume invalid token
+        parse_error(ctx, PARSE_ERROR_UNEXPECTED_TOKEN, ctx->current_token);
+        advance(ctx); // consume invalid token
     }
     return stmt;
 }
 
-static ASTNode *parse_program(void) {
-    ASTNode *program = create_node(AST_PROGRAM);
+static Segment *segment_push(SegmentList *list) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 64;
+        Segment *items = realloc(list->items, capacity * sizeof(Segment));
+        if (!items) {
+            printf("Error: Memory allocation failed\n");
+            return NULL;
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+    return &list->items[list->count++];
+}
+
+/* The lexer's operator state after 'token'. == and != leave the state as it
+   was, so it cannot be told from the token alone and 0 (unknown) is given. */
+static char lexer_type_after(Token token) {
+    if (TOKEN_IS_ARITHMETIC(token.type) || token.error == ERROR_CONSECUTIVE_OPERATORS) return 'o';
+    if (token.type == TOKEN_EQUAL_EQUAL || token.type == TOKEN_NOT_EQUAL) return 0;
+    return 'x';
+}
+
+/* Segment i of the table; its start and line still need the back shifts
+   when i >= front */
+static Segment *segment_at(const EditState *state, int i) {
+    return &state->segments[i < state->front ? i : state->capacity - state->back + (i - state->front)];
+}
+
+static size_t segment_start(const EditState *state, int i) {
+    return segment_at(state, i)->start + (i < state->front ? 0 : state->back_shift);
+}
+
+static int segment_line(const EditState *state, int i) {
+    return segment_at(state, i)->line + (i < state->front ? 0 : state->back_line_shift);
+}
+
+/* Moves the gap so that 'front' statements precede it */
+static void move_gap(EditState *state, int front) {
+    while (state->front > front) {
+        Segment segment = state->segments[--state->front];
+        segment.start -= state->back_shift;
+        segment.line -= state->back_line_shift;
+        state->segments[state->capacity - ++state->back] = segment;
+        state->front_errors -= segment.errors;
+    }
+    while (state->front < front) {
+        Segment segment = state->segments[state->capacity - state->back--];
+        segment.start += state->back_shift;
+        segment.line += state->back_line_shift;
+        state->segments[state->front++] = segment;
+        state->front_errors += segment.errors;
+    }
+}
+
+/* First statement in [first, count) whose first token ends at or after
+   'offset' (with 'length' set) or starts at or after it */
+static int search_segments(const EditState *state, size_t offset, int with_length, int first) {
+    int limit = state->front + state->back;
+    while (first < limit) {
+        int middle = first + (limit - first) / 2;
+        size_t end = segment_start(state, middle) + (with_length ? (size_t)segment_at(state, middle)->length : 0);
+        if (end < offset) {
+            first = middle + 1;
+        } else {
+            limit = middle;
+        }
+    }
+    return first;
+}
+
+/* Where a run of top-level statements is lexed from, and where it may
+   rejoin the statements of the previous parse */
+typedef struct {
+    const char *text;       // Start of the lexed text
+    size_t base;            // Offset of 'text' in the whole source
+    const EditState *old;   // Statements of the previous parse; NULL to parse to the end
+    size_t resume;          // Earliest offset at which to rejoin them
+    int first;              // Old statements that may be rejoined: [first, limit)
+    int limit;
+    long shift;             // Offset in the edited text minus offset in the old one
+    int synced;             // Old statement the run stopped at, or -1
+    int line_shift;         // Line of that statement now minus its old line
+} SegmentRun;
+
+/* parse_program's statement loop, recording a segment for each statement in
+   'out'. With run->old set it stops as soon as it reaches the start of an old
+   statement past the edit in the same lexer state: from there on the tokens,
+   and so the statements, are the old ones with lines moved. */
+static int parse_segments(ParserContext *ctx, ASTNode ***link, SegmentList *out, SegmentRun *run, char last_type) {
+    while (!match(ctx, TOKEN_EOF)) {
+        Token token = ctx->current_token;
+        size_t start = run->base + (size_t)(token.lexeme - run->text);
+        if (run->old && start >= run->resume && last_type) {
+            size_t old_start = (size_t)((long)start - run->shift);
+            int j = search_segments(run->old, old_start, 0, run->first);
+            const Segment *old = j < run->limit ? segment_at(run->old, j) : NULL;
+            if (old && segment_start(run->old, j) == old_start && old->last_type &&
+                old->column == token.column && (old->last_type == 'o') == (last_type == 'o')) {
+                run->synced = j;
+                run->line_shift = token.line - segment_line(run->old, j);
+                return 0;
+            }
+        }
+
+        Segment *segment = segment_push(out);
+        if (!segment) return 1;
+        segment->start = start;
+        segment->length = token.length;
+        segment->line = token.line;
+        segment->column = token.column;
+        segment->last_type = last_type;
+        ErrorList *errors = &ctx->unit->edit->region_errors;
+        int errors_before = errors->count;
+
+        ASTNode *stmt = parse_statement(ctx);
+        if (stmt) {
+            **link = stmt;
+            *link = &stmt->next;
+        } else {
+            while (!match(ctx, TOKEN_SEMICOLON) &&
+                   !match(ctx, TOKEN_RBRACE) &&
+                   !match(ctx, TOKEN_EOF)) {
+                advance(ctx);
+            }
+            if (match(ctx, TOKEN_SEMICOLON)) advance(ctx);
+        }
+        segment->stmt = stmt;
+        segment->errors = errors->count - errors_before;
+        last_type = lexer_type_after(ctx->previous_token);
+    }
+    return 0;
+}
+
+static ASTNode *parse_program(ParserContext *ctx) {
+    ASTNode *program = &ctx->unit->root;
+    program->type = AST_PROGRAM;
+    program->op = BINOP_NONE;
+    program->slot = -1;
+    program->token = ctx->current_token;
+    program->left = NULL;
+    program->right = NULL;
+    program->next = NULL;
     /* Link statements using the 'next' pointer in the program node */
     ASTNode **current = &program->next;
+
+    if (ctx->unit->edit) {
+        SegmentRun run = {ctx->stream.text, 0, NULL, 0, 0, 0, 0, -1, 0};
+        parse_segments(ctx, &current, &ctx->unit->edit->region, &run, 'x');
+        return program;
+    }
     
-    while (!match(TOKEN_EOF)) {
-        ASTNode *stmt = parse_statement();
+    while (!match(ctx, TOKEN_EOF)) {
+        ASTNode *stmt = parse_statement(ctx);
         if (stmt) {
             *current = stmt;
             current = &stmt->next;
         } else {
-            while (!match(TOKEN_SEMICOLON) && 
-                   !match(TOKEN_RBRACE) && 
-                   !match(TOKEN_EOF)) {
-                advance();
+            while (!match(ctx, TOKEN_SEMICOLON) && 
+                   !match(ctx, TOKEN_RBRACE) && 
+                   !match(ctx, TOKEN_EOF)) {
+                advance(ctx);
             }
-            if (match(TOKEN_SEMICOLON)) advance();
+            if (match(ctx, TOKEN_SEMICOLON)) advance(ctx);
         }
     }
     
     return program;
 }
 
-void parser_init(const char *input) {
-    source = input;
-    position = 0;
-    error_count = 0;  // Reset error count on new input
-    advance(); 
+/* Starts a new unit; a unit from an earlier parser_init that was never
+   parsed is dropped */
+static int begin_unit(ParserContext *ctx) {
+    if (ctx->unit) {
+        intern_release(&ctx->unit->names);
+        arena_release(&ctx->unit->arena);
+        free(ctx->unit);
+    }
+    ctx->unit = malloc(sizeof(struct ASTUnit));
+    if (!ctx->unit) {
+        printf("Error: Memory allocation failed\n");
+        return 0;
+    }
+    arena_init(&ctx->unit->arena);
+    intern_init(&ctx->unit->names, NULL);
+    ctx->unit->edit = NULL;
+    ctx->source_buffer = NULL;
+    ctx->released_offset = 0;
+    ctx->error_count = 0;  // Reset error count on new input
+    return 1;
 }
 
-ASTNode *parse(void) {
-    return parse_program();
+void parser_init(ParserContext *ctx, const char *input) {
+    token_stream_close(&ctx->stream);
+    if (!begin_unit(ctx)) return;
+    token_stream_init_string(&ctx->stream, input, &ctx->unit->names);
+    advance(ctx); 
+}
+
+/* Parses straight out of a loaded (possibly memory-mapped) source */
+void parser_init_source(ParserContext *ctx, const SourceBuffer *input) {
+    parser_init(ctx, input->data);
+    ctx->source_buffer = input;
+}
+
+/* Parses from a descriptor in chunks without loading the whole input.
+   Token text is copied into the unit's arena as it is lexed. */
+int parser_init_fd(ParserContext *ctx, int fd) {
+    token_stream_close(&ctx->stream);
+    if (!begin_unit(ctx)) return 1;
+    /* Names must outlive the reused input window */
+    intern_init(&ctx->unit->names, &ctx->unit->arena);
+    if (token_stream_init_fd(&ctx->stream, fd, &ctx->unit->arena, &ctx->unit->names) != 0) return 1;
+    advance(ctx);
+    return 0;
+}
+
+ASTNode *parse(ParserContext *ctx) {
+    if (!ctx->unit) return NULL;
+    ASTNode *program = parse_program(ctx);
+    token_stream_close(&ctx->stream);
+    ctx->unit = NULL;
+    return program;
+}
+
+/* Copies the edited text between old offsets 'lo' and 'hi' (around the
+   edit) into 'out' */
+static size_t apply_edit(char *out, const char *source, size_t lo, size_t hi, const TextEdit *edit) {
+    size_t before = edit->offset - lo;
+    size_t after = hi - (edit->offset + edit->deleted);
+    memcpy(out, source + lo, before);
+    memcpy(out + before, edit->inserted, edit->inserted_length);
+    memcpy(out + before + edit->inserted_length, source + edit->offset + edit->deleted, after);
+    out[before + edit->inserted_length + after] = '\0';
+    return before + edit->inserted_length + after;
+}
+
+/* Parses the whole edited text into a new editable tree, which owns a copy
+   of the text */
+static ASTNode *reparse_all(ParserContext *ctx, const char *source, size_t length, const TextEdit *edit) {
+    token_stream_close(&ctx->stream);
+    if (!begin_unit(ctx)) return NULL;
+    struct ASTUnit *unit = ctx->unit;
+    char *text = arena_alloc(&unit->arena, length - edit->deleted + edit->inserted_length + 1);
+    unit->edit = calloc(1, sizeof(EditState));
+    if (!text || !unit->edit) {
+        printf("Error: Memory allocation failed\n");
+        free(unit->edit);
+        unit->edit = NULL;
+        return NULL;
+    }
+    unit->edit->text_length = apply_edit(text, source, 0, length, edit);
+    token_stream_init_string(&ctx->stream, text, &unit->names);
+    advance(ctx);
+    ASTNode *program = parse(ctx);
+
+    EditState *state = unit->edit;
+    state->segments = state->region.items;
+    state->capacity = state->region.capacity;
+    state->front = state->region.count;
+    state->region = (SegmentList){NULL, 0, 0};
+    state->errors = state->region_errors;
+    state->front_errors = state->errors.count;
+    state->region_errors = (ErrorList){NULL, 0, 0};
+    state->compact_limit = 4 * unit->arena.bytes_used + 64 * 1024;
+    return program;
+}
+
+/* Moves a token the walker's 'data' lines. Walks start at a top-level
+   statement without its siblings, since its own 'next' is the following
+   statement, which the caller shifts itself. */
+static int shift_line(AstWalker *walker, AstWalkFrame *frame) {
+    frame->node->token.line += *(int *)walker->data;
+    return AST_WALK_CONTINUE;
+}
+
+/* Re-parses the top-level statements the edit can affect and splices the
+   rest of the old tree back around them. Returns nonzero when the tree has
+   to be rebuilt instead. */
+static int reparse_region(ParserContext *ctx, ASTNode *root, const char *source, const TextEdit *edit) {
+    struct ASTUnit *unit = unit_of(root);
+    EditState *state = unit->edit;
+    int count = state->front + state->back;
+    size_t edit_end = edit->offset + edit->deleted;
+    long shift = (long)edit->inserted_length - (long)edit->deleted;
+
+    /* Statements saw at most the first token of the next one as lookahead.
+       Start at the last statement whose first token, and the byte the lexer
+       looked at after it, come before the edit; the ones before it stay. */
+    int first_kept = search_segments(state, edit->offset, 1, 0) - 1;
+    while (first_kept >= 0 && !segment_at(state, first_kept)->last_type) first_kept--;
+    int start_index = first_kept < 0 ? 0 : first_kept;
+    move_gap(state, start_index);
+    Segment restart = first_kept >= 0 ? *segment_at(state, first_kept) : (Segment){0};
+    if (first_kept >= 0) {
+        restart.start = segment_start(state, first_kept);
+        restart.line = segment_line(state, first_kept);
+    }
+
+    /* Old statements that start after the edit can be rejoined */
+    int first = search_segments(state, edit_end, 0, start_index);
+
+    ASTNode **region_link = &root->next;
+    for (int i = start_index - 1; i >= 0; i--) {
+        if (state->segments[i].stmt) {
+            region_link = &state->segments[i].stmt->next;
+            break;
+        }
+    }
+
+    /* Lex a window of the edited text that ends at an old statement a few
+       past the edit, and widen it until the parse rejoins the old statements
+       or reaches the real end of the text */
+    ctx->unit = unit;
+    ctx->source_buffer = NULL;
+    SegmentRun run;
+    ASTNode **link;
+    int window_end = first + 4;
+    for (;;) {
+        size_t hi = window_end < count ? segment_start(state, window_end) : state->text_length;
+        char *window = arena_alloc(&unit->arena, hi - restart.start + edit->inserted_length - edit->deleted + 1);
+        if (!window) {
+            printf("Error: Memory allocation failed\n");
+            ctx->unit = NULL;
+            return 1;
+        }
+        apply_edit(window, source, restart.start, hi, edit);
+
+        token_stream_init_string(&ctx->stream, window, &unit->names);
+        if (first_kept >= 0) {
+            ctx->stream.lexer.line = restart.line;
+            ctx->stream.lexer.column = restart.column;
+            ctx->stream.lexer.last_token_type = restart.last_type;
+        }
+        ctx->error_count = 0;
+        state->region_errors.count = 0;
+        advance(ctx);
+        if (first_kept < 0) root->token = ctx->current_token;
+
+        /* A statement is rejoined only if the token after its first one is
+           inside the window too, so the lexer did not see the window's end
+           when it produced it */
+        run = (SegmentRun){window, restart.start, state, edit->offset + edit->inserted_length,
+                           first, window_end < count ? window_end - 1 : count, shift, -1, 0};
+        link = region_link;
+        state->region.count = 0;
+        if (parse_segments(ctx, &link, &state->region, &run, first_kept >= 0 ? restart.last_type : 'x') != 0) {
+            token_stream_close(&ctx->stream);
+            ctx->unit = NULL;
+            return 1;
+        }
+        if (run.synced >= 0 || window_end >= count) break;
+        window_end = first + 2 * (window_end - first);
+    }
+    token_stream_close(&ctx->stream);
+    ctx->unit = NULL;
+
+    /* Drop the re-parsed old statements from the gap buffer */
+    int synced = run.synced >= 0 ? run.synced : count;
+    int dropped_errors = 0;
+    for (int i = start_index; i < synced; i++) dropped_errors += segment_at(state, i)->errors;
+    int kept = state->front_errors;
+    int tail_errors = state->errors.count - kept - dropped_errors;
+    state->back -= synced - start_index;
+
+    int needed = state->front + state->region.count + state->back;
+    if (needed > state->capacity) {
+        int capacity = needed > 2 * state->capacity ? needed : 2 * state->capacity;
+        Segment *segments = realloc(state->segments, capacity * sizeof(Segment));
+        if (!segments) {
+            printf("Error: Memory allocation failed\n");
+            return 1;
+        }
+        memmove(segments + capacity - state->back, segments + state->capacity - state->back,
+                state->back * sizeof(Segment));
+        state->segments = segments;
+        state->capacity = capacity;
+    }
+    for (int i = 0; i < state->region.count; i++) {
+        state->segments[state->front++] = state->region.items[i];
+        state->front_errors += state->region.items[i].errors;
+    }
+    state->back_shift += (size_t)shift;
+    state->back_line_shift += run.line_shift;
+
+    /* Rejoin the old statements from 'synced' on, with their errors */
+    Segment *tail = state->segments + state->capacity - state->back;
+    *link = NULL;
+    for (int i = 0; i < state->back; i++) {
+        if (tail[i].stmt) {
+            *link = tail[i].stmt;
+            break;
+        }
+    }
+    if (run.line_shift) {
+        AstWalker walker;
+        int failed = 0;
+        ast_walker_init(&walker, shift_line, NULL, &run.line_shift);
+        for (int i = 0; i < state->back && !failed; i++) {
+            if (tail[i].stmt) failed = ast_walk(&walker, tail[i].stmt, 0, 0);
+        }
+        ast_walker_release(&walker);
+        if (failed) return 1;
+    }
+
+    /* The error list becomes the kept errors before the edit, the new ones,
+       then the kept ones after it; the context gets the first MAX_ERRORS */
+    ErrorList *errors = &state->errors;
+    int total = kept + state->region_errors.count + tail_errors;
+    if (total > errors->capacity) {
+        ParseErrorInfo *items = realloc(errors->items, total * sizeof(ParseErrorInfo));
+        if (!items) {
+            printf("Error: Memory allocation failed\n");
+            return 1;
+        }
+        errors->items = items;
+        errors->capacity = total;
+    }
+    if (tail_errors > 0) {
+        ParseErrorInfo *tail_error = errors->items + kept + state->region_errors.count;
+        memmove(tail_error, errors->items + kept + dropped_errors, tail_errors * sizeof(ParseErrorInfo));
+        for (int i = 0; i < tail_errors; i++) tail_error[i].position.line += run.line_shift;
+    }
+    if (state->region_errors.count > 0) {
+        memcpy(errors->items + kept, state->region_errors.items, state->region_errors.count * sizeof(ParseErrorInfo));
+    }
+    errors->count = total;
+    ctx->error_count = total < MAX_ERRORS ? total : MAX_ERRORS;
+    if (total > 0) memcpy(ctx->errors, errors->items, ctx->error_count * sizeof(ParseErrorInfo));
+
+    state->text_length = (size_t)((long)state->text_length + shift);
+    return 0;
+}
+
+ASTNode *parse_edit(ParserContext *ctx, ASTNode *root, const char *source, const TextEdit *edit) {
+    struct ASTUnit *unit = unit_of(root);
+    EditState *state = unit->edit;
+    size_t length = state ? state->text_length : strlen(source);
+    if (edit->offset > length || edit->deleted > length - edit->offset) {
+        printf("Error: Edit at offset %zu deleting %zu bytes is outside the %zu-byte source\n",
+               edit->offset, edit->deleted, length);
+        return NULL;
+    }
+
+    /* Re-parsed statements leave garbage in the arena, which a full parse
+       clears out now and then */
+    if (state && unit->arena.bytes_used < state->compact_limit &&
+        reparse_region(ctx, root, source, edit) == 0) {
+        return root;
+    }
+    ASTNode *tree = reparse_all(ctx, source, length, edit);
+    if (tree) free_ast(root);
+    return tree;
 }
 
 void print_ast(ASTNode *node, int level) {
-    if (!node) return;
-    for (int i = 0; i < level; i++) printf("  ");
+    print_ast_to(node, level, stdout);
+}
+
+/* Prints one node; the walk visits its children and statements after it */
+static int print_node(AstWalker *walker, AstWalkFrame *frame) {
+    FILE *out = walker->data;
+    ASTNode *node = frame->node;
+    for (int i = 0; i < frame->depth; i++) fprintf(out, "  ");
     
     switch (node->type) {
         case AST_PROGRAM:
-            printf("Program\n");
+            fprintf(out, "Program\n");
             break;
         case AST_VARDECL:
-            printf("VarDecl: %s\n", node->token.lexeme);
+            fprintf(out, "VarDecl: %.*s\n", node->token.length, node->token.lexeme);
             break;
         case AST_ASSIGN:
-            printf("Assign\n");
+            fprintf(out, "Assign\n");
             break;
         case AST_NUMBER:
-            printf("Number: %s\n", node->token.lexeme);
+            fprintf(out, "Number: %.*s\n", node->token.length, node->token.lexeme);
             break;
         case AST_IDENTIFIER:
-            printf("Identifier: %s\n", node->token.lexeme);
+            fprintf(out, "Identifier: %.*s\n", node->token.length, node->token.lexeme);
             break;
         case AST_IF:
-            printf("If\n");
+            fprintf(out, "If\n");
             break;
         case AST_WHILE:
-            printf("While\n");
+            fprintf(out, "While\n");
             break;
         case AST_BLOCK:
-            printf("Block\n");
+            fprintf(out, "Block\n");
             break;
         case AST_BINOP:
-            printf("BinaryOp: %s\n", node->token.lexeme);
+            fprintf(out, "BinaryOp: %.*s\n", node->token.length, node->token.lexeme);
             break;
         case AST_PRINT:
-            printf("Print\n");
+            fprintf(out, "Print\n");
             break;
         case AST_REPEAT:
-            printf("Repeat\n");
+            fprintf(out, "Repeat\n");
             break;
         case AST_FACTORIAL:
-            printf("Factorial\n");
+            fprintf(out, "Factorial\n");
             break;
         case AST_ARRAYDECL:
-            printf("ArrayDecl: %s\n", node->left ? node->left->token.lexeme : "unknown");
+            if (node->left) {
+                fprintf(out, "ArrayDecl: %.*s\n", node->left->token.length, node->left->token.lexeme);
+            } else {
+                fprintf(out, "ArrayDecl: unknown\n");
+            }
             break;
         case AST_ARRAYACCESS:
-            printf("ArrayAccess: %s\n", node->left ? node->left->token.lexeme : "unknown");
+            if (node->left) {
+                fprintf(out, "ArrayAccess: %.*s\n", node->left->token.length, node->left->token.lexeme);
+            } else {
+                fprintf(out, "ArrayAccess: unknown\n");
+            }
             break;
         default:
-            printf("Unknown node type\n");
+            fprintf(out, "Unknown node type\n");
     }
-    
-    print_ast(node->left, level + 1);
-    print_ast(node->right, level + 1);
-    print_ast(node->next, level);
+    return AST_WALK_CONTINUE;
+}
+
+void print_ast_to(ASTNode *node, int level, FILE *out) {
+    AstWalker walker;
+    ast_walker_init(&walker, print_node, NULL, out);
+    ast_walk(&walker, node, level, 1);
+    ast_walker_release(&walker);
 }
 
+/* Releases every node of a tree returned by parse() in one step. Other
+   nodes are owned by that tree's arena, so passing them is a no-op. */
 void free_ast(ASTNode *node) {
-    if (!node) return;
-    free_ast(node->left);
-    free_ast(node->right);
-    free_ast(node->next);
-    free(node);
+    if (!node || node->type != AST_PROGRAM) return;
+    struct ASTUnit *unit = unit_of(node);
+    if (unit->edit) {
+        free(unit->edit->segments);
+        free(unit->edit->region.items);
+        free(unit->edit->errors.items);
+        free(unit->edit->region_errors.items);
+        free(unit->edit);
+    }
+    intern_release(&unit->names);
+    arena_release(&unit->arena);
+    free(unit);
+}
+
+/* A program node with no statements, owning a fresh arena, for trees that
+   are built node by node rather than parsed */
+ASTNode *ast_new_program(void) {
+    struct ASTUnit *unit = malloc(sizeof(struct ASTUnit));
+    if (!unit) {
+        printf("Error: Memory allocation failed\n");
+        return NULL;
+    }
+    arena_init(&unit->arena);
+    intern_init(&unit->names, NULL);
+    unit->edit = NULL;
+    memset(&unit->root, 0, sizeof(unit->root));
+    unit->root.type = AST_PROGRAM;
+    unit->root.slot = -1;
+    return &unit->root;
+}
+
+void ast_get_stats(const ASTNode *root, ArenaStats *stats) {
+    arena_get_stats(&unit_of(root)->arena, stats);
+}
+
+void *ast_alloc(ASTNode *root, size_t size) {
+    return arena_alloc(&unit_of(root)->arena, size);
+}
+
+/* Tokens are not NUL-terminated */
+long long ast_number_value(const ASTNode *node) {
+    const char *text = node->token.lexeme;
+    int length = node->token.length;
+    int negative = length > 0 && text[0] == '-';
+    unsigned long long value = 0;
+    for (int i = negative; i < length; i++) {
+        value = value * 10 + (unsigned long long)(text[i] - '0');
+    }
+    return (long long)(negative ? 0ULL - value : value);
 }
 
 /* Uncomment the main function below for standalone testing
@@ -699,12 +1236,13 @@ int main(int argc, char *argv[]) {
     fclose(file);
     
     printf("Parsing file: %s\n", argv[1]);
-    parser_init(source);
-    ASTNode *ast = parse();
+    static ParserContext parser;
+    parser_init(&parser, source);
+    ASTNode *ast = parse(&parser);
     
-    if (error_count > 0) {
-        printf("\n%d errors found:\n", error_count);
-        print_errors();
+    if (parser.error_count > 0) {
+        printf("\n%d errors found:\n", parser.error_count);
+        print_errors(&parser);
     } else {
         printf("\nFile parsed successfully!\n");
         printf("Abstract Syntax Tree:\n");
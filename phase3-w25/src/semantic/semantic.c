@@ -2,51 +2,149 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "../../include/parser.h"
 #include "../../include/lexer.h"
 #include "../../include/tokens.h"
 #include "../../include/semantic.h"
+#include "../../include/bench.h"
+#include "../../include/source.h"
+#include "../../include/driver.h"
+#include "../../include/interpreter.h"
+#include "../../include/bytecode.h"
+#include "../../include/jit.h"
+#include "../../include/ir.h"
+#include "../../include/codegen.h"
+#include "../../include/lsp.h"
+#include "../../include/cache.h"
+#include "../../include/astfile.h"
+#include "../../include/aststore.h"
 
-/* Declare external error count and print_errors() from parser.c */
-extern int error_count;
-extern void print_errors(void);
+/* A node being checked: an ASTNode* when the table checks a tree, and a
+   store index plus one when it checks an AstStore. 0 is no node in both. */
+typedef uintptr_t CheckNode;
+#define NO_NODE ((CheckNode)0)
 
 /* Function prototypes from semantic analysis */
 SymbolTable* init_symbol_table();
-Symbol* add_symbol(SymbolTable* table, const char* name, int type, int line);
-Symbol* lookup_symbol(SymbolTable* table, const char* name);
-int analyze_semantics(ASTNode* ast);
-int check_declaration(ASTNode* node, SymbolTable* table);
-int check_assignment(ASTNode* node, SymbolTable* table);
-int check_block(ASTNode* node, SymbolTable* table);
-int check_condition(ASTNode* node, SymbolTable* table);
-int check_program(ASTNode* node, SymbolTable* table);
-int check_array_access(ASTNode* node, SymbolTable* table);
-int check_array_declaration(ASTNode* node, SymbolTable* table);
-
-int semantic_error_count = 0;
+Symbol* add_symbol(SymbolTable* table, int name_id, int type, int line, int column);
+Symbol* lookup_symbol(SymbolTable* table, int name_id);
+int check_expression(CheckNode node, SymbolTable* table);
+int check_declaration(CheckNode node, SymbolTable* table);
+int check_assignment(CheckNode node, SymbolTable* table);
+int check_block(CheckNode node, SymbolTable* table);
+int check_condition(CheckNode node, SymbolTable* table);
+int check_program(CheckNode node, SymbolTable* table);
+int check_array_access(CheckNode node, SymbolTable* table);
+int check_array_declaration(CheckNode node, SymbolTable* table);
+static SymbolSlot* find_slot(SymbolTable* table, int name_id);
+
+/* Value of a number token, or LLONG_MAX if it does not fit; tokens are
+   not NUL-terminated */
+static long long token_int_value(Token token) {
+    long long value = 0;
+    for (int i = 0; i < token.length; i++) {
+        int digit = token.lexeme[i] - '0';
+        if (value > (LLONG_MAX - digit) / 10) return LLONG_MAX;
+        value = value * 10 + digit;
+    }
+    return value;
+}
+
+/* Node accessors. The checks read nodes only through these, so the same
+   checks run on a tree from parse() and on an AstStore. */
+static ASTNode* tree_node(CheckNode node) {
+    return (ASTNode*)node;
+}
+
+static uint32_t store_index(CheckNode node) {
+    return (uint32_t)(node - 1);
+}
+
+static CheckNode store_node(uint32_t index) {
+    return index == AST_STORE_NONE ? NO_NODE : (CheckNode)index + 1;
+}
+
+static ASTNodeType node_type(const SymbolTable* table, CheckNode node) {
+    if (table->store) return AST_STORE_TYPE(table->store, store_index(node));
+    return (ASTNodeType)tree_node(node)->type;
+}
+
+static CheckNode node_left(const SymbolTable* table, CheckNode node) {
+    if (table->store) return store_node(AST_STORE_LEFT(table->store, store_index(node)));
+    return (CheckNode)tree_node(node)->left;
+}
+
+static CheckNode node_right(const SymbolTable* table, CheckNode node) {
+    if (table->store) return store_node(ast_store_right(table->store, store_index(node)));
+    return (CheckNode)tree_node(node)->right;
+}
+
+static CheckNode node_next(const SymbolTable* table, CheckNode node) {
+    if (table->store) return store_node(ast_store_next(table->store, store_index(node)));
+    return (CheckNode)tree_node(node)->next;
+}
+
+/* A store token is lexed again, so it is only fetched for declarations
+   and diagnostics */
+static Token node_token(const SymbolTable* table, CheckNode node) {
+    if (table->store) return ast_store_token(table->store, store_index(node));
+    return tree_node(node)->token;
+}
+
+/* Interned name of an identifier */
+static int node_name(const SymbolTable* table, CheckNode node) {
+    if (table->store) return AST_STORE_NAME(table->store, store_index(node));
+    return tree_node(node)->token.id;
+}
+
+static long long node_number(const SymbolTable* table, CheckNode node) {
+    if (table->store) return ast_store_number(table->store, store_index(node));
+    return ast_number_value(tree_node(node));
+}
+
+static BinaryOp node_op(const SymbolTable* table, CheckNode node) {
+    if (table->store) return ast_store_operator(table->store, store_index(node));
+    return (BinaryOp)tree_node(node)->op;
+}
+
+/* Stores are read-only, so only trees record the slots */
+static void set_slot(const SymbolTable* table, CheckNode node, int slot) {
+    if (!table->store) tree_node(node)->slot = slot;
+}
 
 /* Scope management functions */
 void enter_scope(SymbolTable* table){
-    table->current_scope++;
+    int scope = table->current_scope + 1;
+    if (scope >= table->mark_capacity) {
+        int capacity = table->mark_capacity ? table->mark_capacity * 2 : 16;
+        Symbol** marks = realloc(table->scope_marks, sizeof(Symbol*) * capacity);
+        if (!marks) {
+            printf("Error: Memory allocation failed\n");
+            exit(1);
+        }
+        table->scope_marks = marks;
+        table->mark_capacity = capacity;
+    }
+    table->scope_marks[scope] = table->head;
+    table->current_scope = scope;
 }
 
+/* Pops the symbols declared since the scope was entered, uncovering any
+   declarations they shadowed */
 void remove_symbols_in_current_scope(SymbolTable* table){
-    Symbol* prev = NULL;
-    Symbol* curr = table->head;
-    while (curr) {
-        if (curr->scope_level == table->current_scope) {
-            if (prev) {
-                prev->next = curr->next;
-            } else {
-                table->head = curr->next;
-            }
-            Symbol* temp = curr;
-            curr = curr->next;
-            free(temp);
+    Symbol* mark = table->scope_marks[table->current_scope];
+    while (table->head != mark) {
+        Symbol* symbol = table->head;
+        find_slot(table, symbol->name_id)->symbol = symbol->shadowed;
+        table->head = symbol->next;
+        if (table->keep_symbols) {
+            symbol->next = table->retired;
+            table->retired = symbol;
         } else {
-            prev = curr;
-            curr = curr->next;
+            free(symbol);
         }
     }
 }
@@ -57,232 +155,532 @@ void exit_scope(SymbolTable* table){
 }
 
 void free_symbol_table(SymbolTable* table){
-    Symbol* curr = table->head;
-    while (curr) {
-        Symbol* next = curr->next;
-        free(curr);
-        curr = next;
+    Symbol* lists[] = {table->head, table->retired};
+    for (int i = 0; i < 2; i++) {
+        Symbol* curr = lists[i];
+        while (curr) {
+            Symbol* next = curr->next;
+            free(curr);
+            curr = next;
+        }
     }
+    free(table->slots);
+    free(table->scope_marks);
     free(table);
 }
 
-/* Expression and type checking */
-int check_expression(ASTNode* node, SymbolTable* table){
-    if (!node) return 0;
-    int valid = 1;
-    switch (node->type) {
+/* Constant folding. Operands are checked (and folded) first, and each
+   expression yields the constant it folds to, if any. On a tree a binary
+   node whose operands are both constants is replaced by a number node
+   holding the result, and x+0, 0+x, x-0, x*1, 1*x and x/1 are replaced by
+   x. The node is rewritten in place, so its parent needs no update. A
+   store is never rewritten, so there the constant is only passed up.
+   Arithmetic wraps to 64 bits like the engines that run the program. */
+typedef struct {
+    int constant;            // The expression folds to a number
+    long long value;
+} FoldValue;
+
+static int is_constant(const FoldValue* value, long long number) {
+    return value->constant && value->value == number;
+}
+
+/* Turns 'node' into a number; its text is allocated in the tree's arena.
+   Returns 0 if out of memory. */
+static int make_number(ASTNode* node, long long value, SymbolTable* table) {
+    char text[24];
+    int length = snprintf(text, sizeof(text), "%lld", value);
+    char* copy = ast_alloc(table->root, (size_t)length + 1);
+    if (!copy) return 0;
+    memcpy(copy, text, (size_t)length + 1);
+    node->type = AST_NUMBER;
+    node->op = BINOP_NONE;
+    node->token.type = TOKEN_NUMBER;
+    node->token.lexeme = copy;
+    node->token.length = length;
+    node->token.id = 0;
+    node->left = NULL;
+    node->right = NULL;
+    return 1;
+}
+
+/* Returns 0 after reporting a division by a constant zero */
+static int fold_binop(CheckNode node, SymbolTable* table, const FoldValue* left, const FoldValue* right,
+                      FoldValue* result) {
+    BinaryOp op = node_op(table, node);
+    if (op == BINOP_DIV && is_constant(right, 0)) {
+        Token token = node_token(table, node);
+        semantic_error(table, SEM_ERROR_DIVIDE_BY_ZERO, token.lexeme, token.length, token.line);
+        return 0;
+    }
+    if (!table->root && !table->store) return 1;
+
+    if (left->constant && right->constant) {
+        unsigned long long a = (unsigned long long)left->value;
+        unsigned long long b = (unsigned long long)right->value;
+        long long x = left->value;
+        long long y = right->value;
+        long long value;
+        switch (op) {
+            case BINOP_ADD:       value = (long long)(a + b); break;
+            case BINOP_SUB:       value = (long long)(a - b); break;
+            case BINOP_MUL:       value = (long long)(a * b); break;
+            case BINOP_DIV:       value = y == -1 ? (long long)(0ULL - a) : x / y; break;
+            case BINOP_LESS:      value = x < y; break;
+            case BINOP_GREATER:   value = x > y; break;
+            case BINOP_EQUAL:     value = x == y; break;
+            case BINOP_NOT_EQUAL: value = x != y; break;
+            default: return 1;
+        }
+        if (table->store || make_number(tree_node(node), value, table)) {
+            result->constant = 1;
+            result->value = value;
+        }
+        return 1;
+    }
+
+    CheckNode keep = NO_NODE;
+    if ((op == BINOP_ADD && is_constant(right, 0)) || (op == BINOP_SUB && is_constant(right, 0)) ||
+        (op == BINOP_MUL && is_constant(right, 1)) || (op == BINOP_DIV && is_constant(right, 1))) {
+        keep = node_left(table, node);
+        *result = *left;
+    } else if ((op == BINOP_ADD && is_constant(left, 0)) || (op == BINOP_MUL && is_constant(left, 1))) {
+        keep = node_right(table, node);
+        *result = *right;
+    }
+    if (keep && !table->store) {
+        ASTNode* tree = tree_node(node);
+        ASTNode* next = tree->next;
+        *tree = *tree_node(keep);
+        tree->next = next;
+    }
+    return 1;
+}
+
+/* Expression and type checking. Operator chains such as a + b + ... + z
+   nest as deep as they are long, so they are walked on an explicit stack
+   holding the operators being checked; leaves are checked in place. A
+   frame's 'valid' is 1 while its subexpression is valid. A finished
+   operand clears its parent's when it is not, and hands up the constant
+   it folds to. A right operand finishes just before its parent, so only
+   the left one's constant is kept in the frame. */
+#define EXPRESSION_LOCAL_FRAMES 16
+
+typedef struct {
+    CheckNode node;
+    int state;               // Operands visited so far
+    int valid;
+    FoldValue left;          // What the left operand folds to
+} ExpressionFrame;
+
+/* Checks a node on entry, setting 'valid' and, for a number, 'value'.
+   Returns 1 for an operator whose operands are still to be walked. */
+static int enter_expression(CheckNode node, SymbolTable* table, int* valid, FoldValue* value) {
+    *valid = 1;
+    value->constant = 0;
+    switch (node_type(table, node)) {
         case AST_NUMBER:
             /* Number literals are int by default. */
-            break;
+            value->constant = 1;
+            value->value = node_number(table, node);
+            return 0;
         case AST_IDENTIFIER: {
-            Symbol* symbol = lookup_symbol(table, node->token.lexeme);
-            if (!symbol) {
-                semantic_error(SEM_ERROR_UNDECLARED_VARIABLE, node->token.lexeme, node->token.line);
-                valid = 0;
-            } else if (!symbol->is_initialized) {
-                semantic_error(SEM_ERROR_UNINITIALIZED_VARIABLE, node->token.lexeme, node->token.line);
+            Symbol* symbol = lookup_symbol(table, node_name(table, node));
+            if (!symbol || !symbol->is_initialized) {
+                Token name = node_token(table, node);
+                semantic_error(table, symbol ? SEM_ERROR_UNINITIALIZED_VARIABLE : SEM_ERROR_UNDECLARED_VARIABLE,
+                               name.lexeme, name.length, name.line);
             }
-            break;
-        }
-        case AST_BINOP: {
-            if (node->token.lexeme == '/'){
-                if (node->right->token.lexeme == '0'){
-                    semantic_error(SEM_ERROR_DIVIDE_BY_ZERO, node->token.lexeme, node->token.line);
-                    valid = 0;
-                    return valid;
-                }
+            if (!symbol) {
+                *valid = 0;
+                return 0;
             }
-            int leftValid = check_expression(node->left, table);
-            int rightValid = check_expression(node->right, table);
-            valid = leftValid && rightValid;
-            break;
+            set_slot(table, node, symbol->slot);
+            return 0;
         }
+        case AST_BINOP:
+            /* A missing operand is invalid; the other one is still checked */
+            *valid = node_left(table, node) && node_right(table, node);
+            return 1;
         case AST_FACTORIAL:
-            if (!node->left) {
-                semantic_error(SEM_ERROR_INVALID_OPERATION, "factorial", node->token.line);
-                valid = 0;
-            } else {
-                valid = check_expression(node->left, table);
+            if (!node_left(table, node)) {
+                semantic_error(table, SEM_ERROR_INVALID_OPERATION, "factorial", 9, node_token(table, node).line);
+                *valid = 0;
+                return 0;
             }
-            break;
+            return 1;
         case AST_ARRAYACCESS:
-            return check_array_access(node, table);
+            *valid = check_array_access(node, table);
+            return 0;
         default:
-            valid = check_expression(node->left, table) && check_expression(node->right, table);
-            break;
+            *valid = check_expression(node_left(table, node), table) &&
+                     check_expression(node_right(table, node), table);
+            return 0;
     }
+}
+
+/* Hands a finished operand to the operator it belongs to */
+static void pass_up(ExpressionFrame* parent, int valid, const FoldValue* value) {
+    if (parent->state == 1) parent->left = *value;
+    if (!valid) parent->valid = 0;
+}
+
+static int check_value(CheckNode node, SymbolTable* table, FoldValue* result) {
+    ExpressionFrame local[EXPRESSION_LOCAL_FRAMES];
+    ExpressionFrame* frames = local;
+    size_t count = 0;
+    size_t capacity = EXPRESSION_LOCAL_FRAMES;
+    result->constant = 0;
+    if (!node) return 0;
+
+    /* The node being entered, or once it is finished, its outcome */
+    CheckNode child = node;
+    int valid;
+    FoldValue value;
+    for (;;) {
+        if (child) {
+            if (enter_expression(child, table, &valid, &value)) {
+                if (count == capacity) {
+                    ExpressionFrame* grown = frames == local
+                        ? malloc(capacity * 2 * sizeof(ExpressionFrame))
+                        : realloc(frames, capacity * 2 * sizeof(ExpressionFrame));
+                    if (!grown) {
+                        printf("Error: Memory allocation failed\n");
+                        valid = 0;
+                        break;
+                    }
+                    if (frames == local) memcpy(grown, local, sizeof(local));
+                    frames = grown;
+                    capacity *= 2;
+                }
+                ExpressionFrame* frame = &frames[count++];
+                frame->node = child;
+                frame->state = 0;
+                frame->valid = valid;
+                frame->left.constant = 0;
+            } else if (count == 0) {
+                break;
+            } else {
+                pass_up(&frames[count - 1], valid, &value);
+            }
+        }
+
+        ExpressionFrame* frame = &frames[count - 1];
+        child = NO_NODE;
+        if (frame->state == 0) {
+            frame->state = 1;
+            child = node_left(table, frame->node);
+            continue;
+        }
+        if (frame->state == 1) {
+            frame->state = 2;
+            if (node_type(table, frame->node) == AST_BINOP) child = node_right(table, frame->node);
+            if (child) continue;
+        }
+
+        /* Every operand is done, and 'value' holds the right one's */
+        FoldValue right = value;
+        valid = frame->valid;
+        value.constant = 0;
+        if (node_type(table, frame->node) == AST_BINOP && valid) {
+            valid = fold_binop(frame->node, table, &frame->left, &right, &value);
+        }
+        count--;
+        if (count == 0) break;
+        pass_up(&frames[count - 1], valid, &value);
+    }
+    if (frames != local) free(frames);
+    if (valid) *result = value;
     return valid;
 }
 
-int check_statement(ASTNode* node, SymbolTable* table) {
+int check_expression(CheckNode node, SymbolTable* table){
+    FoldValue value;
+    return check_value(node, table, &value);
+}
+
+int check_statement(CheckNode node, SymbolTable* table) {
     if (!node) return 1;
-    switch (node->type) {
+    switch (node_type(table, node)) {
         case AST_VARDECL:
             return check_declaration(node, table);
         case AST_ARRAYDECL:
             return check_array_declaration(node, table);
         case AST_ASSIGN:
             return check_assignment(node, table);
-        case AST_IF:
-            return check_condition(node->left, table) && check_block(node->right, table);
+        case AST_IF: {
+            /* The body of an if may be a single statement */
+            CheckNode body = node_right(table, node);
+            if (body && node_type(table, body) != AST_BLOCK) {
+                return check_condition(node_left(table, node), table) && check_statement(body, table);
+            }
+            return check_condition(node_left(table, node), table) && check_block(body, table);
+        }
         case AST_WHILE:
-            return check_condition(node->left, table) && check_block(node->right, table);
+            return check_condition(node_left(table, node), table) && check_block(node_right(table, node), table);
+        case AST_REPEAT:
+            /* The condition is checked after the body, which may initialize its variables */
+            return check_block(node_right(table, node), table) && check_condition(node_left(table, node), table);
+        case AST_FACTORIAL:
+            return check_expression(node, table);
         case AST_BLOCK:
             return check_block(node, table);
         case AST_PRINT:
-            return check_expression(node->left, table);
-        default:
-            semantic_error(SEM_ERROR_INVALID_OPERATION, node->token.lexeme, node->token.line);
+            return check_expression(node_left(table, node), table);
+        default: {
+            Token token = node_token(table, node);
+            semantic_error(table, SEM_ERROR_INVALID_OPERATION, token.lexeme, token.length, token.line);
             return 0;
+        }
     }
 }
 
 /* Symbol table functions */
+#define SYMBOL_TABLE_INITIAL_SLOTS 64
+
 SymbolTable* init_symbol_table() {
     SymbolTable* table = malloc(sizeof(SymbolTable));
     if (table) {
         table->head = NULL;
         table->current_scope = 0;
+        table->slots = calloc(SYMBOL_TABLE_INITIAL_SLOTS, sizeof(SymbolSlot));
+        table->slot_capacity = SYMBOL_TABLE_INITIAL_SLOTS;
+        table->slot_count = 0;
+        table->scope_marks = NULL;
+        table->mark_capacity = 0;
+        table->frame_size = 0;
+        table->error_count = 0;
+        table->out = stdout;
+        table->root = NULL;
+        table->store = NULL;
+        table->keep_symbols = 0;
+        table->retired = NULL;
+        if (!table->slots) {
+            free(table);
+            table = NULL;
+        }
     }
     return table;
 }
 
-Symbol* add_symbol(SymbolTable* table, const char* name, int type, int line) {
+/* Slot holding the name, or the empty slot where it would be inserted.
+   IDs are dense, so a multiplicative hash spreads them well. */
+static SymbolSlot* find_slot(SymbolTable* table, int name_id) {
+    unsigned int mask = (unsigned int)table->slot_capacity - 1;
+    unsigned int index = ((unsigned int)name_id * 2654435761u) & mask;
+    for (;;) {
+        SymbolSlot* slot = &table->slots[index];
+        if (slot->name_id == name_id || slot->name_id == 0) return slot;
+        index = (index + 1) & mask;
+    }
+}
+
+static int grow_slots(SymbolTable* table) {
+    int capacity = table->slot_capacity * 2;
+    SymbolSlot* old = table->slots;
+    int old_capacity = table->slot_capacity;
+    SymbolSlot* slots = calloc(capacity, sizeof(SymbolSlot));
+    if (!slots) return 0;
+
+    table->slots = slots;
+    table->slot_capacity = capacity;
+    for (int i = 0; i < old_capacity; i++) {
+        if (old[i].name_id) {
+            *find_slot(table, old[i].name_id) = old[i];
+        }
+    }
+    free(old);
+    return 1;
+}
+
+Symbol* add_symbol(SymbolTable* table, int name_id, int type, int line, int column) {
+    if ((table->slot_count + 1) * 2 > table->slot_capacity && !grow_slots(table)) {
+        return NULL;
+    }
+
     Symbol* symbol = malloc(sizeof(Symbol));
     if (symbol) {
-        strcpy(symbol->name, name);
+        SymbolSlot* slot = find_slot(table, name_id);
+        if (!slot->name_id) {
+            slot->name_id = name_id;
+            slot->symbol = NULL;
+            table->slot_count++;
+        }
+
+        symbol->name_id = name_id;
         symbol->type = type;
         symbol->scope_level = table->current_scope;
         symbol->line_declared = line;
+        symbol->column_declared = column;
         symbol->is_initialized = 0;
         symbol->is_array = 0;
         symbol->array_size = 0;
+        symbol->slot = table->frame_size++;
+        symbol->shadowed = slot->symbol;
+        slot->symbol = symbol;
         symbol->next = table->head;
         table->head = symbol;
     }
     return symbol;
 }
 
-
-Symbol* lookup_symbol(SymbolTable* table, const char* name) {
-    Symbol* current = table->head;
-    while (current) {
-        if (strcmp(current->name, name) == 0) {
-            return current;
-        }
-        current = current->next;
-    }
-    return NULL;
+Symbol* lookup_symbol(SymbolTable* table, int name_id) {
+    return find_slot(table, name_id)->symbol;
 }
 
-Symbol* lookup_symbol_current_scope(SymbolTable* table, const char* name) {
-    Symbol* current = table->head;
-    while (current) {
-        if (strcmp(current->name, name) == 0 && current->scope_level == table->current_scope) {
-            return current;
-        }
-        current = current->next;
+Symbol* lookup_symbol_current_scope(SymbolTable* table, int name_id) {
+    Symbol* symbol = lookup_symbol(table, name_id);
+    if (symbol && symbol->scope_level == table->current_scope) {
+        return symbol;
     }
     return NULL;
 }
 
 /* High-level semantic analysis */
 int analyze_semantics(ASTNode* ast) {
-    semantic_error_count = 0;
+    return analyze_semantics_to(ast, stdout);
+}
+
+int analyze_semantics_to(ASTNode* ast, FILE* out) {
     SymbolTable* table = init_symbol_table();
-    check_program(ast, table);
+    if (!table) return 0;
+    table->out = out;
+    table->root = ast;
+    check_program((CheckNode)ast, table);
+    int error_count = table->error_count;
     free_symbol_table(table);
-    return (semantic_error_count == 0);
+    return (error_count == 0);
+}
+
+/* The store's tokens carry no slots and its nodes cannot be folded, so it
+   is only checked */
+int analyze_semantics_store(const AstStore* store, FILE* out) {
+    SymbolTable* table = init_symbol_table();
+    if (!table) return 0;
+    table->out = out;
+    table->store = store;
+    if (store->count > 0) check_program(store_node(0), table);
+    int error_count = table->error_count;
+    free_symbol_table(table);
+    return (error_count == 0);
+}
+
+SymbolTable* analyze_semantics_keep(ASTNode* ast, FILE* out) {
+    SymbolTable* table = init_symbol_table();
+    if (!table) return NULL;
+    table->out = out;
+    table->root = ast;
+    table->keep_symbols = 1;
+    check_program((CheckNode)ast, table);
+    return table;
 }
 
 
 /* Updated check_program function:
    It now iterates over the AST_PROGRAM node's 'next' pointer,
    ensuring that all top-level statements are semantically checked. */
-int check_program(ASTNode* node, SymbolTable* table) {
+int check_program(CheckNode node, SymbolTable* table) {
     if (!node) return 1;
     int result = 1;
     
-    if (node->type == AST_PROGRAM) {
-        ASTNode* stmt = node->next;
+    if (node_type(table, node) == AST_PROGRAM) {
+        CheckNode stmt = node_next(table, node);
         while (stmt) {
             result = check_statement(stmt, table) && result;
-            stmt = stmt->next;
+            stmt = node_next(table, stmt);
         }
     }
     return result;
 }
 
 
-int check_declaration(ASTNode* node, SymbolTable* table) {
-    if (node->type != AST_VARDECL || !node->left) {
+int check_declaration(CheckNode node, SymbolTable* table) {
+    CheckNode left = node_left(table, node);
+    if (node_type(table, node) != AST_VARDECL || !left) {
         return 0;
     }
-    const char* name = node->left->token.lexeme;
-    Symbol* existing = lookup_symbol_current_scope(table, name);
+    Token name = node_token(table, left);
+    Symbol* existing = lookup_symbol_current_scope(table, name.id);
     if (existing) {
-        semantic_error(SEM_ERROR_REDECLARED_VARIABLE, name, node->left->token.line);
+        semantic_error(table, SEM_ERROR_REDECLARED_VARIABLE, name.lexeme, name.length, name.line);
         return 0;
     }
-    add_symbol(table, name, TOKEN_INT, node->left->token.line);
+    if (table->frame_size == SEM_MAX_FRAME_SIZE) {
+        semantic_error(table, SEM_ERROR_OUT_OF_STORAGE, name.lexeme, name.length, name.line);
+        return 0;
+    }
+    Symbol* symbol = add_symbol(table, name.id, TOKEN_INT, name.line, name.column);
+    if (symbol) set_slot(table, left, symbol->slot);
     return 1;
 }
 
-int check_array_declaration(ASTNode* node, SymbolTable* table) {
-    if (node->type != AST_ARRAYDECL || !node->left || !node->right) {
+int check_array_declaration(CheckNode node, SymbolTable* table) {
+    CheckNode left = node_left(table, node);
+    CheckNode right = node_right(table, node);
+    if (node_type(table, node) != AST_ARRAYDECL || !left || !right) {
         return 0;
     }
     
-    const char* name = node->left->token.lexeme;
+    Token name = node_token(table, left);
     
-    Symbol* existing = lookup_symbol_current_scope(table, name);
+    Symbol* existing = lookup_symbol_current_scope(table, name.id);
     if (existing) {
-        semantic_error(SEM_ERROR_REDECLARED_VARIABLE, name, node->left->token.line);
+        semantic_error(table, SEM_ERROR_REDECLARED_VARIABLE, name.lexeme, name.length, name.line);
         return 0;
     }
     
-    if (node->right->type != AST_NUMBER) {
-        semantic_error(SEM_ERROR_INVALID_ARRAY_SIZE, name, node->left->token.line);
+    if (node_type(table, right) != AST_NUMBER) {
+        semantic_error(table, SEM_ERROR_INVALID_ARRAY_SIZE, name.lexeme, name.length, name.line);
         return 0;
     }
     
-    int size = atoi(node->right->token.lexeme);
+    Token size_token = node_token(table, right);
+    long long size = token_int_value(size_token);
     if (size <= 0) {
-        semantic_error(SEM_ERROR_INVALID_ARRAY_SIZE, name, node->right->token.line);
+        semantic_error(table, SEM_ERROR_INVALID_ARRAY_SIZE, name.lexeme, name.length, size_token.line);
+        return 0;
+    }
+    if (size > SEM_MAX_FRAME_SIZE - table->frame_size) {
+        semantic_error(table, SEM_ERROR_OUT_OF_STORAGE, name.lexeme, name.length, size_token.line);
         return 0;
     }
-    Symbol* symbol = add_symbol(table, name, TOKEN_INT, node->left->token.line);
+    Symbol* symbol = add_symbol(table, name.id, TOKEN_INT, name.line, name.column);
+    if (!symbol) return 0;
     symbol->is_array = 1;
-    symbol->array_size = size;
+    symbol->array_size = (int)size;
+    /* The elements follow the first cell */
+    table->frame_size += size - 1;
+    set_slot(table, left, symbol->slot);
     return 1;
 }
 
-int check_array_access(ASTNode* node, SymbolTable* table) {
-    if (node->type != AST_ARRAYACCESS || !node->left) {
+int check_array_access(CheckNode node, SymbolTable* table) {
+    CheckNode left = node_left(table, node);
+    if (node_type(table, node) != AST_ARRAYACCESS || !left) {
         return 0;
     }
     
-    const char* name = node->left->token.lexeme;
-    Symbol* symbol = lookup_symbol(table, name);
+    Symbol* symbol = lookup_symbol(table, node_name(table, left));
     
-    if (!symbol) {
-        semantic_error(SEM_ERROR_UNDECLARED_VARIABLE, name, node->left->token.line);
-        return 0;
-    }
-    
-    if (!symbol->is_array) {
-        semantic_error(SEM_ERROR_NOT_AN_ARRAY, name, node->left->token.line);
+    if (!symbol || !symbol->is_array) {
+        Token name = node_token(table, left);
+        semantic_error(table, symbol ? SEM_ERROR_NOT_AN_ARRAY : SEM_ERROR_UNDECLARED_VARIABLE,
+                       name.lexeme, name.length, name.line);
         return 0;
     }
+    set_slot(table, left, symbol->slot);
     
     // Check index expression
-    int index_valid = check_expression(node->right, table);
+    CheckNode index = node_right(table, node);
+    FoldValue value;
+    int index_valid = check_value(index, table, &value);
     
     // Check bounds if index is a constant
-    if (index_valid && node->right->type == AST_NUMBER) {
-        int index = atoi(node->right->token.lexeme);
-        if (index < 0 || index >= symbol->array_size) {
-            semantic_error(SEM_ERROR_ARRAY_INDEX_OUT_OF_BOUNDS, name, node->right->token.line);
+    if (index_valid && value.constant) {
+        if (value.value < 0 || value.value >= symbol->array_size) {
+            Token name = node_token(table, left);
+            semantic_error(table, SEM_ERROR_ARRAY_INDEX_OUT_OF_BOUNDS, name.lexeme, name.length,
+                           node_token(table, index).line);
             return 0;
         }
     }
@@ -291,34 +689,33 @@ int check_array_access(ASTNode* node, SymbolTable* table) {
 }
 
 
-int check_assignment(ASTNode* node, SymbolTable* table) {
-    if (node->type != AST_ASSIGN || !node->left || !node->right) {
+int check_assignment(CheckNode node, SymbolTable* table) {
+    CheckNode left = node_left(table, node);
+    CheckNode right = node_right(table, node);
+    if (node_type(table, node) != AST_ASSIGN || !left || !right) {
         return 0;
     }
     
-    if (node->left->type == AST_IDENTIFIER) {
-        const char* name = node->left->token.lexeme;
-        Symbol* symbol = lookup_symbol(table, name);
-        
-        if (!symbol) {
-            semantic_error(SEM_ERROR_UNDECLARED_VARIABLE, name, node->left->token.line);
-            return 0;
-        }
+    if (node_type(table, left) == AST_IDENTIFIER) {
+        Symbol* symbol = lookup_symbol(table, node_name(table, left));
         
-        if (symbol->is_array) {
-            semantic_error(SEM_ERROR_ARRAY_ASSIGNMENT, name, node->left->token.line);
+        if (!symbol || symbol->is_array) {
+            Token name = node_token(table, left);
+            semantic_error(table, symbol ? SEM_ERROR_ARRAY_ASSIGNMENT : SEM_ERROR_UNDECLARED_VARIABLE,
+                           name.lexeme, name.length, name.line);
             return 0;
         }
         
-        int expr_valid = check_expression(node->right, table);
+        set_slot(table, left, symbol->slot);
+        int expr_valid = check_expression(right, table);
         if (expr_valid) {
             symbol->is_initialized = 1;
         }
         return expr_valid;
     } 
-    else if (node->left->type == AST_ARRAYACCESS) {
-        int lhs_valid = check_array_access(node->left, table);
-        int rhs_valid = check_expression(node->right, table);
+    else if (node_type(table, left) == AST_ARRAYACCESS) {
+        int lhs_valid = check_array_access(left, table);
+        int rhs_valid = check_expression(right, table);
         return lhs_valid && rhs_valid;
     }
     
@@ -326,119 +723,564 @@ int check_assignment(ASTNode* node, SymbolTable* table) {
 }
 
 
-int check_block(ASTNode* node, SymbolTable* table){
-    if (!node || node->type != AST_BLOCK) return 0;
+int check_block(CheckNode node, SymbolTable* table){
+    if (!node || node_type(table, node) != AST_BLOCK) return 0;
     enter_scope(table);
     int valid = 1;
     /* Iterate over block statements linked via the 'next' pointer */
-    ASTNode* stmt = node->next;
+    CheckNode stmt = node_next(table, node);
     while (stmt) {
         valid &= check_statement(stmt, table);
-        stmt = stmt->next;
+        stmt = node_next(table, stmt);
     }
     exit_scope(table);
     return valid;
 }
 
-int check_condition(ASTNode* node, SymbolTable* table){
+int check_condition(CheckNode node, SymbolTable* table){
     if (!node) return 0;
     /* Simply validate the expression for the condition */
     return check_expression(node, table);
 }
 
-void semantic_error(SemanticErrorType error, const char* name, int line) {
-    semantic_error_count++;
-    printf("Semantic Error at line %d: ", line);
+void semantic_error(SymbolTable* table, SemanticErrorType error, const char* name, int length, int line) {
+    table->error_count++;
+    fprintf(table->out, "Semantic Error at line %d: ", line);
     switch (error) {
         case SEM_ERROR_UNDECLARED_VARIABLE:
-            printf("Undeclared variable '%s'\n", name);
+            fprintf(table->out, "Undeclared variable '%.*s'\n", length, name);
             break;
         case SEM_ERROR_REDECLARED_VARIABLE:
-            printf("Variable '%s' already declared in this scope\n", name);
+            fprintf(table->out, "Variable '%.*s' already declared in this scope\n", length, name);
             break;
         case SEM_ERROR_TYPE_MISMATCH:
-            printf("Type mismatch involving '%s'\n", name);
+            fprintf(table->out, "Type mismatch involving '%.*s'\n", length, name);
             break;
         case SEM_ERROR_UNINITIALIZED_VARIABLE:
-            printf("Variable '%s' may be used uninitialized\n", name);
+            fprintf(table->out, "Variable '%.*s' may be used uninitialized\n", length, name);
             break;
         case SEM_ERROR_INVALID_OPERATION:
-            printf("Invalid operation involving '%s'\n", name);
+            fprintf(table->out, "Invalid operation involving '%.*s'\n", length, name);
             break;
         case SEM_ERROR_INVALID_ARRAY_SIZE:
-            printf("Invalid array size for array '%s'\n", name);
+            fprintf(table->out, "Invalid array size for array '%.*s'\n", length, name);
+            break;
+        case SEM_ERROR_OUT_OF_STORAGE:
+            fprintf(table->out, "Variable '%.*s' does not fit in the %d storage cells of a program\n",
+                    length, name, SEM_MAX_FRAME_SIZE);
             break;
         case SEM_ERROR_NOT_AN_ARRAY:
-            printf("Variable '%s' is not an array\n", name);
+            fprintf(table->out, "Variable '%.*s' is not an array\n", length, name);
             break;
         case SEM_ERROR_ARRAY_INDEX_OUT_OF_BOUNDS:
-            printf("Array index out of bounds for array '%s'\n", name);
+            fprintf(table->out, "Array index out of bounds for array '%.*s'\n", length, name);
             break;
         case SEM_ERROR_ARRAY_ASSIGNMENT:
-            printf("Cannot assign to array '%s' directly\n", name);
+            fprintf(table->out, "Cannot assign to array '%.*s' directly\n", length, name);
             break;
         case SEM_ERROR_DIVIDE_BY_ZERO:
-            printf("Divide by zero error: '%s'\n", name);
+            fprintf(table->out, "Divide by zero error: '%.*s'\n", length, name);
             break;
         default:
-            printf("Unknown semantic error with '%s'\n", name);
+            fprintf(table->out, "Unknown semantic error with '%.*s'\n", length, name);
     }
 }
 
+static void print_stats(ASTNode* ast) {
+    ArenaStats unit, process;
+    ast_get_stats(ast, &unit);
+    arena_get_global_stats(&process);
+    printf("\nAST arena: %zu allocations, %zu bytes used, %zu bytes reserved in %zu blocks\n",
+           unit.allocations, unit.bytes_used, unit.bytes_reserved, unit.block_count);
+    printf("Arena high-water mark: %zu bytes\n", process.high_water);
+}
+
+/* Execution engines selectable from the command line */
+enum { ENGINE_NONE, ENGINE_VM, ENGINE_AST, ENGINE_JIT, ENGINE_IR };
+
+/* Targets of --emit= */
+enum { NATIVE_NONE, NATIVE_ASM, NATIVE_EXE };
+
+/* Output path when -o is not given: the input name without its extension,
+   plus 'suffix' */
+static char* default_output(const char* input, const char* suffix) {
+    if (strcmp(input, "-") == 0) input = *suffix ? "a" : "a.out.";
+    const char* base = strrchr(input, '/');
+    base = base ? base + 1 : input;
+    const char* dot = strrchr(base, '.');
+    size_t length = dot && dot != base ? (size_t)(dot - input) : strlen(input);
+    char* path = malloc(length + strlen(suffix) + 1);
+    if (path) {
+        memcpy(path, input, length);
+        strcpy(path + length, suffix);
+    }
+    return path;
+}
+
+/* Writes optimised IR as x86-64 assembly and, for an executable, links it
+   with the system compiler; returns 1 on success */
+static int compile_native(IrProgram* ir, int native, const char* output) {
+    if (!(ir->analyses & IR_ANALYSIS_CFG)) {
+        IrPassOptions cfg = {"cfg", NULL, 0, stdout};
+        if (ir_run_passes(ir, &cfg) != 0) return 0;
+    }
+
+    char assembly[] = "/tmp/compiler-XXXXXX.s";
+    FILE* out;
+    if (native == NATIVE_ASM) {
+        out = fopen(output, "w");
+    } else {
+        int fd = mkstemps(assembly, 2);
+        out = fd >= 0 ? fdopen(fd, "w") : NULL;
+    }
+    if (!out) {
+        printf("Error: Could not write %s\n", native == NATIVE_ASM ? output : "a temporary assembly file");
+        return 0;
+    }
+    int completed = codegen_x86_64(ir, out) == 0;
+    if (fclose(out) != 0) completed = 0;
+    if (!completed) {
+        printf("Error: Code generation failed\n");
+    } else if (native == NATIVE_EXE) {
+        completed = codegen_link(assembly, output) == 0;
+    }
+    if (native == NATIVE_EXE) unlink(assembly);
+    if (completed) {
+        printf("\n%s written to %s\n", native == NATIVE_ASM ? "Assembly" : "Executable", output);
+    }
+    return completed;
+}
+
+/* Lowers a checked program to SSA form, runs the pass pipeline, and prints,
+   runs and/or compiles the result to native code; returns 1 on success */
+static int compile_ir(ASTNode* ast, const IrPassOptions* options, int emit, int execute,
+                      int native, const char* output) {
+    IrProgram ir;
+    if (ir_lower(ast, &ir) != 0) {
+        printf("Error: Memory allocation failed\n");
+        return 0;
+    }
+    int completed = ir_run_passes(&ir, options) == 0;
+    if (completed && emit) {
+        printf("\n");
+        ir_print(&ir, stdout);
+    }
+    if (completed && execute) {
+        printf("\nProgram output:\n");
+        completed = ir_execute(&ir, stdout) == 0;
+    }
+    if (completed && native != NATIVE_NONE) {
+        completed = compile_native(&ir, native, output);
+    }
+    ir_free(&ir);
+    return completed;
+}
+
+/* Prints the disassembly and, for ENGINE_VM, runs the program; returns 1
+   if it ran to completion */
+static int run_bytecode(const Bytecode* bytecode, int engine, int disassemble) {
+    int completed = 1;
+    if (disassemble) {
+        printf("\n");
+        bytecode_disassemble(bytecode, stdout);
+    }
+    if (engine == ENGINE_VM) {
+        printf("\nProgram output:\n");
+        completed = vm_run(bytecode, stdout) == 0;
+    }
+    return completed;
+}
+
+/* Runs the program on 'engine'; with 'show_stats', --jit also reports what
+   its JIT compiled. Returns 1 if it ran to completion. */
+static int execute_program(ASTNode* ast, int engine, int disassemble, int show_stats) {
+    if (engine == ENGINE_AST) {
+        printf("\nProgram output:\n");
+        return interpret(ast, stdout) == 0;
+    }
+    if (engine == ENGINE_JIT) {
+        JitStats stats;
+        printf("\nProgram output:\n");
+        int completed = interpret_jit(ast, stdout, &stats) == 0;
+        if (show_stats) {
+            printf("\nJIT: %d loops compiled, %d left interpreted, %zu bytes of code\n",
+                   stats.loops_compiled, stats.loops_rejected, stats.code_bytes);
+        }
+        return completed;
+    }
+
+    Bytecode bytecode;
+    if (bytecode_compile(ast, &bytecode) != 0) {
+        printf("Error: Memory allocation failed\n");
+        return 0;
+    }
+    int completed = run_bytecode(&bytecode, engine, disassemble);
+    bytecode_free(&bytecode);
+    return completed;
+}
+
+/* Checks the loaded source through the cache and, if it passes, runs or
+   disassembles its bytecode; 'engine' is ENGINE_NONE or ENGINE_VM. Returns
+   what main would: 1 on success, 0 after semantic or runtime errors and 1
+   after parse errors. */
+static int run_cached(ParserContext* parser, const SourceBuffer* source, Cache* cache,
+                      int engine, int disassemble) {
+    int want_bytecode = engine == ENGINE_VM || disassemble;
+    Bytecode bytecode;
+    int status = driver_check_source(parser, source, cache, stdout, want_bytecode ? &bytecode : NULL);
+    if (status < 0) {
+        return 1;
+    }
+    if (!status || !want_bytecode) {
+        return status;
+    }
+    if (!bytecode.code) {
+        printf("Error: Memory allocation failed\n");
+        return 0;
+    }
+    int completed = run_bytecode(&bytecode, engine, disassemble);
+    bytecode_free(&bytecode);
+    return completed;
+}
+
+static void print_cache_stats(Cache* cache) {
+    CacheStats stats;
+    cache_trim(cache);
+    cache_get_stats(cache, &stats);
+    printf("\nCache: %zu hits, %zu misses, %zu stored, %zu evicted (%zu bytes), %zu bytes on disk\n",
+           stats.hits, stats.misses, stats.stores, stats.evictions, stats.bytes_evicted, stats.size);
+}
+
+static void print_usage(const char* program) {
+    printf("Usage: %s [--no-echo] [--stream] [--stats] [--run | --run-ast | --jit | --run-ir] [--disasm] <filename>\n", program);
+    printf("       %s [--emit-ir] [--passes=LIST] [--dump-ir-after=PASS|all] [--time-passes] <filename>\n", program);
+    printf("       %s --emit=asm|exe [-o OUTPUT] [--passes=LIST] <filename>\n", program);
+    printf("       %s --list-passes\n", program);
+    printf("       %s [--jobs N] <filename>... [@responsefile]...\n", program);
+    printf("       %s --bench-lexer <filename>\n", program);
+    printf("       %s --bench-keywords\n", program);
+    printf("       %s --bench-vm\n", program);
+    printf("       %s --bench-jit\n", program);
+    printf("       %s --bench-edit <filename>\n", program);
+    printf("       %s --check-edits <filename>\n", program);
+    printf("       %s --bench-ast-file <filename>\n", program);
+    printf("       %s --bench-ast-store <filename>\n", program);
+    printf("       %s --bench-walk\n", program);
+    printf("       %s --lsp [--stats]\n", program);
+    printf("Add --cache-dir DIR [--cache-size N[K|M|G]] [--cache-stats] to reuse the diagnostics\n");
+    printf("and bytecode of sources compiled before when checking or with --run and --disasm.\n");
+    printf("Add --emit-ast FILE to write the parsed program as a binary AST file, and\n");
+    printf("--load-ast to read such a file instead of source. --print-ast prints the tree\n");
+    printf("before semantic analysis.\n");
+    printf("Use '-' as the filename to read from standard input.\n");
+    printf("With several files, or --jobs, or a response file listing one file per line,\n");
+    printf("the files are checked in parallel and the exit status is 0 only if all pass.\n");
+}
+
 /* Main function */
 int main(int argc, char* argv[]) {
-    FILE* file;
-    char* buffer = NULL;
-    long file_size;
-    const char* filename;
-    
-    if (argc < 2) {
+    static ParserContext parser;
+    SourceBuffer source = {0};
+    const char* filename = NULL;
+    char** files = NULL;
+    int file_count = 0;
+    int file_capacity = 0;
+    int multi_file = 0;
+    int jobs = 0;
+    int echo_source = 1;
+    int show_stats = 0;
+    int serve_lsp = 0;
+    int stream_input = 0;
+    int engine = ENGINE_NONE;
+    int disassemble = 0;
+    int emit_ir = 0;
+    int use_ir = 0;
+    int native = NATIVE_NONE;
+    const char* output = NULL;
+    const char* cache_dir = NULL;
+    size_t cache_size = CACHE_DEFAULT_SIZE;
+    int show_cache_stats = 0;
+    const char* emit_ast = NULL;
+    int load_ast = 0;
+    int print_tree = 0;
+    IrPassOptions ir_options = {NULL, NULL, 0, stdout};
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-echo") == 0) {
+            echo_source = 0;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            show_stats = 1;
+        } else if (strcmp(argv[i], "--run") == 0) {
+            engine = ENGINE_VM;
+        } else if (strcmp(argv[i], "--run-ast") == 0) {
+            engine = ENGINE_AST;
+        } else if (strcmp(argv[i], "--jit") == 0) {
+            engine = ENGINE_JIT;
+        } else if (strcmp(argv[i], "--run-ir") == 0) {
+            engine = ENGINE_IR;
+            use_ir = 1;
+        } else if (strcmp(argv[i], "--disasm") == 0) {
+            disassemble = 1;
+        } else if (strcmp(argv[i], "--emit-ir") == 0) {
+            emit_ir = use_ir = 1;
+        } else if (strncmp(argv[i], "--passes=", 9) == 0) {
+            ir_options.pipeline = argv[i] + 9;
+            use_ir = 1;
+        } else if (strncmp(argv[i], "--dump-ir-after=", 16) == 0) {
+            ir_options.dump_after = argv[i] + 16;
+            use_ir = 1;
+        } else if (strcmp(argv[i], "--time-passes") == 0) {
+            ir_options.time_passes = 1;
+            use_ir = 1;
+        } else if (strncmp(argv[i], "--emit=", 7) == 0) {
+            if (strcmp(argv[i] + 7, "asm") == 0) {
+                native = NATIVE_ASM;
+            } else if (strcmp(argv[i] + 7, "exe") == 0) {
+                native = NATIVE_EXE;
+            } else {
+                printf("Error: --emit takes 'asm' or 'exe'.\n");
+                driver_free_files(files, file_count);
+                return 1;
+            }
+            use_ir = 1;
+        } else if (strcmp(argv[i], "-o") == 0) {
+            if (i + 1 >= argc) {
+                printf("Error: -o requires an output file.\n");
+                driver_free_files(files, file_count);
+                return 1;
+            }
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--list-passes") == 0) {
+            ir_list_passes(stdout);
+            return 0;
+        } else if (strcmp(argv[i], "--bench-vm") == 0) {
+            return bench_vm();
+        } else if (strcmp(argv[i], "--bench-jit") == 0) {
+            return bench_jit();
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            stream_input = 1;
+        } else if (strcmp(argv[i], "--bench-keywords") == 0) {
+            return bench_keywords();
+        } else if (strcmp(argv[i], "--bench-lexer") == 0) {
+            if (i + 1 >= argc) {
+                printf("Error: --bench-lexer requires an input file.\n");
+                return 1;
+            }
+            return bench_lexer(argv[i + 1]);
+        } else if (strcmp(argv[i], "--bench-edit") == 0) {
+            if (i + 1 >= argc) {
+                printf("Error: --bench-edit requires an input file.\n");
+                return 1;
+            }
+            return bench_edit(argv[i + 1]);
+        } else if (strcmp(argv[i], "--check-edits") == 0) {
+            if (i + 1 >= argc) {
+                printf("Error: --check-edits requires an input file.\n");
+                return 1;
+            }
+            return check_edits(argv[i + 1]);
+        } else if (strcmp(argv[i], "--bench-ast-file") == 0) {
+            if (i + 1 >= argc) {
+                printf("Error: --bench-ast-file requires an input file.\n");
+                return 1;
+            }
+            return bench_ast_file(argv[i + 1]);
+        } else if (strcmp(argv[i], "--bench-ast-store") == 0) {
+            if (i + 1 >= argc) {
+                printf("Error: --bench-ast-store requires an input file.\n");
+                return 1;
+            }
+            return bench_ast_store(argv[i + 1]);
+        } else if (strcmp(argv[i], "--bench-walk") == 0) {
+            return bench_walk();
+        } else if (strcmp(argv[i], "--emit-ast") == 0) {
+            if (i + 1 >= argc) {
+                printf("Error: --emit-ast requires an output file.\n");
+                driver_free_files(files, file_count);
+                return 1;
+            }
+            emit_ast = argv[++i];
+        } else if (strcmp(argv[i], "--load-ast") == 0) {
+            load_ast = 1;
+        } else if (strcmp(argv[i], "--print-ast") == 0) {
+            print_tree = 1;
+        } else if (strcmp(argv[i], "--lsp") == 0) {
+            serve_lsp = 1;
+        } else if (strcmp(argv[i], "--cache-dir") == 0) {
+            if (i + 1 >= argc) {
+                printf("Error: --cache-dir requires a directory.\n");
+                driver_free_files(files, file_count);
+                return 1;
+            }
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--cache-size") == 0) {
+            if (i + 1 >= argc || (cache_size = cache_parse_size(argv[i + 1])) == 0) {
+                printf("Error: --cache-size requires a size such as 512K, 64M or 2G.\n");
+                driver_free_files(files, file_count);
+                return 1;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--cache-stats") == 0) {
+            show_cache_stats = 1;
+        } else if (strcmp(argv[i], "--jobs") == 0) {
+            if (i + 1 >= argc || atoi(argv[i + 1]) <= 0) {
+                printf("Error: --jobs requires a positive number.\n");
+                driver_free_files(files, file_count);
+                return 1;
+            }
+            jobs = atoi(argv[++i]);
+            multi_file = 1;
+        } else if (argv[i][0] == '@' && argv[i][1] != '\0') {
+            if (driver_read_response_file(argv[i] + 1, &files, &file_count, &file_capacity) != 0) {
+                driver_free_files(files, file_count);
+                return 1;
+            }
+            multi_file = 1;
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            printf("Error: Unknown option %s\n", argv[i]);
+            print_usage(argv[0]);
+            driver_free_files(files, file_count);
+            return 1;
+        } else {
+            if (driver_add_file(&files, &file_count, &file_capacity, argv[i]) != 0) {
+                driver_free_files(files, file_count);
+                return 1;
+            }
+            filename = argv[i];
+        }
+    }
+
+    if (serve_lsp) {
+        driver_free_files(files, file_count);
+        /* Protocol messages keep the real standard output; anything else
+           printed goes to stderr, where it cannot corrupt them */
+        int protocol_out = dup(STDOUT_FILENO);
+        if (protocol_out < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+            printf("Error: Could not redirect standard output\n");
+            return 1;
+        }
+        return lsp_serve(STDIN_FILENO, protocol_out, show_stats);
+    }
+
+    if (output && native == NATIVE_NONE) {
+        printf("Error: -o needs --emit=asm or --emit=exe.\n");
+        driver_free_files(files, file_count);
+        return 1;
+    }
+
+    if (file_count == 0) {
         printf("Error: No input file specified.\n");
-        printf("Usage: %s <filename>\n", argv[0]);
+        print_usage(argv[0]);
+        driver_free_files(files, file_count);
         return 1;
     }
-    
-    filename = argv[1];
-    file = fopen(filename, "rb");
-    if (file == NULL) {
-        printf("Error: Could not open file %s\n", filename);
+
+    if ((show_cache_stats || cache_size != CACHE_DEFAULT_SIZE) && !cache_dir) {
+        printf("Error: --cache-size and --cache-stats need --cache-dir.\n");
+        driver_free_files(files, file_count);
         return 1;
     }
-    
-    fseek(file, 0, SEEK_END);
-    file_size = ftell(file);
-    rewind(file);
-    
-    buffer = (char*)malloc(file_size + 1);
-    if (buffer == NULL) {
-        printf("Error: Memory allocation failed\n");
-        fclose(file);
+    Cache* cache = NULL;
+    if (cache_dir && !(cache = cache_open(cache_dir, cache_size))) {
+        driver_free_files(files, file_count);
         return 1;
     }
-    
-    if (fread(buffer, 1, file_size, file) != file_size) {
-        printf("Error: Failed to read file %s\n", filename);
-        free(buffer);
-        fclose(file);
+
+    if (multi_file || file_count > 1) {
+        if (stream_input || show_stats || engine != ENGINE_NONE || disassemble || use_ir || emit_ast || load_ast || print_tree) {
+            printf("Error: --stream, --stats, --run, --disasm, --emit-ast, --load-ast, --print-ast and the IR options take a single input file.\n");
+            driver_free_files(files, file_count);
+            return 1;
+        }
+        int status = driver_run(files, file_count, jobs, cache);
+        driver_free_files(files, file_count);
+        if (cache && show_cache_stats) print_cache_stats(cache);
+        cache_close(cache);
+        return status;
+    }
+    driver_free_files(files, file_count);
+
+    if (load_ast && (stream_input || cache)) {
+        printf("Error: --load-ast cannot be combined with --stream or --cache-dir.\n");
+        cache_close(cache);
         return 1;
     }
-    
-    buffer[file_size] = '\0';
-    fclose(file);
-    
-    printf("Analyzing input from file %s:\n%s\n\n", filename, buffer);
-    parser_init(buffer);
-    ASTNode* ast = parse();
+
+    ASTNode* ast;
+    if (load_ast) {
+        /* Trees are only written after a parse without errors */
+        AstFile file;
+        if (ast_file_open(&file, filename) != 0) {
+            return 1;
+        }
+        printf("Analyzing AST from file %s:\n\n", filename);
+        ast = ast_file_to_tree(&file);
+        ast_file_close(&file);
+        if (!ast) {
+            return 1;
+        }
+    } else if (stream_input) {
+        /* The input is never held in memory as a whole, so it is not echoed */
+        int fd = strcmp(filename, "-") == 0 ? STDIN_FILENO : open(filename, O_RDONLY);
+        if (fd < 0) {
+            printf("Error: Could not open file %s\n", filename);
+            return 1;
+        }
+        printf("Analyzing input from file %s:\n\n", filename);
+        if (parser_init_fd(&parser, fd) != 0) {
+            return 1;
+        }
+        ast = parse(&parser);
+        if (fd != STDIN_FILENO) close(fd);
+    } else {
+        if (source_open(&source, filename) != 0) {
+            return 1;
+        }
+
+        printf("Analyzing input from file %s:\n", filename);
+        if (echo_source) {
+            fwrite(source.data, 1, source.size, stdout);
+            printf("\n");
+        }
+        printf("\n");
+        /* Only checking, the VM and the disassembly can be served from the
+           cache; the other modes need the AST */
+        if (cache && (engine == ENGINE_NONE || engine == ENGINE_VM) && !use_ir && !show_stats && !emit_ast && !print_tree) {
+            int result = run_cached(&parser, &source, cache, engine, disassemble);
+            source_close(&source);
+            if (show_cache_stats) print_cache_stats(cache);
+            cache_close(cache);
+            return result;
+        }
+        parser_init_source(&parser, &source);
+        ast = parse(&parser);
+    }
+    cache_close(cache);
     
     /* Check for parse errors before semantic analysis */
-    if (error_count > 0) {
-        printf("\nParsing failed with %d errors. Semantic analysis aborted.\n", error_count);
-        print_errors();
+    if (parser.error_count > 0) {
+        printf("\nParsing failed with %d errors. Semantic analysis aborted.\n", parser.error_count);
+        print_errors(&parser);
         free_ast(ast);
-        free(buffer);
+        source_close(&source);
         return 1;
     }
     
+    /* Written before semantic analysis, which folds constants in place */
+    if (emit_ast) {
+        size_t size;
+        if (ast_file_write(ast, emit_ast, &size) != 0) {
+            free_ast(ast);
+            source_close(&source);
+            return 1;
+        }
+        printf("AST written to %s (%zu bytes)\n", emit_ast, size);
+    }
+    if (print_tree) {
+        print_ast(ast, 0);
+        printf("\n");
+    }
+
     printf("AST created. Performing semantic analysis...\n\n");
     
     int result = analyze_semantics(ast);
@@ -447,9 +1289,29 @@ int main(int argc, char* argv[]) {
     } else {
         printf("Semantic analysis failed. Errors detected.\n");
     }
+
+    char* default_path = NULL;
+    if (native != NATIVE_NONE && !output) {
+        output = default_path = default_output(filename, native == NATIVE_ASM ? ".s" : "");
+        if (!output) {
+            printf("Error: Memory allocation failed\n");
+            result = 0;
+        }
+    }
+    if (use_ir && result) {
+        result = compile_ir(ast, &ir_options, emit_ir, engine == ENGINE_IR, native, output);
+    }
+    if (((engine != ENGINE_NONE && engine != ENGINE_IR) || disassemble) && result) {
+        result = execute_program(ast, engine, disassemble, show_stats);
+    }
+
+    if (show_stats) {
+        print_stats(ast);
+    }
     
+    free(default_path);
     free_ast(ast);
-    free(buffer);
+    source_close(&source);
     
     return result;
 }
@@ -0,0 +1,138 @@
+/* source.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../../include/source.h"
+
+/* Reads everything from a descriptor into a NUL-terminated heap buffer */
+static int read_stream(SourceBuffer* source, int fd, const char* filename, FILE* out) {
+    size_t capacity = 64 * 1024;
+    size_t size = 0;
+    char* buffer = malloc(capacity + 1);
+    if (!buffer) {
+        fprintf(out, "Error: Memory allocation failed\n");
+        return 1;
+    }
+
+    for (;;) {
+        if (size == capacity) {
+            capacity *= 2;
+            char* grown = realloc(buffer, capacity + 1);
+            if (!grown) {
+                fprintf(out, "Error: Memory allocation failed\n");
+                free(buffer);
+                return 1;
+            }
+            buffer = grown;
+        }
+        ssize_t n = read(fd, buffer + size, capacity - size);
+        if (n < 0) {
+            fprintf(out, "Error: Failed to read file %s\n", filename);
+            free(buffer);
+            return 1;
+        }
+        if (n == 0) break;
+        size += n;
+    }
+
+    buffer[size] = '\0';
+    source->data = buffer;
+    source->size = size;
+    source->mapping = NULL;
+    source->mapping_size = 0;
+    return 0;
+}
+
+/* Maps a regular file read-only. The mapping is one byte longer than the
+   file, rounded up to whole pages: an anonymous zero-filled region is
+   reserved first and the file is mapped over its start, so the byte after
+   the text is always a NUL terminator even when the file fills its last
+   page exactly. */
+static int map_file(SourceBuffer* source, int fd, size_t size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t mapping_size = (size + 1 + page - 1) / page * page;
+
+    void* region = mmap(NULL, mapping_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) return 1;
+
+    void* text = mmap(region, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    if (text == MAP_FAILED) {
+        munmap(region, mapping_size);
+        return 1;
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(region, mapping_size, MADV_SEQUENTIAL);
+#endif
+
+    source->data = text;
+    source->size = size;
+    source->mapping = region;
+    source->mapping_size = mapping_size;
+    return 0;
+}
+
+int source_open(SourceBuffer* source, const char* filename) {
+    return source_open_to(source, filename, stdout);
+}
+
+int source_open_to(SourceBuffer* source, const char* filename, FILE* out) {
+    if (strcmp(filename, "-") == 0) {
+        return read_stream(source, STDIN_FILENO, "<stdin>", out);
+    }
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(out, "Error: Could not open file %s\n", filename);
+        return 1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        fprintf(out, "Error: Could not open file %s\n", filename);
+        close(fd);
+        return 1;
+    }
+
+    /* Lexer positions are ints */
+    if (S_ISREG(info.st_mode) && (unsigned long long)info.st_size >= INT_MAX) {
+        fprintf(out, "Error: File %s is too large\n", filename);
+        close(fd);
+        return 1;
+    }
+
+    int status;
+    if (S_ISREG(info.st_mode) && info.st_size > 0 && map_file(source, fd, (size_t)info.st_size) == 0) {
+        status = 0;
+    } else {
+        status = read_stream(source, fd, filename, out);
+    }
+    close(fd);
+    return status;
+}
+
+void source_release(const SourceBuffer* source, size_t offset) {
+    if (!source->mapping) return;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t length = offset / page * page;
+    if (length > 0) {
+        madvise(source->mapping, length, MADV_DONTNEED);
+    }
+}
+
+void source_close(SourceBuffer* source) {
+    if (source->mapping) {
+        munmap(source->mapping, source->mapping_size);
+    } else {
+        free((char*)source->data);
+    }
+    source->data = NULL;
+    source->size = 0;
+    source->mapping = NULL;
+    source->mapping_size = 0;
+}